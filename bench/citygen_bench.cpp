@@ -0,0 +1,376 @@
+#include "CityGenerator.h"
+#include "Config.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+/**
+ * @file citygen_bench.cpp
+ *
+ * Benchmark harness for the generator and exporters.  Every case of a
+ * (layout, grid size, population) matrix is generated and exported with
+ * each writer; per stage the harness records wall time, throughput and the
+ * peak resident set size reached while the stage ran.  The "parcels"
+ * stage is read from the generator's own trace and reports the cost per
+ * parcel of block subdivision and building construction.  Results are
+ * printed as JSON and can be compared against a stored earlier run.
+ *
+ * Usage:
+ *   citygen_bench [--quick] [--repeat=N] [--threads=N] [--output=file.json]
+ *                 [--baseline=file.json] [--tolerance=0.15]
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchCase {
+    Config::LayoutType layout;
+    int gridSize;
+    int population;
+
+    std::string name() const {
+        return std::string(layout == Config::LayoutType::Grid ? "grid" : "radial") + "/" +
+               std::to_string(gridSize) + "/" + std::to_string(population);
+    }
+};
+
+struct StageResult {
+    std::string caseName;
+    std::string stage;
+    double wallMs = 0.0;   ///< Median over repetitions
+    double minMs = 0.0;
+    std::int64_t items = -1;   ///< Buildings generated (generate stage)
+    std::int64_t bytes = -1;   ///< Bytes written (export stages)
+    std::int64_t parcels = -1; ///< Parcels cut (parcels stage)
+    long peakRssKiB = 0;
+};
+
+std::string parseArg(const std::string &arg, const std::string &prefix) {
+    if (arg.rfind(prefix, 0) == 0) {
+        return arg.substr(prefix.size());
+    }
+    return std::string();
+}
+
+// Peak RSS tracking.  On Linux writing "5" to /proc/self/clear_refs resets
+// VmHWM to the current RSS, which gives a per-stage peak.  Elsewhere the
+// process-wide maximum from getrusage() is reported instead.
+bool resetPeakRss() {
+    std::ofstream refs("/proc/self/clear_refs");
+    if (!refs) return false;
+    refs << "5";
+    refs.flush();
+    return static_cast<bool>(refs);
+}
+
+long readPeakRssKiB() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return std::strtol(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    struct rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+std::int64_t fileBytes(const std::vector<std::filesystem::path> &paths) {
+    std::int64_t total = 0;
+    for (const auto &p : paths) {
+        std::error_code ec;
+        auto n = std::filesystem::file_size(p, ec);
+        if (!ec) total += static_cast<std::int64_t>(n);
+    }
+    return total;
+}
+
+bool g_peakResetSupported = false;
+
+// Run @p fn @p repeat times; the reported peak RSS covers all runs.
+template <class Fn>
+StageResult timeStage(const std::string &caseName, const std::string &stage, int repeat, Fn &&fn) {
+    StageResult r;
+    r.caseName = caseName;
+    r.stage = stage;
+    g_peakResetSupported = resetPeakRss();
+    std::vector<double> samples;
+    for (int i = 0; i < repeat; ++i) {
+        auto t0 = Clock::now();
+        fn();
+        auto t1 = Clock::now();
+        samples.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+    }
+    r.peakRssKiB = readPeakRssKiB();
+    std::sort(samples.begin(), samples.end());
+    r.minMs = samples.front();
+    r.wallMs = samples[samples.size() / 2];
+    return r;
+}
+
+// Time the "parcels" stage of @p repeat traced generations of @p cfg.
+StageResult timeParcels(const std::string &caseName, const Config &cfg, int repeat) {
+    StageResult r;
+    r.caseName = caseName;
+    r.stage = "parcels";
+    g_peakResetSupported = resetPeakRss();
+    std::vector<double> samples;
+    for (int i = 0; i < repeat; ++i) {
+        Trace trace;
+        CityGenerator::generate(cfg, &trace);
+        for (const auto &stage : trace.stages()) {
+            if (stage.name != "parcels") continue;
+            samples.push_back(stage.durationUs / 1000.0);
+            for (const auto &c : stage.counters) {
+                if (c.name == "parcels") r.parcels = c.value;
+            }
+        }
+    }
+    r.peakRssKiB = readPeakRssKiB();
+    if (samples.empty()) return r;
+    std::sort(samples.begin(), samples.end());
+    r.minMs = samples.front();
+    r.wallMs = samples[samples.size() / 2];
+    return r;
+}
+
+std::string jsonEscape(const std::string &s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out.push_back('\\');
+        out.push_back(c);
+    }
+    return out;
+}
+
+// Results are written one per line, which keeps baseline parsing trivial.
+std::string resultLine(const StageResult &r) {
+    std::ostringstream oss;
+    oss << std::setprecision(6);
+    double seconds = r.wallMs / 1000.0;
+    oss << "{\"case\":\"" << jsonEscape(r.caseName) << "\",\"stage\":\"" << r.stage << "\""
+        << ",\"wallMs\":" << r.wallMs << ",\"minMs\":" << r.minMs
+        << ",\"peakRssKiB\":" << r.peakRssKiB;
+    if (r.items >= 0) {
+        oss << ",\"buildings\":" << r.items
+            << ",\"buildingsPerSec\":" << (seconds > 0 ? r.items / seconds : 0.0);
+    }
+    if (r.parcels > 0) {
+        oss << ",\"parcels\":" << r.parcels
+            << ",\"nsPerParcel\":" << r.wallMs * 1e6 / static_cast<double>(r.parcels);
+    }
+    if (r.bytes >= 0) {
+        oss << ",\"bytes\":" << r.bytes
+            << ",\"mbPerSec\":" << (seconds > 0 ? r.bytes / 1e6 / seconds : 0.0);
+    }
+    oss << "}";
+    return oss.str();
+}
+
+// Extract a string or number field from one of our own result lines.
+bool findField(const std::string &line, const std::string &key, std::string &value) {
+    std::string needle = "\"" + key + "\":";
+    std::size_t pos = line.find(needle);
+    if (pos == std::string::npos) return false;
+    pos += needle.size();
+    if (pos < line.size() && line[pos] == '"') {
+        std::size_t end = line.find('"', pos + 1);
+        if (end == std::string::npos) return false;
+        value = line.substr(pos + 1, end - pos - 1);
+    } else {
+        std::size_t end = line.find_first_of(",}", pos);
+        value = line.substr(pos, end - pos);
+    }
+    return true;
+}
+
+// Median wall time per "case|stage" of a previous run.
+std::map<std::string, double> loadBaseline(const std::string &path) {
+    std::map<std::string, double> out;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string caseName, stage, wall;
+        if (findField(line, "case", caseName) && findField(line, "stage", stage) &&
+            findField(line, "wallMs", wall)) {
+            out[caseName + "|" + stage] = std::strtod(wall.c_str(), nullptr);
+        }
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    bool quick = false;
+    int repeat = 3;
+    int threads = 0;
+    double tolerance = 0.15;
+    std::string outputPath;
+    std::string baselinePath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--quick") {
+            quick = true;
+        } else if (auto s = parseArg(arg, "--repeat="); !s.empty()) {
+            repeat = std::max(1, static_cast<int>(std::strtol(s.c_str(), nullptr, 10)));
+        } else if (auto s = parseArg(arg, "--threads="); !s.empty()) {
+            threads = static_cast<int>(std::strtol(s.c_str(), nullptr, 10));
+        } else if (auto s = parseArg(arg, "--output="); !s.empty()) {
+            outputPath = s;
+        } else if (auto s = parseArg(arg, "--baseline="); !s.empty()) {
+            baselinePath = s;
+        } else if (auto s = parseArg(arg, "--tolerance="); !s.empty()) {
+            tolerance = std::strtod(s.c_str(), nullptr);
+        } else if (arg == "--help" || arg == "-h") {
+            std::cout << "Usage: citygen_bench [options]\n\n"
+                      << "Options:\n"
+                      << "  --quick               Small matrix, one repetition (smoke test)\n"
+                      << "  --repeat=<number>     Repetitions per stage; the median is reported (default 3)\n"
+                      << "  --threads=<number>    Worker threads for generation and export (default 0)\n"
+                      << "  --output=<file>       Write the JSON report to a file instead of stdout\n"
+                      << "  --baseline=<file>     Compare median wall times against an earlier report\n"
+                      << "  --tolerance=<float>   Allowed slowdown vs. baseline before failing (default 0.15)\n"
+                      << std::endl;
+            return 0;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (quick) repeat = 1;
+
+    std::vector<BenchCase> cases;
+    std::vector<int> grids = quick ? std::vector<int>{60} : std::vector<int>{100, 300, 1000, 3000};
+    std::vector<int> populations = quick ? std::vector<int>{20000} : std::vector<int>{50000, 500000};
+    for (auto layout : {Config::LayoutType::Grid, Config::LayoutType::Radial}) {
+        for (int g : grids) {
+            for (int p : populations) cases.push_back({layout, g, p});
+        }
+    }
+
+    std::filesystem::path workDir = std::filesystem::temp_directory_path() /
+                                    ("citygen_bench_" + std::to_string(getpid()));
+    std::filesystem::create_directories(workDir);
+    const auto objPath = workDir / "city.obj";
+    const auto gltfPath = workDir / "city.gltf";
+    const auto glbPath = workDir / "city.glb";
+    const auto summaryPath = workDir / "city_summary.json";
+
+    std::vector<StageResult> results;
+    for (const auto &bc : cases) {
+        Config cfg;
+        cfg.layout = bc.layout;
+        cfg.grid_size = bc.gridSize;
+        cfg.population = bc.population;
+        cfg.hospitals = 3;
+        cfg.schools = 8;
+        cfg.seed = 1;
+        cfg.threads = threads;
+        std::string name = bc.name();
+        std::cerr << "bench " << name << std::endl;
+
+        City city;
+        StageResult gen = timeStage(name, "generate", repeat, [&]() { city = CityGenerator::generate(cfg); });
+        gen.items = static_cast<std::int64_t>(city.buildings.size());
+        results.push_back(gen);
+        results.push_back(timeParcels(name, cfg, repeat));
+
+        GltfExportOptions gltfOptions;
+        gltfOptions.threads = threads;
+        GltfExportOptions glbOptions = gltfOptions;
+        glbOptions.binary = true;
+
+        StageResult obj = timeStage(name, "saveOBJ", repeat, [&]() { city.saveOBJ(objPath.string(), -1, threads); });
+        obj.bytes = fileBytes({objPath, workDir / "city.mtl"});
+        results.push_back(obj);
+
+        StageResult gltf = timeStage(name, "saveGLTF", repeat, [&]() { city.saveGLTF(gltfPath.string(), gltfOptions); });
+        gltf.bytes = fileBytes({gltfPath, workDir / "city.bin"});
+        results.push_back(gltf);
+
+        StageResult glb = timeStage(name, "saveGLB", repeat, [&]() { city.saveGLTF(glbPath.string(), glbOptions); });
+        glb.bytes = fileBytes({glbPath});
+        results.push_back(glb);
+
+        StageResult summary = timeStage(name, "saveSummary", repeat, [&]() {
+            city.saveSummary(summaryPath.string(), nullptr, nullptr, threads);
+        });
+        summary.bytes = fileBytes({summaryPath});
+        results.push_back(summary);
+    }
+    std::error_code ec;
+    std::filesystem::remove_all(workDir, ec);
+
+    // Baseline comparison: ratio of median wall times, flagged when the
+    // slowdown exceeds the tolerance.  Stages under a millisecond are too
+    // noisy to judge and never count as regressions.
+    std::map<std::string, double> baseline;
+    if (!baselinePath.empty()) {
+        baseline = loadBaseline(baselinePath);
+        if (baseline.empty()) {
+            std::cerr << "Warning: no results found in baseline " << baselinePath << std::endl;
+        }
+    }
+    int regressions = 0;
+
+    std::ostringstream report;
+    report << std::setprecision(6);
+    report << "{\n";
+    report << "\"tool\":\"citygen_bench\",\"repeat\":" << repeat << ",\"threads\":" << threads
+           << ",\"peakRssPerStage\":" << (g_peakResetSupported ? "true" : "false") << ",\n";
+    report << "\"results\":[\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        std::string line = resultLine(results[i]);
+        auto it = baseline.find(results[i].caseName + "|" + results[i].stage);
+        if (it != baseline.end() && it->second > 0.0) {
+            double ratio = results[i].wallMs / it->second;
+            bool regressed = ratio > 1.0 + tolerance && results[i].wallMs >= 1.0;
+            if (regressed) {
+                ++regressions;
+                std::cerr << "REGRESSION " << results[i].caseName << " " << results[i].stage
+                          << ": " << it->second << " ms -> " << results[i].wallMs << " ms" << std::endl;
+            }
+            std::ostringstream extra;
+            extra << std::setprecision(6) << ",\"baselineMs\":" << it->second << ",\"ratio\":" << ratio
+                  << ",\"regressed\":" << (regressed ? "true" : "false") << "}";
+            line.pop_back();
+            line += extra.str();
+        }
+        report << line << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    report << "]";
+    if (!baselinePath.empty()) {
+        report << ",\n\"baseline\":\"" << jsonEscape(baselinePath) << "\",\"tolerance\":" << tolerance
+               << ",\"regressions\":" << regressions;
+    }
+    report << "\n}\n";
+
+    if (outputPath.empty()) {
+        std::cout << report.str();
+    } else {
+        std::ofstream out(outputPath);
+        if (!out) {
+            std::cerr << "Error: cannot write " << outputPath << std::endl;
+            return 1;
+        }
+        out << report.str();
+    }
+    return regressions > 0 ? 2 : 0;
+}
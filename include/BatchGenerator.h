@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Config.h"
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @file BatchGenerator.h
+ *
+ * Generates many cities in one process for parameter sweeps.  A manifest
+ * lists one configuration per row; rows are generated concurrently on a
+ * worker pool and their summaries are streamed, in manifest order, into a
+ * single JSON Lines output.
+ */
+
+/// One manifest row.
+struct BatchJob {
+    std::string id; ///< Row label; names the mesh directory when exporting
+    Config config;
+};
+
+/// Settings shared by every job of a batch run.
+struct BatchOptions {
+    /// Concurrent cities (0 = hardware concurrency).  Each city is
+    /// generated single-threaded so that throughput scales with cores.
+    int threads = 0;
+    /// Write each city's mesh to <outputDir>/<id>/ in its export format.
+    bool exportMeshes = false;
+    std::string outputDir;
+};
+
+/// Totals reported by BatchGenerator::run().
+struct BatchStats {
+    std::size_t cities = 0;   ///< Rows generated successfully
+    std::size_t failures = 0; ///< Rows that raised an error
+    double seconds = 0.0;     ///< Wall time of the whole run
+};
+
+class BatchGenerator {
+public:
+    /**
+     * @brief Read a batch manifest.
+     *
+     * Files ending in ".csv" are read as CSV with a header row; anything
+     * else is read as JSON Lines with one flat object per line.  Field
+     * names follow the command-line options ("grid_size" or "grid-size"):
+     * id, population, hospitals, schools, transport, seed, grid_size,
+     * radius_fraction, layout, rng, green, format, obj_precision, instancing,
+     * lod, quantize, meshopt.  Missing or empty fields take their value
+     * from @p defaults, and rows without an id are labelled by their index.
+     *
+     * @throws std::invalid_argument on malformed rows, unknown fields or
+     *         invalid values; std::runtime_error if the file is unreadable.
+     */
+    static std::vector<BatchJob> loadManifest(const std::string &path, const Config &defaults);
+
+    /// Key/value pairs of one manifest row.
+    using Fields = std::vector<std::pair<std::string, std::string>>;
+
+    /// Parse one flat JSON object, as found on a JSON Lines manifest row.
+    /// @throws std::invalid_argument if it is malformed.
+    static Fields parseFields(const std::string &json);
+
+    /**
+     * @brief Apply manifest fields (other than id, which is ignored) to a
+     * copy of @p defaults.
+     * @throws std::invalid_argument on unknown fields or invalid values.
+     */
+    static Config configFromFields(const Fields &fields, const Config &defaults);
+
+    /**
+     * @brief Generate every job and stream one summary line per job.
+     *
+     * Each output line is {"index":i,"id":"...","ms":t,"summary":{...}}, or
+     * {"index":i,"id":"...","error":"..."} if the job failed.  Lines appear
+     * in job order.  Only a bounded window of jobs is in flight, so memory
+     * stays proportional to the worker count no matter how long the
+     * manifest is.
+     */
+    static BatchStats run(const std::vector<BatchJob> &jobs, const BatchOptions &options,
+                          std::ostream &summaries);
+};
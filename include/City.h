@@ -1,8 +1,17 @@
 #pragma once
 
+#include "Config.h"
+#include "MemoryReport.h"
+
 #include <vector>
 #include <string>
 #include <array>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <iosfwd>
+
+class Trace;
 
 /**
  * @file City.h
@@ -16,7 +25,7 @@
  */
 
 /// Enumeration of high‑level land‑use zones.
-enum class ZoneType {
+enum class ZoneType : std::uint8_t {
     None,        ///< Undeveloped (outside the city radius)
     Residential, ///< Residential areas (houses, apartments)
     Commercial,  ///< Commercial/business districts
@@ -24,6 +33,21 @@ enum class ZoneType {
     Green        ///< Parks, green spaces
 };
 
+/// Number of ZoneType values.
+constexpr std::size_t kZoneTypeCount = 5;
+
+/// Cell count per zone, indexed by the ZoneType value.
+using ZoneCounts = std::array<std::uint64_t, kZoneTypeCount>;
+
+/**
+ * @brief Count the cells of each zone in @p zones.
+ *
+ * Works on eight cells per 64-bit word: each zone value is matched bytewise
+ * (SWAR) and the matches summed in per-byte counters, so the grid is read
+ * once without per-cell branches or table updates.
+ */
+ZoneCounts countZones(const ZoneType *zones, std::size_t count);
+
 /// Simple 2D point convenience type.
 struct Vec2 {
     double x = 0.0;
@@ -33,7 +57,7 @@ struct Vec2 {
 /// Representation of a public facility such as a hospital or school.
 struct Facility {
     /// Kinds of facilities supported by the generator.
-    enum class Type { Hospital, School };
+    enum class Type : std::uint8_t { Hospital, School };
     double x = 0.0;
     double y = 0.0;
     Type type = Type::Hospital;
@@ -63,6 +87,120 @@ struct Building {
     Facility::Type facilityType = Facility::Type::Hospital; ///< Meaningful when facility==true
 };
 
+/**
+ * @brief Column-wise (structure-of-arrays) storage for buildings.
+ *
+ * Footprints, zones, heights and flag bits live in separate arrays so that
+ * passes touching one or two attributes stream only those columns.  Corner
+ * quads are kept in a side table and only for buildings whose corners are
+ * not simply the corners of their footprint rectangle; every grid-layout
+ * building therefore costs no corner storage at all.
+ *
+ * Existing code can keep treating the store like a container of Building:
+ * operator[] and iteration assemble Building values on the fly, and
+ * push_back()/set() scatter them back into the columns.  Assembled values
+ * are copies, so mutations go through set() or the dedicated setters.
+ */
+class BuildingStore {
+public:
+    /// Read-only iterator yielding assembled Building values.
+    class const_iterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = Building;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = Building;
+
+        const_iterator() = default;
+        const_iterator(const BuildingStore *store, std::size_t index) : store_(store), index_(index) {}
+
+        Building operator*() const { return (*store_)[index_]; }
+        Building operator[](difference_type n) const { return (*store_)[index_ + n]; }
+        const_iterator &operator++() { ++index_; return *this; }
+        const_iterator operator++(int) { const_iterator t = *this; ++index_; return t; }
+        const_iterator &operator--() { --index_; return *this; }
+        const_iterator operator--(int) { const_iterator t = *this; --index_; return t; }
+        const_iterator &operator+=(difference_type n) { index_ += n; return *this; }
+        const_iterator &operator-=(difference_type n) { index_ -= n; return *this; }
+        const_iterator operator+(difference_type n) const { return {store_, index_ + n}; }
+        const_iterator operator-(difference_type n) const { return {store_, index_ - n}; }
+        difference_type operator-(const const_iterator &o) const {
+            return static_cast<difference_type>(index_) - static_cast<difference_type>(o.index_);
+        }
+        bool operator==(const const_iterator &o) const { return index_ == o.index_; }
+        bool operator!=(const const_iterator &o) const { return index_ != o.index_; }
+        bool operator<(const const_iterator &o) const { return index_ < o.index_; }
+
+    private:
+        const BuildingStore *store_ = nullptr;
+        std::size_t index_ = 0;
+    };
+
+    std::size_t size() const { return footprints_.size(); }
+    bool empty() const { return footprints_.empty(); }
+    void reserve(std::size_t n);
+    void clear();
+
+    /// Append one building, splitting it into columns.
+    void push_back(const Building &b);
+    /// Append a batch of buildings in order.
+    void append(const std::vector<Building> &batch);
+
+    /// Assemble building @p i.  No bounds checking is performed.
+    Building operator[](std::size_t i) const;
+    /// Overwrite building @p i.
+    void set(std::size_t i, const Building &b);
+
+    const_iterator begin() const { return {this, 0}; }
+    const_iterator end() const { return {this, size()}; }
+
+    // ----- Column access -----
+    const std::vector<Rect> &footprints() const { return footprints_; }
+    const std::vector<ZoneType> &zones() const { return zones_; }
+    const std::vector<int> &heights() const { return heights_; }
+
+    const Rect &footprint(std::size_t i) const { return footprints_[i]; }
+    ZoneType zone(std::size_t i) const { return zones_[i]; }
+    int height(std::size_t i) const { return heights_[i]; }
+    bool isFacility(std::size_t i) const { return (flags_[i] & kFacilityBit) != 0; }
+    Facility::Type facilityType(std::size_t i) const {
+        return (flags_[i] & kSchoolBit) ? Facility::Type::School : Facility::Type::Hospital;
+    }
+    bool hasCorners(std::size_t i) const { return (flags_[i] & kCornersBit) != 0; }
+    /// Base corners of building @p i; the footprint's corners when no
+    /// explicit quad is stored.
+    std::array<Vec2, 4> corners(std::size_t i) const;
+
+    void setHeight(std::size_t i, int height) { heights_[i] = height; }
+    /// Mark building @p i as hosting a facility of the given type.
+    void setFacility(std::size_t i, Facility::Type type);
+
+    /// Number of buildings that need an explicit corner quad.
+    std::size_t storedCornerCount() const { return corners_.size(); }
+
+    /// Heap bytes of all columns and the corner side table.
+    MemoryUsage memoryUsage() const;
+
+private:
+    friend class CitySnapshot; // bulk column (de)serialization
+
+    static constexpr std::uint8_t kFacilityBit = 1;
+    static constexpr std::uint8_t kSchoolBit = 2;
+    static constexpr std::uint8_t kCornersBit = 4;
+    static constexpr std::uint32_t kNoCorners = 0xFFFFFFFFu;
+
+    static std::uint8_t packFlags(const Building &b);
+    std::uint32_t storeCorners(const Building &b);
+
+    std::vector<Rect> footprints_;
+    std::vector<ZoneType> zones_;
+    std::vector<int> heights_;
+    std::vector<std::uint8_t> flags_;
+    std::vector<std::uint32_t> cornerSlot_;    ///< Index into corners_ or kNoCorners
+    std::vector<std::array<Vec2, 4>> corners_; ///< Non-rectangular quads only
+};
+
 /// Representation of a city block bounded by roads.
 struct Block {
     Rect bounds;
@@ -94,6 +232,215 @@ inline double roadWidth(RoadType type) {
     }
 }
 
+/**
+ * @brief Uniform bucket grid accelerating proximity queries on road segments.
+ *
+ * Each segment is inflated by half its hierarchy width and registered in
+ * every cell its bounding box overlaps.  Queries visit cells in rings of
+ * increasing size around the query rectangle and stop as soon as no
+ * unvisited cell can hold a closer segment, so results are bit-identical to
+ * a linear scan over all roads.  The index keeps its own copy of the
+ * inflated bounds and stays valid when the owning City is copied or moved.
+ */
+class RoadIndex {
+public:
+    /// Rebuild the index for the given segments.  The cell size is derived
+    /// from the grid dimension so that cells hold a handful of segments.
+    void build(const std::vector<RoadSegment> &roads, int gridSize);
+
+    /// Number of segments indexed by the last build() call.
+    std::size_t size() const { return boxes_.size(); }
+
+    /// Heap bytes of the bounds and the bucket arrays.
+    MemoryUsage memoryUsage() const;
+
+    /// Distance from a rectangle to the nearest width-inflated segment
+    /// bounding box (zero when they touch).  Returns the maximum double if
+    /// the index is empty.  When @p nearest is non-null it receives the
+    /// index of a closest segment.
+    double distanceTo(const Rect &r, std::size_t *nearest = nullptr) const;
+
+    /// Append indices of segments whose inflated bounds intersect @p area.
+    /// Each segment is reported at most once, in ascending order.
+    void query(const Rect &area, std::vector<std::size_t> &out) const;
+
+    /// Distance between a rectangle and an inflated segment bounding box
+    /// using the same arithmetic as the generator's facility placement.
+    static double rectDistance(const Rect &r, const Rect &box);
+
+private:
+    void cellRange(const Rect &r, int &ix0, int &iy0, int &ix1, int &iy1) const;
+
+    std::vector<Rect> boxes_;           ///< Inflated segment bounds
+    std::vector<std::uint32_t> cellStart_; ///< CSR offsets, cells_²+1 entries
+    std::vector<std::uint32_t> cellItems_; ///< Segment ids bucketed per cell
+    int cells_ = 0;                     ///< Cells per side
+    double originX_ = 0.0;
+    double originY_ = 0.0;
+    double cellSize_ = 1.0;
+};
+
+/**
+ * @brief Static 2-d tree over facility positions for nearest-neighbour
+ * queries.
+ *
+ * Points are stored in a flat array arranged as an implicit balanced tree:
+ * the median of each range (split alternately on x and y) sits at the
+ * range's midpoint.  Building is O(n log n) via nth_element; a query visits
+ * O(log n) nodes on typical inputs.  Distances equal those of a linear scan
+ * exactly, since the minimum squared distance is taken before the root.
+ */
+class FacilityIndex {
+public:
+    /// Index the facilities of the given type.
+    void build(const std::vector<Facility> &facilities, Facility::Type type);
+
+    std::size_t size() const { return points_.size(); }
+    bool empty() const { return points_.empty(); }
+
+    MemoryUsage memoryUsage() const { return MemoryUsage().add(points_); }
+
+    /// Euclidean distance from (x, y) to the closest indexed facility, or
+    /// -1 when the index is empty.
+    double nearestDistance(double x, double y) const;
+
+private:
+    void buildRange(std::size_t begin, std::size_t end, int axis);
+    void search(std::size_t begin, std::size_t end, int axis,
+                double x, double y, double &bestSq) const;
+
+    std::vector<Vec2> points_;
+};
+
+/**
+ * @brief The road network as a graph in compressed sparse row (CSR) form.
+ *
+ * Nodes are the segment endpoints plus every point where two segments
+ * cross or touch; points closer than a millionth of a cell are snapped
+ * together, so ring polylines chain up and radials meet at the centre.
+ * Each segment is split at its crossings into edges that keep the
+ * segment's RoadType.  Crossing candidates come from a RoadIndex query
+ * per segment, so dense ring polylines cost near-linear time rather than
+ * a test of every pair.
+ */
+class RoadGraph {
+public:
+    /// Where a point joins the network: the closest point of an edge.
+    struct Anchor {
+        std::size_t edge = 0;
+        double along = 0.0;  ///< Distance from the edge's first node
+        double offset = 0.0; ///< Straight-line distance from the point
+    };
+
+    /// Rebuild the graph for the given segments.  @p segments, when given,
+    /// must index @p roads for @p gridSize; otherwise one is built.
+    void build(const std::vector<RoadSegment> &roads, int gridSize,
+               const RoadIndex *segments = nullptr);
+
+    std::size_t nodeCount() const { return nodes_.size(); }
+    std::size_t edgeCount() const { return edgeNodes_.size(); }
+    bool empty() const { return edgeNodes_.empty(); }
+
+    /// Heap bytes of the node, arc and edge arrays and the edge index.
+    MemoryUsage memoryUsage() const;
+
+    /// Closest network point to (x, y).  Returns false for an empty graph.
+    bool anchor(double x, double y, Anchor &out) const;
+
+    /**
+     * @brief Multi-source Dijkstra over the network.
+     *
+     * Returns, per node, the travel time in minutes from the nearest of
+     * @p sources.  Sources walk to their anchor at walking speed and edges
+     * are driven, ridden or walked at the speed of @p mode for their
+     * RoadType (one grid cell is 100 m).  Unreachable nodes get infinity.
+     */
+    std::vector<double> travelMinutes(const std::vector<Anchor> &sources,
+                                      Config::TransportMode mode) const;
+
+    /// Minutes to traverse edge @p edge completely with @p mode.
+    double edgeMinutes(std::size_t edge, Config::TransportMode mode) const;
+    /// First and second node of edge @p edge.
+    const std::array<std::uint32_t, 2> &edgeNodes(std::size_t edge) const { return edgeNodes_[edge]; }
+    double edgeLength(std::size_t edge) const { return edgeLength_[edge]; }
+
+    /// Minutes spent walking @p distance cells off the network.
+    static double walkMinutes(double distance);
+
+private:
+    std::vector<Vec2> nodes_;
+    std::vector<std::uint32_t> arcStart_;  ///< CSR offsets, nodeCount()+1 entries
+    std::vector<std::uint32_t> arcTarget_; ///< Neighbour node per arc
+    std::vector<std::uint32_t> arcEdge_;   ///< Edge per arc
+    std::vector<std::array<std::uint32_t, 2>> edgeNodes_;
+    std::vector<double> edgeLength_;
+    std::vector<RoadType> edgeType_;
+    std::vector<RoadSegment> edgeSegments_; ///< Edge geometry for anchoring
+    RoadIndex edgeIndex_;
+    double maxQueryRadius_ = 0.0;
+};
+
+/**
+ * @brief Network travel time to the nearest facility of one type.
+ *
+ * Both ends walk straight to their closest road, then travel along the
+ * network.  A point anchored on the same edge as a facility may also go
+ * straight along that edge.
+ */
+class FacilityAccess {
+public:
+    /// Index the facilities of @p type for travel over @p graph, which
+    /// must outlive this object.
+    void build(const RoadGraph &graph, const std::vector<Facility> &facilities,
+               Facility::Type type, Config::TransportMode mode);
+
+    /// True when no facility of the type is reachable.
+    bool empty() const { return sources_.empty(); }
+
+    MemoryUsage memoryUsage() const { return MemoryUsage().add(sources_).add(nodeMinutes_); }
+
+    /// Minutes from (x, y) to the nearest facility, or -1 when none can be
+    /// reached.
+    double travelMinutes(double x, double y) const;
+
+private:
+    const RoadGraph *graph_ = nullptr;
+    Config::TransportMode mode_ = Config::TransportMode::Car;
+    std::vector<RoadGraph::Anchor> sources_; ///< Sorted by edge
+    std::vector<double> nodeMinutes_;
+};
+
+/**
+ * @brief Options for City::saveGLTF().
+ */
+struct GltfExportOptions {
+    /// Emit a single GLB instead of a .gltf/.bin pair.
+    bool binary = false;
+    /// Place axis-aligned prisms as EXT_mesh_gpu_instancing instances of a
+    /// per-material unit box (one node per material and archetype).  Prisms
+    /// that are not axis-aligned, e.g. radial wedges, stay baked.
+    bool instancing = false;
+    /// Add a coarse level of detail through MSFT_lod: one extrusion per
+    /// block and simplified road polylines.  Ignored by saveTiles().
+    bool lod = false;
+    /// KHR_mesh_quantization: baked positions as 16-bit integers over each
+    /// mesh's bounds (per tile for saveTiles()), normals as bytes.
+    bool quantize = false;
+    /// EXT_meshopt_compression on every buffer view.  Viewers must support
+    /// the extension; there is no uncompressed fallback.
+    bool meshopt = false;
+    /// Worker threads for building the meshes (0 = all cores); callers set
+    /// it from Config::threads.  saveModels() also runs at most this many
+    /// writers at once.
+    int threads = 0;
+};
+
+/// One model file written by City::saveModels().
+struct ModelOutput {
+    Config::ExportFormat format = Config::ExportFormat::OBJ;
+    std::string path;
+};
+
 /**
  * @brief Representation of an entire city.
  *
@@ -117,18 +464,46 @@ public:
     /// statistics and to compute parcel zoning.
     std::vector<ZoneType> zones;
 
-    /// Collection of parcel-based buildings (one per parcel).
-    std::vector<Building> buildings;
+    /// Collection of parcel-based buildings (one per parcel), stored column-wise.
+    BuildingStore buildings;
 
     /// List of facilities (hospitals, schools) placed within the city.
     std::vector<Facility> facilities;
 
     /// Collection of road segments forming the primary road network.
-    std::vector<RoadSegment> roads;
+    const std::vector<RoadSegment> &roads() const { return roads_; }
+
+    /// Replace the road network.  The road index is stale until the next
+    /// buildRoadIndex().
+    void setRoads(std::vector<RoadSegment> roads);
 
     /// Blocks carved out by the road network.
     std::vector<Block> blocks;
 
+    /// How residents reach facilities; selects the road speeds of the
+    /// network accessibility figures in the summary.
+    Config::TransportMode transportMode = Config::TransportMode::Car;
+
+    /// (Re)build the spatial road index from the current road list.
+    void buildRoadIndex();
+
+    /// The spatial index over roads(), or null while it is stale (before
+    /// the first buildRoadIndex() and after every setRoads()).
+    const RoadIndex *roadIndex() const { return roadIndexCurrent_ ? &roadIndex_ : nullptr; }
+
+    /// Shortest distance from a rectangle to the road network, treating
+    /// roads as width-inflated boxes.  Uses the road index when no
+    /// setRoads() came after the last buildRoadIndex() and falls back to a
+    /// linear scan otherwise.
+    double distanceToRoads(const Rect &r) const;
+
+    /// Heap bytes per container: zones, buildings, facilities, roads,
+    /// blocks and the road index.
+    std::vector<MemoryComponent> memoryUsage() const;
+
+    /// Cells per zone in the zoning grid; see countZones().
+    ZoneCounts zoneCounts() const { return countZones(zones.data(), zones.size()); }
+
     /// Access zoning at coordinates (x, y).  No bounds checking is
     /// performed; callers should ensure indices are valid (0 ≤ x,y < size).
     ZoneType &zoneAt(int x, int y) {
@@ -147,26 +522,65 @@ public:
      * generic parcels become extruded boxes, parks become low pads, and
      * facilities use bespoke school/hospital forms.  A companion MTL file
      * with zone-based colours is written alongside the OBJ and referenced
-     * via `mtllib`/`usemtl` statements.  Undeveloped parcels (None) are
+     * via `mtllib`/`usemtl` statements; faces are grouped so each material
+     * appears in a single `usemtl` run.  Undeveloped parcels (None) are
      * ignored.  Note that building height is scaled by 1.0 unit per floor,
      * but this can be adjusted by postprocessing.
      *
+     * Output is buffered and numbers are formatted with std::to_chars.  By
+     * default coordinates use six significant digits (like iostream
+     * defaults); a non-negative @p fixedPrecision writes that many
+     * fractional digits instead.
+     *
      * @param filename Path to the OBJ file to create.
+     * @param fixedPrecision Fractional digits for coordinates, or -1.
+     * @param threads Worker threads for building the mesh (0 = all cores).
+     * @return False if the OBJ file could not be written in full.
      */
-    void saveOBJ(const std::string &filename) const;
+    bool saveOBJ(const std::string &filename, int fixedPrecision = -1, int threads = 0) const;
 
     /**
      * @brief Write the city as a glTF 2.0 scene.
      *
      * Geometry, materials and roads are exported with a fixed Y‑up coordinate
-     * convention (X/Z ground plane, +Y up).  An optional binary GLB can be
+     * convention (X/Z ground plane, +Y up).  Meshes are indexed: the four
+     * corners of each flat-shaded face are shared by its two triangles, and
+     * every primitive is kept below 65535 vertices so indices fit in
+     * 16 bits.  An optional binary GLB can be
      * produced by passing binary=true; otherwise a JSON .gltf plus external
      * .bin is written.
      *
      * @param filename Path to the output glTF (.gltf or .glb) file.
      * @param binary If true, emit GLB; otherwise emit JSON + BIN pair.
+     * @return False if a file could not be written in full.
+     */
+    bool saveGLTF(const std::string &filename, bool binary = false) const;
+
+    /// saveGLTF() with explicit export options.
+    bool saveGLTF(const std::string &filename, const GltfExportOptions &options) const;
+
+    /// Append the GLB that saveGLTF() writes with @p options to @p out,
+    /// whatever options.binary says.
+    void writeGLB(std::string &out, const GltfExportOptions &options) const;
+
+    /**
+     * @brief Write the city as a 3D Tiles tileset of square GLB tiles.
+     *
+     * The grid is cut into tiles of @p tileSize cells.  Each building goes
+     * to the tile holding its footprint centre and roads are clipped at tile
+     * borders.  Every non-empty tile becomes @p directory/tiles/tile_X_Y.glb,
+     * and @p directory/tileset.json lists them with box bounding volumes
+     * (Z-up, Y negated, matching the glTF-to-tileset convention).  Tiles are
+     * built and written one at a time, so peak memory scales with the tile
+     * size rather than the city.  options.binary is ignored.
+     *
+     * When @p memory is given, the largest tile is recorded as export
+     * stage "tiles" and the tile assignment as "tileIndex".  Returns false
+     * if a tile or the tileset could not be written in full.
      */
-    void saveGLTF(const std::string &filename, bool binary = false) const;
+    bool saveTiles(const std::string &directory, double tileSize,
+                   const GltfExportOptions &options = GltfExportOptions{},
+                   MemoryReport *memory = nullptr) const;
 
     /**
      * @brief Write a JSON file summarising high‑level statistics of the city.
@@ -177,6 +591,54 @@ public:
      * manual string concatenation to avoid external dependencies.
      *
      * @param filename Path to the JSON file to create.
+     * @param trace Optional trace; when given, its stage timings and
+     *        counters are written under a "timings" key.
+     * @param memory Optional memory report; when given, the summary
+     *        builder is recorded as export stage "summary" and the report
+     *        is written under a "memory" key.
+     * @param threads Worker threads for the accessibility queries
+     *        (0 = all cores).
+     * @return False if the JSON file could not be written in full.
+     */
+    bool saveSummary(const std::string &filename, const Trace *trace = nullptr,
+                     MemoryReport *memory = nullptr, int threads = 0) const;
+
+    /// Write the summary JSON of saveSummary() to @p out.
+    void writeSummary(std::ostream &out, const Trace *trace = nullptr,
+                      MemoryReport *memory = nullptr, int threads = 0) const;
+
+    /**
+     * @brief Write several model files and the summary in one go.
+     *
+     * Produces the same files as saveOBJ(), saveGLTF() and saveSummary()
+     * called one after another.  The city is decomposed into prisms once
+     * for all mesh writers, and each writer runs on its own thread (at most
+     * gltfOptions.threads at once, when set) with its own output buffer.
+     * gltfOptions.threads also bounds the mesh and summary workers.  The
+     * summary's accessibility queries overlap with mesh encoding, and
+     * .gltf and .glb outputs share one glTF scene.  Latency is therefore
+     * close to that of the slowest writer.
+     *
+     * The whole call is the "export" stage of @p trace.  The summary is
+     * written last, so its timings include that stage.  An empty
+     * @p summaryPath skips the summary.  gltfOptions.binary is ignored:
+     * each ModelOutput names its format.
+     *
+     * With @p memory, every writer records its transients at their
+     * largest as an export stage: "geometry" (the shared prisms), "obj",
+     * "gltfScene", one stage per glTF file format and "summary".  The
+     * summary then carries the report.
+     *
+     * Returns false if any file could not be written in full; the other
+     * files are still written.
      */
-    void saveSummary(const std::string &filename) const;
+    bool saveModels(const std::vector<ModelOutput> &models, const GltfExportOptions &gltfOptions,
+                    int objPrecision, const std::string &summaryPath,
+                    Trace *trace = nullptr, MemoryReport *memory = nullptr) const;
+
+private:
+    std::vector<RoadSegment> roads_;
+    /// Spatial index over roads_; only consulted while roadIndexCurrent_.
+    RoadIndex roadIndex_;
+    bool roadIndexCurrent_ = false;
 };
@@ -3,6 +3,8 @@
 #include "Config.h"
 #include "City.h"
 
+class Trace;
+
 /**
  * @file CityGenerator.h
  *
@@ -24,7 +26,23 @@ public:
      * (CityGenerator.cpp) for details of the algorithm.
      *
      * @param cfg Configuration controlling the generation process.
+     * @param trace Optional trace receiving per-stage timings and counters
+     *        (cells zoned, roads, blocks, parcels, buildings, RNG draws).
+     * @param memory Optional memory report receiving the city's containers
+     *        and the scratch arrays of the generation stages.
      * @return Generated City object.
      */
-    static City generate(const Config &cfg);
+    static City generate(const Config &cfg, Trace *trace = nullptr, MemoryReport *memory = nullptr);
+
+    /**
+     * @brief Predict, without generating, the memory that generate() and
+     * the export of @p cfg's formats and summary need.
+     *
+     * Costs per cell, road, block and building mirror the containers that
+     * MemoryReport accounts.  The building count is bounded from the
+     * developed area at a parcel density above what either layout
+     * produces, and growable arrays are assumed to be at twice their
+     * size, so the estimate errs high.
+     */
+    static MemoryEstimate estimateMemory(const Config &cfg);
 };
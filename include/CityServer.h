@@ -0,0 +1,133 @@
+#pragma once
+
+#include "Config.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class City;
+class IncrementalCityGenerator;
+
+/**
+ * @file CityServer.h
+ *
+ * Long-running generation daemon (citygen --serve).  Requests carry the
+ * fields of a batch manifest row and are answered with the summary or
+ * GLB bytes straight from memory, so a warm server never touches disk.
+ */
+
+/// Settings of a CityServer.
+struct ServerOptions {
+    /// "PORT" or "HOST:PORT" for TCP (loopback unless a host is given);
+    /// "unix:PATH", or any value containing '/', for a Unix socket.
+    std::string listen;
+    /// Concurrent generations (0 = hardware concurrency).
+    int workers = 0;
+    /// Cities kept in memory; the least recently used is evicted first.
+    std::size_t cacheEntries = 32;
+    /// Values of the fields a request leaves out.
+    Config defaults;
+};
+
+/// A response of CityServer::handle().
+struct ServerResponse {
+    int status = 200;
+    std::string contentType = "application/json";
+    std::shared_ptr<const std::string> body;
+    /// "hit", "miss" or "coalesced" (waited for an identical request);
+    /// empty when no city was involved.
+    std::string cache;
+    double generateMs = 0.0;
+    double encodeMs = 0.0;
+};
+
+/**
+ * @brief HTTP/1.1 front end to a cache of generated cities.
+ *
+ * Endpoints (GET with a query string, or POST with a flat JSON object;
+ * both take the batch manifest fields, see BatchGenerator::loadManifest):
+ *
+ *   /summary  the city summary JSON
+ *   /glb      the GLB model; instancing, lod, quantize and meshopt apply
+ *   /stats    cache and generator counters
+ *
+ * Cities are cached keyed on the normalised Config fields that generation
+ * reads, with their encoded outputs alongside, so a repeated request is a
+ * hash lookup and a write.  Identical requests in flight share a single
+ * generation.  Misses run on a pool of single-threaded
+ * IncrementalCityGenerator workers; each miss goes to the idle worker
+ * with the fewest stages left to run, so near-duplicates (say, another
+ * school count) redo only the stages whose inputs changed.
+ *
+ * Each connection is served by its own thread.  Connections are kept
+ * alive between requests and closed when idle.  Memory is the cached
+ * cities and outputs plus up to three cities per worker.
+ */
+class CityServer {
+public:
+    explicit CityServer(ServerOptions options);
+    ~CityServer();
+    CityServer(const CityServer &) = delete;
+    CityServer &operator=(const CityServer &) = delete;
+
+    /**
+     * @brief Open the listening socket.
+     * @return The bound address, e.g. "127.0.0.1:8080" (with the port
+     *         chosen by the system for port 0) or "unix:/tmp/citygen.sock".
+     * @throws std::invalid_argument for a malformed address and
+     *         std::runtime_error if the socket cannot be opened.
+     */
+    std::string bind();
+
+    /// Accept connections until stop(); returns once they are all closed.
+    void run();
+
+    /// Make run() return.  Safe to call from any thread.
+    void stop();
+
+    /// Answer one request; @p target is the path with its query string.
+    ServerResponse handle(const std::string &method, const std::string &target,
+                          const std::string &body);
+
+private:
+    struct Entry;
+
+    std::shared_ptr<Entry> lookup(const Config &cfg, std::string &cache);
+    std::size_t acquireWorker(const Config &cfg);
+    void releaseWorker(std::size_t worker);
+    std::string statsJson();
+    void serveConnection(int fd, bool tcp);
+
+    ServerOptions options_;
+
+    std::mutex cacheMutex_;
+    std::list<std::string> lru_; ///< Cache keys, most recently used first
+    std::unordered_map<std::string, std::shared_ptr<Entry>> cache_;
+
+    std::mutex workerMutex_;
+    std::condition_variable workerFree_;
+    std::vector<std::unique_ptr<IncrementalCityGenerator>> workers_;
+    std::vector<bool> busy_;
+
+    std::atomic<std::uint64_t> requests_{0};
+    std::atomic<std::uint64_t> hits_{0};
+    std::atomic<std::uint64_t> misses_{0};
+    std::atomic<std::uint64_t> coalesced_{0};
+    std::atomic<std::uint64_t> stageRuns_[3] = {{0}, {0}, {0}};
+
+    int listenFd_ = -1;
+    bool tcp_ = true;
+    std::string unixPath_;
+    std::atomic<bool> stopping_{false};
+    std::mutex connectionMutex_;
+    std::condition_variable connectionsDone_;
+    std::size_t connections_ = 0;
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "City.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @file CitySnapshot.h
+ *
+ * Versioned binary serialization of a complete City.  A snapshot holds the
+ * zoning grid as a packed byte grid, plus the building columns, blocks,
+ * roads and facilities, each stored as a flat little-endian array.  A
+ * header with a section table records the offset, element size and count
+ * of every array.  Sections are 8-byte aligned, so a mapped file can be
+ * read in place without any parse step.
+ *
+ * Layout (all integers little-endian):
+ *
+ *     Header   magic "CITYSNAP", u32 version, u32 sectionCount,
+ *              i32 gridSize, u32 reserved
+ *     Section  sectionCount × { u32 id, u32 elementSize, u64 offset, u64 count }
+ *     Payload  section arrays, each starting on an 8-byte boundary
+ *
+ * Readers ignore sections with unknown ids, so later versions can add
+ * arrays without breaking older tools.
+ */
+
+/// On-disk block record; mirrors Block with explicit padding.
+struct SnapshotBlock {
+    Rect bounds;
+    std::array<Vec2, 4> corners;
+    std::uint8_t hasCorners;
+    std::uint8_t pad[7];
+};
+
+/// On-disk road record; mirrors RoadSegment with explicit padding.
+struct SnapshotRoad {
+    double x1, y1, x2, y2;
+    std::int32_t type;
+    std::uint32_t pad;
+};
+
+/// On-disk facility record; mirrors Facility with explicit padding.
+struct SnapshotFacility {
+    double x, y;
+    std::uint8_t type;
+    std::uint8_t pad[7];
+};
+
+/**
+ * @brief Read-only view of a snapshot file mapped into memory.
+ *
+ * The constructor maps the file and validates the header and section
+ * table.  Array accessors return pointers into the mapping, and toCity()
+ * copies the columns into a City with bulk copies.
+ */
+class CitySnapshot {
+public:
+    static constexpr std::uint32_t kVersion = 1;
+
+    /// Section identifiers.
+    enum Section : std::uint32_t {
+        Zones = 1,
+        BuildingFootprints,
+        BuildingZones,
+        BuildingHeights,
+        BuildingFlags,
+        BuildingCornerSlots,
+        BuildingCorners,
+        Blocks,
+        Roads,
+        Facilities
+    };
+
+    /// Typed, bounds-known view of one section.
+    template <class T>
+    struct Array {
+        const T *data = nullptr;
+        std::size_t count = 0;
+        const T *begin() const { return data; }
+        const T *end() const { return data + count; }
+    };
+
+    /// Write @p city to @p path.  Throws std::runtime_error on I/O failure.
+    static void write(const City &city, const std::string &path);
+
+    /// Map and validate @p path.  Throws std::runtime_error when the file
+    /// cannot be read or is not a compatible snapshot.
+    explicit CitySnapshot(const std::string &path);
+    ~CitySnapshot();
+    CitySnapshot(const CitySnapshot &) = delete;
+    CitySnapshot &operator=(const CitySnapshot &) = delete;
+
+    int gridSize() const { return gridSize_; }
+    Array<ZoneType> zones() const { return section<ZoneType>(Zones); }
+    Array<Rect> buildingFootprints() const { return section<Rect>(BuildingFootprints); }
+    Array<ZoneType> buildingZones() const { return section<ZoneType>(BuildingZones); }
+    Array<std::int32_t> buildingHeights() const { return section<std::int32_t>(BuildingHeights); }
+    Array<SnapshotBlock> blocks() const { return section<SnapshotBlock>(Blocks); }
+    Array<SnapshotRoad> roads() const { return section<SnapshotRoad>(Roads); }
+    Array<SnapshotFacility> facilities() const { return section<SnapshotFacility>(Facilities); }
+
+    /// Materialise the full City, including its road index.
+    City toCity() const;
+
+private:
+    struct Entry {
+        std::uint32_t elementSize = 0;
+        std::uint64_t offset = 0;
+        std::uint64_t count = 0;
+    };
+
+    template <class T>
+    Array<T> section(std::uint32_t id) const {
+        const Entry &e = entries_[id];
+        return {reinterpret_cast<const T *>(base_ + e.offset), static_cast<std::size_t>(e.count)};
+    }
+
+    void validate(const std::string &path);
+    void release();
+
+    const unsigned char *base_ = nullptr;
+    std::size_t size_ = 0;
+    bool mapped_ = false;
+    std::vector<unsigned char> fallback_; ///< File contents when mmap is unavailable
+    int gridSize_ = 0;
+    Entry entries_[Facilities + 1];
+};
@@ -4,6 +4,7 @@
 #include <string>
 #include <algorithm>
 #include <stdexcept>
+#include <vector>
 
 /**
  * @brief High-level configuration for procedural city generation.
@@ -31,7 +32,8 @@ struct Config {
     int schools = 5;
 
     // ===== Urban planning parameters =====
-    // Minimal green area per person (m^2)
+    // Minimal green area per person (m^2).  Reserved: the generator
+    // always targets 8 m^2.
     double green_m2_per_capita = 8.0;
 
     // ===== Transport =====
@@ -47,9 +49,41 @@ struct Config {
     std::string output_prefix = "city";
     enum class ExportFormat { OBJ, GLTF, GLB };
     ExportFormat export_format = ExportFormat::OBJ;
+    // Further formats written in the same run (--format=obj,glb).
+    std::vector<ExportFormat> extra_export_formats;
+    // Fractional digits for OBJ coordinates; -1 keeps six significant digits.
+    int obj_precision = -1;
+    // glTF/GLB: instance axis-aligned prisms via EXT_mesh_gpu_instancing.
+    bool gltf_instancing = false;
+    // glTF/GLB: add a coarse block-level LOD via MSFT_lod.
+    bool gltf_lod = false;
+    // glTF/GLB: quantize attributes via KHR_mesh_quantization.
+    bool gltf_quantize = false;
+    // glTF/GLB: compress buffer views via EXT_meshopt_compression.
+    bool gltf_meshopt = false;
+    // Edge of square 3D Tiles tiles in grid cells; 0 writes a single model.
+    double tile_size = 0.0;
     enum class LayoutType { Grid, Radial };
     LayoutType layout = LayoutType::Grid;
 
+    // ===== Performance =====
+    // Worker threads for parallel stages (0 = hardware concurrency).  The
+    // generated city is identical for every thread count.
+    int threads = 0;
+
+    // Random stream layout for parcelization.  Sequential threads one engine
+    // through all blocks (reference output); PerBlock derives an independent
+    // counter-based stream per block so blocks parcelize in parallel.
+    enum class RngMode { Sequential, PerBlock };
+    RngMode rng_mode = RngMode::Sequential;
+
+    // How cells are picked for conversion to green space.  Shuffle permutes
+    // every residential/industrial cell (reference output); Sample draws
+    // only the cells it converts, so its cost scales with the shortfall
+    // rather than the grid.  The two pick different cells.
+    enum class GreenMode { Shuffle, Sample };
+    GreenMode green_mode = GreenMode::Shuffle;
+
     // ===== Sanity checks =====
     void normalize() {
         if (population < 0) population = 0;
@@ -59,6 +93,8 @@ struct Config {
         if (hospitals < 0) hospitals = 0;
         if (schools < 0) schools = 0;
         if (green_m2_per_capita < 0.0) green_m2_per_capita = 0.0;
+        if (threads < 0) threads = 0;
+        if (tile_size < 0.0) tile_size = 0.0;
     }
 };
 
@@ -74,6 +110,30 @@ inline Config::TransportMode transportModeFromString(std::string s) {
     throw std::invalid_argument("Unknown transport mode: " + s);
 }
 
+inline const char *transportModeName(Config::TransportMode mode) {
+    switch (mode) {
+        case Config::TransportMode::PublicTransit: return "transit";
+        case Config::TransportMode::Walk: return "walk";
+        case Config::TransportMode::Car:
+        default: return "car";
+    }
+}
+
+/// Largest fixed precision for OBJ coordinates; beyond 17 fractional
+/// digits a double has nothing left to print.
+constexpr int kMaxObjPrecision = 17;
+
+/// Validate an OBJ precision: -1 (six significant digits) or 1 to
+/// kMaxObjPrecision fixed decimals.  Zero decimals would merge distinct
+/// vertices.
+inline int objPrecisionFromInt(long digits) {
+    if (digits != -1 && (digits < 1 || digits > kMaxObjPrecision)) {
+        throw std::invalid_argument("OBJ precision must be -1 or 1 to " +
+                                    std::to_string(kMaxObjPrecision) + ": " + std::to_string(digits));
+    }
+    return static_cast<int>(digits);
+}
+
 inline Config::ExportFormat exportFormatFromString(std::string s) {
     std::transform(s.begin(), s.end(), s.begin(), ::tolower);
     if (s == "obj") return Config::ExportFormat::OBJ;
@@ -82,9 +142,60 @@ inline Config::ExportFormat exportFormatFromString(std::string s) {
     throw std::invalid_argument("Unknown export format: " + s);
 }
 
+/// File extension of a model written in @p format, with the dot.
+inline const char *exportFormatExtension(Config::ExportFormat format) {
+    switch (format) {
+        case Config::ExportFormat::OBJ: return ".obj";
+        case Config::ExportFormat::GLB: return ".glb";
+        case Config::ExportFormat::GLTF:
+        default: return ".gltf";
+    }
+}
+
+/// Parse a comma-separated list such as "obj,glb" into cfg.export_format
+/// (the first entry) and cfg.extra_export_formats (the rest, without
+/// repeats).
+inline void setExportFormats(Config &cfg, const std::string &list) {
+    std::vector<Config::ExportFormat> formats;
+    std::size_t begin = 0;
+    for (;;) {
+        std::size_t end = list.find(',', begin);
+        Config::ExportFormat f = exportFormatFromString(list.substr(begin, end - begin));
+        if (std::find(formats.begin(), formats.end(), f) == formats.end()) formats.push_back(f);
+        if (end == std::string::npos) break;
+        begin = end + 1;
+    }
+    cfg.export_format = formats.front();
+    cfg.extra_export_formats.assign(formats.begin() + 1, formats.end());
+}
+
+/// Every format cfg asks for: export_format, then the extra formats.
+inline std::vector<Config::ExportFormat> exportFormats(const Config &cfg) {
+    std::vector<Config::ExportFormat> formats{cfg.export_format};
+    for (Config::ExportFormat f : cfg.extra_export_formats) {
+        if (std::find(formats.begin(), formats.end(), f) == formats.end()) formats.push_back(f);
+    }
+    return formats;
+}
+
 inline Config::LayoutType layoutTypeFromString(std::string s) {
     std::transform(s.begin(), s.end(), s.begin(), ::tolower);
     if (s == "grid") return Config::LayoutType::Grid;
     if (s == "radial") return Config::LayoutType::Radial;
     throw std::invalid_argument("Unknown layout type: " + s);
 }
+
+inline Config::RngMode rngModeFromString(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    if (s == "sequential") return Config::RngMode::Sequential;
+    if (s == "per-block" || s == "per_block" || s == "block")
+        return Config::RngMode::PerBlock;
+    throw std::invalid_argument("Unknown RNG mode: " + s);
+}
+
+inline Config::GreenMode greenModeFromString(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    if (s == "shuffle") return Config::GreenMode::Shuffle;
+    if (s == "sample") return Config::GreenMode::Sample;
+    throw std::invalid_argument("Unknown green mode: " + s);
+}
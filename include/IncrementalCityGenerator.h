@@ -0,0 +1,107 @@
+#pragma once
+
+#include "City.h"
+#include "Config.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class Trace;
+
+/**
+ * @file IncrementalCityGenerator.h
+ *
+ * Regenerates a city after a Config change by re-running only the
+ * generation stages whose inputs changed.
+ */
+
+/**
+ * @brief Stage-caching front end to CityGenerator.
+ *
+ * Generation runs in three stages.  Each one is cached, keyed by the
+ * Config fields it reads:
+ *
+ * | Stage      | Work                                   | Key fields                         |
+ * |------------|----------------------------------------|------------------------------------|
+ * | Zoning     | noise zoning                           | seed, grid_size, city_radius       |
+ * | Layout     | green space, roads, blocks, parcels,   | + population, layout, rng_mode,    |
+ * |            | road index, facility candidate order   |   green_mode                       |
+ * | Facilities | hospital and school imprinting         | + hospitals, schools,              |
+ * |            |                                        |   transport_mode                   |
+ *
+ * A call re-runs the first stage whose key changed and every stage after
+ * it.  Changing only facility counts therefore costs one facility pass
+ * plus a copy of the laid-out city.  Fields no stage reads, such as the
+ * export format, threads or tile size, reuse the previous city as is.
+ * Results equal CityGenerator::generate for the same Config.
+ *
+ * Memory: the zoned grid, the laid-out city and the latest result are all
+ * kept.
+ */
+class IncrementalCityGenerator {
+public:
+    /// Stage bits reported by lastStages().
+    enum Stage : unsigned {
+        Zoning = 1u,
+        Layout = 2u,
+        Facilities = 4u
+    };
+
+    /**
+     * @brief Generate the city for @p cfg, reusing cached stages.
+     *
+     * The returned city is never modified afterwards.  Later calls return
+     * new objects, so callers may hold on to earlier results.
+     */
+    std::shared_ptr<const City> generate(const Config &cfg, Trace *trace = nullptr);
+
+    /// Bitmask of the stages generate(@p cfg) would run now.
+    unsigned pendingStages(const Config &cfg) const;
+
+    /// Bitmask of the stages run by the last generate() call.
+    unsigned lastStages() const { return lastStages_; }
+
+    /// Drop every cached stage.
+    void clear();
+
+private:
+    struct ZoningKey {
+        std::uint32_t seed;
+        int gridSize;
+        double cityRadius;
+        bool operator==(const ZoningKey &o) const {
+            return seed == o.seed && gridSize == o.gridSize && cityRadius == o.cityRadius;
+        }
+    };
+    struct LayoutKey {
+        int population;
+        Config::LayoutType layout;
+        Config::RngMode rngMode;
+        Config::GreenMode greenMode;
+        bool operator==(const LayoutKey &o) const {
+            return population == o.population && layout == o.layout && rngMode == o.rngMode &&
+                   greenMode == o.greenMode;
+        }
+    };
+    struct FacilityKey {
+        int hospitals;
+        int schools;
+        Config::TransportMode transportMode;
+        bool operator==(const FacilityKey &o) const {
+            return hospitals == o.hospitals && schools == o.schools &&
+                   transportMode == o.transportMode;
+        }
+    };
+
+    bool haveZoning_ = false;
+    bool haveLayout_ = false;
+    ZoningKey zoningKey_{};
+    LayoutKey layoutKey_{};
+    FacilityKey facilityKey_{};
+    City zoned_;                            ///< After zoning
+    City laidOut_;                          ///< After layout, before facilities
+    std::vector<std::size_t> facilityOrder_; ///< Candidate parcels, best first
+    std::shared_ptr<const City> result_;    ///< Latest full city
+    unsigned lastStages_ = 0;
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @file MemoryReport.h
+ *
+ * Memory accounting (citygen --mem-report).  Containers report the bytes
+ * of their live elements and of their allocation; a MemoryReport collects
+ * those figures for the City, for the transients of each generation and
+ * export stage, and next to them the prediction of
+ * CityGenerator::estimateMemory().  Only container payloads are counted,
+ * not allocator overhead or fixed-size members, so the figures are a
+ * floor on what the process holds.
+ */
+
+/// Heap bytes held by a container or a group of containers.
+struct MemoryUsage {
+    std::size_t bytes = 0;    ///< size() elements
+    std::size_t capacity = 0; ///< capacity() elements, i.e. what is allocated
+
+    template <class T>
+    MemoryUsage &add(const std::vector<T> &v) {
+        bytes += v.size() * sizeof(T);
+        capacity += v.capacity() * sizeof(T);
+        return *this;
+    }
+
+    /// Nested vectors: the outer array and every inner allocation.
+    template <class T>
+    MemoryUsage &add(const std::vector<std::vector<T>> &v) {
+        bytes += v.size() * sizeof(std::vector<T>);
+        capacity += v.capacity() * sizeof(std::vector<T>);
+        for (const auto &inner : v) add(inner);
+        return *this;
+    }
+
+    MemoryUsage &add(const MemoryUsage &other) {
+        bytes += other.bytes;
+        capacity += other.capacity;
+        return *this;
+    }
+};
+
+/// A named entry of a memory report.
+struct MemoryComponent {
+    std::string name;
+    MemoryUsage usage;
+};
+
+/// Sum of the usages of @p components.
+MemoryUsage totalUsage(const std::vector<MemoryComponent> &components);
+
+/**
+ * @brief Memory a Config is predicted to need, from
+ * CityGenerator::estimateMemory().
+ *
+ * Every figure is allocated bytes and errs on the high side, so a
+ * scheduler can admit a job when peak plus the process baseline fits.
+ */
+struct MemoryEstimate {
+    std::size_t buildings = 0;  ///< Upper estimate of the building count
+    std::size_t city = 0;       ///< City containers
+    std::size_t generate = 0;   ///< Largest transient of a generation stage
+    std::size_t exportPeak = 0; ///< Transients of all export stages together
+    /// city + max(generate, exportPeak).
+    std::size_t peak() const { return city + (generate > exportPeak ? generate : exportPeak); }
+};
+
+/// Write @p estimate as a one-line JSON object.
+void writeEstimateJson(std::ostream &out, const MemoryEstimate &estimate);
+
+/**
+ * @brief Collects the memory accounting of one run.
+ *
+ * Stages record their containers at the point they are largest; a stage
+ * recorded several times (one tile after another, say) keeps its
+ * high-water mark.  Generation stages run one after another, while the
+ * export stages of City::saveModels() run concurrently, so the accounted
+ * peak is the city plus the larger of the biggest generation stage and
+ * the sum of all export stages.  Recording is thread-safe.
+ */
+class MemoryReport {
+public:
+    /// Stage high-water mark: its components when their capacity peaked.
+    struct Stage {
+        std::string name;
+        std::vector<MemoryComponent> components;
+        MemoryUsage total;
+    };
+
+    /// Record the containers of the finished city, replacing earlier ones.
+    void setCity(std::vector<MemoryComponent> components);
+    /// Record the transients of generation stage @p stage.
+    void recordGenerateStage(const std::string &stage, std::vector<MemoryComponent> components);
+    /// Record the transients of export stage @p stage.
+    void recordExportStage(const std::string &stage, std::vector<MemoryComponent> components);
+    /// Keep @p estimate to report it next to the accounted figures.
+    void setEstimate(const MemoryEstimate &estimate);
+
+    MemoryUsage city() const;
+    /// Accounted peak in allocated bytes; see the class comment.
+    std::size_t peak() const;
+
+    /// Write the report as a JSON object; @p indent prefixes nested lines.
+    void writeJson(std::ostream &out, const std::string &indent) const;
+    /// Write the report as a table in MiB.
+    void writeText(std::ostream &out) const;
+
+    /// Peak resident set size of this process in bytes (0 if unknown).
+    static std::size_t peakResidentBytes();
+
+private:
+    static void record(std::vector<Stage> &stages, const std::string &name,
+                       std::vector<MemoryComponent> components);
+    std::size_t peakLocked() const;
+
+    mutable std::mutex mutex_;
+    std::vector<MemoryComponent> city_;
+    std::vector<Stage> generate_;
+    std::vector<Stage> export_;
+    bool hasEstimate_ = false;
+    MemoryEstimate estimate_;
+};
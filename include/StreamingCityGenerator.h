@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Config.h"
+
+#include <cstddef>
+#include <string>
+
+class Trace;
+
+/**
+ * @file StreamingCityGenerator.h
+ *
+ * Out-of-core generation: writes a city straight to OBJ and summary files
+ * without ever holding its zoning grid or building list in memory.
+ */
+
+/// Sizes of a streamed city, for reporting.
+struct StreamingStats {
+    std::size_t blocks = 0;
+    std::size_t buildings = 0;
+    std::size_t facilityCandidates = 0;
+};
+
+/**
+ * @brief Generate a city block by block and stream it to disk.
+ *
+ * The output equals CityGenerator::generate followed by City::saveOBJ and
+ * City::saveSummary for the same Config, byte for byte.  Zoning is never
+ * stored: fractalNoise is position-pure, so each parcel recomputes the
+ * zone of the cell it samples, and green conversion is kept as the sorted
+ * list of converted cells.  That requires Config::GreenMode::Sample;
+ * Shuffle permutes every candidate cell and has no bounded-memory form.
+ *
+ * Passes:
+ *  1. Count zones row by row (in parallel), keeping candidates per row.
+ *  2. Draw the green ranks and locate them, re-zoning only their rows.
+ *  3. Plan roads and blocks; parcelize every block once to collect the
+ *     facility candidates (building index and road distance).
+ *  4. Order the candidates and re-parcelize the blocks holding the chosen
+ *     sites to imprint them.
+ *  5. For each material, re-parcelize the blocks containing it and write
+ *     its buildings; then write the roads.
+ *
+ * Blocks are regenerated from a per-block RNG snapshot (sequential mode)
+ * or their own Philox stream (per-block mode), so revisiting one costs no
+ * replay of earlier blocks.  Memory is O(grid_size + blocks) plus 16 bytes
+ * per residential or commercial building for the candidate list, 32 bytes
+ * per residential building for the summary percentiles and network
+ * queries, and one block's parcels at a time.
+ *
+ * Only OBJ output is supported: glTF buffers span the whole scene.
+ */
+class StreamingCityGenerator {
+public:
+    /**
+     * @brief Generate @p cfg into @p objPath and @p summaryPath.
+     * @throws std::invalid_argument if cfg asks for shuffle green space or
+     *         a format other than a single OBJ.
+     * @throws std::runtime_error if either file could not be written.
+     */
+    static StreamingStats generate(const Config &cfg, const std::string &objPath,
+                                   const std::string &summaryPath, Trace *trace = nullptr);
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @file Trace.h
+ *
+ * Optional stage-level instrumentation.  Code under measurement opens a
+ * Trace::Scope per stage and attaches counters to it; every entry point
+ * takes a nullable Trace pointer, and a Scope built from a null pointer
+ * does nothing (no clock reads, no allocation), so instrumentation costs
+ * next to nothing when tracing is off.
+ */
+class Trace {
+public:
+    /// Named integer metric attached to a stage.
+    struct Counter {
+        std::string name;
+        std::int64_t value = 0;
+    };
+
+    /// One completed (or still open) stage.
+    struct Stage {
+        std::string name;
+        double startUs = 0.0;    ///< Microseconds since the Trace was created
+        double durationUs = 0.0;
+        int depth = 0;           ///< Nesting level; top-level stages are 0
+        int thread = 0;          ///< Chrome trace track; 0 is the calling thread
+        std::vector<Counter> counters;
+    };
+
+    /**
+     * @brief RAII timer for one stage.
+     *
+     * The stage closes when the scope is destroyed or end() is called,
+     * whichever comes first.
+     */
+    class Scope {
+    public:
+        Scope(Trace *trace, const char *name);
+        ~Scope() { end(); }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+        /// Add @p value to the counter @p name of this stage.
+        void count(const char *name, std::int64_t value);
+        /// Close the stage early.
+        void end();
+
+    private:
+        Trace *trace_;
+        std::size_t index_ = 0;
+        bool open_ = false;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    Trace();
+
+    /**
+     * @brief Add a stage that ran from @p start to @p end, nested in the
+     * innermost open scope.
+     *
+     * Scopes are not thread-safe, so work on worker threads reads the
+     * clock itself and is added here once the workers are joined.
+     * @p thread places it on its own trace track (1 and up).
+     */
+    void addStage(const char *name, Clock::time_point start, Clock::time_point end, int thread,
+                  std::vector<Counter> counters = {});
+
+    /// CPU time of the calling thread in microseconds, or 0 if the
+    /// platform has no per-thread clock.
+    static std::int64_t threadCpuUs();
+
+    const std::vector<Stage> &stages() const { return stages_; }
+
+    /// Write all stages as Chrome trace-event JSON ("X" complete events
+    /// with counters as args), loadable in chrome://tracing or Perfetto.
+    bool writeChromeTrace(const std::string &path) const;
+
+    /// Write a JSON object mapping each stage name to its duration in
+    /// milliseconds and its counters.  @p indent prefixes nested lines.
+    void writeTimingsJson(std::ostream &out, const std::string &indent) const;
+
+private:
+    double nowUs() const;
+
+    Clock::time_point origin_;
+    std::vector<Stage> stages_;
+    int depth_ = 0;
+};
@@ -0,0 +1,193 @@
+#ifndef CITYGEN_C_H
+#define CITYGEN_C_H
+
+/**
+ * @file citygen_c.h
+ *
+ * Stable C interface to the city generator, for embedding it in other
+ * processes (services, ctypes/cffi bindings) without spawning the CLI.
+ *
+ * A city is generated from a citygen_config into an opaque citygen_city
+ * handle.  Array accessors return pointers straight into the handle's
+ * storage: they stay valid until citygen_city_free() and must not be
+ * written through.  Functions returning int report CITYGEN_OK on success;
+ * on failure citygen_last_error() describes the problem.
+ *
+ * ABI rules: the structs below only ever grow at the end, and callers set
+ * citygen_config::struct_size (citygen_config_init() does) so older
+ * callers keep working against newer libraries.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#  if defined(CITYGEN_BUILDING_DLL)
+#    define CITYGEN_API __declspec(dllexport)
+#  else
+#    define CITYGEN_API
+#  endif
+#elif defined(__GNUC__)
+#  define CITYGEN_API __attribute__((visibility("default")))
+#else
+#  define CITYGEN_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CITYGEN_C_API_VERSION 5
+
+/* Status codes. */
+#define CITYGEN_OK 0
+#define CITYGEN_ERROR_INVALID_ARGUMENT 1
+#define CITYGEN_ERROR_OUT_OF_MEMORY 2
+#define CITYGEN_ERROR_INTERNAL 3
+#define CITYGEN_ERROR_IO 4 /**< An output file could not be written; API version 5 */
+
+/* Enumerations; values match the C++ enums. */
+#define CITYGEN_TRANSPORT_CAR 0
+#define CITYGEN_TRANSPORT_TRANSIT 1
+#define CITYGEN_TRANSPORT_WALK 2
+
+#define CITYGEN_LAYOUT_GRID 0
+#define CITYGEN_LAYOUT_RADIAL 1
+
+#define CITYGEN_RNG_SEQUENTIAL 0
+#define CITYGEN_RNG_PER_BLOCK 1
+
+#define CITYGEN_GREEN_SHUFFLE 0
+#define CITYGEN_GREEN_SAMPLE 1
+
+#define CITYGEN_ZONE_NONE 0
+#define CITYGEN_ZONE_RESIDENTIAL 1
+#define CITYGEN_ZONE_COMMERCIAL 2
+#define CITYGEN_ZONE_INDUSTRIAL 3
+#define CITYGEN_ZONE_GREEN 4
+
+#define CITYGEN_ROAD_ARTERIAL 0
+#define CITYGEN_ROAD_SECONDARY 1
+#define CITYGEN_ROAD_LOCAL 2
+
+#define CITYGEN_FACILITY_HOSPITAL 0
+#define CITYGEN_FACILITY_SCHOOL 1
+
+/* Stage bits reported by citygen_incremental_last_stages(). */
+#define CITYGEN_STAGE_ZONING 1u
+#define CITYGEN_STAGE_LAYOUT 2u
+#define CITYGEN_STAGE_FACILITIES 4u
+
+/* Flags for citygen_city_save_gltf(). */
+#define CITYGEN_GLTF_BINARY 1u
+#define CITYGEN_GLTF_INSTANCING 2u
+#define CITYGEN_GLTF_LOD 4u           /**< API version 3 */
+#define CITYGEN_GLTF_QUANTIZE 8u      /**< API version 4 */
+#define CITYGEN_GLTF_MESHOPT 16u      /**< API version 4 */
+
+/** Generation parameters; mirrors the C++ Config. */
+typedef struct citygen_config {
+    uint32_t struct_size;      /**< sizeof(citygen_config) */
+    uint32_t seed;
+    int32_t population;
+    int32_t grid_size;
+    double city_radius;        /**< Fraction of the half grid, (0, 1] */
+    int32_t hospitals;
+    int32_t schools;
+    double green_m2_per_capita; /**< Reserved; ignored (the target is 8 m^2) */
+    int32_t transport;         /**< CITYGEN_TRANSPORT_* */
+    int32_t layout;            /**< CITYGEN_LAYOUT_* */
+    int32_t rng_mode;          /**< CITYGEN_RNG_* */
+    int32_t threads;           /**< 0 = all cores */
+    int32_t green_mode;        /**< CITYGEN_GREEN_*; API version 3 */
+} citygen_config;
+
+/** Axis-aligned rectangle; layout-compatible with the C++ Rect. */
+typedef struct citygen_rect {
+    double x0, y0, x1, y1;
+} citygen_rect;
+
+typedef struct citygen_vec2 {
+    double x, y;
+} citygen_vec2;
+
+/** Road segment; layout-compatible with the C++ RoadSegment. */
+typedef struct citygen_road {
+    double x1, y1, x2, y2;
+    int32_t type;              /**< CITYGEN_ROAD_* */
+} citygen_road;
+
+/** Facility; layout-compatible with the C++ Facility. */
+typedef struct citygen_facility {
+    double x, y;
+    uint8_t type;              /**< CITYGEN_FACILITY_* */
+} citygen_facility;
+
+typedef struct citygen_city citygen_city;
+typedef struct citygen_incremental citygen_incremental;
+
+/** CITYGEN_C_API_VERSION of the loaded library. */
+CITYGEN_API int citygen_api_version(void);
+
+/** Message for the last failed call on this thread ("" if none). */
+CITYGEN_API const char *citygen_last_error(void);
+
+/** Fill @p cfg with the generator defaults. */
+CITYGEN_API void citygen_config_init(citygen_config *cfg);
+
+/**
+ * Generate a city.  Out-of-range parameters are clamped as by
+ * Config::normalize().  On success *out receives a handle to release with
+ * citygen_city_free().
+ */
+CITYGEN_API int citygen_generate(const citygen_config *cfg, citygen_city **out);
+
+CITYGEN_API void citygen_city_free(citygen_city *city);
+
+/**
+ * Incremental generation (API version 2).  A generator caches the zoning
+ * and layout stages of its last call and re-runs only the stages whose
+ * inputs changed; see IncrementalCityGenerator.h.  Every returned city is
+ * an independent handle for citygen_city_free(), and handles returned
+ * earlier remain valid.
+ */
+CITYGEN_API citygen_incremental *citygen_incremental_create(void);
+CITYGEN_API void citygen_incremental_free(citygen_incremental *generator);
+CITYGEN_API int citygen_incremental_generate(citygen_incremental *generator,
+                                             const citygen_config *cfg, citygen_city **out);
+/** CITYGEN_STAGE_* bits of the stages run by the last generate call. */
+CITYGEN_API unsigned citygen_incremental_last_stages(const citygen_incremental *generator);
+
+/** Grid dimension; the zoning grid has size * size cells. */
+CITYGEN_API int32_t citygen_city_grid_size(const citygen_city *city);
+
+/** Row-major zoning grid of CITYGEN_ZONE_* values. */
+CITYGEN_API const uint8_t *citygen_city_zones(const citygen_city *city, size_t *count);
+
+/* Buildings, stored column-wise; every column has building_count entries. */
+CITYGEN_API size_t citygen_city_building_count(const citygen_city *city);
+CITYGEN_API const citygen_rect *citygen_city_building_footprints(const citygen_city *city);
+CITYGEN_API const uint8_t *citygen_city_building_zones(const citygen_city *city);
+CITYGEN_API const int32_t *citygen_city_building_heights(const citygen_city *city);
+/** Base corners of building @p index, copied into @p corners. */
+CITYGEN_API int citygen_city_building_corners(const citygen_city *city, size_t index,
+                                              citygen_vec2 corners[4]);
+
+CITYGEN_API const citygen_road *citygen_city_roads(const citygen_city *city, size_t *count);
+CITYGEN_API const citygen_facility *citygen_city_facilities(const citygen_city *city,
+                                                            size_t *count);
+
+/* Exporters; see the City::save* methods. */
+CITYGEN_API int citygen_city_save_obj(const citygen_city *city, const char *path,
+                                      int fixed_precision);
+CITYGEN_API int citygen_city_save_gltf(const citygen_city *city, const char *path,
+                                       unsigned flags);
+CITYGEN_API int citygen_city_save_tiles(const citygen_city *city, const char *directory,
+                                        double tile_size, unsigned flags);
+CITYGEN_API int citygen_city_save_summary(const citygen_city *city, const char *path);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* CITYGEN_C_H */
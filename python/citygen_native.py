@@ -0,0 +1,383 @@
+"""
+citygen_native.py
+=================
+
+In-process Python bindings for the C++ city generator, built with
+:mod:`ctypes` on the C API in ``include/citygen_c.h``.
+
+Unlike :mod:`generate_city`, nothing is spawned and nothing touches the
+disk unless an exporter is called.  The city's arrays are exposed as
+``ctypes`` arrays that point straight into the C++ storage.  They support
+the buffer protocol, so ``memoryview(city.zones)``, ``numpy.asarray`` and
+``numpy.ctypeslib.as_array`` view the data without copying it.  ctypes
+releases the GIL for every foreign call, so ``generate`` runs other
+Python threads concurrently.
+
+The shared library is located through the ``CITYGEN_LIBRARY`` environment
+variable, or else looked up in the usual CMake build directories
+(``build/``, ``_gate_build/``) and the project root.
+
+Example:
+
+.. code-block:: python
+
+    import numpy as np
+    from citygen_native import generate
+
+    city = generate(population=250000, seed=7, layout="radial")
+    zones = np.asarray(city.zones)              # (grid, grid) uint8, no copy
+    heights = np.asarray(city.building_heights)
+    city.save_gltf("city.glb", binary=True)
+"""
+
+import ctypes
+import os
+from pathlib import Path
+from typing import Optional
+
+PROJECT_ROOT = Path(__file__).resolve().parents[1]
+
+_OK = 0
+_TRANSPORTS = {"car": 0, "public": 1, "public_transit": 1, "transit": 1,
+               "walk": 2, "pedestrian": 2}
+_LAYOUTS = {"grid": 0, "radial": 1}
+_RNG_MODES = {"sequential": 0, "per-block": 1, "per_block": 1, "block": 1}
+_GREEN_MODES = {"shuffle": 0, "sample": 1}
+_GLTF_BINARY = 1
+_GLTF_INSTANCING = 2
+_GLTF_LOD = 4
+_GLTF_QUANTIZE = 8
+_GLTF_MESHOPT = 16
+
+
+class _Config(ctypes.Structure):
+    _fields_ = [
+        ("struct_size", ctypes.c_uint32),
+        ("seed", ctypes.c_uint32),
+        ("population", ctypes.c_int32),
+        ("grid_size", ctypes.c_int32),
+        ("city_radius", ctypes.c_double),
+        ("hospitals", ctypes.c_int32),
+        ("schools", ctypes.c_int32),
+        ("green_m2_per_capita", ctypes.c_double),
+        ("transport", ctypes.c_int32),
+        ("layout", ctypes.c_int32),
+        ("rng_mode", ctypes.c_int32),
+        ("threads", ctypes.c_int32),
+        ("green_mode", ctypes.c_int32),
+    ]
+
+
+class Road(ctypes.Structure):
+    """Road segment; mirrors ``citygen_road``."""
+
+    _fields_ = [
+        ("x1", ctypes.c_double),
+        ("y1", ctypes.c_double),
+        ("x2", ctypes.c_double),
+        ("y2", ctypes.c_double),
+        ("type", ctypes.c_int32),
+    ]
+
+
+class Facility(ctypes.Structure):
+    """Facility position and type; mirrors ``citygen_facility``."""
+
+    _fields_ = [
+        ("x", ctypes.c_double),
+        ("y", ctypes.c_double),
+        ("type", ctypes.c_uint8),
+    ]
+
+
+class _Vec2(ctypes.Structure):
+    _fields_ = [("x", ctypes.c_double), ("y", ctypes.c_double)]
+
+
+_Handle = ctypes.c_void_p
+_Size = ctypes.c_size_t
+
+
+def _candidate_paths():
+    env = os.environ.get("CITYGEN_LIBRARY")
+    if env:
+        yield Path(env)
+        return
+    for directory in (PROJECT_ROOT / "build", PROJECT_ROOT / "_gate_build", PROJECT_ROOT):
+        yield directory / "libcitygen.so"
+        yield directory / "libcitygen.dylib"
+        yield directory / "citygen.dll"
+
+
+def _declare(lib: ctypes.CDLL) -> ctypes.CDLL:
+    signatures = {
+        "citygen_api_version": (ctypes.c_int, []),
+        "citygen_last_error": (ctypes.c_char_p, []),
+        "citygen_config_init": (None, [ctypes.POINTER(_Config)]),
+        "citygen_generate": (ctypes.c_int, [ctypes.POINTER(_Config), ctypes.POINTER(_Handle)]),
+        "citygen_city_free": (None, [_Handle]),
+        "citygen_incremental_create": (_Handle, []),
+        "citygen_incremental_free": (None, [_Handle]),
+        "citygen_incremental_generate": (ctypes.c_int, [_Handle, ctypes.POINTER(_Config),
+                                                        ctypes.POINTER(_Handle)]),
+        "citygen_incremental_last_stages": (ctypes.c_uint, [_Handle]),
+        "citygen_city_grid_size": (ctypes.c_int32, [_Handle]),
+        "citygen_city_zones": (ctypes.c_void_p, [_Handle, ctypes.POINTER(_Size)]),
+        "citygen_city_building_count": (_Size, [_Handle]),
+        "citygen_city_building_footprints": (ctypes.c_void_p, [_Handle]),
+        "citygen_city_building_zones": (ctypes.c_void_p, [_Handle]),
+        "citygen_city_building_heights": (ctypes.c_void_p, [_Handle]),
+        "citygen_city_building_corners": (ctypes.c_int, [_Handle, _Size, _Vec2 * 4]),
+        "citygen_city_roads": (ctypes.c_void_p, [_Handle, ctypes.POINTER(_Size)]),
+        "citygen_city_facilities": (ctypes.c_void_p, [_Handle, ctypes.POINTER(_Size)]),
+        "citygen_city_save_obj": (ctypes.c_int, [_Handle, ctypes.c_char_p, ctypes.c_int]),
+        "citygen_city_save_gltf": (ctypes.c_int, [_Handle, ctypes.c_char_p, ctypes.c_uint]),
+        "citygen_city_save_tiles": (ctypes.c_int, [_Handle, ctypes.c_char_p, ctypes.c_double,
+                                                   ctypes.c_uint]),
+        "citygen_city_save_summary": (ctypes.c_int, [_Handle, ctypes.c_char_p]),
+    }
+    for name, (restype, argtypes) in signatures.items():
+        fn = getattr(lib, name)
+        fn.restype = restype
+        fn.argtypes = argtypes
+    return lib
+
+
+_lib: Optional[ctypes.CDLL] = None
+
+
+def load_library(path: Optional[os.PathLike] = None) -> ctypes.CDLL:
+    """Load (once) and return the ``libcitygen`` shared library.
+
+    Raises
+    ------
+    FileNotFoundError
+        If no library is found at ``path`` or in the default locations.
+    """
+    global _lib
+    if _lib is not None and path is None:
+        return _lib
+    candidates = [Path(path)] if path is not None else list(_candidate_paths())
+    for candidate in candidates:
+        if candidate.exists():
+            _lib = _declare(ctypes.CDLL(str(candidate)))
+            return _lib
+    raise FileNotFoundError(
+        "libcitygen shared library not found; build it with CMake or set CITYGEN_LIBRARY "
+        f"(looked in: {', '.join(str(c) for c in candidates)})"
+    )
+
+
+def _check(lib: ctypes.CDLL, status: int, what: str) -> None:
+    if status != _OK:
+        message = lib.citygen_last_error().decode("utf-8", "replace")
+        if status == 1:
+            raise ValueError(f"{what}: {message}")
+        if status == 2:
+            raise MemoryError(f"{what}: {message}")
+        if status == 4:
+            raise OSError(f"{what}: {message}")
+        raise RuntimeError(f"{what}: {message}")
+
+
+def _lookup(table: dict, value: str, what: str) -> int:
+    try:
+        return table[value.lower()]
+    except KeyError:
+        raise ValueError(f"Unknown {what}: {value}") from None
+
+
+class City:
+    """Handle to a city generated in-process.
+
+    Array properties are ctypes arrays aliasing the C++ storage; they keep
+    this object alive, and the storage is freed once neither the city nor
+    any array (or buffer view of one) is referenced.
+    """
+
+    def __init__(self, lib: ctypes.CDLL, handle: int) -> None:
+        self._lib = lib
+        self._handle = handle
+
+    def __del__(self) -> None:
+        handle, self._handle = getattr(self, "_handle", None), None
+        if handle:
+            self._lib.citygen_city_free(handle)
+
+    def _view(self, address: Optional[int], array_type):
+        if not address:
+            return array_type()
+        view = array_type.from_address(address)
+        view._city = self  # keep the owning handle alive as long as the view
+        return view
+
+    @property
+    def grid_size(self) -> int:
+        return self._lib.citygen_city_grid_size(self._handle)
+
+    @property
+    def zones(self):
+        """Zoning grid as a ``grid_size`` × ``grid_size`` uint8 array."""
+        count = _Size()
+        address = self._lib.citygen_city_zones(self._handle, ctypes.byref(count))
+        size = self.grid_size
+        if count.value != size * size:
+            raise RuntimeError("zoning grid does not match the grid size")
+        return self._view(address, (ctypes.c_uint8 * size) * size)
+
+    @property
+    def building_count(self) -> int:
+        return self._lib.citygen_city_building_count(self._handle)
+
+    @property
+    def building_footprints(self):
+        """Footprints as an ``n`` × 4 array of ``x0, y0, x1, y1`` doubles."""
+        address = self._lib.citygen_city_building_footprints(self._handle)
+        return self._view(address, (ctypes.c_double * 4) * self.building_count)
+
+    @property
+    def building_zones(self):
+        address = self._lib.citygen_city_building_zones(self._handle)
+        return self._view(address, ctypes.c_uint8 * self.building_count)
+
+    @property
+    def building_heights(self):
+        address = self._lib.citygen_city_building_heights(self._handle)
+        return self._view(address, ctypes.c_int32 * self.building_count)
+
+    def building_corners(self, index: int) -> list[tuple[float, float]]:
+        """Base corners of one building (copied)."""
+        corners = (_Vec2 * 4)()
+        _check(self._lib, self._lib.citygen_city_building_corners(self._handle, index, corners),
+               "building_corners")
+        return [(c.x, c.y) for c in corners]
+
+    @property
+    def roads(self):
+        """Road segments as an array of :class:`Road`."""
+        count = _Size()
+        address = self._lib.citygen_city_roads(self._handle, ctypes.byref(count))
+        return self._view(address, Road * count.value)
+
+    @property
+    def facilities(self):
+        """Facilities as an array of :class:`Facility`."""
+        count = _Size()
+        address = self._lib.citygen_city_facilities(self._handle, ctypes.byref(count))
+        return self._view(address, Facility * count.value)
+
+    def save_obj(self, path: os.PathLike, precision: int = -1) -> None:
+        _check(self._lib, self._lib.citygen_city_save_obj(
+            self._handle, os.fsencode(path), precision), "save_obj")
+
+    def save_gltf(self, path: os.PathLike, *, binary: bool = False,
+                  instancing: bool = False, lod: bool = False, quantize: bool = False,
+                  meshopt: bool = False) -> None:
+        flags = ((_GLTF_BINARY if binary else 0) | (_GLTF_INSTANCING if instancing else 0)
+                 | (_GLTF_LOD if lod else 0) | (_GLTF_QUANTIZE if quantize else 0)
+                 | (_GLTF_MESHOPT if meshopt else 0))
+        _check(self._lib, self._lib.citygen_city_save_gltf(
+            self._handle, os.fsencode(path), flags), "save_gltf")
+
+    def save_tiles(self, directory: os.PathLike, tile_size: float, *,
+                   instancing: bool = False, quantize: bool = False,
+                   meshopt: bool = False) -> None:
+        flags = ((_GLTF_INSTANCING if instancing else 0) | (_GLTF_QUANTIZE if quantize else 0)
+                 | (_GLTF_MESHOPT if meshopt else 0))
+        _check(self._lib, self._lib.citygen_city_save_tiles(
+            self._handle, os.fsencode(directory), tile_size, flags), "save_tiles")
+
+    def save_summary(self, path: os.PathLike) -> None:
+        _check(self._lib, self._lib.citygen_city_save_summary(
+            self._handle, os.fsencode(path)), "save_summary")
+
+
+_CONFIG_FIELDS = ("population", "hospitals", "schools", "transport", "seed",
+                  "grid_size", "radius_fraction")
+
+
+def _make_config(lib: ctypes.CDLL, config, layout: str, rng: str, green: str, threads: int,
+                 overrides: dict) -> _Config:
+    cfg = _Config()
+    lib.citygen_config_init(ctypes.byref(cfg))
+    params = {}
+    if config is not None:
+        for name in _CONFIG_FIELDS:
+            params[name] = getattr(config, name)
+    unknown = set(overrides) - set(_CONFIG_FIELDS)
+    if unknown:
+        raise TypeError(f"unexpected parameters: {', '.join(sorted(unknown))}")
+    params.update(overrides)
+    for name in ("population", "hospitals", "schools", "seed", "grid_size"):
+        if name in params:
+            setattr(cfg, name, int(params[name]))
+    if "radius_fraction" in params:
+        cfg.city_radius = float(params["radius_fraction"])
+    if "transport" in params:
+        cfg.transport = _lookup(_TRANSPORTS, params["transport"], "transport mode")
+    cfg.layout = _lookup(_LAYOUTS, layout, "layout type")
+    cfg.rng_mode = _lookup(_RNG_MODES, rng, "RNG mode")
+    cfg.green_mode = _lookup(_GREEN_MODES, green, "green mode")
+    cfg.threads = threads
+    return cfg
+
+
+def generate(config=None, *, layout: str = "grid", rng: str = "sequential",
+             green: str = "shuffle", threads: int = 0, library: Optional[os.PathLike] = None, **overrides) -> City:
+    """Generate a city in-process.
+
+    Parameters
+    ----------
+    config : generate_city.CityConfig, optional
+        Base parameters; its ``output`` field is ignored.  Keyword
+        arguments named like its fields (``population``, ``seed``, ...)
+        override individual values.
+    layout, rng, green, threads
+        Street layout, parcel RNG mode, green-space selection and worker
+        threads, as for the ``--layout``, ``--rng``, ``--green`` and
+        ``--threads`` options of ``citygen``.
+    library : path, optional
+        Explicit path of the shared library.
+    """
+    lib = load_library(library)
+    cfg = _make_config(lib, config, layout, rng, green, threads, overrides)
+    handle = _Handle()
+    _check(lib, lib.citygen_generate(ctypes.byref(cfg), ctypes.byref(handle)), "generate")
+    return City(lib, handle.value)
+
+
+class IncrementalGenerator:
+    """Regenerates cities re-running only the stages whose inputs changed.
+
+    Zoning depends on seed, grid size and radius; the layout stage adds
+    population, layout, RNG and green modes; facility placement adds the hospital
+    and school counts.  Tweaking only facility counts thus skips zoning and
+    layout entirely.  :attr:`last_stages` names the stages the previous
+    call ran.  Arguments of :meth:`generate` are those of :func:`generate`.
+    """
+
+    STAGES = ("zoning", "layout", "facilities")
+
+    def __init__(self, library: Optional[os.PathLike] = None) -> None:
+        self._lib = load_library(library)
+        self._handle = self._lib.citygen_incremental_create()
+        if not self._handle:
+            raise MemoryError("citygen_incremental_create failed")
+
+    def __del__(self) -> None:
+        handle, self._handle = getattr(self, "_handle", None), None
+        if handle:
+            self._lib.citygen_incremental_free(handle)
+
+    def generate(self, config=None, *, layout: str = "grid", rng: str = "sequential",
+                 green: str = "shuffle", threads: int = 0, **overrides) -> City:
+        cfg = _make_config(self._lib, config, layout, rng, green, threads, overrides)
+        handle = _Handle()
+        _check(self._lib, self._lib.citygen_incremental_generate(
+            self._handle, ctypes.byref(cfg), ctypes.byref(handle)), "generate")
+        return City(self._lib, handle.value)
+
+    @property
+    def last_stages(self) -> tuple[str, ...]:
+        bits = self._lib.citygen_incremental_last_stages(self._handle)
+        return tuple(name for i, name in enumerate(self.STAGES) if bits & (1 << i))
@@ -21,7 +21,8 @@ After running, the directory ``out_dir`` will contain ``city.obj`` and
 ``city_summary.json`` representing the generated city.
 
 Alternatively, this module can be imported and the ``generate`` function
-called from Python code.
+called from Python code.  To generate in-process without the executable or
+any file round trip, see :mod:`citygen_native`.
 """
 
 import argparse
@@ -63,6 +64,10 @@ class CitySummary:
     max_residential_height: int
     max_commercial_height: int
     max_industrial_height: int
+    mean_distance_to_school: float = -1.0
+    p90_distance_to_school: float = -1.0
+    mean_distance_to_hospital: float = -1.0
+    p90_distance_to_hospital: float = -1.0
 
     @classmethod
     def from_mapping(cls, data: Mapping[str, object]) -> "CitySummary":
@@ -83,6 +88,10 @@ class CitySummary:
             max_residential_height=int(data["maxResidentialHeight"]),
             max_commercial_height=int(data["maxCommercialHeight"]),
             max_industrial_height=int(data["maxIndustrialHeight"]),
+            mean_distance_to_school=float(data.get("meanDistanceToSchool", -1.0)),
+            p90_distance_to_school=float(data.get("p90DistanceToSchool", -1.0)),
+            mean_distance_to_hospital=float(data.get("meanDistanceToHospital", -1.0)),
+            p90_distance_to_hospital=float(data.get("p90DistanceToHospital", -1.0)),
         )
 
 
@@ -0,0 +1,379 @@
+#include "BatchGenerator.h"
+
+#include "City.h"
+#include "CityGenerator.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+using Fields = BatchGenerator::Fields;
+
+// Parse one flat JSON object ({"key": value, ...}) into key/value strings.
+// Nested objects and arrays are rejected; string escapes are decoded for
+// the ASCII range, which is all a manifest needs.
+Fields parseJsonObject(const std::string &line) {
+    Fields fields;
+    std::size_t i = 0;
+    auto skipSpace = [&]() {
+        while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i]))) ++i;
+    };
+    auto expect = [&](char c) {
+        skipSpace();
+        if (i >= line.size() || line[i] != c) {
+            throw std::invalid_argument(std::string("expected '") + c + "' at column " +
+                                        std::to_string(i + 1));
+        }
+        ++i;
+    };
+    auto parseString = [&]() {
+        expect('"');
+        std::string out;
+        while (i < line.size() && line[i] != '"') {
+            char c = line[i++];
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (i >= line.size()) break;
+            char e = line[i++];
+            switch (e) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'u': {
+                    if (i + 4 > line.size()) throw std::invalid_argument("bad \\u escape");
+                    long code = std::strtol(line.substr(i, 4).c_str(), nullptr, 16);
+                    if (code > 0x7F) throw std::invalid_argument("non-ASCII \\u escape");
+                    out += static_cast<char>(code);
+                    i += 4;
+                    break;
+                }
+                default: out += e; break; // \" \\ \/
+            }
+        }
+        if (i >= line.size()) throw std::invalid_argument("unterminated string");
+        ++i;
+        return out;
+    };
+    expect('{');
+    skipSpace();
+    if (i < line.size() && line[i] == '}') return fields;
+    for (;;) {
+        std::string key = parseString();
+        expect(':');
+        skipSpace();
+        std::string value;
+        if (i < line.size() && line[i] == '"') {
+            value = parseString();
+        } else {
+            std::size_t start = i;
+            while (i < line.size() && line[i] != ',' && line[i] != '}' &&
+                   !std::isspace(static_cast<unsigned char>(line[i]))) {
+                ++i;
+            }
+            value = line.substr(start, i - start);
+            if (value.empty() || value[0] == '{' || value[0] == '[') {
+                throw std::invalid_argument("unsupported value for \"" + key + "\"");
+            }
+            if (value == "null") value.clear();
+        }
+        fields.emplace_back(std::move(key), std::move(value));
+        skipSpace();
+        if (i < line.size() && line[i] == ',') {
+            ++i;
+            continue;
+        }
+        expect('}');
+        break;
+    }
+    skipSpace();
+    if (i != line.size()) throw std::invalid_argument("trailing characters after object");
+    return fields;
+}
+
+// Split one CSV record.  Fields may be double-quoted, with "" for a quote.
+std::vector<std::string> splitCsv(const std::string &line) {
+    std::vector<std::string> cells;
+    std::string cell;
+    bool quoted = false;
+    for (std::size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (quoted) {
+            if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+                cell += '"';
+                ++i;
+            } else if (c == '"') {
+                quoted = false;
+            } else {
+                cell += c;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            cells.push_back(cell);
+            cell.clear();
+        } else {
+            cell += c;
+        }
+    }
+    if (quoted) throw std::invalid_argument("unterminated quoted field");
+    cells.push_back(cell);
+    for (auto &s : cells) {
+        std::size_t b = s.find_first_not_of(" \t\r");
+        std::size_t e = s.find_last_not_of(" \t\r");
+        s = (b == std::string::npos) ? std::string() : s.substr(b, e - b + 1);
+    }
+    return cells;
+}
+
+long parseInteger(const std::string &key, const std::string &value) {
+    char *end = nullptr;
+    long v = std::strtol(value.c_str(), &end, 10);
+    if (end == value.c_str() || *end != '\0') {
+        throw std::invalid_argument("Invalid integer for " + key + ": " + value);
+    }
+    return v;
+}
+
+double parseReal(const std::string &key, const std::string &value) {
+    char *end = nullptr;
+    double v = std::strtod(value.c_str(), &end);
+    if (end == value.c_str() || *end != '\0') {
+        throw std::invalid_argument("Invalid number for " + key + ": " + value);
+    }
+    return v;
+}
+
+bool parseBool(const std::string &key, const std::string &value) {
+    if (value == "true" || value == "1") return true;
+    if (value == "false" || value == "0") return false;
+    throw std::invalid_argument("Invalid boolean for " + key + ": " + value);
+}
+
+// Apply one manifest field to a job.  Empty values keep the default.
+void applyField(BatchJob &job, std::string key, const std::string &value) {
+    std::replace(key.begin(), key.end(), '-', '_');
+    if (value.empty()) return;
+    Config &cfg = job.config;
+    if (key == "id") {
+        if (value.find('/') != std::string::npos || value.find('\\') != std::string::npos ||
+            value == "." || value == "..") {
+            throw std::invalid_argument("Invalid id: " + value);
+        }
+        job.id = value;
+    } else if (key == "population") {
+        cfg.population = static_cast<int>(parseInteger(key, value));
+    } else if (key == "hospitals") {
+        cfg.hospitals = static_cast<int>(parseInteger(key, value));
+    } else if (key == "schools") {
+        cfg.schools = static_cast<int>(parseInteger(key, value));
+    } else if (key == "transport") {
+        cfg.transport_mode = transportModeFromString(value);
+    } else if (key == "seed") {
+        cfg.seed = static_cast<std::uint32_t>(parseInteger(key, value));
+    } else if (key == "grid_size") {
+        cfg.grid_size = static_cast<int>(parseInteger(key, value));
+    } else if (key == "radius_fraction") {
+        cfg.city_radius = parseReal(key, value);
+    } else if (key == "layout") {
+        cfg.layout = layoutTypeFromString(value);
+    } else if (key == "rng") {
+        cfg.rng_mode = rngModeFromString(value);
+    } else if (key == "green") {
+        cfg.green_mode = greenModeFromString(value);
+    } else if (key == "format") {
+        setExportFormats(cfg, value);
+    } else if (key == "obj_precision") {
+        cfg.obj_precision = objPrecisionFromInt(parseInteger(key, value));
+    } else if (key == "instancing") {
+        cfg.gltf_instancing = parseBool(key, value);
+    } else if (key == "lod") {
+        cfg.gltf_lod = parseBool(key, value);
+    } else if (key == "quantize") {
+        cfg.gltf_quantize = parseBool(key, value);
+    } else if (key == "meshopt") {
+        cfg.gltf_meshopt = parseBool(key, value);
+    } else {
+        throw std::invalid_argument("Unknown manifest field: " + key);
+    }
+}
+
+std::string escapeJson(const std::string &s) {
+    std::string out;
+    out.reserve(s.size());
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out += ' ';
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+// City::writeSummary pretty-prints; JSON Lines needs each record on one
+// line.  The summary holds no string values, so folding every newline and
+// its indentation into one space is safe.
+std::string singleLine(const std::string &json) {
+    std::string out;
+    out.reserve(json.size());
+    for (std::size_t i = 0; i < json.size(); ++i) {
+        if (json[i] != '\n') {
+            out += json[i];
+            continue;
+        }
+        while (i + 1 < json.size() && json[i + 1] == ' ') ++i;
+        if (!out.empty() && out.back() != '{' && i + 1 < json.size() && json[i + 1] != '}') {
+            out += ' ';
+        }
+    }
+    return out;
+}
+
+void exportMesh(const City &city, const Config &cfg, const std::string &dir) {
+    std::filesystem::create_directories(dir);
+    GltfExportOptions options;
+    options.instancing = cfg.gltf_instancing;
+    options.lod = cfg.gltf_lod;
+    options.quantize = cfg.gltf_quantize;
+    options.meshopt = cfg.gltf_meshopt;
+    options.threads = cfg.threads;
+    std::vector<ModelOutput> models;
+    for (Config::ExportFormat format : exportFormats(cfg)) {
+        models.push_back({format, dir + "/city" + exportFormatExtension(format)});
+    }
+    if (!city.saveModels(models, options, cfg.obj_precision, std::string())) {
+        throw std::runtime_error("could not write " + dir);
+    }
+}
+
+} // namespace
+
+std::vector<BatchJob> BatchGenerator::loadManifest(const std::string &path, const Config &defaults) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("cannot open batch manifest " + path);
+    std::string ext = std::filesystem::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    const bool csv = (ext == ".csv");
+    std::vector<BatchJob> jobs;
+    std::vector<std::string> header;
+    std::string line;
+    std::size_t lineNo = 0;
+    while (std::getline(in, line)) {
+        ++lineNo;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        std::size_t first = line.find_first_not_of(" \t");
+        if (first == std::string::npos || line[first] == '#') continue;
+        try {
+            Fields fields;
+            if (csv) {
+                std::vector<std::string> cells = splitCsv(line);
+                if (header.empty()) {
+                    header = cells;
+                    continue;
+                }
+                if (cells.size() != header.size()) {
+                    throw std::invalid_argument("expected " + std::to_string(header.size()) +
+                                                " fields, found " + std::to_string(cells.size()));
+                }
+                for (std::size_t c = 0; c < cells.size(); ++c) fields.emplace_back(header[c], cells[c]);
+            } else {
+                fields = parseJsonObject(line);
+            }
+            BatchJob job;
+            job.config = defaults;
+            for (const auto &f : fields) applyField(job, f.first, f.second);
+            if (job.id.empty()) job.id = std::to_string(jobs.size());
+            jobs.push_back(std::move(job));
+        } catch (const std::invalid_argument &e) {
+            throw std::invalid_argument(path + ":" + std::to_string(lineNo) + ": " + e.what());
+        }
+    }
+    return jobs;
+}
+
+BatchGenerator::Fields BatchGenerator::parseFields(const std::string &json) {
+    return parseJsonObject(json);
+}
+
+Config BatchGenerator::configFromFields(const Fields &fields, const Config &defaults) {
+    BatchJob job;
+    job.config = defaults;
+    for (const auto &f : fields) applyField(job, f.first, f.second);
+    return job.config;
+}
+
+BatchStats BatchGenerator::run(const std::vector<BatchJob> &jobs, const BatchOptions &options,
+                               std::ostream &summaries) {
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+    const std::size_t workers = resolveThreadCount(options.threads);
+    // Jobs may run at most this far ahead of the oldest unwritten line, which
+    // bounds both the reorder buffer and the number of live cities.
+    const std::size_t window = 4 * workers;
+    BatchStats stats;
+    std::mutex mutex;
+    std::condition_variable advanced;
+    std::map<std::size_t, std::string> ready; // finished lines awaiting their turn
+    std::size_t nextToWrite = 0;
+
+    parallelForChunks(jobs.size(), 1, static_cast<int>(workers),
+                      [&](std::size_t index, std::size_t, std::size_t) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            advanced.wait(lock, [&]() { return index < nextToWrite + window; });
+        }
+        const BatchJob &job = jobs[index];
+        std::ostringstream line;
+        line << "{\"index\":" << index << ",\"id\":\"" << escapeJson(job.id) << "\",";
+        bool ok = true;
+        try {
+            const auto t0 = Clock::now();
+            Config cfg = job.config;
+            cfg.threads = 1; // parallelism comes from running jobs side by side
+            City city = CityGenerator::generate(cfg);
+            if (options.exportMeshes) exportMesh(city, cfg, options.outputDir + "/" + job.id);
+            std::ostringstream summary;
+            city.writeSummary(summary, nullptr, nullptr, cfg.threads);
+            double ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+            line << "\"ms\":" << ms << ",\"summary\":" << singleLine(summary.str()) << "}";
+        } catch (const std::exception &e) {
+            ok = false;
+            line << "\"error\":\"" << escapeJson(e.what()) << "\"}";
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        (ok ? stats.cities : stats.failures)++;
+        ready.emplace(index, line.str());
+        // Stream every line whose predecessors are all written.
+        bool wrote = false;
+        for (auto it = ready.begin(); it != ready.end() && it->first == nextToWrite;
+             it = ready.erase(it)) {
+            summaries << it->second << '\n';
+            ++nextToWrite;
+            wrote = true;
+        }
+        if (wrote) {
+            summaries.flush();
+            advanced.notify_all();
+        }
+    });
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return stats;
+}
@@ -0,0 +1,112 @@
+#include "City.h"
+
+namespace {
+
+std::array<Vec2, 4> rectCorners(const Rect &r) {
+    return {{
+        {r.x0, r.y0},
+        {r.x1, r.y0},
+        {r.x1, r.y1},
+        {r.x0, r.y1}
+    }};
+}
+
+bool sameCorners(const std::array<Vec2, 4> &a, const std::array<Vec2, 4> &b) {
+    for (std::size_t i = 0; i < 4; ++i) {
+        if (a[i].x != b[i].x || a[i].y != b[i].y) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+void BuildingStore::reserve(std::size_t n) {
+    footprints_.reserve(n);
+    zones_.reserve(n);
+    heights_.reserve(n);
+    flags_.reserve(n);
+    cornerSlot_.reserve(n);
+}
+
+MemoryUsage BuildingStore::memoryUsage() const {
+    return MemoryUsage().add(footprints_).add(zones_).add(heights_).add(flags_).add(cornerSlot_).add(corners_);
+}
+
+void BuildingStore::clear() {
+    footprints_.clear();
+    zones_.clear();
+    heights_.clear();
+    flags_.clear();
+    cornerSlot_.clear();
+    corners_.clear();
+}
+
+std::uint8_t BuildingStore::packFlags(const Building &b) {
+    std::uint8_t flags = 0;
+    if (b.facility) flags |= kFacilityBit;
+    if (b.facilityType == Facility::Type::School) flags |= kSchoolBit;
+    if (b.hasCorners) flags |= kCornersBit;
+    return flags;
+}
+
+std::uint32_t BuildingStore::storeCorners(const Building &b) {
+    if (!b.hasCorners || sameCorners(b.corners, rectCorners(b.footprint))) return kNoCorners;
+    corners_.push_back(b.corners);
+    return static_cast<std::uint32_t>(corners_.size() - 1);
+}
+
+void BuildingStore::push_back(const Building &b) {
+    footprints_.push_back(b.footprint);
+    zones_.push_back(b.zone);
+    heights_.push_back(b.height);
+    flags_.push_back(packFlags(b));
+    cornerSlot_.push_back(storeCorners(b));
+}
+
+void BuildingStore::append(const std::vector<Building> &batch) {
+    reserve(size() + batch.size());
+    for (const auto &b : batch) push_back(b);
+}
+
+std::array<Vec2, 4> BuildingStore::corners(std::size_t i) const {
+    std::uint32_t slot = cornerSlot_[i];
+    return slot == kNoCorners ? rectCorners(footprints_[i]) : corners_[slot];
+}
+
+Building BuildingStore::operator[](std::size_t i) const {
+    Building b;
+    b.footprint = footprints_[i];
+    b.zone = zones_[i];
+    b.height = heights_[i];
+    b.facility = isFacility(i);
+    b.facilityType = facilityType(i);
+    b.hasCorners = hasCorners(i);
+    if (b.hasCorners) b.corners = corners(i);
+    return b;
+}
+
+void BuildingStore::set(std::size_t i, const Building &b) {
+    footprints_[i] = b.footprint;
+    zones_[i] = b.zone;
+    heights_[i] = b.height;
+    flags_[i] = packFlags(b);
+    // Reuse the existing corner slot when possible; a slot dropped here
+    // stays allocated until clear().
+    bool explicitCorners = b.hasCorners && !sameCorners(b.corners, rectCorners(b.footprint));
+    if (!explicitCorners) {
+        cornerSlot_[i] = kNoCorners;
+    } else if (cornerSlot_[i] != kNoCorners) {
+        corners_[cornerSlot_[i]] = b.corners;
+    } else {
+        cornerSlot_[i] = storeCorners(b);
+    }
+}
+
+void BuildingStore::setFacility(std::size_t i, Facility::Type type) {
+    flags_[i] = static_cast<std::uint8_t>(flags_[i] | kFacilityBit);
+    if (type == Facility::Type::School) {
+        flags_[i] = static_cast<std::uint8_t>(flags_[i] | kSchoolBit);
+    } else {
+        flags_[i] = static_cast<std::uint8_t>(flags_[i] & ~kSchoolBit);
+    }
+}
@@ -1,73 +1,63 @@
 #include "City.h"
+#include "CityExport.h"
+#include "CityMesh.h"
+#include "GltfWriter.h"
+#include "OutputBuffer.h"
+#include "Parallel.h"
+#include "Trace.h"
 
+#include <cstring>
+#include <filesystem>
+#include <initializer_list>
 #include <fstream>
 #include <array>
 #include <cmath>
 #include <algorithm>
 #include <string>
-#include <sstream>
 #include <vector>
-#include <unordered_map>
 #include <limits>
+#include <sstream>
 #include <cstdint>
+#include <optional>
+#include <functional>
+#include <iterator>
+#include <utility>
 
 namespace {
 
-using Quad = std::array<std::pair<double, double>, 4>;
-
-Quad rectToQuad(const Rect &r) {
-    return {{
-        {r.x0, r.y0},
-        {r.x1, r.y0},
-        {r.x1, r.y1},
-        {r.x0, r.y1}
-    }};
-}
-
-Quad toQuad(const std::array<Vec2, 4> &v) {
-    return {{
-        {v[0].x, v[0].y},
-        {v[1].x, v[1].y},
-        {v[2].x, v[2].y},
-        {v[3].x, v[3].y}
-    }};
-}
-
-Quad buildingQuad(const Building &b) {
-    if (b.hasCorners) {
-        return toQuad(b.corners);
-    }
-    return rectToQuad(b.footprint);
-}
-
 // Write a prism defined by four base corners to an OBJ stream.
 // The corners should be specified in winding order around the base face.
-void writeQuadPrism(std::ofstream &ofs,
-                    const Quad &base,
-                    double baseZ,
-                    double topZ,
-                    std::size_t &vertexOffset) {
-    ofs << "v " << base[0].first << " " << base[0].second << " " << baseZ << "\n";
-    ofs << "v " << base[1].first << " " << base[1].second << " " << baseZ << "\n";
-    ofs << "v " << base[2].first << " " << base[2].second << " " << baseZ << "\n";
-    ofs << "v " << base[3].first << " " << base[3].second << " " << baseZ << "\n";
-    ofs << "v " << base[0].first << " " << base[0].second << " " << topZ << "\n";
-    ofs << "v " << base[1].first << " " << base[1].second << " " << topZ << "\n";
-    ofs << "v " << base[2].first << " " << base[2].second << " " << topZ << "\n";
-    ofs << "v " << base[3].first << " " << base[3].second << " " << topZ << "\n";
+void writeObjPrism(OutputBuffer &out,
+                   const Quad &base,
+                   double baseZ,
+                   double topZ,
+                   std::size_t &vertexOffset) {
+    for (double z : {baseZ, topZ}) {
+        for (const auto &corner : base) {
+            out.put("v ");
+            out.putDouble(corner.first);
+            out.put(' ');
+            out.putDouble(corner.second);
+            out.put(' ');
+            out.putDouble(z);
+            out.put('\n');
+        }
+    }
+    static const int kFaces[12][3] = {
+        {0, 1, 2}, {0, 2, 3}, {4, 7, 6}, {4, 6, 5},
+        {0, 4, 5}, {0, 5, 1}, {1, 5, 6}, {1, 6, 2},
+        {2, 6, 7}, {2, 7, 3}, {3, 7, 4}, {3, 4, 0}
+    };
     auto v = vertexOffset;
-    ofs << "f " << v << " " << v + 1 << " " << v + 2 << "\n";
-    ofs << "f " << v << " " << v + 2 << " " << v + 3 << "\n";
-    ofs << "f " << v + 4 << " " << v + 7 << " " << v + 6 << "\n";
-    ofs << "f " << v + 4 << " " << v + 6 << " " << v + 5 << "\n";
-    ofs << "f " << v << " " << v + 4 << " " << v + 5 << "\n";
-    ofs << "f " << v << " " << v + 5 << " " << v + 1 << "\n";
-    ofs << "f " << v + 1 << " " << v + 5 << " " << v + 6 << "\n";
-    ofs << "f " << v + 1 << " " << v + 6 << " " << v + 2 << "\n";
-    ofs << "f " << v + 2 << " " << v + 6 << " " << v + 7 << "\n";
-    ofs << "f " << v + 2 << " " << v + 7 << " " << v + 3 << "\n";
-    ofs << "f " << v + 3 << " " << v + 7 << " " << v + 4 << "\n";
-    ofs << "f " << v + 3 << " " << v + 4 << " " << v << "\n";
+    for (const auto &f : kFaces) {
+        out.put("f ");
+        out.putUInt(v + f[0]);
+        out.put(' ');
+        out.putUInt(v + f[1]);
+        out.put(' ');
+        out.putUInt(v + f[2]);
+        out.put('\n');
+    }
     vertexOffset += 8;
 }
 
@@ -87,37 +77,6 @@ std::string replaceExtension(const std::string &path, const std::string &ext) {
     return path.substr(0, dot) + ext;
 }
 
-struct MaterialDef {
-    const char *name;
-    double r;
-    double g;
-    double b;
-    double ks;
-    double shininess;
-    double metallic;
-    double roughness;
-};
-
-static const MaterialDef kMaterialPalette[] = {
-    {"mat_default", 0.7, 0.7, 0.7, 0.05, 32.0, 0.0, 0.6},
-    {"mat_commercial", 0.6, 0.65, 0.72, 0.5, 96.0, 0.05, 0.35}, // glassy grey
-    {"mat_residential", 0.83, 0.72, 0.62, 0.08, 48.0, 0.0, 0.55}, // warm tones
-    {"mat_industrial", 0.32, 0.34, 0.36, 0.04, 24.0, 0.02, 0.75}, // muted dark
-    {"mat_green", 0.3, 0.62, 0.34, 0.02, 12.0, 0.0, 0.7}, // vegetation
-    {"mat_road", 0.15, 0.15, 0.15, 0.02, 12.0, 0.0, 0.8} // asphalt
-};
-
-// Material palette per zone/element.
-const char *materialForZone(ZoneType zone) {
-    switch (zone) {
-        case ZoneType::Commercial: return "mat_commercial";
-        case ZoneType::Residential: return "mat_residential";
-        case ZoneType::Industrial: return "mat_industrial";
-        case ZoneType::Green: return "mat_green";
-        default: return "mat_default";
-    }
-}
-
 // Emit a single material block to an MTL stream.
 void writeMaterial(std::ofstream &mtl, const std::string &name,
                    double r, double g, double b,
@@ -138,645 +97,1077 @@ bool writeMaterialsFile(const std::string &mtlPath) {
     for (const auto &m : kMaterialPalette) {
         writeMaterial(mtl, m.name, m.r, m.g, m.b, m.ks, m.shininess);
     }
-    return true;
+    mtl.close();
+    return static_cast<bool>(mtl);
+}
+
+GltfEncoding gltfEncoding(const GltfExportOptions &options) {
+    GltfEncoding encoding;
+    encoding.quantize = options.quantize;
+    encoding.meshopt = options.meshopt;
+    return encoding;
 }
 
-constexpr double kRoadThickness = 0.05;
+// Geometry of (part of) a city, collected per palette slot before it is
+// laid out in a GltfDocument.  With instancing, axis-aligned prisms are
+// recorded as TRS instances of a unit box, grouped per slot and archetype
+// (roads form an extra group); everything else is baked into triangles.
+class GltfScene {
+public:
+    explicit GltfScene(bool instancing) : instancing_(instancing) {}
+
+    void addBuilding(const Building &b) {
+        if (b.zone == ZoneType::None) return;
+        std::size_t slot = materialSlotForZone(b.zone);
+        InstanceList &list = instances_[slot][static_cast<std::size_t>(archetypeFor(b))];
+        forEachBuildingPrism(b, [&](const Quad &q, double baseZ, double topZ) {
+            addPrism(slot, list, q, baseZ, topZ);
+        });
+    }
+
+    /**
+     * @brief Add a decomposed city: its prisms, then its roads as
+     * roadRect() footprints.
+     *
+     * Equivalent to addBuilding() for every building followed by addRoad()
+     * for every road.  Each slot is counted, sized exactly and then filled
+     * in parallel over disjoint prism ranges.
+     */
+    void addGeometry(const CityGeometry &geometry, int threads) {
+        for (std::size_t slot = 0; slot < kMaterialCount; ++slot) {
+            addPrisms(slot, geometry.prisms(slot), threads);
+        }
+        for (const Quad &q : geometry.roads()) addRoad(roadRectFromQuad(q));
+    }
+
+    /// Add a road footprint, as produced by roadRect().
+    void addRoad(const Rect &r) {
+        addRoadQuad(rectToQuad(r));
+    }
+
+    /// Add an oriented road carriageway, as produced by roadQuad().
+    void addRoadQuad(const Quad &q) {
+        addPrism(kRoadMaterialSlot, instances_[kRoadMaterialSlot][kRoadGroup], q, 0.0, kRoadThickness);
+    }
+
+    /// Add a single solid extruded from the ground, e.g. a merged block.
+    void addMass(const Quad &q, ZoneType zone, double topZ) {
+        std::size_t slot = materialSlotForZone(zone);
+        Archetype group = zone == ZoneType::Green ? Archetype::Park : Archetype::Standard;
+        addPrism(slot, instances_[slot][static_cast<std::size_t>(group)], q, 0.0, topZ);
+    }
+
+    bool empty() const { return extent_.empty; }
+
+    /// Heap bytes of the baked buffers and instance lists.
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage;
+        for (std::size_t slot = 0; slot < kMaterialCount; ++slot) {
+            usage.add(baked_[slot].memoryUsage());
+            for (const InstanceList &list : instances_[slot]) usage.add(list.translations).add(list.scales);
+        }
+        return usage;
+    }
+
+    /// Ground-plane bounds (internal X/Y) and height range of the geometry.
+    const Rect &bounds() const { return extent_.bounds; }
+    double minZ() const { return extent_.minZ; }
+    double maxZ() const { return extent_.maxZ; }
+
+    using MaterialIndex = std::array<int, kMaterialCount>;
+
+    /// Add the materials used by any of @p scenes.  Materials are added in
+    /// palette order so indices are stable.
+    static MaterialIndex addMaterials(GltfDocument &doc, std::initializer_list<const GltfScene *> scenes) {
+        MaterialIndex materialIndex;
+        materialIndex.fill(-1);
+        for (std::size_t slot = 0; slot < kMaterialCount; ++slot) {
+            bool used = false;
+            for (const GltfScene *scene : scenes) used = used || scene->usesSlot(slot);
+            if (used) materialIndex[slot] = static_cast<int>(doc.addMaterial(kMaterialPalette[slot]));
+        }
+        return materialIndex;
+    }
+
+    /// Lay the geometry out as top-level scene nodes.
+    void build(GltfDocument &doc) const {
+        for (std::size_t node : addNodes(doc, addMaterials(doc, {this}), std::string())) {
+            doc.addSceneNode(node);
+        }
+    }
+
+    /// Add meshes and nodes for the geometry and return the nodes, which are
+    /// not yet part of the scene.  @p suffix is appended to mesh names.
+    std::vector<std::size_t> addNodes(GltfDocument &doc, const MaterialIndex &materialIndex,
+                                      const std::string &suffix) const {
+        std::vector<std::size_t> nodes;
+        for (std::size_t slot = 0; slot < kMaterialCount; ++slot) {
+            GltfNode node;
+            int mesh = doc.addMeshBuffer(baked_[slot], kMaterialPalette[slot].name + suffix,
+                                         materialIndex[slot], &node);
+            if (mesh < 0) continue;
+            node.mesh = mesh;
+            nodes.push_back(doc.addNode(std::move(node)));
+        }
+        if (!instancing_) return nodes;
+        // The document borrows mesh data until it is written, so the shared
+        // box lives for the whole program.
+        static const MeshBuffer unitBox = [] {
+            MeshBuffer box;
+            appendRectPrism(box, Rect{-0.5, -0.5, 0.5, 0.5}, 0.0, 1.0);
+            return box;
+        }();
+        bool anyInstances = false;
+        for (std::size_t slot = 0; slot < kMaterialCount; ++slot) {
+            int boxMesh = -1;
+            for (std::size_t group = 0; group <= kArchetypeCount; ++group) {
+                const InstanceList &list = instances_[slot][group];
+                if (list.translations.empty()) continue;
+                const char *kind = group == kRoadGroup ? "road" : archetypeName(static_cast<Archetype>(group));
+                if (boxMesh < 0) {
+                    boxMesh = doc.addMeshBuffer(unitBox, std::string(kMaterialPalette[slot].name) + "_box" + suffix,
+                                                materialIndex[slot]);
+                }
+                GltfNode node;
+                node.name = std::string(kMaterialPalette[slot].name) + "/" + kind + suffix;
+                node.mesh = boxMesh;
+                node.instancing.push_back({"TRANSLATION", doc.addVec3Accessor(list.translations, 0, false)});
+                node.instancing.push_back({"SCALE", doc.addVec3Accessor(list.scales, 0, false)});
+                nodes.push_back(doc.addNode(std::move(node)));
+                anyInstances = true;
+            }
+        }
+        // Without the extension every node would collapse into a single unit box.
+        if (anyInstances) doc.useExtension("EXT_mesh_gpu_instancing", true);
+        return nodes;
+    }
+
+private:
+    static constexpr std::size_t kRoadGroup = kArchetypeCount;
+    // Prisms per addPrisms() chunk.
+    static constexpr std::size_t kPrismGrain = 4096;
+    struct InstanceList {
+        std::vector<float> translations;
+        std::vector<float> scales;
+    };
+
+    bool usesSlot(std::size_t slot) const {
+        bool used = !baked_[slot].indices.empty();
+        for (const auto &list : instances_[slot]) used = used || !list.translations.empty();
+        return used;
+    }
+
+    // Ground and height extent of some geometry.
+    struct Extent {
+        bool empty = true;
+        Rect bounds{};
+        double minZ = 0.0;
+        double maxZ = 0.0;
+
+        void add(const Rect &r, double baseZ, double topZ) {
+            if (empty) {
+                bounds = r;
+                minZ = baseZ;
+                maxZ = topZ;
+                empty = false;
+                return;
+            }
+            bounds.x0 = std::min(bounds.x0, r.x0);
+            bounds.y0 = std::min(bounds.y0, r.y0);
+            bounds.x1 = std::max(bounds.x1, r.x1);
+            bounds.y1 = std::max(bounds.y1, r.y1);
+            minZ = std::min(minZ, baseZ);
+            maxZ = std::max(maxZ, topZ);
+        }
+
+        void add(const Extent &o) {
+            if (o.empty) return;
+            add(o.bounds, o.minZ, o.maxZ);
+        }
+    };
+
+    bool instanced(const Quad &q) const { return instancing_ && isAxisAlignedQuad(q); }
 
-struct Vec3 {
-    double x;
-    double y;
-    double z;
+    static void writeInstance(InstanceList &list, std::size_t at, const Rect &r, double baseZ,
+                              double topZ) {
+        Vec3 t = toGltfCoords(r.centreX(), r.centreY(), baseZ);
+        Vec3 s = toGltfCoords(r.width(), r.height(), topZ - baseZ);
+        float *tp = list.translations.data() + at * 3;
+        float *sp = list.scales.data() + at * 3;
+        for (double v : {t.x, t.y, t.z}) *tp++ = static_cast<float>(v);
+        for (double v : {s.x, s.y, s.z}) *sp++ = static_cast<float>(v);
+    }
+
+    void addPrism(std::size_t slot, InstanceList &list, const Quad &q, double baseZ, double topZ) {
+        Rect r = boundsFromQuad(q);
+        extent_.add(r, baseZ, topZ);
+        if (instanced(q)) {
+            std::size_t at = list.translations.size() / 3;
+            list.translations.resize((at + 1) * 3);
+            list.scales.resize((at + 1) * 3);
+            writeInstance(list, at, r, baseZ, topZ);
+        } else {
+            appendQuadPrism(baked_[slot], q, baseZ, topZ);
+        }
+    }
+
+    // Per-chunk output positions of addPrisms(): baked prisms, then one
+    // instance count per archetype group.
+    using ChunkCounts = std::array<std::size_t, kArchetypeCount + 1>;
+
+    void addPrisms(std::size_t slot, const std::vector<Prism> &prisms, int threads) {
+        if (prisms.empty()) return;
+        constexpr std::size_t kBaked = kArchetypeCount;
+        const std::size_t chunks = (prisms.size() + kPrismGrain - 1) / kPrismGrain;
+        std::vector<ChunkCounts> offsets(chunks + 1, ChunkCounts{});
+        parallelForChunks(prisms.size(), kPrismGrain, threads,
+                          [&](std::size_t c, std::size_t begin, std::size_t end) {
+            ChunkCounts &n = offsets[c + 1];
+            for (std::size_t i = begin; i < end; ++i) {
+                const Prism &p = prisms[i];
+                n[instanced(p.base) ? static_cast<std::size_t>(p.archetype) : kBaked]++;
+            }
+        });
+        // Start after whatever the scene already holds.
+        std::array<InstanceList, kArchetypeCount + 1> &groups = instances_[slot];
+        offsets[0][kBaked] = baked_[slot].indices.size() / kPrismIndices;
+        for (std::size_t g = 0; g < kArchetypeCount; ++g) {
+            offsets[0][g] = groups[g].translations.size() / 3;
+        }
+        for (std::size_t c = 0; c < chunks; ++c) {
+            for (std::size_t k = 0; k <= kArchetypeCount; ++k) offsets[c + 1][k] += offsets[c][k];
+        }
+        resizeForPrisms(baked_[slot], offsets[chunks][kBaked]);
+        for (std::size_t g = 0; g < kArchetypeCount; ++g) {
+            groups[g].translations.resize(offsets[chunks][g] * 3);
+            groups[g].scales.resize(offsets[chunks][g] * 3);
+        }
+        std::vector<Extent> extents(chunks);
+        parallelForChunks(prisms.size(), kPrismGrain, threads,
+                          [&](std::size_t c, std::size_t begin, std::size_t end) {
+            ChunkCounts next = offsets[c];
+            for (std::size_t i = begin; i < end; ++i) {
+                const Prism &p = prisms[i];
+                Rect r = boundsFromQuad(p.base);
+                extents[c].add(r, p.baseZ, p.topZ);
+                if (instanced(p.base)) {
+                    auto g = static_cast<std::size_t>(p.archetype);
+                    writeInstance(groups[g], next[g]++, r, p.baseZ, p.topZ);
+                } else {
+                    writeQuadPrism(baked_[slot], next[kBaked]++, p.base, p.baseZ, p.topZ);
+                }
+            }
+        });
+        for (const Extent &e : extents) extent_.add(e);
+    }
+
+    bool instancing_;
+    Extent extent_;
+    std::array<MeshBuffer, kMaterialCount> baked_;
+    std::array<std::array<InstanceList, kArchetypeCount + 1>, kMaterialCount> instances_;
 };
 
-// Map internal coordinates (X horizontal, Y horizontal, Z up) into glTF's
-// Y‑up convention (X/Z ground plane, +Y up).
-Vec3 toGltfCoords(double x, double y, double z) {
-    return {x, z, y};
+// Largest distance a simplified coarse-LOD road may stray from the
+// original polyline, in grid units.
+constexpr double kLodRoadTolerance = 2.0;
+
+// Screen fraction below which viewers switch to the coarse level.
+constexpr double kLodScreenCoverage = 0.25;
+
+double quadArea(const Quad &q) {
+    double twice = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        const auto &a = q[i];
+        const auto &b = q[(i + 1) % 4];
+        twice += a.first * b.second - b.first * a.second;
+    }
+    return 0.5 * std::abs(twice);
+}
+
+// Point-in-convex-quad test for either winding.
+bool quadContains(const Quad &q, double x, double y) {
+    bool anyPos = false;
+    bool anyNeg = false;
+    for (int i = 0; i < 4; ++i) {
+        const auto &a = q[i];
+        const auto &b = q[(i + 1) % 4];
+        double cross = (b.first - a.first) * (y - a.second) - (b.second - a.second) * (x - a.first);
+        anyPos = anyPos || cross > 0.0;
+        anyNeg = anyNeg || cross < 0.0;
+    }
+    return !(anyPos && anyNeg);
 }
 
-struct MeshBuffer {
-    std::vector<float> positions;
-    std::vector<float> normals;
-    std::vector<std::uint32_t> indices;
-    bool hasBounds = false;
-    std::array<double, 3> minPos{};
-    std::array<double, 3> maxPos{};
-};
+Quad blockQuad(const Block &b) {
+    return b.hasCorners ? toQuad(b.corners) : rectToQuad(b.bounds);
+}
 
-void updateBounds(MeshBuffer &buf, const Vec3 &p) {
-    if (!buf.hasBounds) {
-        buf.minPos = {p.x, p.y, p.z};
-        buf.maxPos = buf.minPos;
-        buf.hasBounds = true;
-        return;
-    }
-    buf.minPos[0] = std::min(buf.minPos[0], p.x);
-    buf.minPos[1] = std::min(buf.minPos[1], p.y);
-    buf.minPos[2] = std::min(buf.minPos[2], p.z);
-    buf.maxPos[0] = std::max(buf.maxPos[0], p.x);
-    buf.maxPos[1] = std::max(buf.maxPos[1], p.y);
-    buf.maxPos[2] = std::max(buf.maxPos[2], p.z);
-}
-
-void appendTriangle(MeshBuffer &buf, const Vec3 &p0, const Vec3 &p1,
-                    const Vec3 &p2, const Vec3 &n) {
-    std::uint32_t base = static_cast<std::uint32_t>(buf.positions.size() / 3);
-    auto pushPos = [&](const Vec3 &p) {
-        buf.positions.push_back(static_cast<float>(p.x));
-        buf.positions.push_back(static_cast<float>(p.y));
-        buf.positions.push_back(static_cast<float>(p.z));
-        updateBounds(buf, p);
+// Coarse LOD buildings: every block becomes one extrusion of its outline.
+// Its height is the area-weighted mean height of the block's buildings and
+// its material that of the zone covering most of its built area; blocks
+// that are mostly park become a single low pad.  Buildings are matched to
+// the block containing their centroid.  The generator emits them block by
+// block, so the previous match is tried first.  Buildings outside every
+// block keep a plain prism of their own.
+void addCoarseBuildings(const City &city, GltfScene &scene) {
+    struct Mass {
+        std::array<double, kZoneTypeCount> zoneArea{};
+        double heightArea = 0.0;
     };
-    auto pushNormal = [&](const Vec3 &nn) {
-        buf.normals.push_back(static_cast<float>(nn.x));
-        buf.normals.push_back(static_cast<float>(nn.y));
-        buf.normals.push_back(static_cast<float>(nn.z));
+    std::vector<Quad> quads;
+    quads.reserve(city.blocks.size());
+    for (const auto &block : city.blocks) quads.push_back(blockQuad(block));
+    std::vector<Mass> masses(quads.size());
+    std::size_t current = 0;
+    for (const auto &b : city.buildings) {
+        if (b.zone == ZoneType::None) continue;
+        Quad q = buildingQuad(b);
+        double x = 0.0, y = 0.0;
+        for (const auto &p : q) { x += 0.25 * p.first; y += 0.25 * p.second; }
+        if (current >= quads.size() || !quadContains(quads[current], x, y)) {
+            current = 0;
+            while (current < quads.size() && !quadContains(quads[current], x, y)) ++current;
+        }
+        if (current == quads.size()) {
+            double top = b.zone == ZoneType::Green ? 0.08 : std::max(1.0, static_cast<double>(b.height));
+            scene.addMass(q, b.zone, top);
+            continue;
+        }
+        double area = quadArea(q);
+        Mass &m = masses[current];
+        m.zoneArea[static_cast<std::size_t>(b.zone)] += area;
+        if (b.zone != ZoneType::Green) m.heightArea += area * std::max(1, b.height);
+    }
+    for (std::size_t i = 0; i < masses.size(); ++i) {
+        const Mass &m = masses[i];
+        ZoneType dominant = ZoneType::None;
+        double builtArea = 0.0;
+        for (ZoneType z : {ZoneType::Residential, ZoneType::Commercial, ZoneType::Industrial}) {
+            double area = m.zoneArea[static_cast<std::size_t>(z)];
+            builtArea += area;
+            if (area > 0.0 && (dominant == ZoneType::None ||
+                               area > m.zoneArea[static_cast<std::size_t>(dominant)])) {
+                dominant = z;
+            }
+        }
+        double greenArea = m.zoneArea[static_cast<std::size_t>(ZoneType::Green)];
+        if (builtArea <= 0.0 && greenArea <= 0.0) continue;
+        if (greenArea >= builtArea) {
+            scene.addMass(quads[i], ZoneType::Green, 0.08);
+        } else {
+            scene.addMass(quads[i], dominant, m.heightArea / builtArea);
+        }
+    }
+}
+
+double distanceToSegment(const Vec2 &p, const Vec2 &a, const Vec2 &b) {
+    double dx = b.x - a.x;
+    double dy = b.y - a.y;
+    double len2 = dx * dx + dy * dy;
+    double t = len2 > 0.0 ? std::clamp(((p.x - a.x) * dx + (p.y - a.y) * dy) / len2, 0.0, 1.0) : 0.0;
+    double ex = a.x + t * dx - p.x;
+    double ey = a.y + t * dy - p.y;
+    return std::sqrt(ex * ex + ey * ey);
+}
+
+// Douglas-Peucker: mark the vertices of points[first..last] to keep.
+void simplifyPolyline(const std::vector<Vec2> &points, std::size_t first, std::size_t last,
+                      double tolerance, std::vector<bool> &keep) {
+    if (last <= first + 1) return;
+    double worst = -1.0;
+    std::size_t split = first;
+    for (std::size_t i = first + 1; i < last; ++i) {
+        double d = distanceToSegment(points[i], points[first], points[last]);
+        if (d > worst) {
+            worst = d;
+            split = i;
+        }
+    }
+    if (worst <= tolerance) return;
+    keep[split] = true;
+    simplifyPolyline(points, first, split, tolerance, keep);
+    simplifyPolyline(points, split, last, tolerance, keep);
+}
+
+// Coarse LOD roads: runs of consecutive segments of one road type that
+// join end to start (the polylines approximating ring roads) are
+// simplified to within kLodRoadTolerance, then drawn as oriented prisms.
+void addCoarseRoads(const std::vector<RoadSegment> &roads, GltfScene &scene) {
+    std::vector<Vec2> points;
+    std::vector<bool> keep;
+    auto emit = [&](RoadType type) {
+        keep.assign(points.size(), false);
+        keep.front() = keep.back() = true;
+        simplifyPolyline(points, 0, points.size() - 1, kLodRoadTolerance, keep);
+        std::size_t from = 0;
+        for (std::size_t i = 1; i < points.size(); ++i) {
+            if (!keep[i]) continue;
+            RoadSegment seg{points[from].x, points[from].y, points[i].x, points[i].y, type};
+            Quad q;
+            if (roadQuad(seg, q)) scene.addRoadQuad(q);
+            from = i;
+        }
+    };
+    for (std::size_t i = 0; i < roads.size(); ++i) {
+        const RoadSegment &r = roads[i];
+        bool continues = i > 0 && !points.empty() && roads[i - 1].type == r.type &&
+                         points.back().x == r.x1 && points.back().y == r.y1;
+        if (!continues) {
+            if (!points.empty()) emit(roads[i - 1].type);
+            points.clear();
+            points.push_back({r.x1, r.y1});
+        }
+        points.push_back({r.x2, r.y2});
+    }
+    if (!points.empty()) emit(roads.back().type);
+}
+
+// 3D Tiles box volume (centre followed by three half-axes).  Tile content
+// is glTF, whose Y-up frame 3D Tiles rotates into its Z-up frame; internal
+// (x, y, z) therefore maps to tileset (x, -y, z).
+void writeTileBox(std::ostream &out, const Rect &r, double minZ, double maxZ) {
+    double hz = 0.5 * (maxZ - minZ);
+    out << "\"boundingVolume\":{\"box\":["
+        << r.centreX() << "," << -r.centreY() << "," << minZ + hz << ","
+        << 0.5 * r.width() << ",0,0,"
+        << "0," << 0.5 * r.height() << ",0,"
+        << "0,0," << hz << "]}";
+}
+
+// Nearest-rank percentiles found by successive nth_element calls, each
+// restricted to the range above the previous rank, so the whole set costs
+// linear time on average.  Reorders @p d.
+DistanceStats summarizeDistances(std::vector<double> &d) {
+    DistanceStats stats;
+    if (d.empty()) return stats;
+    double sum = 0.0;
+    for (double v : d) {
+        sum += v;
+        stats.max = std::max(stats.max, v);
+    }
+    stats.mean = sum / static_cast<double>(d.size());
+    auto lower = d.begin();
+    auto rank = [&](double p) {
+        std::size_t k = static_cast<std::size_t>(std::ceil(p * static_cast<double>(d.size())));
+        auto nth = d.begin() + static_cast<std::ptrdiff_t>(std::max<std::size_t>(k, 1) - 1);
+        std::nth_element(lower, nth, d.end());
+        lower = nth;
+        return *nth;
     };
-    pushPos(p0); pushPos(p1); pushPos(p2);
-    pushNormal(n); pushNormal(n); pushNormal(n);
-    buf.indices.push_back(base);
-    buf.indices.push_back(base + 1);
-    buf.indices.push_back(base + 2);
-}
-
-void appendQuadPrism(MeshBuffer &buf, const Quad &q,
-                     double baseZ, double topZ) {
-    Vec3 p0 = toGltfCoords(q[0].first, q[0].second, baseZ);
-    Vec3 p1 = toGltfCoords(q[1].first, q[1].second, baseZ);
-    Vec3 p2 = toGltfCoords(q[2].first, q[2].second, baseZ);
-    Vec3 p3 = toGltfCoords(q[3].first, q[3].second, baseZ);
-    Vec3 p4 = toGltfCoords(q[0].first, q[0].second, topZ);
-    Vec3 p5 = toGltfCoords(q[1].first, q[1].second, topZ);
-    Vec3 p6 = toGltfCoords(q[2].first, q[2].second, topZ);
-    Vec3 p7 = toGltfCoords(q[3].first, q[3].second, topZ);
-    const Vec3 nDown{0.0, -1.0, 0.0};
-    const Vec3 nUp{0.0, 1.0, 0.0};
-    const Vec3 nPosX{1.0, 0.0, 0.0};
-    const Vec3 nNegX{-1.0, 0.0, 0.0};
-    const Vec3 nPosZ{0.0, 0.0, 1.0};
-    const Vec3 nNegZ{0.0, 0.0, -1.0};
-    // bottom
-    appendTriangle(buf, p0, p2, p1, nDown);
-    appendTriangle(buf, p0, p3, p2, nDown);
-    // top
-    appendTriangle(buf, p4, p5, p6, nUp);
-    appendTriangle(buf, p4, p6, p7, nUp);
-    // +X
-    appendTriangle(buf, p1, p2, p6, nPosX);
-    appendTriangle(buf, p1, p6, p5, nPosX);
-    // -X
-    appendTriangle(buf, p3, p0, p4, nNegX);
-    appendTriangle(buf, p3, p4, p7, nNegX);
-    // +Z (internal +Y)
-    appendTriangle(buf, p2, p3, p7, nPosZ);
-    appendTriangle(buf, p2, p7, p6, nPosZ);
-    // -Z (internal -Y)
-    appendTriangle(buf, p0, p1, p5, nNegZ);
-    appendTriangle(buf, p0, p5, p4, nNegZ);
-}
-
-void appendRectPrism(MeshBuffer &buf, const Rect &r,
-                     double baseZ, double topZ) {
-    appendQuadPrism(buf, rectToQuad(r), baseZ, topZ);
+    stats.p50 = rank(0.50);
+    stats.p90 = rank(0.90);
+    stats.p95 = rank(0.95);
+    return stats;
 }
 
+// Residential parcels per network-query chunk.
+constexpr std::size_t kAccessGrain = 4096;
+
+void writeTravelStats(std::ostream &ofs, const char *facility, const DistanceStats &stats) {
+    ofs << "  \"maxTravelMinutesTo" << facility << "\": " << stats.max << ",\n";
+    ofs << "  \"meanTravelMinutesTo" << facility << "\": " << stats.mean << ",\n";
+    ofs << "  \"p50TravelMinutesTo" << facility << "\": " << stats.p50 << ",\n";
+    ofs << "  \"p90TravelMinutesTo" << facility << "\": " << stats.p90 << ",\n";
+    ofs << "  \"p95TravelMinutesTo" << facility << "\": " << stats.p95 << ",\n";
+}
+
+// Feed every building of @p city to @p summary.
+void addSummaryBuildings(const City &city, SummaryBuilder &summary) {
+    // Only the zone, height and footprint columns are scanned.
+    const std::vector<ZoneType> &buildingZones = city.buildings.zones();
+    const std::vector<int> &heights = city.buildings.heights();
+    const std::vector<Rect> &footprints = city.buildings.footprints();
+    for (std::size_t i = 0; i < city.buildings.size(); ++i) {
+        summary.addBuilding(buildingZones[i], heights[i], footprints[i]);
+    }
+}
+
+bool writeOBJ(const CityGeometry &geometry, const std::string &filename, int fixedPrecision,
+              MemoryReport *memory = nullptr) {
+    ObjStreamWriter writer(filename, fixedPrecision);
+    if (!writer.isOpen()) return false;
+    if (memory) {
+        std::size_t buffer = writer.bufferCapacity();
+        memory->recordExportStage("obj", {{"outputBuffer", {buffer, buffer}}});
+    }
+    // Faces are grouped per material so each material is selected by a
+    // single usemtl run; CityGeometry already groups prisms by slot.
+    for (std::size_t slot = 0; slot < kMaterialCount; ++slot) {
+        if (geometry.prisms(slot).empty()) continue;
+        writer.beginMaterial(slot);
+        writer.writePrisms(geometry.prisms(slot));
+    }
+    writer.writeRoads(geometry.roads());
+    return writer.finish();
+}
+
+// The glTF content of a city: its full-detail scene and, with LOD, the
+// coarse one.  Documents only borrow scene buffers, so a model can be
+// written to several files, concurrently.
+class GltfModel {
+public:
+    GltfModel(const City &city, const CityGeometry &geometry, const GltfExportOptions &options,
+              MemoryReport *memory = nullptr)
+        : scene_(options.instancing), coarse_(options.instancing), lod_(options.lod),
+          encoding_(gltfEncoding(options)) {
+        scene_.addGeometry(geometry, options.threads);
+        if (lod_) {
+            addCoarseBuildings(city, coarse_);
+            addCoarseRoads(city.roads(), coarse_);
+        }
+        if (memory) {
+            memory->recordExportStage("gltfScene", {{"scene", scene_.memoryUsage()},
+                                                    {"coarseScene", coarse_.memoryUsage()}});
+        }
+    }
+
+    /// With @p memory, the document is recorded as export stage "gltf" or
+    /// "glb".  False if a file could not be written in full.
+    bool write(const std::string &filename, bool binary, MemoryReport *memory = nullptr) const {
+        GltfDocument doc(encoding_);
+        build(doc);
+        if (memory) memory->recordExportStage(binary ? "glb" : "gltf", {{"document", doc.memoryUsage()}});
+        if (binary) return doc.writeGLB(filename);
+        std::string binFilename = replaceExtension(filename, ".bin");
+        return doc.writeGLTF(filename, binFilename, filenameOnly(binFilename));
+    }
+
+    void appendGLB(std::string &out) const {
+        GltfDocument doc(encoding_);
+        build(doc);
+        doc.appendGLB(out);
+    }
+
+private:
+    void build(GltfDocument &doc) const {
+        if (lod_) {
+            // The full-detail root node lists the coarse root as its MSFT_lod
+            // alternative; only the full-detail root is placed in the scene.
+            auto materials = GltfScene::addMaterials(doc, {&scene_, &coarse_});
+            GltfNode detailRoot;
+            detailRoot.name = "city";
+            detailRoot.children = scene_.addNodes(doc, materials, std::string());
+            GltfNode coarseRoot;
+            coarseRoot.name = "city_lod1";
+            coarseRoot.children = coarse_.addNodes(doc, materials, "_lod1");
+            detailRoot.lods.push_back(doc.addNode(std::move(coarseRoot)));
+            detailRoot.screenCoverage = {kLodScreenCoverage, 0.0};
+            doc.addSceneNode(doc.addNode(std::move(detailRoot)));
+            doc.useExtension("MSFT_lod");
+        } else {
+            scene_.build(doc);
+        }
+    }
+
+    GltfScene scene_;
+    GltfScene coarse_;
+    bool lod_;
+    GltfEncoding encoding_;
+};
+
 } // namespace
 
 City::City(int s) : size(s) {
-    zones.resize(size * size, ZoneType::None);
+    zones.resize(static_cast<std::size_t>(size) * static_cast<std::size_t>(size), ZoneType::None);
 }
 
-void City::saveOBJ(const std::string &filename) const {
-    // Precompute and emit MTL palette
-    std::string mtlPath = replaceExtension(filename, ".mtl");
-    bool hasMtl = writeMaterialsFile(mtlPath);
-    std::string mtlName = filenameOnly(mtlPath);
+std::vector<MemoryComponent> City::memoryUsage() const {
+    return {{"zones", MemoryUsage().add(zones)},
+            {"buildings", buildings.memoryUsage()},
+            {"facilities", MemoryUsage().add(facilities)},
+            {"roads", MemoryUsage().add(roads_)},
+            {"blocks", MemoryUsage().add(blocks)},
+            {"roadIndex", roadIndex_.memoryUsage()}};
+}
 
-    std::ofstream ofs(filename);
-    if (!ofs) return;
-    if (hasMtl) {
-        ofs << "mtllib " << mtlName << "\n";
-    }
-    // Accumulate vertices and faces.  We write one object per parcel-based
-    // building for clarity, but the file can contain thousands of objects.
-    // A running vertex index is maintained to offset face indices.
-    std::size_t vertexOffset = 1;
-    auto boundsFromQuad = [](const Quad &q) {
-        Rect r;
-        r.x0 = r.x1 = q[0].first;
-        r.y0 = r.y1 = q[0].second;
-        for (int i = 1; i < 4; ++i) {
-            r.x0 = std::min(r.x0, q[i].first);
-            r.x1 = std::max(r.x1, q[i].first);
-            r.y0 = std::min(r.y0, q[i].second);
-            r.y1 = std::max(r.y1, q[i].second);
-        }
-        return r;
-    };
-    auto scaleQuad = [](const Quad &q, double scale) {
-        double cx = 0.0, cy = 0.0;
-        for (const auto &p : q) { cx += p.first; cy += p.second; }
-        cx *= 0.25; cy *= 0.25;
-        Quad out;
-        for (int i = 0; i < 4; ++i) {
-            double dx = q[i].first - cx;
-            double dy = q[i].second - cy;
-            out[i].first = cx + dx * scale;
-            out[i].second = cy + dy * scale;
-        }
-        return out;
-    };
-    auto emitStandard = [&](const Building &b) {
-        double h = std::max(1.0, static_cast<double>(b.height));
-        writeQuadPrism(ofs, buildingQuad(b), 0.0, h, vertexOffset);
-    };
-    auto emitPark = [&](const Building &b) {
-        Quad base = buildingQuad(b);
-        Rect bounds = boundsFromQuad(base);
-        double minDim = std::min(bounds.width(), bounds.height());
-        double marginFrac = 0.08;
-        double scale = std::max(0.2, 1.0 - 2.0 * marginFrac);
-        Quad lawn = scaleQuad(base, scale);
-        double padHeight = 0.08;
-        writeQuadPrism(ofs, lawn, 0.0, padHeight, vertexOffset);
-        double baseScale = 0.3 + (0.2 / std::max(minDim, 1.0));
-        double planterScale = std::clamp(baseScale, 0.25, 0.65);
-        Quad planterA = scaleQuad(lawn, planterScale);
-        Quad planterB = scaleQuad(lawn, 1.0 - planterScale * 0.5);
-        double planterHeight = padHeight * 2.5;
-        writeQuadPrism(ofs, planterA, padHeight, padHeight + planterHeight, vertexOffset);
-        writeQuadPrism(ofs, planterB, padHeight, padHeight + planterHeight, vertexOffset);
-    };
-    auto emitSchool = [&](const Building &b) {
-        Quad base = buildingQuad(b);
-        Quad field = scaleQuad(base, 0.92);
-        double fieldHeight = 0.05;
-        writeQuadPrism(ofs, field, 0.0, fieldHeight, vertexOffset);
-        Quad building = scaleQuad(base, 0.55);
-        double schoolHeight = std::max(2.0, static_cast<double>(b.height));
-        writeQuadPrism(ofs, building, 0.0, schoolHeight, vertexOffset);
-    };
-    auto emitHospital = [&](const Building &b) {
-        Quad base = buildingQuad(b);
-        Quad podium = scaleQuad(base, 0.9);
-        double podiumTop = std::max(1.2, static_cast<double>(b.height) * 0.25);
-        writeQuadPrism(ofs, podium, 0.0, podiumTop, vertexOffset);
-        Quad main = scaleQuad(base, 0.65);
-        double mainTop = std::max(podiumTop + 2.0, static_cast<double>(b.height));
-        writeQuadPrism(ofs, main, podiumTop, mainTop, vertexOffset);
-        Quad wing = scaleQuad(base, 0.45);
-        double wingTop = std::max(podiumTop + 1.2, mainTop * 0.9);
-        writeQuadPrism(ofs, wing, podiumTop, wingTop, vertexOffset);
-    };
-    for (const auto &b : buildings) {
-        if (b.zone == ZoneType::None) continue;
-        if (b.zone == ZoneType::Green) {
-            ofs << "usemtl " << materialForZone(b.zone) << "\n";
-            emitPark(b);
-            continue;
-        }
-        if (b.facility) {
-            ofs << "usemtl " << materialForZone(b.zone) << "\n";
-            if (b.facilityType == Facility::Type::Hospital) {
-                emitHospital(b);
-            } else {
-                emitSchool(b);
+ZoneCounts countZones(const ZoneType *zones, std::size_t count) {
+    constexpr std::uint64_t kOnes = 0x0101010101010101ull;
+    constexpr std::uint64_t kLow7 = 0x7F7F7F7F7F7F7F7Full;
+    constexpr std::uint64_t kEvenBytes = 0x00FF00FF00FF00FFull;
+    // Byte lanes of an accumulator overflow after 255 words.
+    constexpr std::size_t kFlushWords = 255;
+    ZoneCounts counts{};
+    const auto *bytes = reinterpret_cast<const unsigned char *>(zones);
+    std::size_t i = 0;
+    while (i + 8 <= count) {
+        // One counter byte per cell lane and zone; None is whatever the
+        // other four leave over.
+        std::array<std::uint64_t, kZoneTypeCount> lanes{};
+        const std::size_t words = std::min(kFlushWords, (count - i) / 8);
+        for (std::size_t w = 0; w < words; ++w, i += 8) {
+            std::uint64_t word;
+            std::memcpy(&word, bytes + i, sizeof(word));
+            for (std::size_t z = 1; z < kZoneTypeCount; ++z) {
+                // Bytes equal to z become zero; the classic zero-byte test
+                // then sets the high bit of exactly those bytes.
+                std::uint64_t x = word ^ (kOnes * z);
+                std::uint64_t zeroBytes = ~(((x & kLow7) + kLow7) | x | kLow7);
+                lanes[z] += zeroBytes >> 7;
             }
-            continue;
         }
-        ofs << "usemtl " << materialForZone(b.zone) << "\n";
-        emitStandard(b);
+        // Horizontal sum: bytes into 16-bit pairs, then a multiply folds
+        // the four pairs into the top 16 bits.
+        for (std::size_t z = 1; z < kZoneTypeCount; ++z) {
+            std::uint64_t pairs = (lanes[z] & kEvenBytes) + ((lanes[z] >> 8) & kEvenBytes);
+            counts[z] += (pairs * 0x0001000100010001ull) >> 48;
+        }
+    }
+    for (; i < count; ++i) {
+        if (bytes[i] != 0 && bytes[i] < kZoneTypeCount) counts[bytes[i]]++;
     }
+    std::uint64_t zoned = 0;
+    for (std::size_t z = 1; z < kZoneTypeCount; ++z) zoned += counts[z];
+    counts[0] = count - zoned;
+    return counts;
+}
+
+void City::setRoads(std::vector<RoadSegment> roads) {
+    roads_ = std::move(roads);
+    roadIndexCurrent_ = false;
+}
+
+void City::buildRoadIndex() {
+    roadIndex_.build(roads_, size);
+    roadIndexCurrent_ = true;
+}
+
+double City::distanceToRoads(const Rect &r) const {
+    if (roadIndexCurrent_) {
+        return roadIndex_.distanceTo(r);
+    }
+    double best = std::numeric_limits<double>::max();
+    for (const auto &road : roads_) {
+        double halfWidth = 0.5 * roadWidth(road.type);
+        Rect box{std::min(road.x1, road.x2) - halfWidth,
+                 std::min(road.y1, road.y2) - halfWidth,
+                 std::max(road.x1, road.x2) + halfWidth,
+                 std::max(road.y1, road.y2) + halfWidth};
+        best = std::min(best, RoadIndex::rectDistance(r, box));
+    }
+    return best;
+}
+
+ObjStreamWriter::ObjStreamWriter(const std::string &filename, int fixedPrecision)
+    : sink_(filename), out_(sink_) {
+    out_.setFixedPrecision(fixedPrecision);
+    if (!sink_.isOpen()) return;
+    // Precompute and emit MTL palette
+    std::string mtlPath = replaceExtension(filename, ".mtl");
+    if (writeMaterialsFile(mtlPath)) {
+        out_.put("mtllib ");
+        out_.put(filenameOnly(mtlPath));
+        out_.put('\n');
+    }
+}
+
+bool ObjStreamWriter::finish() {
+    out_.flush();
+    return sink_.close() && out_.ok();
+}
+
+void ObjStreamWriter::beginMaterial(std::size_t slot) {
+    out_.put("usemtl ");
+    out_.put(kMaterialPalette[slot].name);
+    out_.put('\n');
+}
+
+void ObjStreamWriter::writeBuilding(const Building &b) {
+    forEachBuildingPrism(b, [&](const Quad &base, double baseZ, double topZ) {
+        writeObjPrism(out_, base, baseZ, topZ, vertexOffset_);
+    });
+}
+
+void ObjStreamWriter::writePrisms(const std::vector<Prism> &prisms) {
+    for (const auto &p : prisms) {
+        writeObjPrism(out_, p.base, p.baseZ, p.topZ, vertexOffset_);
+    }
+}
+
+void ObjStreamWriter::writeRoads(const std::vector<Quad> &carriageways) {
+    if (carriageways.empty()) return;
+    beginMaterial(kRoadMaterialSlot);
+    for (const auto &q : carriageways) {
+        writeObjPrism(out_, q, 0.0, kRoadThickness, vertexOffset_);
+    }
+}
+
+void ObjStreamWriter::writeRoads(const std::vector<RoadSegment> &roads) {
     // Roads: extrude each centreline into a thin rectangular prism so that
     // the street hierarchy is visible in the 3D export.
+    bool roadMaterialSelected = false;
     for (const auto &road : roads) {
-        ofs << "usemtl mat_road\n";
-        double dx = road.x2 - road.x1;
-        double dy = road.y2 - road.y1;
-        double len = std::sqrt(dx * dx + dy * dy);
-        if (len < 1e-6) continue;
-        double invLen = 1.0 / len;
-        double nx = -dy * invLen;
-        double ny = dx * invLen;
-        double halfWidth = 0.5 * roadWidth(road.type);
-        double hx = nx * halfWidth;
-        double hy = ny * halfWidth;
-        std::array<std::pair<double, double>, 4> base = {{
-            {road.x1 + hx, road.y1 + hy},
-            {road.x1 - hx, road.y1 - hy},
-            {road.x2 - hx, road.y2 - hy},
-            {road.x2 + hx, road.y2 + hy}
-        }};
-        writeQuadPrism(ofs, base, 0.0, kRoadThickness, vertexOffset);
+        Quad base;
+        if (!roadQuad(road, base)) continue;
+        if (!roadMaterialSelected) {
+            beginMaterial(kRoadMaterialSlot);
+            roadMaterialSelected = true;
+        }
+        writeObjPrism(out_, base, 0.0, kRoadThickness, vertexOffset_);
     }
-    ofs.close();
 }
 
-void City::saveGLTF(const std::string &filename, bool binary) const {
-    std::unordered_map<std::string, MeshBuffer> meshByMaterial;
-    auto bufferFor = [&](const std::string &mat) -> MeshBuffer & {
-        return meshByMaterial[mat];
-    };
-    auto boundsFromQuad = [](const Quad &q) {
-        Rect r;
-        r.x0 = r.x1 = q[0].first;
-        r.y0 = r.y1 = q[0].second;
-        for (int i = 1; i < 4; ++i) {
-            r.x0 = std::min(r.x0, q[i].first);
-            r.x1 = std::max(r.x1, q[i].first);
-            r.y0 = std::min(r.y0, q[i].second);
-            r.y1 = std::max(r.y1, q[i].second);
-        }
-        return r;
-    };
-    auto scaleQuad = [](const Quad &q, double scale) {
-        double cx = 0.0, cy = 0.0;
-        for (const auto &p : q) { cx += p.first; cy += p.second; }
-        cx *= 0.25; cy *= 0.25;
-        Quad out;
-        for (int i = 0; i < 4; ++i) {
-            double dx = q[i].first - cx;
-            double dy = q[i].second - cy;
-            out[i].first = cx + dx * scale;
-            out[i].second = cy + dy * scale;
-        }
-        return out;
-    };
-    auto emitStandard = [&](const Building &b) {
-        double h = std::max(1.0, static_cast<double>(b.height));
-        appendQuadPrism(bufferFor(materialForZone(b.zone)), buildingQuad(b), 0.0, h);
-    };
-    auto emitPark = [&](const Building &b) {
-        Quad base = buildingQuad(b);
-        Rect bounds = boundsFromQuad(base);
-        double minDim = std::min(bounds.width(), bounds.height());
-        double scale = std::max(0.2, 1.0 - 0.16);
-        Quad lawn = scaleQuad(base, scale);
-        double padHeight = 0.08;
-        appendQuadPrism(bufferFor("mat_green"), lawn, 0.0, padHeight);
-        double baseScale = 0.3 + (0.2 / std::max(minDim, 1.0));
-        double planterScale = std::clamp(baseScale, 0.25, 0.65);
-        Quad planterA = scaleQuad(lawn, planterScale);
-        Quad planterB = scaleQuad(lawn, 1.0 - planterScale * 0.5);
-        double planterHeight = padHeight * 2.5;
-        appendQuadPrism(bufferFor("mat_green"), planterA, padHeight, padHeight + planterHeight);
-        appendQuadPrism(bufferFor("mat_green"), planterB, padHeight, padHeight + planterHeight);
-    };
-    auto emitSchool = [&](const Building &b) {
-        Quad base = buildingQuad(b);
-        Quad field = scaleQuad(base, 0.92);
-        double fieldHeight = 0.05;
-        appendQuadPrism(bufferFor(materialForZone(b.zone)), field, 0.0, fieldHeight);
-        Quad buildingRect = scaleQuad(base, 0.55);
-        double schoolHeight = std::max(2.0, static_cast<double>(b.height));
-        appendQuadPrism(bufferFor(materialForZone(b.zone)), buildingRect, 0.0, schoolHeight);
-    };
-    auto emitHospital = [&](const Building &b) {
-        Quad base = buildingQuad(b);
-        Quad podium = scaleQuad(base, 0.9);
-        double podiumTop = std::max(1.2, static_cast<double>(b.height) * 0.25);
-        appendQuadPrism(bufferFor(materialForZone(b.zone)), podium, 0.0, podiumTop);
-        Quad main = scaleQuad(base, 0.65);
-        double mainTop = std::max(podiumTop + 2.0, static_cast<double>(b.height));
-        appendQuadPrism(bufferFor(materialForZone(b.zone)), main, podiumTop, mainTop);
-        Quad wing = scaleQuad(base, 0.45);
-        double wingTop = std::max(podiumTop + 1.2, mainTop * 0.9);
-        appendQuadPrism(bufferFor(materialForZone(b.zone)), wing, podiumTop, wingTop);
+bool City::saveOBJ(const std::string &filename, int fixedPrecision, int threads) const {
+    return writeOBJ(CityGeometry(*this, threads), filename, fixedPrecision);
+}
+
+bool City::saveGLTF(const std::string &filename, bool binary) const {
+    GltfExportOptions options;
+    options.binary = binary;
+    return saveGLTF(filename, options);
+}
+
+bool City::saveGLTF(const std::string &filename, const GltfExportOptions &options) const {
+    return GltfModel(*this, CityGeometry(*this, options.threads), options).write(filename, options.binary);
+}
+
+void City::writeGLB(std::string &out, const GltfExportOptions &options) const {
+    GltfModel(*this, CityGeometry(*this, options.threads), options).appendGLB(out);
+}
+
+bool City::saveTiles(const std::string &directory, double tileSize,
+                     const GltfExportOptions &options, MemoryReport *memory) const {
+    if (tileSize <= 0.0 || size <= 0) return false;
+    int tilesPerSide = std::max(1, static_cast<int>(std::ceil(size / tileSize)));
+    auto tileCoord = [&](double v) {
+        return std::clamp(static_cast<int>(std::floor(v / tileSize)), 0, tilesPerSide - 1);
     };
-    for (const auto &b : buildings) {
-        if (b.zone == ZoneType::None) continue;
-        if (b.zone == ZoneType::Green) {
-            emitPark(b);
-            continue;
+    // Bucket buildings by the tile holding their footprint centre.  Roads are
+    // clipped to every tile they cross; outer tiles extend to infinity so
+    // nothing outside the grid is lost.
+    std::size_t tileCount = static_cast<std::size_t>(tilesPerSide) * tilesPerSide;
+    std::vector<std::vector<std::size_t>> tileBuildings(tileCount);
+    std::vector<std::vector<std::size_t>> tileRoads(tileCount);
+    for (std::size_t i = 0; i < buildings.size(); ++i) {
+        if (buildings.zone(i) == ZoneType::None) continue;
+        Rect r = boundsFromQuad(toQuad(buildings.corners(i)));
+        int tx = tileCoord(r.centreX());
+        int ty = tileCoord(r.centreY());
+        tileBuildings[static_cast<std::size_t>(ty) * tilesPerSide + tx].push_back(i);
+    }
+    std::vector<Rect> roadRects(roads_.size());
+    for (std::size_t i = 0; i < roads_.size(); ++i) {
+        if (!roadRect(roads_[i], roadRects[i])) continue;
+        const Rect &r = roadRects[i];
+        for (int ty = tileCoord(r.y0); ty <= tileCoord(r.y1); ++ty) {
+            for (int tx = tileCoord(r.x0); tx <= tileCoord(r.x1); ++tx) {
+                tileRoads[static_cast<std::size_t>(ty) * tilesPerSide + tx].push_back(i);
+            }
+        }
+    }
+    if (memory) {
+        memory->recordExportStage("tileIndex", {{"tileBuildings", MemoryUsage().add(tileBuildings)},
+                                                {"tileRoads", MemoryUsage().add(tileRoads)},
+                                                {"roadRects", MemoryUsage().add(roadRects)}});
+    }
+    auto tileEdge = [&](int t, bool upper) {
+        if (upper) {
+            return t == tilesPerSide - 1 ? std::numeric_limits<double>::infinity() : (t + 1) * tileSize;
         }
-        if (b.facility) {
-            if (b.facilityType == Facility::Type::Hospital) {
-                emitHospital(b);
+        return t == 0 ? -std::numeric_limits<double>::infinity() : t * tileSize;
+    };
+
+    std::filesystem::path root(directory);
+    std::filesystem::create_directories(root / "tiles");
+    std::ostringstream children;
+    children.precision(std::numeric_limits<double>::max_digits10);
+    Rect extent{};
+    double minZ = 0.0;
+    double maxZ = 0.0;
+    std::size_t written = 0;
+    bool ok = true;
+    for (int ty = 0; ty < tilesPerSide; ++ty) {
+        for (int tx = 0; tx < tilesPerSide; ++tx) {
+            std::size_t t = static_cast<std::size_t>(ty) * tilesPerSide + tx;
+            // Only one tile's geometry is held in memory at a time.
+            GltfScene scene(options.instancing);
+            for (std::size_t idx : tileBuildings[t]) scene.addBuilding(buildings[idx]);
+            for (std::size_t idx : tileRoads[t]) {
+                Rect piece = roadRects[idx];
+                piece.x0 = std::max(piece.x0, tileEdge(tx, false));
+                piece.x1 = std::min(piece.x1, tileEdge(tx, true));
+                piece.y0 = std::max(piece.y0, tileEdge(ty, false));
+                piece.y1 = std::min(piece.y1, tileEdge(ty, true));
+                if (piece.x1 > piece.x0 && piece.y1 > piece.y0) scene.addRoad(piece);
+            }
+            if (scene.empty()) continue;
+            std::string uri = "tiles/tile_" + std::to_string(tx) + "_" + std::to_string(ty) + ".glb";
+            GltfDocument doc(gltfEncoding(options));
+            scene.build(doc);
+            if (memory) {
+                memory->recordExportStage("tiles", {{"scene", scene.memoryUsage()},
+                                                    {"document", doc.memoryUsage()}});
+            }
+            ok = doc.writeGLB((root / uri).string()) && ok;
+
+            const Rect &r = scene.bounds();
+            if (written == 0) {
+                extent = r;
+                minZ = scene.minZ();
+                maxZ = scene.maxZ();
             } else {
-                emitSchool(b);
+                extent.x0 = std::min(extent.x0, r.x0);
+                extent.y0 = std::min(extent.y0, r.y0);
+                extent.x1 = std::max(extent.x1, r.x1);
+                extent.y1 = std::max(extent.y1, r.y1);
+                minZ = std::min(minZ, scene.minZ());
+                maxZ = std::max(maxZ, scene.maxZ());
             }
-            continue;
+            if (written++) children << ",";
+            children << "{";
+            writeTileBox(children, r, scene.minZ(), scene.maxZ());
+            children << ",\"geometricError\":0,\"content\":{\"uri\":\"" << uri << "\"}}";
         }
-        emitStandard(b);
     }
-    for (const auto &road : roads) {
-        double dx = road.x2 - road.x1;
-        double dy = road.y2 - road.y1;
-        double len = std::sqrt(dx * dx + dy * dy);
-        if (len < 1e-6) continue;
-        double invLen = 1.0 / len;
-        double nx = -dy * invLen;
-        double ny = dx * invLen;
-        double halfWidth = 0.5 * roadWidth(road.type);
-        double hx = nx * halfWidth;
-        double hy = ny * halfWidth;
-        Rect base{road.x1 + hx, road.y1 + hy, road.x2 - hx, road.y2 - hy};
-        // Base rectangle might flip if hx/hy reorder bounds; normalise bounds.
-        if (base.x0 > base.x1) std::swap(base.x0, base.x1);
-        if (base.y0 > base.y1) std::swap(base.y0, base.y1);
-        appendRectPrism(bufferFor("mat_road"), base, 0.0, kRoadThickness);
-    }
-
-    // Collect used materials in palette order so indices are stable.
-    std::vector<const MaterialDef *> materials;
-    std::unordered_map<std::string, int> materialIndex;
-    for (const auto &def : kMaterialPalette) {
-        auto it = meshByMaterial.find(def.name);
-        if (it != meshByMaterial.end() && !it->second.indices.empty()) {
-            int idx = static_cast<int>(materials.size());
-            materials.push_back(&def);
-            materialIndex[def.name] = idx;
-        }
-    }
-
-    struct ViewInfo { std::size_t offset; std::size_t length; int target; };
-    struct AccessorInfo {
-        std::size_t bufferView;
-        std::size_t count;
-        int componentType;
-        std::string type;
-        bool hasMinMax = false;
-        std::array<double, 3> min{};
-        std::array<double, 3> max{};
-    };
-    struct MeshPrimitive {
-        int positionAccessor = -1;
-        int normalAccessor = -1;
-        int indexAccessor = -1;
-        int material = -1;
-        std::string name;
-    };
 
-    std::vector<std::uint8_t> binData;
-    auto align4 = [&](std::vector<std::uint8_t> &v) {
-        while (v.size() % 4 != 0) v.push_back(0);
-    };
-    auto appendBytes = [&](const void *ptr, std::size_t len) -> std::size_t {
-        align4(binData);
-        std::size_t offset = binData.size();
-        const auto *bytes = reinterpret_cast<const std::uint8_t *>(ptr);
-        binData.insert(binData.end(), bytes, bytes + len);
-        return offset;
-    };
-    std::vector<ViewInfo> views;
-    std::vector<AccessorInfo> accessors;
-    std::vector<MeshPrimitive> primitives;
-
-    for (const auto *mat : materials) {
-        auto it = meshByMaterial.find(mat->name);
-        if (it == meshByMaterial.end()) continue;
-        const MeshBuffer &buf = it->second;
-        if (buf.indices.empty() || buf.positions.empty()) continue;
-        // positions
-        std::size_t posOffset = appendBytes(buf.positions.data(), buf.positions.size() * sizeof(float));
-        views.push_back({posOffset, buf.positions.size() * sizeof(float), 34962});
-        std::size_t posAccessor = accessors.size();
-        AccessorInfo posAcc;
-        posAcc.bufferView = views.size() - 1;
-        posAcc.count = buf.positions.size() / 3;
-        posAcc.componentType = 5126;
-        posAcc.type = "VEC3";
-        if (buf.hasBounds) {
-            posAcc.hasMinMax = true;
-            posAcc.min = buf.minPos;
-            posAcc.max = buf.maxPos;
-        }
-        accessors.push_back(posAcc);
-        // normals
-        std::size_t normOffset = appendBytes(buf.normals.data(), buf.normals.size() * sizeof(float));
-        views.push_back({normOffset, buf.normals.size() * sizeof(float), 34962});
-        std::size_t normAccessor = accessors.size();
-        AccessorInfo normAcc;
-        normAcc.bufferView = views.size() - 1;
-        normAcc.count = buf.normals.size() / 3;
-        normAcc.componentType = 5126;
-        normAcc.type = "VEC3";
-        accessors.push_back(normAcc);
-        // indices
-        std::size_t idxOffset = appendBytes(buf.indices.data(), buf.indices.size() * sizeof(std::uint32_t));
-        views.push_back({idxOffset, buf.indices.size() * sizeof(std::uint32_t), 34963});
-        std::size_t idxAccessor = accessors.size();
-        AccessorInfo idxAcc;
-        idxAcc.bufferView = views.size() - 1;
-        idxAcc.count = buf.indices.size();
-        idxAcc.componentType = 5125;
-        idxAcc.type = "SCALAR";
-        accessors.push_back(idxAcc);
-
-        MeshPrimitive prim;
-        prim.positionAccessor = static_cast<int>(posAccessor);
-        prim.normalAccessor = static_cast<int>(normAccessor);
-        prim.indexAccessor = static_cast<int>(idxAccessor);
-        prim.material = materialIndex[mat->name];
-        prim.name = mat->name;
-        primitives.push_back(prim);
-    }
-
-    // Compose glTF JSON
-    std::ostringstream oss;
-    oss << "{";
-    oss << "\"asset\":{\"version\":\"2.0\",\"generator\":\"citygen\"},";
-    // nodes/scene
-    oss << "\"scene\":0,";
-    oss << "\"scenes\":[{\"nodes\":[";
-    for (std::size_t i = 0; i < primitives.size(); ++i) {
-        if (i) oss << ",";
-        oss << i;
-    }
-    oss << "]}],";
-    // nodes
-    oss << "\"nodes\":[";
-    for (std::size_t i = 0; i < primitives.size(); ++i) {
-        if (i) oss << ",";
-        oss << "{\"mesh\":" << i << "}";
-    }
-    oss << "],";
-    // materials
-    oss << "\"materials\":[";
-    for (std::size_t i = 0; i < materials.size(); ++i) {
-        if (i) oss << ",";
-        const auto *m = materials[i];
-        oss << "{\"name\":\"" << m->name << "\",";
-        oss << "\"pbrMetallicRoughness\":{\"baseColorFactor\":["
-            << m->r << "," << m->g << "," << m->b << ",1],";
-        oss << "\"metallicFactor\":" << m->metallic << ",";
-        oss << "\"roughnessFactor\":" << m->roughness << "},";
-        oss << "\"doubleSided\":true}";
-    }
-    oss << "],";
-    // meshes
-    oss << "\"meshes\":[";
-    for (std::size_t i = 0; i < primitives.size(); ++i) {
-        if (i) oss << ",";
-        const auto &p = primitives[i];
-        oss << "{\"name\":\"" << p.name << "\",\"primitives\":[{";
-        oss << "\"attributes\":{\"POSITION\":" << p.positionAccessor
-            << ",\"NORMAL\":" << p.normalAccessor << "},";
-        oss << "\"indices\":" << p.indexAccessor << ",";
-        oss << "\"material\":" << p.material;
-        oss << "}]}";
-    }
-    oss << "],";
-    // accessors
-    oss << "\"accessors\":[";
-    for (std::size_t i = 0; i < accessors.size(); ++i) {
-        if (i) oss << ",";
-        const auto &a = accessors[i];
-        oss << "{\"bufferView\":" << a.bufferView
-            << ",\"componentType\":" << a.componentType
-            << ",\"count\":" << a.count
-            << ",\"type\":\"" << a.type << "\"";
-        if (a.hasMinMax) {
-            oss << ",\"min\":[" << a.min[0] << "," << a.min[1] << "," << a.min[2] << "]";
-            oss << ",\"max\":[" << a.max[0] << "," << a.max[1] << "," << a.max[2] << "]";
-        }
-        oss << "}";
-    }
-    oss << "],";
-    // bufferViews
-    oss << "\"bufferViews\":[";
-    for (std::size_t i = 0; i < views.size(); ++i) {
-        if (i) oss << ",";
-        const auto &v = views[i];
-        oss << "{\"buffer\":0,"
-            << "\"byteOffset\":" << v.offset
-            << ",\"byteLength\":" << v.length
-            << ",\"target\":" << v.target
-            << "}";
-    }
-    oss << "],";
-    // buffers
-    std::string binFilename = replaceExtension(filename, ".bin");
-    oss << "\"buffers\":[{";
-    oss << "\"byteLength\":" << binData.size();
-    if (!binary) {
-        oss << ",\"uri\":\"" << filenameOnly(binFilename) << "\"";
-    }
-    oss << "}]}";
-    std::string json = oss.str();
-
-    if (binary) {
-        // Write GLB (JSON + BIN)
-        std::ofstream ofs(filename, std::ios::binary);
-        if (!ofs) return;
-        // Pad JSON to 4-byte boundary with spaces
-        std::vector<std::uint8_t> jsonBytes(json.begin(), json.end());
-        while (jsonBytes.size() % 4 != 0) jsonBytes.push_back(0x20);
-        align4(binData);
-        std::uint32_t totalLength = 12 // header
-            + 8 + static_cast<std::uint32_t>(jsonBytes.size())
-            + 8 + static_cast<std::uint32_t>(binData.size());
-        ofs.write("glTF", 4);
-        std::uint32_t version = 2;
-        ofs.write(reinterpret_cast<const char *>(&version), sizeof(version));
-        ofs.write(reinterpret_cast<const char *>(&totalLength), sizeof(totalLength));
-        std::uint32_t jsonLength = static_cast<std::uint32_t>(jsonBytes.size());
-        std::uint32_t jsonType = 0x4E4F534Au; // JSON
-        ofs.write(reinterpret_cast<const char *>(&jsonLength), sizeof(jsonLength));
-        ofs.write(reinterpret_cast<const char *>(&jsonType), sizeof(jsonType));
-        ofs.write(reinterpret_cast<const char *>(jsonBytes.data()), jsonBytes.size());
-        std::uint32_t binLength = static_cast<std::uint32_t>(binData.size());
-        std::uint32_t binType = 0x004E4942u; // BIN
-        ofs.write(reinterpret_cast<const char *>(&binLength), sizeof(binLength));
-        ofs.write(reinterpret_cast<const char *>(&binType), sizeof(binType));
-        ofs.write(reinterpret_cast<const char *>(binData.data()), binData.size());
-    } else {
-        align4(binData);
-        std::ofstream binOut(binFilename, std::ios::binary);
-        if (!binOut) return;
-        binOut.write(reinterpret_cast<const char *>(binData.data()),
-                     static_cast<std::streamsize>(binData.size()));
-        binOut.close();
-        std::ofstream gltfOut(filename);
-        if (!gltfOut) return;
-        gltfOut << json;
-    }
-}
-
-void City::saveSummary(const std::string &filename) const {
+    // The root carries no content of its own; its geometric error is the
+    // tile edge so viewers load tiles once they span a few pixels.
+    std::ofstream ofs((root / "tileset.json").string());
+    if (!ofs) return false;
+    ofs.precision(std::numeric_limits<double>::max_digits10);
+    ofs << "{\"asset\":{\"version\":\"1.1\",\"generator\":\"citygen\"},";
+    ofs << "\"geometricError\":" << tileSize * 2.0 << ",";
+    ofs << "\"root\":{";
+    writeTileBox(ofs, extent, minZ, maxZ);
+    ofs << ",\"geometricError\":" << tileSize << ",\"refine\":\"ADD\",";
+    ofs << "\"children\":[" << children.str() << "]}}";
+    ofs.close();
+    return ok && ofs;
+}
+
+bool City::saveSummary(const std::string &filename, const Trace *trace, MemoryReport *memory,
+                       int threads) const {
     std::ofstream ofs(filename);
-    if (!ofs) return;
-    // Count metrics
-    std::size_t countResidential = 0;
-    std::size_t countCommercial = 0;
-    std::size_t countIndustrial = 0;
-    std::size_t countGreen = 0;
-    std::size_t countUndeveloped = 0;
-    std::size_t totalBuildings = 0;
-    int maxResidentialHeight = 0;
-    int maxCommercialHeight = 0;
-    int maxIndustrialHeight = 0;
-    for (const auto z : zones) {
-        if (z == ZoneType::None) { countUndeveloped++; continue; }
-        if (z == ZoneType::Residential) countResidential++;
-        else if (z == ZoneType::Commercial) countCommercial++;
-        else if (z == ZoneType::Industrial) countIndustrial++;
-        else if (z == ZoneType::Green) countGreen++;
-    }
-    std::vector<std::pair<double, double>> schoolPos;
-    std::vector<std::pair<double, double>> hospitalPos;
-    schoolPos.reserve(facilities.size());
-    hospitalPos.reserve(facilities.size());
-    for (const auto &f : facilities) {
-        if (f.type == Facility::Type::School) schoolPos.push_back({f.x, f.y});
-        else if (f.type == Facility::Type::Hospital) hospitalPos.push_back({f.x, f.y});
-    }
-    auto nearest = [](double x, double y, const std::vector<std::pair<double, double>> &pts) {
-        if (pts.empty()) return -1.0;
-        double best = std::numeric_limits<double>::max();
-        for (const auto &p : pts) {
-            double dx = x - p.first;
-            double dy = y - p.second;
-            double d = std::sqrt(dx * dx + dy * dy);
-            if (d < best) best = d;
-        }
-        return best;
+    if (!ofs) return false;
+    writeSummary(ofs, trace, memory, threads);
+    ofs.close();
+    return static_cast<bool>(ofs);
+}
+
+void City::writeSummary(std::ostream &ofs, const Trace *trace, MemoryReport *memory,
+                        int threads) const {
+    SummaryBuilder summary(size, zoneCounts(), facilities, roads_, transportMode, threads,
+                           roadIndex());
+    addSummaryBuildings(*this, summary);
+    if (memory) {
+        summary.finish();
+        memory->recordExportStage("summary", summary.memoryUsage());
+    }
+    summary.write(ofs, trace, memory);
+}
+
+bool City::saveModels(const std::vector<ModelOutput> &models, const GltfExportOptions &gltfOptions,
+                      int objPrecision, const std::string &summaryPath, Trace *trace,
+                      MemoryReport *memory) const {
+    Trace::Scope exportStage(trace, "export");
+    const CityGeometry geometry(*this, gltfOptions.threads);
+    // One writer per task unless the caller limits the threads.
+    auto writerThreads = [&](std::size_t writers) {
+        return gltfOptions.threads > 0 ? gltfOptions.threads : static_cast<int>(writers);
     };
-    double maxDistSchool = -1.0;
-    double maxDistHospital = -1.0;
-    for (const auto &b : buildings) {
-        if (b.zone != ZoneType::None && b.zone != ZoneType::Green) {
-            totalBuildings++;
-        }
-        if (b.zone == ZoneType::Residential) {
-            maxResidentialHeight = std::max(maxResidentialHeight, b.height);
-            if (!schoolPos.empty()) {
-                double d = nearest(b.footprint.centreX(), b.footprint.centreY(), schoolPos);
-                if (d > maxDistSchool) maxDistSchool = d;
-            }
-            if (!hospitalPos.empty()) {
-                double d = nearest(b.footprint.centreX(), b.footprint.centreY(), hospitalPos);
-                if (d > maxDistHospital) maxDistHospital = d;
-            }
-        } else if (b.zone == ZoneType::Commercial) {
-            maxCommercialHeight = std::max(maxCommercialHeight, b.height);
-        } else if (b.zone == ZoneType::Industrial) {
-            maxIndustrialHeight = std::max(maxIndustrialHeight, b.height);
+    if (memory) memory->recordExportStage("geometry", {{"prisms", geometry.memoryUsage()}});
+    std::vector<const ModelOutput *> objModels;
+    std::vector<const ModelOutput *> gltfModels;
+    for (const auto &m : models) {
+        (m.format == Config::ExportFormat::OBJ ? objModels : gltfModels).push_back(&m);
+    }
+    std::optional<SummaryBuilder> summary;
+    std::vector<std::function<bool()>> tasks;
+    std::vector<const char *> taskNames;
+    for (const ModelOutput *m : objModels) {
+        tasks.push_back([&, m] { return writeOBJ(geometry, m->path, objPrecision, memory); });
+        taskNames.push_back("obj");
+    }
+    if (!gltfModels.empty()) {
+        // One scene for every glTF file; the files are then encoded in
+        // parallel from it.
+        tasks.push_back([&] {
+            const GltfModel model(*this, geometry, gltfOptions, memory);
+            std::vector<char> written(gltfModels.size(), 0);
+            parallelForChunks(gltfModels.size(), 1, writerThreads(gltfModels.size()),
+                              [&](std::size_t i, std::size_t, std::size_t) {
+                written[i] = model.write(gltfModels[i]->path,
+                                         gltfModels[i]->format == Config::ExportFormat::GLB, memory);
+            });
+            return std::all_of(written.begin(), written.end(), [](char ok) { return ok != 0; });
+        });
+        taskNames.push_back("gltf");
+    }
+    if (!summaryPath.empty()) {
+        tasks.push_back([&] {
+            summary.emplace(size, zoneCounts(), facilities, roads_, transportMode,
+                            gltfOptions.threads, roadIndex());
+            addSummaryBuildings(*this, *summary);
+            summary->finish();
+            if (memory) memory->recordExportStage("summary", summary->memoryUsage());
+            return true;
+        });
+        taskNames.push_back("summary");
+    }
+    // One thread per task (up to gltfOptions.threads), each with its own
+    // output buffer.  Trace scopes are not thread-safe, so the tasks only
+    // read the clocks and become stages of their own once joined.  Tasks
+    // share cores, so their wall times overlap; cpuUs is the work of the
+    // task's own thread.
+    struct TaskSpan {
+        Trace::Clock::time_point start, end;
+        std::int64_t cpuUs = 0;
+    };
+    std::vector<TaskSpan> spans(tasks.size());
+    std::vector<char> succeeded(tasks.size(), 0);
+    parallelForChunks(tasks.size(), 1, writerThreads(tasks.size()),
+                      [&](std::size_t i, std::size_t, std::size_t) {
+        if (!trace) {
+            succeeded[i] = tasks[i]();
+            return;
         }
+        std::int64_t cpu = Trace::threadCpuUs();
+        spans[i].start = Trace::Clock::now();
+        succeeded[i] = tasks[i]();
+        spans[i].end = Trace::Clock::now();
+        spans[i].cpuUs = Trace::threadCpuUs() - cpu;
+    });
+    if (trace) {
+        for (std::size_t i = 0; i < tasks.size(); ++i) {
+            trace->addStage(taskNames[i], spans[i].start, spans[i].end, static_cast<int>(i) + 1,
+                            {{"cpuUs", spans[i].cpuUs}});
+        }
+    }
+    exportStage.count("models", static_cast<std::int64_t>(models.size()));
+    exportStage.end();
+    bool ok = std::all_of(succeeded.begin(), succeeded.end(), [](char done) { return done != 0; });
+    if (summary) {
+        std::ofstream ofs(summaryPath);
+        if (ofs) summary->write(ofs, trace, memory);
+        ofs.close();
+        ok = ok && ofs;
     }
-    std::size_t countHospitals = 0;
-    std::size_t countSchools = 0;
+    return ok;
+}
+
+SummaryBuilder::SummaryBuilder(int gridSize, const ZoneCounts &cells,
+                               const std::vector<Facility> &facilities,
+                               const std::vector<RoadSegment> &roads, Config::TransportMode mode,
+                               int threads, const RoadIndex *roadIndex)
+    : gridSize_(gridSize), cells_(cells), mode_(mode), threads_(threads) {
+    // Nearest-facility distance of every residential parcel, via k-d trees.
+    schoolIndex_.build(facilities, Facility::Type::School);
+    hospitalIndex_.build(facilities, Facility::Type::Hospital);
+    // Network travel times: one Dijkstra per facility type.
+    graph_.build(roads, gridSize, roadIndex);
+    parallelForChunks(2, 1, threads_, [&](std::size_t i, std::size_t, std::size_t) {
+        FacilityAccess &access = i == 0 ? schoolAccess_ : hospitalAccess_;
+        access.build(graph_, facilities, i == 0 ? Facility::Type::School : Facility::Type::Hospital,
+                     mode_);
+    });
     for (const auto &f : facilities) {
-        if (f.type == Facility::Type::Hospital) countHospitals++;
-        else if (f.type == Facility::Type::School) countSchools++;
+        if (f.type == Facility::Type::Hospital) hospitals_++;
+        else if (f.type == Facility::Type::School) schools_++;
     }
+}
+
+void SummaryBuilder::addBuilding(ZoneType zone, int height, const Rect &footprint) {
+    if (zone != ZoneType::None && zone != ZoneType::Green) {
+        totalBuildings_++;
+    }
+    if (zone == ZoneType::Residential) {
+        maxResidentialHeight_ = std::max(maxResidentialHeight_, height);
+        double cx = footprint.centreX();
+        double cy = footprint.centreY();
+        residentialCentres_.push_back({cx, cy});
+        if (!schoolIndex_.empty()) {
+            schoolDistances_.push_back(schoolIndex_.nearestDistance(cx, cy));
+        }
+        if (!hospitalIndex_.empty()) {
+            hospitalDistances_.push_back(hospitalIndex_.nearestDistance(cx, cy));
+        }
+    } else if (zone == ZoneType::Commercial) {
+        maxCommercialHeight_ = std::max(maxCommercialHeight_, height);
+    } else if (zone == ZoneType::Industrial) {
+        maxIndustrialHeight_ = std::max(maxIndustrialHeight_, height);
+    }
+}
+
+void SummaryBuilder::finish() {
+    if (finished_) return;
+    finished_ = true;
+    school_ = summarizeDistances(schoolDistances_);
+    hospital_ = summarizeDistances(hospitalDistances_);
+    // Network travel times; unreachable parcels are left out.
+    std::vector<double> schoolMinutes;
+    std::vector<double> hospitalMinutes;
+    {
+        std::size_t count = residentialCentres_.size();
+        std::vector<double> school(count, -1.0);
+        std::vector<double> hospital(count, -1.0);
+        parallelForChunks(count, kAccessGrain, threads_, [&](std::size_t, std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                const Vec2 &c = residentialCentres_[i];
+                if (!schoolAccess_.empty()) school[i] = schoolAccess_.travelMinutes(c.x, c.y);
+                if (!hospitalAccess_.empty()) hospital[i] = hospitalAccess_.travelMinutes(c.x, c.y);
+            }
+        });
+        std::copy_if(school.begin(), school.end(), std::back_inserter(schoolMinutes),
+                     [](double m) { return m >= 0.0; });
+        std::copy_if(hospital.begin(), hospital.end(), std::back_inserter(hospitalMinutes),
+                     [](double m) { return m >= 0.0; });
+    }
+    schoolTravel_ = summarizeDistances(schoolMinutes);
+    hospitalTravel_ = summarizeDistances(hospitalMinutes);
+}
+
+std::vector<MemoryComponent> SummaryBuilder::memoryUsage() const {
+    // finish() briefly holds two travel times per residential building
+    // and the reachable subset of each.
+    std::size_t travel = residentialCentres_.size() * 4 * sizeof(double);
+    return {{"distances", MemoryUsage().add(schoolDistances_).add(hospitalDistances_)},
+            {"residentialCentres", MemoryUsage().add(residentialCentres_)},
+            {"travelTimes", {travel, travel}},
+            {"roadGraph", graph_.memoryUsage()},
+            {"facilityIndex", MemoryUsage()
+                                  .add(schoolIndex_.memoryUsage()).add(hospitalIndex_.memoryUsage())
+                                  .add(schoolAccess_.memoryUsage()).add(hospitalAccess_.memoryUsage())}};
+}
+
+void SummaryBuilder::write(std::ostream &ofs, const Trace *trace, const MemoryReport *memory) {
+    finish();
+    const DistanceStats &school = school_;
+    const DistanceStats &hospital = hospital_;
     // Write JSON.  Note: this is simplistic and not pretty‑printed.
     ofs << "{\n";
-    ofs << "  \"gridSize\": " << size << ",\n";
-    ofs << "  \"totalBuildings\": " << totalBuildings << ",\n";
-    ofs << "  \"residentialCells\": " << countResidential << ",\n";
-    ofs << "  \"commercialCells\": " << countCommercial << ",\n";
-    ofs << "  \"industrialCells\": " << countIndustrial << ",\n";
-    ofs << "  \"greenCells\": " << countGreen << ",\n";
-    ofs << "  \"undevelopedCells\": " << countUndeveloped << ",\n";
-    ofs << "  \"numHospitals\": " << countHospitals << ",\n";
-    ofs << "  \"numSchools\": " << countSchools << ",\n";
-    ofs << "  \"maxDistanceToSchool\": " << maxDistSchool << ",\n";
-    ofs << "  \"maxDistanceToHospital\": " << maxDistHospital << ",\n";
-    ofs << "  \"maxResidentialHeight\": " << maxResidentialHeight << ",\n";
-    ofs << "  \"maxCommercialHeight\": " << maxCommercialHeight << ",\n";
-    ofs << "  \"maxIndustrialHeight\": " << maxIndustrialHeight << "\n";
-    ofs << "}";
-    ofs.close();
+    ofs << "  \"gridSize\": " << gridSize_ << ",\n";
+    ofs << "  \"totalBuildings\": " << totalBuildings_ << ",\n";
+    ofs << "  \"residentialCells\": " << cells_[static_cast<std::size_t>(ZoneType::Residential)] << ",\n";
+    ofs << "  \"commercialCells\": " << cells_[static_cast<std::size_t>(ZoneType::Commercial)] << ",\n";
+    ofs << "  \"industrialCells\": " << cells_[static_cast<std::size_t>(ZoneType::Industrial)] << ",\n";
+    ofs << "  \"greenCells\": " << cells_[static_cast<std::size_t>(ZoneType::Green)] << ",\n";
+    ofs << "  \"undevelopedCells\": " << cells_[static_cast<std::size_t>(ZoneType::None)] << ",\n";
+    ofs << "  \"numHospitals\": " << hospitals_ << ",\n";
+    ofs << "  \"numSchools\": " << schools_ << ",\n";
+    ofs << "  \"maxDistanceToSchool\": " << school.max << ",\n";
+    ofs << "  \"maxDistanceToHospital\": " << hospital.max << ",\n";
+    ofs << "  \"meanDistanceToSchool\": " << school.mean << ",\n";
+    ofs << "  \"p50DistanceToSchool\": " << school.p50 << ",\n";
+    ofs << "  \"p90DistanceToSchool\": " << school.p90 << ",\n";
+    ofs << "  \"p95DistanceToSchool\": " << school.p95 << ",\n";
+    ofs << "  \"meanDistanceToHospital\": " << hospital.mean << ",\n";
+    ofs << "  \"p50DistanceToHospital\": " << hospital.p50 << ",\n";
+    ofs << "  \"p90DistanceToHospital\": " << hospital.p90 << ",\n";
+    ofs << "  \"p95DistanceToHospital\": " << hospital.p95 << ",\n";
+    ofs << "  \"transportMode\": \"" << transportModeName(mode_) << "\",\n";
+    ofs << "  \"roadGraphNodes\": " << graph_.nodeCount() << ",\n";
+    ofs << "  \"roadGraphEdges\": " << graph_.edgeCount() << ",\n";
+    writeTravelStats(ofs, "School", schoolTravel_);
+    writeTravelStats(ofs, "Hospital", hospitalTravel_);
+    ofs << "  \"maxResidentialHeight\": " << maxResidentialHeight_ << ",\n";
+    ofs << "  \"maxCommercialHeight\": " << maxCommercialHeight_ << ",\n";
+    ofs << "  \"maxIndustrialHeight\": " << maxIndustrialHeight_;
+    if (trace) {
+        ofs << ",\n  \"timings\": ";
+        trace->writeTimingsJson(ofs, "  ");
+    }
+    if (memory) {
+        ofs << ",\n  \"memory\": ";
+        memory->writeJson(ofs, "  ");
+    }
+    ofs << "\n}";
 }
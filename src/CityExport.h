@@ -0,0 +1,126 @@
+#pragma once
+
+#include "City.h"
+#include "CityMesh.h"
+#include "OutputBuffer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+class Trace;
+
+/**
+ * @file CityExport.h
+ *
+ * Incremental forms of the City OBJ and summary exporters.  City::saveOBJ
+ * and City::writeSummary are written in terms of these, so a city fed to
+ * them piece by piece (see StreamingCityGenerator) produces the same bytes
+ * as the in-memory exporters.
+ */
+
+/**
+ * @brief Writes a city OBJ (and its MTL palette) one building at a time.
+ *
+ * Buildings must arrive grouped by palette slot: call beginMaterial() for
+ * each slot in ascending order, then writeBuilding() for every building
+ * of that slot in building order (or writePrisms() with the slot's
+ * CityGeometry prisms), and finally writeRoads().
+ */
+class ObjStreamWriter {
+public:
+    ObjStreamWriter(const std::string &filename, int fixedPrecision);
+
+    bool isOpen() const { return sink_.isOpen(); }
+
+    /// Select palette slot @p slot for the buildings that follow.
+    void beginMaterial(std::size_t slot);
+    void writeBuilding(const Building &b);
+    void writePrisms(const std::vector<Prism> &prisms);
+    void writeRoads(const std::vector<RoadSegment> &roads);
+    /// writeRoads() for carriageways already expanded by CityGeometry.
+    void writeRoads(const std::vector<Quad> &carriageways);
+
+    /// Flush and close the OBJ file; false if any of it failed to write.
+    bool finish();
+
+    /// Size of the output buffer, the writer's only heap allocation.
+    std::size_t bufferCapacity() const { return out_.capacity(); }
+
+private:
+    FileSink sink_;
+    OutputBuffer out_;
+    std::size_t vertexOffset_ = 1;
+};
+
+/// Accessibility statistics over per-parcel nearest-facility distances or
+/// travel times.  Every field is -1 when there are no samples.
+struct DistanceStats {
+    double max = -1.0;
+    double mean = -1.0;
+    double p50 = -1.0;
+    double p90 = -1.0;
+    double p95 = -1.0;
+};
+
+/**
+ * @brief Accumulates the city summary from zone counts, facilities and a
+ * stream of buildings.
+ *
+ * Memory is four doubles per residential building: its nearest-school
+ * and nearest-hospital distances, needed for exact percentiles, and its
+ * centre, from which write() measures network travel times.
+ */
+class SummaryBuilder {
+public:
+    /// Builds the road graph of @p roads and runs one multi-source
+    /// Dijkstra per facility type (concurrently) for @p mode.  The searches
+    /// and finish() use up to @p threads workers (0 = all cores).  A
+    /// non-null @p roadIndex over @p roads is reused for the graph.
+    SummaryBuilder(int gridSize, const ZoneCounts &cells, const std::vector<Facility> &facilities,
+                   const std::vector<RoadSegment> &roads, Config::TransportMode mode, int threads,
+                   const RoadIndex *roadIndex = nullptr);
+
+    /// Add one building; call in building order.
+    void addBuilding(ZoneType zone, int height, const Rect &footprint);
+
+    /// Compute the accessibility statistics after the last building.  The
+    /// per-building network queries run in parallel.  Reorders the
+    /// collected distances; later calls do nothing.
+    void finish();
+
+    /// Write the summary JSON, calling finish() first if needed.  With
+    /// @p memory the report is appended under a "memory" key.
+    void write(std::ostream &out, const Trace *trace, const MemoryReport *memory = nullptr);
+
+    /// Heap bytes per container: distances, residential centres, the road
+    /// graph and the facility indexes.
+    std::vector<MemoryComponent> memoryUsage() const;
+
+private:
+    int gridSize_;
+    ZoneCounts cells_;
+    std::size_t hospitals_ = 0;
+    std::size_t schools_ = 0;
+    FacilityIndex schoolIndex_;
+    FacilityIndex hospitalIndex_;
+    std::vector<double> schoolDistances_;
+    std::vector<double> hospitalDistances_;
+    std::vector<Vec2> residentialCentres_;
+    Config::TransportMode mode_;
+    int threads_;
+    RoadGraph graph_;
+    FacilityAccess schoolAccess_;
+    FacilityAccess hospitalAccess_;
+    bool finished_ = false;
+    DistanceStats school_;
+    DistanceStats hospital_;
+    DistanceStats schoolTravel_;
+    DistanceStats hospitalTravel_;
+    std::size_t totalBuildings_ = 0;
+    int maxResidentialHeight_ = 0;
+    int maxCommercialHeight_ = 0;
+    int maxIndustrialHeight_ = 0;
+};
@@ -1,67 +1,34 @@
 #include "CityGenerator.h"
+#include "Noise.h"
+#include "Parallel.h"
+#include "GeneratorStages.h"
+#include "Random.h"
+#include "Trace.h"
 
 #include <random>
 #include <cmath>
 #include <algorithm>
 #include <limits>
 #include <array>
+#include <atomic>
+#include <unordered_set>
 
 namespace {
 
-// Hash-based pseudo-random noise for integer coordinates.  Uses bit
-// manipulation to produce repeatable pseudo-random values in [0,1).
-static double noise(int x, int y, std::uint32_t seed) {
-    // Compute a simple 32-bit hash based on coordinates and seed.  The
-    // constants are arbitrary primes chosen to decorrelate bits.  We avoid
-    // std::hash for portability.
-    std::uint32_t h = static_cast<std::uint32_t>(x) * 374761393u;
-    h += static_cast<std::uint32_t>(y) * 668265263u;
-    h ^= seed + 0x9e3779b9u + (h << 6) + (h >> 2);
-    // Final mix
-    h ^= (h >> 17);
-    h *= 0xed5ad4bbU;
-    h ^= (h >> 11);
-    h *= 0xac4c1b51U;
-    h ^= (h >> 15);
-    // Scale to [0,1)
-    return (h & 0xFFFFFFu) / static_cast<double>(0x1000000u);
-}
-
-// Fractal noise combining multiple octaves.  Higher octaves add finer
-// detail.  Frequencies and amplitudes follow a common pattern: each
-// successive octave doubles the frequency and halves the amplitude.
-static double fractalNoise(int x, int y, std::uint32_t seed, int octaves = 4) {
-    double sum = 0.0;
-    double amplitude = 1.0;
-    double frequency = 1.0;
-    double amplitudeSum = 0.0;
-    for (int i = 0; i < octaves; ++i) {
-        // Sample noise at scaled coordinates; cast to int to avoid large
-        // floating point increments (coarse sampling is acceptable here).
-        int sx = static_cast<int>(x * frequency);
-        int sy = static_cast<int>(y * frequency);
-        double n = noise(sx, sy, seed + static_cast<std::uint32_t>(i) * 17u);
-        sum += amplitude * n;
-        amplitudeSum += amplitude;
-        amplitude *= 0.5;
-        frequency *= 2.0;
-    }
-    return sum / amplitudeSum;
-}
-
 // Determine a representative zone for the centre of a rectangle footprint.
-static ZoneType sampleZone(const City &city, const Rect &r) {
-    double cx = std::clamp(r.centreX(), 0.0, static_cast<double>(city.size - 1));
-    double cy = std::clamp(r.centreY(), 0.0, static_cast<double>(city.size - 1));
+static ZoneType sampleZone(const ZoneField &zones, const Rect &r) {
+    double cx = std::clamp(r.centreX(), 0.0, static_cast<double>(zones.size() - 1));
+    double cy = std::clamp(r.centreY(), 0.0, static_cast<double>(zones.size() - 1));
     int ix = static_cast<int>(std::floor(cx));
     int iy = static_cast<int>(std::floor(cy));
-    return city.zoneAt(ix, iy);
+    return zones.at(ix, iy);
 }
 
 // Sample a height for a parcel based on its zone and footprint size.  Larger
 // footprints tend to produce slightly taller buildings in commercial areas.
+template <class Rng>
 static int sampleHeight(ZoneType zone, const Rect &footprint, double distToCentre,
-                        double cityRadius, std::mt19937 &rng) {
+                        double cityRadius, Rng &rng) {
     double area = std::max(footprint.width() * footprint.height(), 1.0);
     double radial = 1.0 - std::clamp(distToCentre / std::max(cityRadius, 1e-6), 0.0, 1.0);
     auto clampHeight = [](double h, int minH, int maxH) {
@@ -97,7 +64,8 @@ static int sampleHeight(ZoneType zone, const Rect &footprint, double distToCentr
 
 // Shrink a parcel footprint and apply small random jitter so buildings do not
 // perfectly fill or align within their parcels.
-static Rect jitterFootprint(const Rect &parcel, std::mt19937 &rng) {
+template <class Rng>
+static Rect jitterFootprint(const Rect &parcel, Rng &rng) {
     double w = parcel.width();
     double h = parcel.height();
     if (w <= 0.0 || h <= 0.0) return parcel;
@@ -132,8 +100,9 @@ static Rect jitterFootprint(const Rect &parcel, std::mt19937 &rng) {
 
 // Recursively subdivide a rectangle into smaller lots using a binary split
 // along the longest dimension until parcels fit within maxSize.
+template <class Rng>
 static void subdivideRect(const Rect &r, double minSize, double maxSize,
-                          std::mt19937 &rng, std::vector<Rect> &out, int depth = 0) {
+                          Rng &rng, std::vector<Rect> &out, int depth = 0) {
     double w = r.width();
     double h = r.height();
     if ((w <= maxSize && h <= maxSize) || depth > 6) {
@@ -164,14 +133,16 @@ static void subdivideRect(const Rect &r, double minSize, double maxSize,
 
 // Carve out a central courtyard from a block and subdivide the remaining
 // strips into parcels.  If the block is too small for a courtyard, the whole
-// area is subdivided.
-static std::vector<Rect> parcelizeBlock(const Block &block, std::mt19937 &rng) {
+// area is subdivided.  Parcels replace the contents of @p parcels so callers
+// can reuse one buffer across blocks.
+template <class Rng>
+static void parcelizeBlock(const Block &block, Rng &rng, std::vector<Rect> &parcels) {
     const Rect &b = block.bounds;
     double w = b.width();
     double h = b.height();
     const double minParcel = 3.0;
     const double maxParcel = 12.0;
-    std::vector<Rect> parcels;
+    parcels.clear();
     // Randomised courtyard fraction; ensures at least ~15% stays open.
     std::uniform_real_distribution<double> fracDist(0.15, 0.30);
     double margin = std::min(w, h) * fracDist(rng);
@@ -192,7 +163,6 @@ static std::vector<Rect> parcelizeBlock(const Block &block, std::mt19937 &rng) {
     } else {
         subdivideRect(b, minParcel, maxParcel, rng, parcels);
     }
-    return parcels;
 }
 
 static std::array<Vec2, 4> rectToQuad(const Rect &r) {
@@ -235,25 +205,60 @@ static Vec2 polarToCartesian(double cx, double cy, double r, double theta) {
     return {x, y};
 }
 
+// Convert the candidate cells whose ranks are listed in @p ranks (all of
+// them when @p ranks is empty) to Green, stopping after @p count cells.
+// One row-major pass maps ranks to cells.
+static std::size_t convertRanksToGreen(std::vector<ZoneType> &zones,
+                                       const std::vector<std::uint64_t> &ranks,
+                                       std::uint64_t count) {
+    const bool all = ranks.empty();
+    std::size_t next = 0;
+    std::uint64_t rank = 0;
+    for (std::size_t idx = 0; idx < zones.size() && next < count; ++idx) {
+        if (!isGreenCandidate(zones[idx])) continue;
+        if (all || ranks[next] == rank) {
+            zones[idx] = ZoneType::Green;
+            ++next;
+        }
+        ++rank;
+    }
+    return next;
+}
+
+// Temporaries of the parcel helpers.  Each thread keeps one instance whose
+// buffers are cleared, not freed, between blocks, so after the first few
+// blocks parcelization no longer touches the allocator.
+struct ParcelScratch {
+    std::vector<Rect> rects;
+    std::vector<std::array<Vec2, 4>> quads;
+};
+
+static ParcelScratch &threadParcelScratch() {
+    thread_local ParcelScratch scratch;
+    return scratch;
+}
+
 // Convert a wedge block into quads by unwrapping to a rectangle in (arc, radius)
-// space, parcelising, and mapping back to polar coordinates.
-static std::vector<std::array<Vec2, 4>> parcelizeWedge(double cx, double cy,
-                                                       double r0, double r1,
-                                                       double theta0, double theta1,
-                                                       std::mt19937 &rng) {
+// space, parcelising, and mapping back to polar coordinates.  The quads
+// replace the contents of scratch.quads; scratch.rects is clobbered.
+template <class Rng>
+static void parcelizeWedge(double cx, double cy, double r0, double r1,
+                           double theta0, double theta1, Rng &rng,
+                           ParcelScratch &scratch) {
+    std::vector<Rect> &uvParcels = scratch.rects;
+    std::vector<std::array<Vec2, 4>> &quads = scratch.quads;
+    uvParcels.clear();
+    quads.clear();
     double radialThickness = r1 - r0;
-    if (radialThickness <= 0.1) return {};
+    if (radialThickness <= 0.1) return;
     double midR = (r0 + r1) * 0.5;
     double thetaSpan = theta1 - theta0;
-    if (thetaSpan <= 1e-4 || midR <= 1e-6) return {};
+    if (thetaSpan <= 1e-4 || midR <= 1e-6) return;
     double arcLength = thetaSpan * midR;
     Rect uvBlock{0.0, 0.0, arcLength, radialThickness};
-    std::vector<Rect> uvParcels;
     const double minParcel = 3.0;
     const double maxParcel = 12.0;
     subdivideRect(uvBlock, minParcel, maxParcel, rng, uvParcels);
-    std::vector<std::array<Vec2, 4>> quads;
-    quads.reserve(uvParcels.size());
     for (const auto &uv : uvParcels) {
         Rect jittered = jitterFootprint(uv, rng);
         double u0 = jittered.x0;
@@ -273,303 +278,434 @@ static std::vector<std::array<Vec2, 4>> parcelizeWedge(double cx, double cy,
         }};
         quads.push_back(quad);
     }
-    return quads;
 }
 
-// Compute the shortest distance from a parcel to the road network.  Roads are
-// treated as thickened line segments (using their hierarchy width) so parcels
-// adjacent to roads yield zero distance.
-static double distanceToRoads(const Rect &parcel, const std::vector<RoadSegment> &roads) {
-    double best = std::numeric_limits<double>::max();
-    for (const auto &road : roads) {
-        double halfWidth = 0.5 * roadWidth(road.type);
-        double minX = std::min(road.x1, road.x2) - halfWidth;
-        double maxX = std::max(road.x1, road.x2) + halfWidth;
-        double minY = std::min(road.y1, road.y2) - halfWidth;
-        double maxY = std::max(road.y1, road.y2) + halfWidth;
-        double dx = 0.0;
-        if (parcel.x1 < minX) dx = minX - parcel.x1;
-        else if (parcel.x0 > maxX) dx = parcel.x0 - maxX;
-        double dy = 0.0;
-        if (parcel.y1 < minY) dy = minY - parcel.y1;
-        else if (parcel.y0 > maxY) dy = parcel.y0 - maxY;
-        double dist = (dx == 0.0 || dy == 0.0) ? std::max(dx, dy) : std::sqrt(dx * dx + dy * dy);
-        if (dist < best) best = dist;
-    }
-    return best;
+
+// Noise thresholds splitting the developed disc into zones.
+static ZoneType zoneForNoise(double value) {
+    if (value < 0.55) return ZoneType::Residential;
+    if (value < 0.75) return ZoneType::Commercial;
+    if (value < 0.90) return ZoneType::Industrial;
+    return ZoneType::Green;
 }
 
+// The developed disc: cells whose centre lies within the city radius.
+struct CityDisc {
+    double centre;
+    double radius;
+
+    explicit CityDisc(const Config &cfg)
+        : centre(static_cast<double>(cfg.grid_size) / 2.0),
+          radius((static_cast<double>(cfg.grid_size) * cfg.city_radius) / 2.0) {}
+
+    bool contains(int x, int y) const {
+        double dx = static_cast<double>(x) + 0.5 - centre;
+        double dy = static_cast<double>(y) + 0.5 - centre;
+        return std::sqrt(dx * dx + dy * dy) <= radius;
+    }
+};
+
 } // anonymous namespace
 
-City CityGenerator::generate(const Config &cfg) {
-    City city(cfg.grid_size);
+void zoneRow(const Config &cfg, int y, ZoneType *row, std::vector<double> &values) {
+    const int size = cfg.grid_size;
+    const CityDisc disc(cfg);
+    // The developed disc intersects each row in one contiguous run; only
+    // that run needs noise samples.
+    int lo = 0;
+    int hi = size - 1;
+    while (lo <= hi && !disc.contains(lo, y)) row[lo++] = ZoneType::None;
+    while (hi >= lo && !disc.contains(hi, y)) row[hi--] = ZoneType::None;
+    if (lo > hi) return;
+    values.resize(static_cast<std::size_t>(size));
+    fractalNoiseRow(lo, y, hi - lo + 1, cfg.seed, values.data());
+    for (int x = lo; x <= hi; ++x) {
+        row[x] = disc.contains(x, y) ? zoneForNoise(values[static_cast<std::size_t>(x - lo)])
+                                     : ZoneType::None;
+    }
+}
+
+ZoneType zoneCell(const Config &cfg, int x, int y) {
+    if (!CityDisc(cfg).contains(x, y)) return ZoneType::None;
+    return zoneForNoise(fractalNoise(x, y, cfg.seed));
+}
+
+ZoneType ZoneField::computeAt(int x, int y) const {
+    ZoneType z = zoneCell(*cfg_, x, y);
+    if (!isGreenCandidate(z)) return z;
+    if (allGreen_) return ZoneType::Green;
+    std::uint64_t idx = static_cast<std::uint64_t>(y) * static_cast<std::uint64_t>(size_) +
+                        static_cast<std::uint64_t>(x);
+    return std::binary_search(greenCells_->begin(), greenCells_->end(), idx) ? ZoneType::Green : z;
+}
+
+void zoneCity(const Config &cfg, City &city, Trace *trace) {
     int size = cfg.grid_size;
-    double centre = static_cast<double>(size) / 2.0;
-    double radius = (static_cast<double>(size) * cfg.city_radius) / 2.0;
-    // RNG for various choices
-    std::mt19937 rng(cfg.seed);
-    // 1. Zone assignment across the base grid
-    for (int y = 0; y < size; ++y) {
-        for (int x = 0; x < size; ++x) {
-            double dx = static_cast<double>(x) + 0.5 - centre;
-            double dy = static_cast<double>(y) + 0.5 - centre;
-            double dist = std::sqrt(dx * dx + dy * dy);
-            if (dist > radius) {
-                city.zoneAt(x, y) = ZoneType::None;
-                continue;
-            }
-            double value = fractalNoise(x, y, cfg.seed);
-            if (value < 0.55) {
-                city.zoneAt(x, y) = ZoneType::Residential;
-            } else if (value < 0.75) {
-                city.zoneAt(x, y) = ZoneType::Commercial;
-            } else if (value < 0.90) {
-                city.zoneAt(x, y) = ZoneType::Industrial;
-            } else {
-                city.zoneAt(x, y) = ZoneType::Green;
-            }
+    // 1. Zone assignment across the base grid.  Noise is position-pure, so
+    // row tiles are zoned independently and the result does not depend on
+    // the number of worker threads.
+    Trace::Scope zoning(trace, "zoning");
+    const std::size_t kZoneTileRows = 16;
+    parallelForChunks(static_cast<std::size_t>(size), kZoneTileRows, cfg.threads,
+                      [&](std::size_t, std::size_t rowBegin, std::size_t rowEnd) {
+        std::vector<double> values(static_cast<std::size_t>(size));
+        for (int y = static_cast<int>(rowBegin); y < static_cast<int>(rowEnd); ++y) {
+            zoneRow(cfg, y, &city.zoneAt(0, y), values);
         }
+    });
+    if (trace) {
+        const ZoneCounts cells = city.zoneCounts();
+        zoning.count("cells", static_cast<std::int64_t>(city.zones.size()));
+        zoning.count("cellsZoned", static_cast<std::int64_t>(
+            city.zones.size() - cells[static_cast<std::size_t>(ZoneType::None)]));
     }
-    // 2. Ensure a minimum amount of green space based on population
+}
+
+std::uint64_t greenTargetCells(const Config &cfg) {
     // The recommended minimum is about 8 m^2 per inhabitant.  Each grid
-    // cell represents an arbitrary area; we assume each cell could be ~100 m ×
-    // 100 m (10,000 m²).  So one cell contributes 10,000 m² of green space.
-    // Compute the target number of green cells and convert some cells if
-    // necessary.  Choose candidates from residential and industrial zones.
+    // cell represents an arbitrary area; we assume each cell could be ~100 m ×
+    // 100 m (10,000 m²).  So one cell contributes 10,000 m² of green space.
     double greenAreaPerPerson = 8.0; // m^2 per person
     double cellArea = 100.0 * 100.0; // m^2 per cell
-    std::uint64_t targetGreenCells = static_cast<std::uint64_t>(
-        std::ceil((cfg.population * greenAreaPerPerson) / cellArea));
-    // Count current green cells
-    std::uint64_t currentGreen = 0;
-    for (const auto z : city.zones) {
-        if (z == ZoneType::Green) currentGreen++;
+    return static_cast<std::uint64_t>(std::ceil((cfg.population * greenAreaPerPerson) / cellArea));
+}
+
+// Floyd's algorithm picks the ranks with one draw per converted cell, so
+// memory and draws are O(count), not O(candidates).
+std::vector<std::uint64_t> sampleGreenRanks(std::uint64_t candidates, std::uint64_t count,
+                                            LayoutRng &rng) {
+    std::vector<std::uint64_t> ranks;
+    if (count >= candidates) return ranks;
+    std::unordered_set<std::uint64_t> chosen;
+    chosen.reserve(static_cast<std::size_t>(count));
+    ranks.reserve(static_cast<std::size_t>(count));
+    for (std::uint64_t j = candidates - count; j < candidates; ++j) {
+        std::uint64_t t = std::uniform_int_distribution<std::uint64_t>(0, j)(rng);
+        if (!chosen.insert(t).second) {
+            chosen.insert(j);
+            t = j;
+        }
+        ranks.push_back(t);
     }
-    if (currentGreen < targetGreenCells) {
-        // Determine how many additional cells we need to convert
-        std::uint64_t diff = targetGreenCells - currentGreen;
-        // Collect candidate indices
-        std::vector<std::size_t> candidates;
-        candidates.reserve(city.zones.size());
-        for (std::size_t idx = 0; idx < city.zones.size(); ++idx) {
-            ZoneType z = city.zones[idx];
-            if (z == ZoneType::Residential || z == ZoneType::Industrial) {
-                candidates.push_back(idx);
+    std::sort(ranks.begin(), ranks.end());
+    return ranks;
+}
+
+namespace {
+
+/*
+ * Layout policies.  A street layout is a struct providing three parts,
+ * which planLayoutStreets() and parcelizeLayoutBlock() combine into a
+ * pipeline instantiated once per layout, so the per-parcel loop is
+ * compiled (and inlined) separately for each and makes no runtime layout
+ * decision:
+ *
+ *   Block enumerator  Streets(cfg): addRoads(roads), addBlocks(plan)
+ *   Parcelizer        parcelize(disc, plan, blockIdx, rng, scratch),
+ *                     returning the block's Parcel list
+ *   Footprint mapper  footprint(parcel, rng), centre(parcel, footprint),
+ *                     corners(parcel, footprint) and kParcelReach, the
+ *                     fraction of the city radius a parcel centre may
+ *                     lie at
+ *
+ * A new layout adds such a struct, a Config::LayoutType value and a case
+ * in withLayout().  RNG draws happen in the parcelizer and in
+ * footprint(); their order defines the generated city.
+ */
+
+// Axis-aligned blocks between straight road lines; parcels are rectangles
+// that are shrunk and jittered into footprints.
+struct GridLayout {
+    using Parcel = Rect;
+    static constexpr double kParcelReach = 1.02;
+
+    class Streets {
+    public:
+        explicit Streets(const Config &cfg) : disc_(cfg) {
+            const double cx = disc_.centre;
+            const double cy = disc_.centre;
+            const double radius = disc_.radius;
+            // Road alignments along fixed grid lines; these are reused when
+            // carving blocks so that road geometry and parcels stay
+            // consistent.
+            xLines_ = {cx - radius, cx - radius * 0.9, cx - radius * 0.5,
+                       cx, cx + radius * 0.5, cx + radius * 0.9, cx + radius};
+            yLines_ = {cy - radius, cy - radius * 0.9, cy - radius * 0.5,
+                       cy, cy + radius * 0.5, cy + radius * 0.9, cy + radius};
+            auto uniqSort = [](std::vector<double> &vals) {
+                std::sort(vals.begin(), vals.end());
+                vals.erase(std::unique(vals.begin(), vals.end()), vals.end());
+            };
+            uniqSort(xLines_);
+            uniqSort(yLines_);
+        }
+
+        // Vertical and horizontal lines spanning the developed area.  Widths
+        // are derived from hierarchy.
+        void addRoads(std::vector<RoadSegment> &roads) const {
+            const double c = disc_.centre;
+            const double radius = disc_.radius;
+            for (double x : xLines_) {
+                roads.push_back({x, c - radius, x, c + radius, classify(x)});
+            }
+            for (double y : yLines_) {
+                roads.push_back({c - radius, y, c + radius, y, classify(y)});
             }
         }
-        // Shuffle candidates deterministically using rng
-        std::shuffle(candidates.begin(), candidates.end(), rng);
-        std::size_t converted = 0;
-        for (std::size_t i = 0; i < candidates.size() && converted < diff; ++i) {
-            std::size_t idx = candidates[i];
-            city.zones[idx] = ZoneType::Green;
-            converted++;
+
+        // Blocks are the axis-aligned cells between road traces.
+        void addBlocks(StreetPlan &plan) const {
+            const double c = disc_.centre;
+            const double radius = disc_.radius;
+            auto insetFor = [&](double coord) { return 0.5 * roadWidth(classify(coord)); };
+            for (std::size_t xi = 0; xi + 1 < xLines_.size(); ++xi) {
+                for (std::size_t yi = 0; yi + 1 < yLines_.size(); ++yi) {
+                    double x0 = xLines_[xi] + insetFor(xLines_[xi]);
+                    double x1 = xLines_[xi + 1] - insetFor(xLines_[xi + 1]);
+                    double y0 = yLines_[yi] + insetFor(yLines_[yi]);
+                    double y1 = yLines_[yi + 1] - insetFor(yLines_[yi + 1]);
+                    if (x1 <= x0 || y1 <= y0) continue;
+                    Rect bounds{x0, y0, x1, y1};
+                    double dx = bounds.centreX() - c;
+                    double dy = bounds.centreY() - c;
+                    double dist = std::sqrt(dx * dx + dy * dy);
+                    if (dist > radius * 1.05) continue; // outside developed area
+                    if (bounds.width() < 1.0 || bounds.height() < 1.0) continue;
+                    Block blk;
+                    blk.bounds = bounds;
+                    blk.hasCorners = true;
+                    blk.corners = rectToQuad(bounds);
+                    plan.blocks.push_back(blk);
+                }
+            }
         }
-    }
-    // 3. Generate primary road network and parcels according to layout
-    double cx = centre;
-    double cy = centre;
-    if (cfg.layout == Config::LayoutType::Grid) {
-        // Road alignments along fixed grid lines; these are reused when carving
-        // blocks so that road geometry and parcels stay consistent.
-        std::vector<double> xLines = {cx - radius, cx - radius * 0.9, cx - radius * 0.5,
-                                      cx, cx + radius * 0.5, cx + radius * 0.9, cx + radius};
-        std::vector<double> yLines = {cy - radius, cy - radius * 0.9, cy - radius * 0.5,
-                                      cy, cy + radius * 0.5, cy + radius * 0.9, cy + radius};
-        auto uniqSort = [](std::vector<double> &vals) {
-            std::sort(vals.begin(), vals.end());
-            vals.erase(std::unique(vals.begin(), vals.end()), vals.end());
-        };
-        uniqSort(xLines);
-        uniqSort(yLines);
-        auto classifyRoad = [&](double coord, bool isX) {
-            double anchor = isX ? cx : cy;
-            double denom = (radius > 1e-6) ? radius : 1.0;
-            double norm = std::abs(coord - anchor) / denom;
+
+    private:
+        // Hierarchy by distance of the line from the centre line.  Both
+        // axes share the centre, so one classifier serves x and y lines.
+        RoadType classify(double coord) const {
+            double denom = (disc_.radius > 1e-6) ? disc_.radius : 1.0;
+            double norm = std::abs(coord - disc_.centre) / denom;
             if (norm < 0.15) return RoadType::Arterial;
             if (norm < 0.6) return RoadType::Secondary;
             return RoadType::Local;
-        };
-        auto addRoad = [&](double x0, double y0, double x1, double y1, RoadType t) {
-            city.roads.push_back({x0, y0, x1, y1, t});
-        };
-        // Vertical and horizontal lines spanning the developed area.  Widths are
-        // derived from hierarchy.
-        for (double x : xLines) {
-            RoadType type = classifyRoad(x, true);
-            addRoad(x, cy - radius, x, cy + radius, type);
-        }
-        for (double y : yLines) {
-            RoadType type = classifyRoad(y, false);
-            addRoad(cx - radius, y, cx + radius, y, type);
         }
-        // 4. Derive blocks from road lines (axis-aligned grid between road traces)
-        auto insetFor = [&](double coord, bool isX) {
-            return 0.5 * roadWidth(classifyRoad(coord, isX));
-        };
-        for (std::size_t xi = 0; xi + 1 < xLines.size(); ++xi) {
-            for (std::size_t yi = 0; yi + 1 < yLines.size(); ++yi) {
-                double x0 = xLines[xi] + insetFor(xLines[xi], true);
-                double x1 = xLines[xi + 1] - insetFor(xLines[xi + 1], true);
-                double y0 = yLines[yi] + insetFor(yLines[yi], false);
-                double y1 = yLines[yi + 1] - insetFor(yLines[yi + 1], false);
-                if (x1 <= x0 || y1 <= y0) continue;
-                Rect bounds{x0, y0, x1, y1};
-                double blockCx = bounds.centreX();
-                double blockCy = bounds.centreY();
-                double dx = blockCx - cx;
-                double dy = blockCy - cy;
-                double dist = std::sqrt(dx * dx + dy * dy);
-                if (dist > radius * 1.05) continue; // outside developed area
-                if (bounds.width() < 1.0 || bounds.height() < 1.0) continue;
-                Block blk;
-                blk.bounds = bounds;
-                blk.hasCorners = true;
-                blk.corners = rectToQuad(bounds);
-                city.blocks.push_back(blk);
+
+        CityDisc disc_;
+        std::vector<double> xLines_;
+        std::vector<double> yLines_;
+    };
+
+    template <class Rng>
+    static const std::vector<Rect> &parcelize(const CityDisc &, const StreetPlan &plan,
+                                              std::size_t blockIdx, Rng &rng,
+                                              ParcelScratch &scratch) {
+        parcelizeBlock(plan.blocks[blockIdx], rng, scratch.rects);
+        return scratch.rects;
+    }
+
+    template <class Rng>
+    static Rect footprint(const Rect &parcel, Rng &rng) { return jitterFootprint(parcel, rng); }
+    static Vec2 centre(const Rect &, const Rect &fp) { return {fp.centreX(), fp.centreY()}; }
+    static std::array<Vec2, 4> corners(const Rect &, const Rect &fp) { return rectToQuad(fp); }
+};
+
+// Wedge blocks between ring roads and radial arterials; parcels are quads
+// already jittered in the wedge's unwrapped space.
+struct RadialLayout {
+    using Parcel = std::array<Vec2, 4>;
+    static constexpr double kParcelReach = 1.05;
+
+    class Streets {
+    public:
+        explicit Streets(const Config &cfg) : disc_(cfg) {
+            ringCount_ = std::clamp(static_cast<int>(std::round(3.0 + cfg.population / 200000.0)), 3, 8);
+            radialRoads_ = std::clamp(static_cast<int>(std::round(10.0 + cfg.city_radius * 8.0)), 8, 20);
+            const double maxR = disc_.radius;
+            ringEdges_.reserve(ringCount_ + 2);
+            ringEdges_.push_back(0.0);
+            for (int i = 1; i <= ringCount_; ++i) {
+                double frac = static_cast<double>(i) / static_cast<double>(ringCount_ + 1);
+                ringEdges_.push_back(maxR * frac);
+            }
+            ringEdges_.push_back(maxR);
+            std::sort(ringEdges_.begin(), ringEdges_.end());
+            ringEdges_.erase(std::unique(ringEdges_.begin(), ringEdges_.end()), ringEdges_.end());
+            angles_.resize(radialRoads_ + 1);
+            double delta = kTwoPi / static_cast<double>(radialRoads_);
+            for (int i = 0; i <= radialRoads_; ++i) {
+                angles_[i] = delta * static_cast<double>(i);
             }
         }
-        // 5. Subdivide blocks into parcels and spawn buildings per parcel
-        for (const auto &block : city.blocks) {
-            std::vector<Rect> parcels = parcelizeBlock(block, rng);
-            for (const auto &footprint : parcels) {
-                Rect adjusted = jitterFootprint(footprint, rng);
-                double cxp = adjusted.centreX();
-                double cyp = adjusted.centreY();
-                double dx = cxp - cx;
-                double dy = cyp - cy;
-                double dist = std::sqrt(dx * dx + dy * dy);
-                if (dist > radius * 1.02) continue;
-                ZoneType z = sampleZone(city, adjusted);
-                if (z == ZoneType::None) continue;
-                Building b;
-                b.footprint = adjusted;
-                b.zone = z;
-                b.height = sampleHeight(z, adjusted, dist, radius, rng);
-                b.facility = false;
-                b.hasCorners = true;
-                b.corners = rectToQuad(adjusted);
-                // If the parcel overlaps predominantly green cells, downgrade to green
-                if (z == ZoneType::Green) {
-                    b.height = 0;
+
+        void addRoads(std::vector<RoadSegment> &roads) const {
+            const double c = disc_.centre;
+            // Ring roads (approximated by segmented polylines)
+            for (std::size_t ri = 1; ri + 1 < ringEdges_.size(); ++ri) {
+                double r = ringEdges_[ri];
+                int segs = std::max(32, radialRoads_ * 2);
+                for (int s = 0; s < segs; ++s) {
+                    double t0 = kTwoPi * static_cast<double>(s) / static_cast<double>(segs);
+                    double t1 = kTwoPi * static_cast<double>(s + 1) / static_cast<double>(segs);
+                    Vec2 p0 = polarToCartesian(c, c, r, t0);
+                    Vec2 p1 = polarToCartesian(c, c, r, t1);
+                    roads.push_back({p0.x, p0.y, p1.x, p1.y, ringType(r)});
                 }
-                city.buildings.push_back(b);
             }
-        }
-    } else { // Radial layout
-        int ringCount = std::clamp(static_cast<int>(std::round(3.0 + cfg.population / 200000.0)), 3, 8);
-        int radialRoads = std::clamp(static_cast<int>(std::round(10.0 + cfg.city_radius * 8.0)), 8, 20);
-        double maxR = radius;
-        std::vector<double> ringEdges;
-        ringEdges.reserve(ringCount + 2);
-        ringEdges.push_back(0.0);
-        for (int i = 1; i <= ringCount; ++i) {
-            double frac = static_cast<double>(i) / static_cast<double>(ringCount + 1);
-            ringEdges.push_back(maxR * frac);
-        }
-        ringEdges.push_back(maxR);
-        std::sort(ringEdges.begin(), ringEdges.end());
-        ringEdges.erase(std::unique(ringEdges.begin(), ringEdges.end()), ringEdges.end());
-        std::vector<double> angles(radialRoads + 1);
-        const double twoPi = 6.28318530717958647692;
-        double delta = twoPi / static_cast<double>(radialRoads);
-        for (int i = 0; i <= radialRoads; ++i) {
-            angles[i] = delta * static_cast<double>(i);
-        }
-        auto ringType = [&](double r) {
-            double norm = (maxR > 1e-6) ? (r / maxR) : 0.0;
-            if (norm < 0.3) return RoadType::Arterial;
-            if (norm < 0.75) return RoadType::Secondary;
-            return RoadType::Local;
-        };
-        // Ring roads (approximated by segmented polylines)
-        for (std::size_t ri = 1; ri + 1 < ringEdges.size(); ++ri) {
-            double r = ringEdges[ri];
-            int segs = std::max(32, radialRoads * 2);
-            for (int s = 0; s < segs; ++s) {
-                double t0 = twoPi * static_cast<double>(s) / static_cast<double>(segs);
-                double t1 = twoPi * static_cast<double>(s + 1) / static_cast<double>(segs);
-                Vec2 p0 = polarToCartesian(cx, cy, r, t0);
-                Vec2 p1 = polarToCartesian(cx, cy, r, t1);
-                city.roads.push_back({p0.x, p0.y, p1.x, p1.y, ringType(r)});
+            // Radial arterials
+            for (int i = 0; i < radialRoads_; ++i) {
+                double t = angles_[i];
+                Vec2 p0 = polarToCartesian(c, c, 0.0, t);
+                Vec2 p1 = polarToCartesian(c, c, disc_.radius, t);
+                roads.push_back({p0.x, p0.y, p1.x, p1.y, RoadType::Arterial});
             }
         }
-        // Radial arterials
-        for (int i = 0; i < radialRoads; ++i) {
-            double t = angles[i];
-            Vec2 p0 = polarToCartesian(cx, cy, 0.0, t);
-            Vec2 p1 = polarToCartesian(cx, cy, maxR, t);
-            city.roads.push_back({p0.x, p0.y, p1.x, p1.y, RoadType::Arterial});
-        }
+
         // Blocks: wedges defined by consecutive ring bands and angular sectors
-        for (std::size_t ri = 0; ri + 1 < ringEdges.size(); ++ri) {
-            double r0 = ringEdges[ri];
-            double r1 = ringEdges[ri + 1];
-            for (int si = 0; si < radialRoads; ++si) {
-                double a0 = angles[si];
-                double a1 = angles[si + 1];
-                std::array<Vec2, 4> corners = {{
-                    polarToCartesian(cx, cy, r0, a0),
-                    polarToCartesian(cx, cy, r1, a0),
-                    polarToCartesian(cx, cy, r1, a1),
-                    polarToCartesian(cx, cy, r0, a1)
-                }};
-                Rect bounds = boundsFromQuad(corners);
-                Vec2 blockC = centroidOfQuad(corners);
-                double dx = blockC.x - cx;
-                double dy = blockC.y - cy;
-                double dist = std::sqrt(dx * dx + dy * dy);
-                if (dist > radius * 1.1) continue;
-                Block blk;
-                blk.bounds = bounds;
-                blk.hasCorners = true;
-                blk.corners = corners;
-                city.blocks.push_back(blk);
-                auto parcels = parcelizeWedge(cx, cy, r0, r1, a0, a1, rng);
-                for (const auto &quad : parcels) {
-                    Rect parcelBounds = boundsFromQuad(quad);
-                    Vec2 centreP = centroidOfQuad(quad);
-                    double pdx = centreP.x - cx;
-                    double pdy = centreP.y - cy;
-                    double pdist = std::sqrt(pdx * pdx + pdy * pdy);
-                    if (pdist > radius * 1.05) continue;
-                    ZoneType z = sampleZone(city, parcelBounds);
-                    if (z == ZoneType::None) continue;
-                    Building b;
-                    b.footprint = parcelBounds;
-                    b.corners = quad;
-                    b.hasCorners = true;
-                    b.zone = z;
-                    b.height = sampleHeight(z, parcelBounds, pdist, radius, rng);
-                    b.facility = false;
-                    if (z == ZoneType::Green) {
-                        b.height = 0;
-                    }
-                    city.buildings.push_back(b);
+        void addBlocks(StreetPlan &plan) const {
+            const double c = disc_.centre;
+            for (std::size_t ri = 0; ri + 1 < ringEdges_.size(); ++ri) {
+                double r0 = ringEdges_[ri];
+                double r1 = ringEdges_[ri + 1];
+                for (int si = 0; si < radialRoads_; ++si) {
+                    double a0 = angles_[si];
+                    double a1 = angles_[si + 1];
+                    std::array<Vec2, 4> corners = {{
+                        polarToCartesian(c, c, r0, a0),
+                        polarToCartesian(c, c, r1, a0),
+                        polarToCartesian(c, c, r1, a1),
+                        polarToCartesian(c, c, r0, a1)
+                    }};
+                    Vec2 blockC = centroidOfQuad(corners);
+                    double dx = blockC.x - c;
+                    double dy = blockC.y - c;
+                    double dist = std::sqrt(dx * dx + dy * dy);
+                    if (dist > disc_.radius * 1.1) continue;
+                    Block blk;
+                    blk.bounds = boundsFromQuad(corners);
+                    blk.hasCorners = true;
+                    blk.corners = corners;
+                    plan.blocks.push_back(blk);
+                    plan.wedges.push_back({r0, r1, a0, a1});
                 }
             }
         }
-    }
-    // 6. Place facilities (hospitals and schools) on suitable parcels
-    struct ParcelCandidate {
-        std::size_t idx;
-        double roadDistance;
-    };
-    std::vector<ParcelCandidate> candidates;
-    candidates.reserve(city.buildings.size());
-    for (std::size_t i = 0; i < city.buildings.size(); ++i) {
-        const auto &b = city.buildings[i];
-        if (b.zone == ZoneType::Residential || b.zone == ZoneType::Commercial) {
-            double dist = distanceToRoads(b.footprint, city.roads);
-            candidates.push_back({i, dist});
+
+    private:
+        static constexpr double kTwoPi = 6.28318530717958647692;
+
+        RoadType ringType(double r) const {
+            double norm = (disc_.radius > 1e-6) ? (r / disc_.radius) : 0.0;
+            if (norm < 0.3) return RoadType::Arterial;
+            if (norm < 0.75) return RoadType::Secondary;
+            return RoadType::Local;
         }
+
+        CityDisc disc_;
+        int ringCount_ = 0;
+        int radialRoads_ = 0;
+        std::vector<double> ringEdges_;
+        std::vector<double> angles_;
+    };
+
+    template <class Rng>
+    static const std::vector<Parcel> &parcelize(const CityDisc &disc, const StreetPlan &plan,
+                                                std::size_t blockIdx, Rng &rng,
+                                                ParcelScratch &scratch) {
+        const StreetPlan::Wedge &w = plan.wedges[blockIdx];
+        parcelizeWedge(disc.centre, disc.centre, w.r0, w.r1, w.a0, w.a1, rng, scratch);
+        return scratch.quads;
     }
-    if (candidates.empty()) {
-        for (std::size_t i = 0; i < city.buildings.size(); ++i) {
-            double dist = distanceToRoads(city.buildings[i].footprint, city.roads);
-            candidates.push_back({i, dist});
+
+    template <class Rng>
+    static Rect footprint(const Parcel &quad, Rng &) { return boundsFromQuad(quad); }
+    static Vec2 centre(const Parcel &quad, const Rect &) { return centroidOfQuad(quad); }
+    static std::array<Vec2, 4> corners(const Parcel &quad, const Rect &) { return quad; }
+};
+
+// Invoke fn with a default-constructed policy for @p layout.
+template <class Fn>
+decltype(auto) withLayout(Config::LayoutType layout, Fn &&fn) {
+    switch (layout) {
+        case Config::LayoutType::Radial: return fn(RadialLayout{});
+        case Config::LayoutType::Grid:
+        default: return fn(GridLayout{});
+    }
+}
+
+template <class Layout>
+void planLayoutStreets(const Config &cfg, StreetPlan &plan, Trace *trace) {
+    plan = StreetPlan();
+    Trace::Scope roadsStage(trace, "roads");
+    const typename Layout::Streets streets(cfg);
+    streets.addRoads(plan.roads);
+    roadsStage.count("roads", static_cast<std::int64_t>(plan.roads.size()));
+    roadsStage.end();
+    Trace::Scope blocksStage(trace, "blocks");
+    streets.addBlocks(plan);
+    blocksStage.count("blocks", static_cast<std::int64_t>(plan.blocks.size()));
+}
+
+// Subdivide one block into parcels and spawn a building per developed
+// parcel: the zone sample, height draw and Building construction shared
+// by every layout.
+template <class Layout, class Rng, class Out>
+std::size_t parcelizeLayoutBlock(const Config &cfg, const StreetPlan &plan, std::size_t blockIdx,
+                                 const ZoneField &zones, Rng &rng, Out &out) {
+    const CityDisc disc(cfg);
+    const auto &parcels = Layout::parcelize(disc, plan, blockIdx, rng, threadParcelScratch());
+    for (const auto &parcel : parcels) {
+        const Rect fp = Layout::footprint(parcel, rng);
+        const Vec2 c = Layout::centre(parcel, fp);
+        double dx = c.x - disc.centre;
+        double dy = c.y - disc.centre;
+        double dist = std::sqrt(dx * dx + dy * dy);
+        if (dist > disc.radius * Layout::kParcelReach) continue;
+        ZoneType z = sampleZone(zones, fp);
+        if (z == ZoneType::None) continue;
+        Building b;
+        b.footprint = fp;
+        b.corners = Layout::corners(parcel, fp);
+        b.hasCorners = true;
+        b.zone = z;
+        b.height = sampleHeight(z, fp, dist, disc.radius, rng);
+        b.facility = false;
+        // If the parcel overlaps predominantly green cells, downgrade to green
+        if (z == ZoneType::Green) {
+            b.height = 0;
         }
+        out.push_back(b);
     }
+    return parcels.size();
+}
+
+} // anonymous namespace
+
+void planStreets(const Config &cfg, StreetPlan &plan, Trace *trace) {
+    withLayout(cfg.layout, [&](auto layout) {
+        planLayoutStreets<decltype(layout)>(cfg, plan, trace);
+    });
+}
+
+template <class Rng, class Out>
+std::size_t parcelizeStreetBlock(const Config &cfg, const StreetPlan &plan, std::size_t blockIdx,
+                                 const ZoneField &zones, Rng &blockRng, Out &out) {
+    return withLayout(cfg.layout, [&](auto layout) {
+        return parcelizeLayoutBlock<decltype(layout)>(cfg, plan, blockIdx, zones, blockRng, out);
+    });
+}
+
+template std::size_t parcelizeStreetBlock(const Config &, const StreetPlan &, std::size_t,
+                                          const ZoneField &, LayoutRng &, BuildingStore &);
+template std::size_t parcelizeStreetBlock(const Config &, const StreetPlan &, std::size_t,
+                                          const ZoneField &, LayoutRng &, BuildingSink &);
+template std::size_t parcelizeStreetBlock(const Config &, const StreetPlan &, std::size_t,
+                                          const ZoneField &, Philox4x32 &, std::vector<Building> &);
+template std::size_t parcelizeStreetBlock(const Config &, const StreetPlan &, std::size_t,
+                                          const ZoneField &, Philox4x32 &, BuildingSink &);
+
+void orderFacilityCandidates(const std::vector<ParcelCandidate> &candidates, LayoutRng &rng,
+                             std::vector<std::size_t> &facilityOrder) {
     std::vector<ParcelCandidate> nearRoads;
     std::vector<ParcelCandidate> interior;
     const double accessibleRadius = 1.6; // one arterial lane away from the carriageway
@@ -586,42 +722,181 @@ City CityGenerator::generate(const Config &cfg) {
     };
     sortByAccess(nearRoads);
     sortByAccess(interior);
-    std::vector<std::size_t> orderedParcels;
-    orderedParcels.reserve(candidates.size());
-    for (const auto &c : nearRoads) orderedParcels.push_back(c.idx);
-    for (const auto &c : interior) orderedParcels.push_back(c.idx);
-
-    auto imprintFacility = [&](Building &b, Facility::Type type) {
-        b.facility = true;
-        b.facilityType = type;
-        double area = std::max(b.footprint.width() * b.footprint.height(), 1.0);
-        double scale = std::sqrt(area);
-        if (type == Facility::Type::Hospital) {
-            int target = static_cast<int>(std::round(4.0 + scale * 0.25));
-            b.height = std::clamp(target, 5, 12);
+    facilityOrder.clear();
+    facilityOrder.reserve(candidates.size());
+    for (const auto &c : nearRoads) facilityOrder.push_back(c.idx);
+    for (const auto &c : interior) facilityOrder.push_back(c.idx);
+}
+
+int facilityHeight(Facility::Type type, const Rect &footprint) {
+    double area = std::max(footprint.width() * footprint.height(), 1.0);
+    double scale = std::sqrt(area);
+    if (type == Facility::Type::Hospital) {
+        int target = static_cast<int>(std::round(4.0 + scale * 0.25));
+        return std::clamp(target, 5, 12);
+    }
+    int target = static_cast<int>(std::round(2.0 + scale * 0.1));
+    return std::clamp(target, 2, 5);
+}
+
+void layoutCity(const Config &cfg, City &city, std::vector<std::size_t> &facilityOrder,
+                Trace *trace, MemoryReport *memory) {
+    // RNG for various choices; draws are counted for the trace.
+    LayoutRng rng{std::mt19937(cfg.seed)};
+    std::uint64_t drawsBefore = 0;
+    auto takeDraws = [&]() {
+        std::int64_t n = static_cast<std::int64_t>(rng.draws() - drawsBefore);
+        drawsBefore = rng.draws();
+        return n;
+    };
+    // 2. Ensure a minimum amount of green space based on population.
+    // Compute the target number of green cells and convert some cells if
+    // necessary.  Choose candidates from residential and industrial zones.
+    Trace::Scope green(trace, "green");
+    std::uint64_t targetGreenCells = greenTargetCells(cfg);
+    // Count current green cells and conversion candidates
+    const ZoneCounts cells = city.zoneCounts();
+    std::uint64_t currentGreen = cells[static_cast<std::size_t>(ZoneType::Green)];
+    std::uint64_t candidateCells = cells[static_cast<std::size_t>(ZoneType::Residential)] +
+                                   cells[static_cast<std::size_t>(ZoneType::Industrial)];
+    if (currentGreen < targetGreenCells) {
+        // Determine how many additional cells we need to convert
+        std::uint64_t diff = targetGreenCells - currentGreen;
+        std::size_t converted = 0;
+        if (cfg.green_mode == Config::GreenMode::Shuffle) {
+            // Collect candidate indices
+            std::vector<std::size_t> candidates;
+            candidates.reserve(static_cast<std::size_t>(candidateCells));
+            for (std::size_t idx = 0; idx < city.zones.size(); ++idx) {
+                ZoneType z = city.zones[idx];
+                if (z == ZoneType::Residential || z == ZoneType::Industrial) {
+                    candidates.push_back(idx);
+                }
+            }
+            if (memory) memory->recordGenerateStage("green", {{"candidates", MemoryUsage().add(candidates)}});
+            // Shuffle candidates deterministically using rng
+            std::shuffle(candidates.begin(), candidates.end(), rng);
+            for (std::size_t i = 0; i < candidates.size() && converted < diff; ++i) {
+                std::size_t idx = candidates[i];
+                city.zones[idx] = ZoneType::Green;
+                converted++;
+            }
         } else {
-            int target = static_cast<int>(std::round(2.0 + scale * 0.1));
-            b.height = std::clamp(target, 2, 5);
+            std::vector<std::uint64_t> ranks = sampleGreenRanks(candidateCells, diff, rng);
+            if (memory) memory->recordGenerateStage("green", {{"ranks", MemoryUsage().add(ranks)}});
+            converted = convertRanksToGreen(city.zones, ranks, std::min(diff, candidateCells));
         }
-    };
+        green.count("cellsConverted", static_cast<std::int64_t>(converted));
+    }
+    green.count("rngDraws", takeDraws());
+    green.end();
+    // 3. Generate primary road network and blocks according to layout
+    StreetPlan plan;
+    planStreets(cfg, plan, trace);
+    city.setRoads(std::move(plan.roads));
+    city.blocks = plan.blocks;
+    // Parcelize every block.  Sequential mode threads the shared engine
+    // through the blocks in order (the historical behaviour).  Per-block
+    // mode gives each block its own Philox stream keyed on (seed, block
+    // index), so blocks parcelize concurrently and the merged result is the
+    // same for any thread count.
+    const ZoneField zones(city);
+    Trace::Scope parcels(trace, "parcels");
+    std::atomic<std::int64_t> parcelCount{0};
+    if (cfg.rng_mode == Config::RngMode::Sequential) {
+        for (std::size_t i = 0; i < plan.blocks.size(); ++i) {
+            parcelCount += static_cast<std::int64_t>(
+                parcelizeStreetBlock(cfg, plan, i, zones, rng, city.buildings));
+        }
+        parcels.count("rngDraws", takeDraws());
+    } else {
+        std::vector<std::vector<Building>> perBlock(plan.blocks.size());
+        std::atomic<std::int64_t> blockDraws{0};
+        parallelForChunks(plan.blocks.size(), 1, cfg.threads,
+                          [&](std::size_t i, std::size_t, std::size_t) {
+            Philox4x32 blockRng(cfg.seed, i);
+            std::size_t n = parcelizeStreetBlock(cfg, plan, i, zones, blockRng, perBlock[i]);
+            parcelCount.fetch_add(static_cast<std::int64_t>(n), std::memory_order_relaxed);
+            blockDraws.fetch_add(static_cast<std::int64_t>(blockRng.draws()), std::memory_order_relaxed);
+        });
+        if (memory) memory->recordGenerateStage("parcels", {{"perBlock", MemoryUsage().add(perBlock)}});
+        std::size_t total = city.buildings.size();
+        for (const auto &part : perBlock) total += part.size();
+        city.buildings.reserve(total);
+        for (const auto &part : perBlock) {
+            city.buildings.append(part);
+        }
+        parcels.count("rngDraws", blockDraws.load());
+    }
+    parcels.count("parcels", parcelCount.load());
+    parcels.count("buildings", static_cast<std::int64_t>(city.buildings.size()));
+    parcels.end();
+    // 6. Place facilities (hospitals and schools) on suitable parcels.  Road
+    // proximity is answered by the spatial index rather than a full scan.
+    Trace::Scope roadIndexStage(trace, "roadIndex");
+    city.buildRoadIndex();
+    roadIndexStage.end();
+    Trace::Scope candidatesStage(trace, "facilityCandidates");
+    // Candidate selection only reads the zone and footprint columns.
+    const std::vector<ZoneType> &buildingZones = city.buildings.zones();
+    const std::vector<Rect> &footprints = city.buildings.footprints();
+    std::vector<ParcelCandidate> candidates;
+    candidates.reserve(city.buildings.size());
+    for (std::size_t i = 0; i < city.buildings.size(); ++i) {
+        ZoneType z = buildingZones[i];
+        if (z == ZoneType::Residential || z == ZoneType::Commercial) {
+            double dist = city.distanceToRoads(footprints[i]);
+            candidates.push_back({i, dist});
+        }
+    }
+    if (candidates.empty()) {
+        for (std::size_t i = 0; i < city.buildings.size(); ++i) {
+            double dist = city.distanceToRoads(footprints[i]);
+            candidates.push_back({i, dist});
+        }
+    }
+    orderFacilityCandidates(candidates, rng, facilityOrder);
+    if (memory) {
+        memory->recordGenerateStage("facilityCandidates", {{"candidates", MemoryUsage().add(candidates)},
+                                                           {"facilityOrder", MemoryUsage().add(facilityOrder)}});
+    }
+    candidatesStage.count("candidates", static_cast<std::int64_t>(candidates.size()));
+    candidatesStage.count("rngDraws", takeDraws());
+}
 
-    auto placeFacilities = [&](Facility::Type type, std::uint32_t count) {
+void placeFacilities(const Config &cfg, City &city, const std::vector<std::size_t> &facilityOrder,
+                     Trace *trace) {
+    Trace::Scope facilitiesStage(trace, "facilities");
+    const std::vector<Rect> &footprints = city.buildings.footprints();
+    auto placeType = [&](Facility::Type type, std::uint32_t count) {
         std::uint32_t placed = 0;
-        for (std::size_t idx : orderedParcels) {
+        for (std::size_t idx : facilityOrder) {
             if (placed >= count) break;
-            Building &b = city.buildings[idx];
-            if (!b.facility) {
-                imprintFacility(b, type);
+            if (!city.buildings.isFacility(idx)) {
+                city.buildings.setFacility(idx, type);
+                city.buildings.setHeight(idx, facilityHeight(type, footprints[idx]));
                 Facility f;
-                f.x = b.footprint.centreX();
-                f.y = b.footprint.centreY();
+                f.x = footprints[idx].centreX();
+                f.y = footprints[idx].centreY();
                 f.type = type;
                 city.facilities.push_back(f);
                 placed++;
             }
         }
     };
-    placeFacilities(Facility::Type::Hospital, cfg.hospitals);
-    placeFacilities(Facility::Type::School, cfg.schools);
+    placeType(Facility::Type::Hospital, cfg.hospitals);
+    placeType(Facility::Type::School, cfg.schools);
+    city.transportMode = cfg.transport_mode;
+    facilitiesStage.count("facilities", static_cast<std::int64_t>(city.facilities.size()));
+}
+
+City CityGenerator::generate(const Config &cfg, Trace *trace, MemoryReport *memory) {
+    Trace::Scope total(trace, "generate");
+    City city(cfg.grid_size);
+    std::vector<std::size_t> facilityOrder;
+    zoneCity(cfg, city, trace);
+    layoutCity(cfg, city, facilityOrder, trace, memory);
+    placeFacilities(cfg, city, facilityOrder, trace);
+    if (memory) memory->setCity(city.memoryUsage());
     return city;
 }
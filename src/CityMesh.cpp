@@ -0,0 +1,60 @@
+#include "CityMesh.h"
+#include "Parallel.h"
+
+namespace {
+
+// Buildings per decomposition chunk.
+constexpr std::size_t kGeometryGrain = 4096;
+
+using SlotCounts = std::array<std::size_t, kMaterialCount>;
+
+} // namespace
+
+CityGeometry::CityGeometry(const City &city, int threads) {
+    const BuildingStore &store = city.buildings;
+    const std::size_t count = store.size();
+    const std::size_t chunks = (count + kGeometryGrain - 1) / kGeometryGrain;
+    // Counting pass over the zone and flag columns: offsets[c + 1] receives
+    // the prisms chunk c adds to each slot.
+    std::vector<SlotCounts> offsets(chunks + 1, SlotCounts{});
+    parallelForChunks(count, kGeometryGrain, threads,
+                      [&](std::size_t c, std::size_t begin, std::size_t end) {
+        SlotCounts &n = offsets[c + 1];
+        for (std::size_t i = begin; i < end; ++i) {
+            ZoneType zone = store.zone(i);
+            if (zone == ZoneType::None) continue;
+            bool facility = store.isFacility(i);
+            Archetype a = archetypeFor(zone, facility,
+                                       facility ? store.facilityType(i) : Facility::Type::School);
+            n[materialSlotForZone(zone)] += archetypePrismCount(a);
+        }
+    });
+    for (std::size_t c = 0; c < chunks; ++c) {
+        for (std::size_t slot = 0; slot < kMaterialCount; ++slot) {
+            offsets[c + 1][slot] += offsets[c][slot];
+        }
+    }
+    for (std::size_t slot = 0; slot < kMaterialCount; ++slot) {
+        prisms_[slot].resize(offsets[chunks][slot]);
+    }
+    // Fill pass: every chunk writes its own ranges of the slot arrays.
+    parallelForChunks(count, kGeometryGrain, threads,
+                      [&](std::size_t c, std::size_t begin, std::size_t end) {
+        SlotCounts next = offsets[c];
+        for (std::size_t i = begin; i < end; ++i) {
+            if (store.zone(i) == ZoneType::None) continue;
+            const Building b = store[i];
+            const std::size_t slot = materialSlotForZone(b.zone);
+            const Archetype a = archetypeFor(b);
+            std::vector<Prism> &out = prisms_[slot];
+            forEachBuildingPrism(b, [&](const Quad &q, double baseZ, double topZ) {
+                out[next[slot]++] = Prism{q, baseZ, topZ, a};
+            });
+        }
+    });
+    roads_.reserve(city.roads().size());
+    for (const auto &road : city.roads()) {
+        Quad q;
+        if (roadQuad(road, q)) roads_.push_back(q);
+    }
+}
@@ -0,0 +1,398 @@
+#pragma once
+
+#include "City.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * @file CityMesh.h
+ *
+ * Geometry helpers shared by the mesh exporters: the material palette,
+ * footprint quads, the prism decomposition of each building archetype,
+ * CityGeometry (that decomposition for a whole city) and the triangle
+ * buffers used by glTF output.  Every archetype is built from extruded
+ * quads ("prisms"), which is what lets OBJ, baked glTF and instanced glTF
+ * all agree on the same shapes.
+ */
+
+using Quad = std::array<std::pair<double, double>, 4>;
+
+inline Quad rectToQuad(const Rect &r) {
+    return {{
+        {r.x0, r.y0},
+        {r.x1, r.y0},
+        {r.x1, r.y1},
+        {r.x0, r.y1}
+    }};
+}
+
+inline Quad toQuad(const std::array<Vec2, 4> &v) {
+    return {{
+        {v[0].x, v[0].y},
+        {v[1].x, v[1].y},
+        {v[2].x, v[2].y},
+        {v[3].x, v[3].y}
+    }};
+}
+
+inline Quad buildingQuad(const Building &b) {
+    if (b.hasCorners) {
+        return toQuad(b.corners);
+    }
+    return rectToQuad(b.footprint);
+}
+
+inline Rect boundsFromQuad(const Quad &q) {
+    Rect r;
+    r.x0 = r.x1 = q[0].first;
+    r.y0 = r.y1 = q[0].second;
+    for (int i = 1; i < 4; ++i) {
+        r.x0 = std::min(r.x0, q[i].first);
+        r.x1 = std::max(r.x1, q[i].first);
+        r.y0 = std::min(r.y0, q[i].second);
+        r.y1 = std::max(r.y1, q[i].second);
+    }
+    return r;
+}
+
+// Scale a quad about its centroid.
+inline Quad scaleQuad(const Quad &q, double scale) {
+    double cx = 0.0, cy = 0.0;
+    for (const auto &p : q) { cx += p.first; cy += p.second; }
+    cx *= 0.25; cy *= 0.25;
+    Quad out;
+    for (int i = 0; i < 4; ++i) {
+        double dx = q[i].first - cx;
+        double dy = q[i].second - cy;
+        out[i].first = cx + dx * scale;
+        out[i].second = cy + dy * scale;
+    }
+    return out;
+}
+
+/// True when the quad is exactly the corner loop of its bounding box, i.e.
+/// an axis-aligned rectangle that can be expressed as a scaled unit box.
+inline bool isAxisAlignedQuad(const Quad &q) {
+    return q == rectToQuad(boundsFromQuad(q));
+}
+
+struct MaterialDef {
+    const char *name;
+    double r;
+    double g;
+    double b;
+    double ks;
+    double shininess;
+    double metallic;
+    double roughness;
+};
+
+inline constexpr MaterialDef kMaterialPalette[] = {
+    {"mat_default", 0.7, 0.7, 0.7, 0.05, 32.0, 0.0, 0.6},
+    {"mat_commercial", 0.6, 0.65, 0.72, 0.5, 96.0, 0.05, 0.35}, // glassy grey
+    {"mat_residential", 0.83, 0.72, 0.62, 0.08, 48.0, 0.0, 0.55}, // warm tones
+    {"mat_industrial", 0.32, 0.34, 0.36, 0.04, 24.0, 0.02, 0.75}, // muted dark
+    {"mat_green", 0.3, 0.62, 0.34, 0.02, 12.0, 0.0, 0.7}, // vegetation
+    {"mat_road", 0.15, 0.15, 0.15, 0.02, 12.0, 0.0, 0.8} // asphalt
+};
+
+constexpr std::size_t kMaterialCount = sizeof(kMaterialPalette) / sizeof(kMaterialPalette[0]);
+constexpr std::size_t kRoadMaterialSlot = kMaterialCount - 1;
+
+// Palette slot per zone.
+inline std::size_t materialSlotForZone(ZoneType zone) {
+    switch (zone) {
+        case ZoneType::Commercial: return 1;
+        case ZoneType::Residential: return 2;
+        case ZoneType::Industrial: return 3;
+        case ZoneType::Green: return 4;
+        default: return 0;
+    }
+}
+
+constexpr double kRoadThickness = 0.05;
+
+/// Building shapes; each one expands to a fixed number of prisms.
+enum class Archetype { Standard, Park, School, Hospital };
+constexpr std::size_t kArchetypeCount = 4;
+
+inline const char *archetypeName(Archetype a) {
+    switch (a) {
+        case Archetype::Park: return "park";
+        case Archetype::School: return "school";
+        case Archetype::Hospital: return "hospital";
+        case Archetype::Standard:
+        default: return "standard";
+    }
+}
+
+inline Archetype archetypeFor(ZoneType zone, bool facility, Facility::Type facilityType) {
+    if (zone == ZoneType::Green) return Archetype::Park;
+    if (facility) {
+        return facilityType == Facility::Type::Hospital ? Archetype::Hospital : Archetype::School;
+    }
+    return Archetype::Standard;
+}
+
+inline Archetype archetypeFor(const Building &b) {
+    return archetypeFor(b.zone, b.facility, b.facilityType);
+}
+
+/// Prisms forEachBuildingPrism() emits for a building of archetype @p a.
+inline std::size_t archetypePrismCount(Archetype a) {
+    switch (a) {
+        case Archetype::Park: return 3;
+        case Archetype::School: return 2;
+        case Archetype::Hospital: return 3;
+        case Archetype::Standard:
+        default: return 1;
+    }
+}
+
+/**
+ * @brief Expand a building into its prisms.
+ *
+ * Calls emit(base, baseZ, topZ) once per prism.  All prisms of a building
+ * use the material of materialSlotForZone(b.zone).  Undeveloped buildings
+ * produce nothing.
+ */
+template <class Emit>
+void forEachBuildingPrism(const Building &b, Emit &&emit) {
+    if (b.zone == ZoneType::None) return;
+    Quad base = buildingQuad(b);
+    switch (archetypeFor(b)) {
+        case Archetype::Park: {
+            Rect bounds = boundsFromQuad(base);
+            double minDim = std::min(bounds.width(), bounds.height());
+            double marginFrac = 0.08;
+            double scale = std::max(0.2, 1.0 - 2.0 * marginFrac);
+            Quad lawn = scaleQuad(base, scale);
+            double padHeight = 0.08;
+            emit(lawn, 0.0, padHeight);
+            double baseScale = 0.3 + (0.2 / std::max(minDim, 1.0));
+            double planterScale = std::clamp(baseScale, 0.25, 0.65);
+            Quad planterA = scaleQuad(lawn, planterScale);
+            Quad planterB = scaleQuad(lawn, 1.0 - planterScale * 0.5);
+            double planterHeight = padHeight * 2.5;
+            emit(planterA, padHeight, padHeight + planterHeight);
+            emit(planterB, padHeight, padHeight + planterHeight);
+            break;
+        }
+        case Archetype::School: {
+            Quad field = scaleQuad(base, 0.92);
+            double fieldHeight = 0.05;
+            emit(field, 0.0, fieldHeight);
+            Quad building = scaleQuad(base, 0.55);
+            double schoolHeight = std::max(2.0, static_cast<double>(b.height));
+            emit(building, 0.0, schoolHeight);
+            break;
+        }
+        case Archetype::Hospital: {
+            Quad podium = scaleQuad(base, 0.9);
+            double podiumTop = std::max(1.2, static_cast<double>(b.height) * 0.25);
+            emit(podium, 0.0, podiumTop);
+            Quad main = scaleQuad(base, 0.65);
+            double mainTop = std::max(podiumTop + 2.0, static_cast<double>(b.height));
+            emit(main, podiumTop, mainTop);
+            Quad wing = scaleQuad(base, 0.45);
+            double wingTop = std::max(podiumTop + 1.2, mainTop * 0.9);
+            emit(wing, podiumTop, wingTop);
+            break;
+        }
+        case Archetype::Standard:
+        default: {
+            double h = std::max(1.0, static_cast<double>(b.height));
+            emit(base, 0.0, h);
+            break;
+        }
+    }
+}
+
+/// Oriented quad covering a road segment's carriageway.  Returns false for
+/// degenerate (zero-length) segments.
+inline bool roadQuad(const RoadSegment &road, Quad &out) {
+    double dx = road.x2 - road.x1;
+    double dy = road.y2 - road.y1;
+    double len = std::sqrt(dx * dx + dy * dy);
+    if (len < 1e-6) return false;
+    double invLen = 1.0 / len;
+    double nx = -dy * invLen;
+    double ny = dx * invLen;
+    double halfWidth = 0.5 * roadWidth(road.type);
+    double hx = nx * halfWidth;
+    double hy = ny * halfWidth;
+    out = {{
+        {road.x1 + hx, road.y1 + hy},
+        {road.x1 - hx, road.y1 - hy},
+        {road.x2 - hx, road.y2 - hy},
+        {road.x2 + hx, road.y2 + hy}
+    }};
+    return true;
+}
+
+/// Axis-aligned footprint used for roads in glTF output: the box spanned
+/// by opposite corners of a roadQuad() carriageway.
+inline Rect roadRectFromQuad(const Quad &q) {
+    Rect out{q[0].first, q[0].second, q[2].first, q[2].second};
+    // Base rectangle might flip if hx/hy reorder bounds; normalise bounds.
+    if (out.x0 > out.x1) std::swap(out.x0, out.x1);
+    if (out.y0 > out.y1) std::swap(out.y0, out.y1);
+    return out;
+}
+
+/// roadRectFromQuad() of a segment.  Returns false for degenerate segments.
+inline bool roadRect(const RoadSegment &road, Rect &out) {
+    Quad q;
+    if (!roadQuad(road, q)) return false;
+    out = roadRectFromQuad(q);
+    return true;
+}
+
+/// One extruded quad of a building.
+struct Prism {
+    Quad base;
+    double baseZ;
+    double topZ;
+    Archetype archetype; ///< Of the building it belongs to
+};
+
+/**
+ * @brief The prism decomposition of a whole city, shared by the exporters.
+ *
+ * Prisms are grouped by palette slot, in building order within a slot,
+ * which is the order both OBJ and glTF emit them in.  A counting pass
+ * over building chunks sizes every slot exactly; a second pass then fills
+ * the chunks' disjoint ranges in parallel.  Roads are kept as carriageway
+ * quads (roadQuad()), in road order, skipping degenerate segments.
+ */
+class CityGeometry {
+public:
+    /// Decompose @p city on up to @p threads workers (0 = all cores).
+    CityGeometry(const City &city, int threads);
+
+    const std::vector<Prism> &prisms(std::size_t slot) const { return prisms_[slot]; }
+    const std::vector<Quad> &roads() const { return roads_; }
+
+    /// Heap bytes of the prism and carriageway arrays.
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage;
+        for (const auto &slot : prisms_) usage.add(slot);
+        return usage.add(roads_);
+    }
+
+private:
+    std::array<std::vector<Prism>, kMaterialCount> prisms_;
+    std::vector<Quad> roads_;
+};
+
+struct Vec3 {
+    double x;
+    double y;
+    double z;
+};
+
+// Map internal coordinates (X horizontal, Y horizontal, Z up) into glTF's
+// Y‑up convention (X/Z ground plane, +Y up).
+inline Vec3 toGltfCoords(double x, double y, double z) {
+    return {x, z, y};
+}
+
+/// Indexed triangle soup for one material.  Faces are independent quads
+/// (four vertices, six indices).
+struct MeshBuffer {
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<std::uint32_t> indices;
+
+    MemoryUsage memoryUsage() const { return MemoryUsage().add(positions).add(normals).add(indices); }
+};
+
+/// A prism is six faces of four vertices and two triangles each.
+constexpr std::size_t kPrismVertices = 24;
+constexpr std::size_t kPrismIndices = 36;
+
+/// Size @p buf for @p prisms prisms.
+inline void resizeForPrisms(MeshBuffer &buf, std::size_t prisms) {
+    buf.positions.resize(prisms * kPrismVertices * 3);
+    buf.normals.resize(prisms * kPrismVertices * 3);
+    buf.indices.resize(prisms * kPrismIndices);
+}
+
+// Write flat-shaded quad face @p face of prism @p prism.  The four corners
+// are shared by the face's two triangles (a, b, c) and (a, c, d); corners
+// are not shared with neighbouring faces because their normals differ.
+inline void writeQuadFace(MeshBuffer &buf, std::size_t prism, std::size_t face,
+                          const Vec3 &a, const Vec3 &b, const Vec3 &c, const Vec3 &d,
+                          const Vec3 &n) {
+    std::size_t vertex = prism * kPrismVertices + face * 4;
+    float *pos = buf.positions.data() + vertex * 3;
+    float *nrm = buf.normals.data() + vertex * 3;
+    for (const Vec3 *p : {&a, &b, &c, &d}) {
+        *pos++ = static_cast<float>(p->x);
+        *pos++ = static_cast<float>(p->y);
+        *pos++ = static_cast<float>(p->z);
+        *nrm++ = static_cast<float>(n.x);
+        *nrm++ = static_cast<float>(n.y);
+        *nrm++ = static_cast<float>(n.z);
+    }
+    std::uint32_t *idx = buf.indices.data() + prism * kPrismIndices + face * 6;
+    const auto base = static_cast<std::uint32_t>(vertex);
+    for (std::uint32_t i : {0u, 1u, 2u, 0u, 2u, 3u}) {
+        *idx++ = base + i;
+    }
+}
+
+/**
+ * @brief Write a prism as prism number @p prism of @p buf, which must
+ * already be sized for it (resizeForPrisms()).
+ *
+ * Writes touch only that prism's vertex and index ranges, so distinct
+ * prisms can be written concurrently.
+ */
+inline void writeQuadPrism(MeshBuffer &buf, std::size_t prism, const Quad &q,
+                           double baseZ, double topZ) {
+    Vec3 p0 = toGltfCoords(q[0].first, q[0].second, baseZ);
+    Vec3 p1 = toGltfCoords(q[1].first, q[1].second, baseZ);
+    Vec3 p2 = toGltfCoords(q[2].first, q[2].second, baseZ);
+    Vec3 p3 = toGltfCoords(q[3].first, q[3].second, baseZ);
+    Vec3 p4 = toGltfCoords(q[0].first, q[0].second, topZ);
+    Vec3 p5 = toGltfCoords(q[1].first, q[1].second, topZ);
+    Vec3 p6 = toGltfCoords(q[2].first, q[2].second, topZ);
+    Vec3 p7 = toGltfCoords(q[3].first, q[3].second, topZ);
+    const Vec3 nDown{0.0, -1.0, 0.0};
+    const Vec3 nUp{0.0, 1.0, 0.0};
+    const Vec3 nPosX{1.0, 0.0, 0.0};
+    const Vec3 nNegX{-1.0, 0.0, 0.0};
+    const Vec3 nPosZ{0.0, 0.0, 1.0};
+    const Vec3 nNegZ{0.0, 0.0, -1.0};
+    // bottom
+    writeQuadFace(buf, prism, 0, p0, p3, p2, p1, nDown);
+    // top
+    writeQuadFace(buf, prism, 1, p4, p5, p6, p7, nUp);
+    // +X
+    writeQuadFace(buf, prism, 2, p1, p2, p6, p5, nPosX);
+    // -X
+    writeQuadFace(buf, prism, 3, p3, p0, p4, p7, nNegX);
+    // +Z (internal +Y)
+    writeQuadFace(buf, prism, 4, p2, p3, p7, p6, nPosZ);
+    // -Z (internal -Y)
+    writeQuadFace(buf, prism, 5, p0, p1, p5, p4, nNegZ);
+}
+
+/// Append a prism to @p buf, which must hold prisms only.
+inline void appendQuadPrism(MeshBuffer &buf, const Quad &q, double baseZ, double topZ) {
+    std::size_t prism = buf.indices.size() / kPrismIndices;
+    resizeForPrisms(buf, prism + 1);
+    writeQuadPrism(buf, prism, q, baseZ, topZ);
+}
+
+inline void appendRectPrism(MeshBuffer &buf, const Rect &r,
+                            double baseZ, double topZ) {
+    appendQuadPrism(buf, rectToQuad(r), baseZ, topZ);
+}
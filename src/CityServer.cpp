@@ -0,0 +1,578 @@
+#include "CityServer.h"
+
+#include "BatchGenerator.h"
+#include "City.h"
+#include "IncrementalCityGenerator.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define CITYGEN_HAVE_SOCKETS 1
+#endif
+
+struct CityServer::Entry {
+    std::shared_future<std::shared_ptr<const City>> city;
+    std::list<std::string>::iterator lruPos;
+    double generateMs = 0.0;
+    std::mutex outputMutex; ///< Guards the outputs map, not the encodes
+    /// Encoded bodies per output key, each filled by its first request.
+    std::map<std::string, std::shared_future<std::shared_ptr<const std::string>>> outputs;
+};
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Limits on one request.
+constexpr std::size_t kMaxHeaderBytes = 64 * 1024;
+constexpr std::size_t kMaxBodyBytes = 1024 * 1024;
+// Idle keep-alive connections are closed after this long.
+constexpr int kIdleSeconds = 30;
+// Connections beyond this are refused with 503.
+constexpr std::size_t kMaxConnections = 256;
+
+double msSince(Clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+std::string escapeJson(const std::string &s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += static_cast<unsigned char>(c) < 0x20 ? ' ' : c;
+    }
+    return out;
+}
+
+ServerResponse errorResponse(int status, const std::string &message) {
+    ServerResponse r;
+    r.status = status;
+    r.body = std::make_shared<const std::string>("{\"error\":\"" + escapeJson(message) + "\"}\n");
+    return r;
+}
+
+// Decode %XX escapes and '+' in a query component.
+std::string urlDecode(const std::string &s) {
+    std::string out;
+    for (std::size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '+') {
+            out += ' ';
+        } else if (s[i] == '%' && i + 2 < s.size() && std::isxdigit(static_cast<unsigned char>(s[i + 1])) &&
+                   std::isxdigit(static_cast<unsigned char>(s[i + 2]))) {
+            out += static_cast<char>(std::strtol(s.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        } else {
+            out += s[i];
+        }
+    }
+    return out;
+}
+
+BatchGenerator::Fields parseQuery(const std::string &query) {
+    BatchGenerator::Fields fields;
+    std::size_t begin = 0;
+    while (begin < query.size()) {
+        std::size_t end = query.find('&', begin);
+        if (end == std::string::npos) end = query.size();
+        std::string pair = query.substr(begin, end - begin);
+        if (!pair.empty()) {
+            std::size_t eq = pair.find('=');
+            fields.emplace_back(urlDecode(pair.substr(0, eq)),
+                                eq == std::string::npos ? std::string("true") : urlDecode(pair.substr(eq + 1)));
+        }
+        begin = end + 1;
+    }
+    return fields;
+}
+
+// The Config fields IncrementalCityGenerator keys its stages on, which
+// are all that generation reads.
+std::string cacheKey(const Config &cfg) {
+    std::ostringstream key;
+    key << cfg.seed << ' ' << cfg.grid_size << ' ' << std::hexfloat << cfg.city_radius << ' '
+        << cfg.population << ' ' << static_cast<int>(cfg.layout) << ' '
+        << static_cast<int>(cfg.rng_mode) << ' ' << static_cast<int>(cfg.green_mode) << ' '
+        << cfg.hospitals << ' ' << cfg.schools << ' ' << static_cast<int>(cfg.transport_mode);
+    return key.str();
+}
+
+GltfExportOptions glbOptions(const Config &cfg) {
+    GltfExportOptions options;
+    options.binary = true;
+    options.instancing = cfg.gltf_instancing;
+    options.lod = cfg.gltf_lod;
+    options.quantize = cfg.gltf_quantize;
+    options.meshopt = cfg.gltf_meshopt;
+    options.threads = cfg.threads;
+    return options;
+}
+
+const char *reasonPhrase(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 503: return "Service Unavailable";
+        default: return "Internal Server Error";
+    }
+}
+
+} // namespace
+
+CityServer::CityServer(ServerOptions options) : options_(std::move(options)) {
+    std::size_t count = resolveThreadCount(options_.workers);
+    for (std::size_t i = 0; i < count; ++i) {
+        workers_.push_back(std::make_unique<IncrementalCityGenerator>());
+    }
+    busy_.assign(count, false);
+    options_.cacheEntries = std::max<std::size_t>(options_.cacheEntries, 1);
+}
+
+CityServer::~CityServer() {
+    stop();
+    std::unique_lock<std::mutex> lock(connectionMutex_);
+    connectionsDone_.wait(lock, [&]() { return connections_ == 0; });
+#ifdef CITYGEN_HAVE_SOCKETS
+    if (listenFd_ >= 0) ::close(listenFd_);
+    if (!unixPath_.empty()) ::unlink(unixPath_.c_str());
+#endif
+}
+
+std::size_t CityServer::acquireWorker(const Config &cfg) {
+    std::unique_lock<std::mutex> lock(workerMutex_);
+    for (;;) {
+        // Prefer the idle worker whose cached stages cover most of cfg.
+        std::size_t best = workers_.size();
+        std::size_t bestStages = 4;
+        for (std::size_t i = 0; i < workers_.size(); ++i) {
+            if (busy_[i]) continue;
+            std::size_t stages = std::bitset<3>(workers_[i]->pendingStages(cfg)).count();
+            if (stages < bestStages) {
+                best = i;
+                bestStages = stages;
+            }
+        }
+        if (best < workers_.size()) {
+            busy_[best] = true;
+            return best;
+        }
+        workerFree_.wait(lock);
+    }
+}
+
+void CityServer::releaseWorker(std::size_t worker) {
+    {
+        std::lock_guard<std::mutex> lock(workerMutex_);
+        busy_[worker] = false;
+    }
+    workerFree_.notify_one();
+}
+
+std::shared_ptr<CityServer::Entry> CityServer::lookup(const Config &cfg, std::string &cache) {
+    const std::string key = cacheKey(cfg);
+    std::promise<std::shared_ptr<const City>> promise;
+    std::shared_ptr<Entry> entry;
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex_);
+        auto it = cache_.find(key);
+        if (it != cache_.end()) {
+            entry = it->second;
+            lru_.splice(lru_.begin(), lru_, entry->lruPos);
+            bool ready = entry->city.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+            cache = ready ? "hit" : "coalesced";
+            (ready ? hits_ : coalesced_)++;
+            return entry;
+        }
+        entry = std::make_shared<Entry>();
+        entry->city = promise.get_future().share();
+        lru_.push_front(key);
+        entry->lruPos = lru_.begin();
+        cache_.emplace(key, entry);
+        // Evicted entries stay alive for requests still holding them.
+        while (cache_.size() > options_.cacheEntries) {
+            cache_.erase(lru_.back());
+            lru_.pop_back();
+        }
+    }
+    cache = "miss";
+    misses_++;
+    std::size_t worker = acquireWorker(cfg);
+    const auto t0 = Clock::now();
+    try {
+        std::shared_ptr<const City> city = workers_[worker]->generate(cfg);
+        unsigned stages = workers_[worker]->lastStages();
+        releaseWorker(worker);
+        for (int s = 0; s < 3; ++s) {
+            if (stages & (1u << s)) stageRuns_[s]++;
+        }
+        entry->generateMs = msSince(t0);
+        promise.set_value(std::move(city));
+    } catch (...) {
+        releaseWorker(worker);
+        promise.set_exception(std::current_exception());
+        // Failures are not cached.
+        std::lock_guard<std::mutex> lock(cacheMutex_);
+        auto it = cache_.find(key);
+        if (it != cache_.end() && it->second == entry) {
+            lru_.erase(entry->lruPos);
+            cache_.erase(it);
+        }
+    }
+    return entry;
+}
+
+std::string CityServer::statsJson() {
+    std::size_t entries = 0;
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex_);
+        entries = cache_.size();
+    }
+    std::ostringstream out;
+    out << "{\"requests\":" << requests_ << ",\"hits\":" << hits_ << ",\"misses\":" << misses_
+        << ",\"coalesced\":" << coalesced_ << ",\"entries\":" << entries
+        << ",\"capacity\":" << options_.cacheEntries << ",\"workers\":" << workers_.size()
+        << ",\"zoningRuns\":" << stageRuns_[0] << ",\"layoutRuns\":" << stageRuns_[1]
+        << ",\"facilityRuns\":" << stageRuns_[2] << "}\n";
+    return out.str();
+}
+
+ServerResponse CityServer::handle(const std::string &method, const std::string &target,
+                                  const std::string &body) {
+    requests_++;
+    std::size_t q = target.find('?');
+    const std::string path = target.substr(0, q);
+    const std::string query = q == std::string::npos ? std::string() : target.substr(q + 1);
+    if (path != "/summary" && path != "/glb" && path != "/stats") {
+        return errorResponse(404, "unknown endpoint " + path);
+    }
+    if (method != "GET" && method != "POST") return errorResponse(405, "use GET or POST");
+    if (path == "/stats") {
+        ServerResponse r;
+        r.body = std::make_shared<const std::string>(statsJson());
+        return r;
+    }
+    Config cfg;
+    try {
+        BatchGenerator::Fields fields = parseQuery(query);
+        if (method == "POST" && body.find_first_not_of(" \t\r\n") != std::string::npos) {
+            std::string object = body.substr(0, body.find_last_not_of(" \t\r\n") + 1);
+            for (auto &f : BatchGenerator::parseFields(object)) fields.push_back(std::move(f));
+        }
+        cfg = BatchGenerator::configFromFields(fields, options_.defaults);
+    } catch (const std::invalid_argument &e) {
+        return errorResponse(400, e.what());
+    }
+    cfg.normalize();
+    // Workers generate side by side, so each city and its encodings run on
+    // one thread, whatever --threads the server was started with.
+    cfg.threads = 1;
+
+    ServerResponse r;
+    std::shared_ptr<Entry> entry = lookup(cfg, r.cache);
+    std::shared_ptr<const City> city;
+    try {
+        city = entry->city.get();
+    } catch (const std::exception &e) {
+        return errorResponse(500, e.what());
+    }
+    r.generateMs = r.cache == "miss" ? entry->generateMs : 0.0;
+    const bool glb = path == "/glb";
+    const GltfExportOptions options = glbOptions(cfg);
+    std::string outputKey = "summary";
+    if (glb) {
+        outputKey = std::string("glb") + (options.instancing ? "i" : "") + (options.lod ? "l" : "") +
+                    (options.quantize ? "q" : "") + (options.meshopt ? "m" : "");
+    }
+    const auto t0 = Clock::now();
+    // Each output is encoded once; requests for it wait on its future, so
+    // a slow encode never holds up the other outputs of the city.
+    std::promise<std::shared_ptr<const std::string>> promise;
+    std::shared_future<std::shared_ptr<const std::string>> output;
+    bool encode = false;
+    {
+        std::lock_guard<std::mutex> lock(entry->outputMutex);
+        auto it = entry->outputs.find(outputKey);
+        if (it != entry->outputs.end()) {
+            output = it->second;
+        } else {
+            output = promise.get_future().share();
+            entry->outputs.emplace(outputKey, output);
+            encode = true;
+        }
+    }
+    if (encode) {
+        try {
+            auto bytes = std::make_shared<std::string>();
+            if (glb) {
+                city->writeGLB(*bytes, options);
+            } else {
+                std::ostringstream summary;
+                city->writeSummary(summary, nullptr, nullptr, cfg.threads);
+                *bytes = summary.str();
+            }
+            promise.set_value(std::move(bytes));
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+            // Failures are not cached.
+            std::lock_guard<std::mutex> lock(entry->outputMutex);
+            entry->outputs.erase(outputKey);
+        }
+    }
+    try {
+        r.body = output.get();
+    } catch (const std::exception &e) {
+        return errorResponse(500, e.what());
+    }
+    r.encodeMs = msSince(t0);
+    r.contentType = glb ? "model/gltf-binary" : "application/json";
+    return r;
+}
+
+#ifdef CITYGEN_HAVE_SOCKETS
+
+namespace {
+
+// Write all of @p pieces; false once the peer is gone.
+bool sendAll(int fd, iovec *pieces, int count) {
+    while (count > 0) {
+        ssize_t n = ::writev(fd, pieces, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        auto done = static_cast<std::size_t>(n);
+        while (count > 0 && done >= pieces->iov_len) {
+            done -= pieces->iov_len;
+            ++pieces;
+            --count;
+        }
+        if (count > 0) {
+            pieces->iov_base = static_cast<char *>(pieces->iov_base) + done;
+            pieces->iov_len -= done;
+        }
+    }
+    return true;
+}
+
+bool sendResponse(int fd, const ServerResponse &r, bool keepAlive) {
+    std::ostringstream head;
+    head << "HTTP/1.1 " << r.status << ' ' << reasonPhrase(r.status) << "\r\n"
+         << "Content-Type: " << r.contentType << "\r\n"
+         << "Content-Length: " << (r.body ? r.body->size() : 0) << "\r\n";
+    if (!r.cache.empty()) {
+        head << "X-Citygen-Cache: " << r.cache << "\r\n"
+             << "Server-Timing: generate;dur=" << r.generateMs << ", encode;dur=" << r.encodeMs << "\r\n";
+    }
+    head << "Connection: " << (keepAlive ? "keep-alive" : "close") << "\r\n\r\n";
+    std::string header = head.str();
+    iovec pieces[2] = {{header.data(), header.size()}, {nullptr, 0}};
+    if (r.body && !r.body->empty()) {
+        pieces[1] = {const_cast<char *>(r.body->data()), r.body->size()};
+    }
+    return sendAll(fd, pieces, pieces[1].iov_len ? 2 : 1);
+}
+
+std::string lowercase(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+} // namespace
+
+std::string CityServer::bind() {
+    std::string spec = options_.listen;
+    if (spec.rfind("unix:", 0) == 0 || spec.find('/') != std::string::npos) {
+        std::string path = spec.rfind("unix:", 0) == 0 ? spec.substr(5) : spec;
+        sockaddr_un addr{};
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            throw std::invalid_argument("Invalid Unix socket path: " + path);
+        }
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        listenFd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd_ < 0) throw std::runtime_error("cannot create socket");
+        ::unlink(path.c_str());
+        if (::bind(listenFd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+            ::listen(listenFd_, SOMAXCONN) != 0) {
+            throw std::runtime_error("cannot listen on " + path + ": " + std::strerror(errno));
+        }
+        tcp_ = false;
+        unixPath_ = path;
+        return "unix:" + path;
+    }
+    std::string host = "127.0.0.1";
+    std::string port = spec;
+    std::size_t colon = spec.rfind(':');
+    if (colon != std::string::npos) {
+        host = spec.substr(0, colon);
+        port = spec.substr(colon + 1);
+    }
+    char *end = nullptr;
+    long portNumber = std::strtol(port.c_str(), &end, 10);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    if (port.empty() || *end != '\0' || portNumber < 0 || portNumber > 65535 ||
+        ::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        throw std::invalid_argument("Invalid listen address: " + spec);
+    }
+    addr.sin_port = htons(static_cast<std::uint16_t>(portNumber));
+    listenFd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd_ < 0) throw std::runtime_error("cannot create socket");
+    int on = 1;
+    ::setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (::bind(listenFd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+        ::listen(listenFd_, SOMAXCONN) != 0) {
+        throw std::runtime_error("cannot listen on " + spec + ": " + std::strerror(errno));
+    }
+    socklen_t len = sizeof(addr);
+    ::getsockname(listenFd_, reinterpret_cast<sockaddr *>(&addr), &len);
+    return host + ":" + std::to_string(ntohs(addr.sin_port));
+}
+
+void CityServer::run() {
+    if (listenFd_ < 0) bind();
+    // A client hanging up mid-response must not kill the server.
+    ::signal(SIGPIPE, SIG_IGN);
+    while (!stopping_) {
+        int fd = ::accept(listenFd_, nullptr, nullptr);
+        if (fd < 0) {
+            if (stopping_) break;
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10)); // e.g. out of descriptors
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(connectionMutex_);
+            if (connections_ >= kMaxConnections) {
+                sendResponse(fd, errorResponse(503, "too many connections"), false);
+                ::close(fd);
+                continue;
+            }
+            ++connections_;
+        }
+        std::thread([this, fd]() {
+            serveConnection(fd, tcp_);
+            ::close(fd);
+            std::lock_guard<std::mutex> lock(connectionMutex_);
+            if (--connections_ == 0) connectionsDone_.notify_all();
+        }).detach();
+    }
+    std::unique_lock<std::mutex> lock(connectionMutex_);
+    connectionsDone_.wait(lock, [&]() { return connections_ == 0; });
+}
+
+void CityServer::stop() {
+    if (stopping_.exchange(true)) return;
+    // Wakes the blocked accept().
+    if (listenFd_ >= 0) ::shutdown(listenFd_, SHUT_RDWR);
+}
+
+void CityServer::serveConnection(int fd, bool tcp) {
+    timeval timeout{kIdleSeconds, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (tcp) {
+        int on = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    std::string buffer;
+    char chunk[16384];
+    auto fill = [&]() {
+        ssize_t n;
+        do {
+            n = ::recv(fd, chunk, sizeof(chunk), 0);
+        } while (n < 0 && errno == EINTR && !stopping_);
+        if (n <= 0) return false;
+        buffer.append(chunk, static_cast<std::size_t>(n));
+        return true;
+    };
+    while (!stopping_) {
+        std::size_t headerEnd;
+        while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+            if (buffer.size() > kMaxHeaderBytes) {
+                sendResponse(fd, errorResponse(431, "request header too large"), false);
+                return;
+            }
+            if (!fill()) return;
+        }
+        std::istringstream head(buffer.substr(0, headerEnd));
+        std::string method, target, version, line;
+        head >> method >> target >> version;
+        std::getline(head, line);
+        std::size_t contentLength = 0;
+        bool keepAlive = version == "HTTP/1.1";
+        while (std::getline(head, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            std::size_t colon = line.find(':');
+            if (colon == std::string::npos) continue;
+            std::string name = lowercase(line.substr(0, colon));
+            std::size_t start = line.find_first_not_of(" \t", colon + 1);
+            std::string value = start == std::string::npos ? std::string() : line.substr(start);
+            if (name == "content-length") {
+                contentLength = std::strtoull(value.c_str(), nullptr, 10);
+            } else if (name == "connection") {
+                value = lowercase(value);
+                if (value == "close") keepAlive = false;
+                if (value == "keep-alive") keepAlive = true;
+            }
+        }
+        if (method.empty() || target.empty() || version.rfind("HTTP/1.", 0) != 0) {
+            sendResponse(fd, errorResponse(400, "malformed request line"), false);
+            return;
+        }
+        if (contentLength > kMaxBodyBytes) {
+            sendResponse(fd, errorResponse(413, "request body too large"), false);
+            return;
+        }
+        const std::size_t bodyStart = headerEnd + 4;
+        while (buffer.size() < bodyStart + contentLength) {
+            if (!fill()) return;
+        }
+        std::string body = buffer.substr(bodyStart, contentLength);
+        buffer.erase(0, bodyStart + contentLength);
+        ServerResponse response = handle(method, target, body);
+        if (!sendResponse(fd, response, keepAlive) || !keepAlive) return;
+    }
+}
+
+#else
+
+std::string CityServer::bind() {
+    throw std::runtime_error("--serve needs POSIX sockets");
+}
+
+void CityServer::run() {
+    bind();
+}
+
+void CityServer::stop() {
+    stopping_ = true;
+}
+
+void CityServer::serveConnection(int, bool) {}
+
+#endif
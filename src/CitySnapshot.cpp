@@ -0,0 +1,300 @@
+#include "CitySnapshot.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CITYGEN_HAVE_MMAP 1
+#endif
+
+static_assert(sizeof(SnapshotBlock) == 104, "SnapshotBlock must have no implicit padding");
+static_assert(sizeof(SnapshotRoad) == 40, "SnapshotRoad must have no implicit padding");
+static_assert(sizeof(SnapshotFacility) == 24, "SnapshotFacility must have no implicit padding");
+static_assert(sizeof(Rect) == 32 && sizeof(std::array<Vec2, 4>) == 64,
+              "geometry columns are written as plain doubles");
+static_assert(std::is_trivially_copyable<Rect>::value, "Rect must be trivially copyable");
+
+namespace {
+
+constexpr char kMagic[8] = {'C', 'I', 'T', 'Y', 'S', 'N', 'A', 'P'};
+constexpr std::size_t kHeaderSize = 24;
+constexpr std::size_t kEntrySize = 24;
+constexpr std::uint32_t kNoCorners = 0xFFFFFFFFu;
+
+bool hostIsLittleEndian() {
+    const std::uint16_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+std::size_t alignUp(std::size_t n) {
+    return (n + 7) & ~static_cast<std::size_t>(7);
+}
+
+template <class T>
+void putScalar(std::vector<unsigned char> &out, std::size_t at, T value) {
+    std::memcpy(out.data() + at, &value, sizeof(T));
+}
+
+template <class T>
+T getScalar(const unsigned char *at) {
+    T value;
+    std::memcpy(&value, at, sizeof(T));
+    return value;
+}
+
+// One array to be written: id, element size and raw bytes.
+struct PendingSection {
+    std::uint32_t id;
+    std::uint32_t elementSize;
+    const void *data;
+    std::size_t count;
+};
+
+std::size_t expectedElementSize(std::uint32_t id) {
+    switch (id) {
+        case CitySnapshot::Zones:
+        case CitySnapshot::BuildingZones:
+        case CitySnapshot::BuildingFlags: return 1;
+        case CitySnapshot::BuildingHeights:
+        case CitySnapshot::BuildingCornerSlots: return 4;
+        case CitySnapshot::BuildingFootprints: return sizeof(Rect);
+        case CitySnapshot::BuildingCorners: return sizeof(std::array<Vec2, 4>);
+        case CitySnapshot::Blocks: return sizeof(SnapshotBlock);
+        case CitySnapshot::Roads: return sizeof(SnapshotRoad);
+        case CitySnapshot::Facilities: return sizeof(SnapshotFacility);
+        default: return 0;
+    }
+}
+
+} // namespace
+
+void CitySnapshot::write(const City &city, const std::string &path) {
+    if (!hostIsLittleEndian()) {
+        throw std::runtime_error("city snapshots can only be written on little-endian hosts");
+    }
+    const BuildingStore &b = city.buildings;
+    std::vector<SnapshotBlock> blocks(city.blocks.size());
+    for (std::size_t i = 0; i < blocks.size(); ++i) {
+        blocks[i] = SnapshotBlock{city.blocks[i].bounds, city.blocks[i].corners,
+                                  static_cast<std::uint8_t>(city.blocks[i].hasCorners), {}};
+    }
+    std::vector<SnapshotRoad> roads(city.roads().size());
+    for (std::size_t i = 0; i < roads.size(); ++i) {
+        const RoadSegment &r = city.roads()[i];
+        roads[i] = SnapshotRoad{r.x1, r.y1, r.x2, r.y2, static_cast<std::int32_t>(r.type), 0};
+    }
+    std::vector<SnapshotFacility> facilities(city.facilities.size());
+    for (std::size_t i = 0; i < facilities.size(); ++i) {
+        const Facility &f = city.facilities[i];
+        facilities[i] = SnapshotFacility{f.x, f.y, static_cast<std::uint8_t>(f.type), {}};
+    }
+    const PendingSection sections[] = {
+        {Zones, 1, city.zones.data(), city.zones.size()},
+        {BuildingFootprints, sizeof(Rect), b.footprints_.data(), b.footprints_.size()},
+        {BuildingZones, 1, b.zones_.data(), b.zones_.size()},
+        {BuildingHeights, 4, b.heights_.data(), b.heights_.size()},
+        {BuildingFlags, 1, b.flags_.data(), b.flags_.size()},
+        {BuildingCornerSlots, 4, b.cornerSlot_.data(), b.cornerSlot_.size()},
+        {BuildingCorners, sizeof(std::array<Vec2, 4>), b.corners_.data(), b.corners_.size()},
+        {Blocks, sizeof(SnapshotBlock), blocks.data(), blocks.size()},
+        {Roads, sizeof(SnapshotRoad), roads.data(), roads.size()},
+        {Facilities, sizeof(SnapshotFacility), facilities.data(), facilities.size()},
+    };
+    const std::size_t sectionCount = sizeof(sections) / sizeof(sections[0]);
+    // Header and section table first, then the payload arrays.
+    std::vector<unsigned char> head(alignUp(kHeaderSize + sectionCount * kEntrySize), 0);
+    std::memcpy(head.data(), kMagic, sizeof(kMagic));
+    putScalar<std::uint32_t>(head, 8, kVersion);
+    putScalar<std::uint32_t>(head, 12, static_cast<std::uint32_t>(sectionCount));
+    putScalar<std::int32_t>(head, 16, city.size);
+    std::size_t offset = head.size();
+    for (std::size_t i = 0; i < sectionCount; ++i) {
+        std::size_t at = kHeaderSize + i * kEntrySize;
+        putScalar<std::uint32_t>(head, at, sections[i].id);
+        putScalar<std::uint32_t>(head, at + 4, sections[i].elementSize);
+        putScalar<std::uint64_t>(head, at + 8, offset);
+        putScalar<std::uint64_t>(head, at + 16, sections[i].count);
+        offset = alignUp(offset + sections[i].count * sections[i].elementSize);
+    }
+    std::ofstream ofs(path, std::ios::binary);
+    if (!ofs) throw std::runtime_error("cannot create snapshot " + path);
+    ofs.write(reinterpret_cast<const char *>(head.data()), static_cast<std::streamsize>(head.size()));
+    static const char zeros[8] = {};
+    for (const auto &s : sections) {
+        std::size_t bytes = s.count * s.elementSize;
+        if (bytes) ofs.write(static_cast<const char *>(s.data), static_cast<std::streamsize>(bytes));
+        ofs.write(zeros, static_cast<std::streamsize>(alignUp(bytes) - bytes));
+    }
+    if (!ofs) throw std::runtime_error("failed writing snapshot " + path);
+}
+
+CitySnapshot::CitySnapshot(const std::string &path) {
+#ifdef CITYGEN_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("cannot open snapshot " + path);
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("cannot stat snapshot " + path);
+    }
+    size_ = static_cast<std::size_t>(st.st_size);
+    if (size_ > 0) {
+        void *p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            base_ = static_cast<const unsigned char *>(p);
+            mapped_ = true;
+        }
+    }
+    ::close(fd);
+#endif
+    if (!mapped_) {
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs) throw std::runtime_error("cannot open snapshot " + path);
+        fallback_.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+        base_ = fallback_.data();
+        size_ = fallback_.size();
+    }
+    try {
+        validate(path);
+    } catch (...) {
+        release();
+        throw;
+    }
+}
+
+CitySnapshot::~CitySnapshot() {
+    release();
+}
+
+void CitySnapshot::release() {
+#ifdef CITYGEN_HAVE_MMAP
+    if (mapped_) ::munmap(const_cast<unsigned char *>(base_), size_);
+#endif
+    mapped_ = false;
+    base_ = nullptr;
+}
+
+void CitySnapshot::validate(const std::string &path) {
+    auto bad = [&](const std::string &why) {
+        return std::runtime_error("invalid snapshot " + path + ": " + why);
+    };
+    if (!hostIsLittleEndian()) throw bad("little-endian host required");
+    if (size_ < kHeaderSize || std::memcmp(base_, kMagic, sizeof(kMagic)) != 0) {
+        throw bad("not a city snapshot");
+    }
+    std::uint32_t version = getScalar<std::uint32_t>(base_ + 8);
+    if (version == 0 || version > kVersion) {
+        throw bad("unsupported version " + std::to_string(version));
+    }
+    std::uint32_t sectionCount = getScalar<std::uint32_t>(base_ + 12);
+    gridSize_ = getScalar<std::int32_t>(base_ + 16);
+    if (gridSize_ < 0) throw bad("negative grid size");
+    if (sectionCount > (size_ - kHeaderSize) / kEntrySize) throw bad("truncated section table");
+    bool seen[Facilities + 1] = {};
+    for (std::uint32_t i = 0; i < sectionCount; ++i) {
+        const unsigned char *at = base_ + kHeaderSize + i * kEntrySize;
+        std::uint32_t id = getScalar<std::uint32_t>(at);
+        Entry e;
+        e.elementSize = getScalar<std::uint32_t>(at + 4);
+        e.offset = getScalar<std::uint64_t>(at + 8);
+        e.count = getScalar<std::uint64_t>(at + 16);
+        if (id == 0 || id > Facilities) continue; // newer section; ignore
+        if (seen[id]) throw bad("duplicate section " + std::to_string(id));
+        if (e.elementSize != expectedElementSize(id)) throw bad("unexpected element size");
+        if (e.offset % 8 != 0 || e.offset > size_ ||
+            e.count > (size_ - e.offset) / e.elementSize) {
+            throw bad("section " + std::to_string(id) + " out of bounds");
+        }
+        entries_[id] = e;
+        seen[id] = true;
+    }
+    for (std::uint32_t id = Zones; id <= Facilities; ++id) {
+        if (!seen[id]) throw bad("missing section " + std::to_string(id));
+    }
+    // Counts that other code indexes by.
+    std::uint64_t buildings = entries_[BuildingFootprints].count;
+    if (entries_[Zones].count != static_cast<std::uint64_t>(gridSize_) * gridSize_) {
+        throw bad("zone grid does not match grid size");
+    }
+    for (std::uint32_t id : {BuildingZones, BuildingHeights, BuildingFlags, BuildingCornerSlots}) {
+        if (entries_[id].count != buildings) throw bad("building columns differ in length");
+    }
+    // Enumerations and corner slots must be in range before they are used
+    // as table indices by the exporters.
+    auto checkZones = [&](Array<ZoneType> zones) {
+        for (ZoneType z : zones) {
+            if (static_cast<std::uint8_t>(z) > static_cast<std::uint8_t>(ZoneType::Green)) {
+                throw bad("zone value out of range");
+            }
+        }
+    };
+    checkZones(zones());
+    checkZones(buildingZones());
+    std::uint64_t storedCorners = entries_[BuildingCorners].count;
+    for (std::uint32_t slot : section<std::uint32_t>(BuildingCornerSlots)) {
+        if (slot != kNoCorners && slot >= storedCorners) throw bad("corner slot out of range");
+    }
+    for (const SnapshotRoad &r : roads()) {
+        if (r.type < 0 || r.type > static_cast<std::int32_t>(RoadType::Local)) {
+            throw bad("road type out of range");
+        }
+    }
+    for (const SnapshotFacility &f : facilities()) {
+        if (f.type > static_cast<std::uint8_t>(Facility::Type::School)) {
+            throw bad("facility type out of range");
+        }
+    }
+}
+
+City CitySnapshot::toCity() const {
+    City city(0);
+    city.size = gridSize_;
+    Array<ZoneType> z = zones();
+    city.zones.assign(z.begin(), z.end());
+    BuildingStore &b = city.buildings;
+    Array<Rect> footprints = buildingFootprints();
+    Array<ZoneType> buildingZoneColumn = buildingZones();
+    Array<std::int32_t> heights = buildingHeights();
+    Array<std::uint8_t> flags = section<std::uint8_t>(BuildingFlags);
+    Array<std::uint32_t> slots = section<std::uint32_t>(BuildingCornerSlots);
+    Array<std::array<Vec2, 4>> corners = section<std::array<Vec2, 4>>(BuildingCorners);
+    b.footprints_.assign(footprints.begin(), footprints.end());
+    b.zones_.assign(buildingZoneColumn.begin(), buildingZoneColumn.end());
+    b.heights_.assign(heights.begin(), heights.end());
+    b.flags_.assign(flags.begin(), flags.end());
+    b.cornerSlot_.assign(slots.begin(), slots.end());
+    b.corners_.assign(corners.begin(), corners.end());
+    city.blocks.reserve(blocks().count);
+    for (const SnapshotBlock &s : blocks()) {
+        Block blk;
+        blk.bounds = s.bounds;
+        blk.corners = s.corners;
+        blk.hasCorners = s.hasCorners != 0;
+        city.blocks.push_back(blk);
+    }
+    std::vector<RoadSegment> roadSegments;
+    roadSegments.reserve(roads().count);
+    for (const SnapshotRoad &s : roads()) {
+        roadSegments.push_back({s.x1, s.y1, s.x2, s.y2, static_cast<RoadType>(s.type)});
+    }
+    city.setRoads(std::move(roadSegments));
+    city.facilities.reserve(facilities().count);
+    for (const SnapshotFacility &s : facilities()) {
+        Facility f;
+        f.x = s.x;
+        f.y = s.y;
+        f.type = static_cast<Facility::Type>(s.type);
+        city.facilities.push_back(f);
+    }
+    city.buildRoadIndex();
+    return city;
+}
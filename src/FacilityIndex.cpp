@@ -0,0 +1,65 @@
+#include "City.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Ranges this small are scanned linearly instead of split further.
+constexpr std::size_t kLeafSize = 8;
+
+} // namespace
+
+void FacilityIndex::build(const std::vector<Facility> &facilities, Facility::Type type) {
+    points_.clear();
+    for (const auto &f : facilities) {
+        if (f.type == type) points_.push_back({f.x, f.y});
+    }
+    buildRange(0, points_.size(), 0);
+}
+
+void FacilityIndex::buildRange(std::size_t begin, std::size_t end, int axis) {
+    if (end - begin <= kLeafSize) return;
+    std::size_t mid = begin + (end - begin) / 2;
+    std::nth_element(points_.begin() + begin, points_.begin() + mid, points_.begin() + end,
+                     [axis](const Vec2 &a, const Vec2 &b) {
+                         return axis == 0 ? a.x < b.x : a.y < b.y;
+                     });
+    buildRange(begin, mid, axis ^ 1);
+    buildRange(mid + 1, end, axis ^ 1);
+}
+
+void FacilityIndex::search(std::size_t begin, std::size_t end, int axis,
+                           double x, double y, double &bestSq) const {
+    if (end - begin <= kLeafSize) {
+        for (std::size_t i = begin; i < end; ++i) {
+            double dx = x - points_[i].x;
+            double dy = y - points_[i].y;
+            bestSq = std::min(bestSq, dx * dx + dy * dy);
+        }
+        return;
+    }
+    std::size_t mid = begin + (end - begin) / 2;
+    const Vec2 &p = points_[mid];
+    double dx = x - p.x;
+    double dy = y - p.y;
+    bestSq = std::min(bestSq, dx * dx + dy * dy);
+    double delta = axis == 0 ? dx : dy;
+    // Descend into the side holding the query first; the far side can only
+    // help if the splitting line is closer than the best match so far.
+    if (delta < 0.0) {
+        search(begin, mid, axis ^ 1, x, y, bestSq);
+        if (delta * delta < bestSq) search(mid + 1, end, axis ^ 1, x, y, bestSq);
+    } else {
+        search(mid + 1, end, axis ^ 1, x, y, bestSq);
+        if (delta * delta < bestSq) search(begin, mid, axis ^ 1, x, y, bestSq);
+    }
+}
+
+double FacilityIndex::nearestDistance(double x, double y) const {
+    if (points_.empty()) return -1.0;
+    double bestSq = std::numeric_limits<double>::max();
+    search(0, points_.size(), 0, x, y, bestSq);
+    return std::sqrt(bestSq);
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "City.h"
+#include "Config.h"
+#include "Random.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <vector>
+
+class Trace;
+
+/**
+ * @file GeneratorStages.h
+ *
+ * The stages of CityGenerator::generate, exposed so that incremental
+ * generation can cache and re-run them separately.  Each stage reads only
+ * the Config fields listed below, which is what makes caching sound:
+ *
+ *   zoneCity        seed, grid_size, city_radius
+ *   layoutCity      + population, layout, rng_mode
+ *   placeFacilities + hospitals, schools, transport_mode
+ *
+ * Thread count never changes the result.
+ *
+ * The building blocks of those stages follow.  They take their zoning from
+ * a ZoneField rather than a City so that StreamingCityGenerator can run the
+ * same code without ever materialising the grid.
+ */
+
+/// Stage 1: fill city.zones from noise.  @p city must be sized to grid_size.
+void zoneCity(const Config &cfg, City &city, Trace *trace);
+
+/// Stage 2: green space, roads, blocks, parcels, road index and the
+/// facility candidate order.  Expects a zoned city without buildings.
+/// With @p memory, the scratch arrays of the green, parcels and
+/// facilityCandidates steps are recorded as generation stages.
+void layoutCity(const Config &cfg, City &city, std::vector<std::size_t> &facilityOrder,
+                Trace *trace, MemoryReport *memory = nullptr);
+
+/// Stage 3: imprint the configured hospitals and schools on the first
+/// free parcels of @p facilityOrder.  Expects a city without facilities.
+void placeFacilities(const Config &cfg, City &city, const std::vector<std::size_t> &facilityOrder,
+                     Trace *trace);
+
+/// Engine threaded through the green and sequential parcel stages.
+using LayoutRng = CountingEngine<std::mt19937>;
+
+/// Zone row @p y into row[0..grid_size).  @p values is scratch space.
+void zoneRow(const Config &cfg, int y, ZoneType *row, std::vector<double> &values);
+
+/// Zone of a single cell before green conversion; equals the value
+/// zoneRow() stores for it.
+ZoneType zoneCell(const Config &cfg, int x, int y);
+
+/// Cells converted to green space are picked among these zones.
+inline bool isGreenCandidate(ZoneType z) {
+    return z == ZoneType::Residential || z == ZoneType::Industrial;
+}
+
+/**
+ * @brief Read access to the final zoning, either from a zoned City or
+ * recomputed per cell from noise plus the list of converted green cells.
+ */
+class ZoneField {
+public:
+    explicit ZoneField(const City &city) : city_(&city), size_(city.size) {}
+
+    /// Pointwise field.  @p greenCells holds the sorted row-major indices
+    /// of converted cells; @p allCandidatesGreen converts every candidate.
+    /// Both referenced objects must outlive the field.
+    ZoneField(const Config &cfg, const std::vector<std::uint64_t> &greenCells,
+              bool allCandidatesGreen)
+        : cfg_(&cfg), greenCells_(&greenCells), allGreen_(allCandidatesGreen),
+          size_(cfg.grid_size) {}
+
+    int size() const { return size_; }
+
+    ZoneType at(int x, int y) const {
+        return city_ ? city_->zoneAt(x, y) : computeAt(x, y);
+    }
+
+private:
+    ZoneType computeAt(int x, int y) const;
+
+    const City *city_ = nullptr;
+    const Config *cfg_ = nullptr;
+    const std::vector<std::uint64_t> *greenCells_ = nullptr;
+    bool allGreen_ = false;
+    int size_ = 0;
+};
+
+/// Green cells the population calls for (8 m² per inhabitant).
+std::uint64_t greenTargetCells(const Config &cfg);
+
+/**
+ * @brief Pick min(@p count, @p candidates) distinct candidate ranks for
+ * green conversion (GreenMode::Sample).
+ *
+ * Returns the ranks in ascending order, or an empty vector when every
+ * candidate is converted.  Draws from @p rng once per picked rank.
+ */
+std::vector<std::uint64_t> sampleGreenRanks(std::uint64_t candidates, std::uint64_t count,
+                                            LayoutRng &rng);
+
+/// Roads and blocks of the street layout, before parcelization.
+struct StreetPlan {
+    /// Polar extent of a radial-layout block.
+    struct Wedge { double r0, r1, a0, a1; };
+
+    std::vector<RoadSegment> roads;
+    std::vector<Block> blocks;
+    std::vector<Wedge> wedges; ///< Radial layout: one per block
+};
+
+/// Lay out roads and blocks for cfg.layout.  Reads no zoning and no RNG.
+void planStreets(const Config &cfg, StreetPlan &plan, Trace *trace);
+
+/// Output adapter forwarding each parcelized building to a callback.
+struct BuildingSink {
+    std::function<void(const Building &)> fn;
+    void push_back(const Building &b) { fn(b); }
+};
+
+/**
+ * @brief Parcelize block @p blockIdx of @p plan and append its buildings
+ * to @p out in generation order.
+ *
+ * Instantiated for LayoutRng and Philox4x32 with BuildingStore,
+ * std::vector<Building> and BuildingSink outputs.  Returns the number of
+ * parcels cut, including those that produced no building.
+ */
+template <class Rng, class Out>
+std::size_t parcelizeStreetBlock(const Config &cfg, const StreetPlan &plan, std::size_t blockIdx,
+                                 const ZoneField &zones, Rng &rng, Out &out);
+
+/// A facility site candidate: building index and distance to the roads.
+struct ParcelCandidate {
+    std::size_t idx;
+    double roadDistance;
+};
+
+/// Order facility candidates, best first: parcels within reach of a road
+/// before interior ones, each group by road distance with ties broken by
+/// a shuffle drawn from @p rng.
+void orderFacilityCandidates(const std::vector<ParcelCandidate> &candidates, LayoutRng &rng,
+                             std::vector<std::size_t> &facilityOrder);
+
+/// Storeys of a facility imprinted on a parcel with this footprint.
+int facilityHeight(Facility::Type type, const Rect &footprint);
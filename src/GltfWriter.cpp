@@ -0,0 +1,572 @@
+#include "GltfWriter.h"
+
+#include "Meshopt.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#define CITYGEN_HAVE_WRITEV 1
+#endif
+
+namespace {
+
+const char kZeros[4] = {0, 0, 0, 0};
+
+constexpr int kFloat = 5126;
+constexpr int kByte = 5120;
+constexpr int kUnsignedShort = 5123;
+// Quantized positions span [0, kPositionSteps] per axis.
+constexpr double kPositionSteps = 65535.0;
+// Element sizes padded to the 4-byte vertex stride glTF requires.
+constexpr std::size_t kQuantizedPositionStride = 4 * sizeof(std::uint16_t);
+constexpr std::size_t kQuantizedNormalStride = 4;
+
+// Quantized position along one axis with the dequantizing translation @p t
+// and scale @p s.  Monotonic, so quantizing bounds gives quantized bounds.
+std::uint16_t quantizePosition(double p, double t, double s) {
+    return static_cast<std::uint16_t>(std::clamp(std::round((p - t) / s), 0.0, kPositionSteps));
+}
+
+std::size_t align4(std::size_t n) {
+    return (n + 3) / 4 * 4;
+}
+
+// Writes a file from (data, length) pieces that stay alive until finish().
+// With writev the pieces go to the kernel in batches without being copied
+// into a staging buffer; elsewhere each one is passed to fwrite.
+class GatherWriter {
+public:
+    explicit GatherWriter(const std::string &path) {
+#ifdef CITYGEN_HAVE_WRITEV
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ok_ = fd_ >= 0;
+#else
+        file_ = std::fopen(path.c_str(), "wb");
+        ok_ = file_ != nullptr;
+#endif
+    }
+    ~GatherWriter() { finish(); }
+    GatherWriter(const GatherWriter &) = delete;
+    GatherWriter &operator=(const GatherWriter &) = delete;
+
+    bool isOpen() const { return ok_; }
+
+    void add(const void *data, std::size_t len) {
+        if (!ok_ || len == 0) return;
+#ifdef CITYGEN_HAVE_WRITEV
+        if (pieces_.size() == kMaxPieces) flush();
+        pieces_.push_back({const_cast<void *>(data), len});
+#else
+        ok_ = std::fwrite(data, 1, len, file_) == len;
+#endif
+    }
+
+    /// Write everything queued and close the file; false on any failure.
+    bool finish() {
+#ifdef CITYGEN_HAVE_WRITEV
+        if (fd_ >= 0) {
+            flush();
+            ok_ = (::close(fd_) == 0) && ok_;
+            fd_ = -1;
+        }
+#else
+        if (file_) {
+            ok_ = (std::fclose(file_) == 0) && ok_;
+            file_ = nullptr;
+        }
+#endif
+        return ok_;
+    }
+
+private:
+#ifdef CITYGEN_HAVE_WRITEV
+    // Stays well below IOV_MAX (1024 on Linux and macOS).
+    static constexpr std::size_t kMaxPieces = 512;
+
+    void flush() {
+        std::size_t first = 0;
+        while (ok_ && first < pieces_.size()) {
+            ssize_t n = ::writev(fd_, pieces_.data() + first,
+                                 static_cast<int>(pieces_.size() - first));
+            if (n < 0) {
+                ok_ = false;
+                break;
+            }
+            // Skip fully written pieces and trim a partially written one.
+            std::size_t done = static_cast<std::size_t>(n);
+            while (first < pieces_.size() && done >= pieces_[first].iov_len) {
+                done -= pieces_[first++].iov_len;
+            }
+            if (done > 0) {
+                pieces_[first].iov_base = static_cast<char *>(pieces_[first].iov_base) + done;
+                pieces_[first].iov_len -= done;
+            }
+        }
+        pieces_.clear();
+    }
+
+    int fd_ = -1;
+    std::vector<iovec> pieces_;
+#else
+    std::FILE *file_ = nullptr;
+#endif
+    bool ok_ = false;
+};
+
+template <class Seq, class Fn>
+void writeArray(std::ostringstream &oss, const char *key, const Seq &items, Fn &&fn) {
+    oss << "\"" << key << "\":[";
+    for (std::size_t i = 0; i < items.size(); ++i) {
+        if (i) oss << ",";
+        fn(items[i]);
+    }
+    oss << "]";
+}
+
+} // namespace
+
+std::size_t GltfDocument::addBufferViewRef(const void *data, std::size_t len, int target) {
+    std::size_t offset = align4(binSize_);
+    views_.push_back({offset, len, target, static_cast<const std::uint8_t *>(data)});
+    binSize_ = offset + len;
+    return views_.size() - 1;
+}
+
+std::uint8_t *GltfDocument::allocateBufferView(std::size_t len, int target) {
+    std::vector<std::uint8_t> &storage = owned_.emplace_back(len);
+    addBufferViewRef(storage.data(), len, target);
+    return storage.data();
+}
+
+std::size_t GltfDocument::addElementView(const void *data, std::size_t count, std::size_t stride,
+                                         int target) {
+    if (!encoding_.meshopt) return addBufferViewRef(data, count * stride, target);
+    bool indices = target == kElementArrayBuffer;
+    std::vector<std::uint8_t> &stream = owned_.emplace_back(
+        indices ? meshoptEncodeIndices(static_cast<const std::uint16_t *>(data), count)
+                : meshoptEncodeAttributes(data, count, stride));
+    std::size_t index = addBufferViewRef(stream.data(), stream.size(), target);
+    View &view = views_[index];
+    view.meshoptMode = indices ? "INDICES" : "ATTRIBUTES";
+    view.count = count;
+    view.elementStride = stride;
+    // Index views must not declare a stride; the extension records it.
+    view.byteStride = indices ? 0 : stride;
+    view.fallbackOffset = align4(fallbackSize_);
+    view.fallbackLength = count * stride;
+    fallbackSize_ = view.fallbackOffset + view.fallbackLength;
+    // The fallback buffer holds no data, so decoding is mandatory.
+    useExtension("EXT_meshopt_compression", true);
+    return index;
+}
+
+std::size_t GltfDocument::addElementView(std::vector<std::uint8_t> &&bytes, std::size_t count,
+                                         std::size_t stride, int target) {
+    if (encoding_.meshopt) return addElementView(bytes.data(), count, stride, target);
+    std::vector<std::uint8_t> &storage = owned_.emplace_back(std::move(bytes));
+    std::size_t index = addBufferViewRef(storage.data(), count * stride, target);
+    views_[index].byteStride = stride;
+    return index;
+}
+
+std::size_t GltfDocument::addBufferView(const void *data, std::size_t len, int target) {
+    if (len > 0) std::memcpy(allocateBufferView(len, target), data, len);
+    else allocateBufferView(0, target);
+    return views_.size() - 1;
+}
+
+std::vector<std::pair<const void *, std::size_t>> GltfDocument::binaryPieces() const {
+    std::vector<std::pair<const void *, std::size_t>> pieces;
+    pieces.reserve(views_.size() * 2 + 1);
+    std::size_t written = 0;
+    for (const View &v : views_) {
+        if (v.offset > written) pieces.push_back({kZeros, v.offset - written});
+        pieces.push_back({v.data, v.length});
+        written = v.offset + v.length;
+    }
+    if (align4(written) > written) pieces.push_back({kZeros, align4(written) - written});
+    return pieces;
+}
+
+MemoryUsage GltfDocument::memoryUsage() const {
+    MemoryUsage usage;
+    for (const auto &bytes : owned_) usage.add(bytes);
+    return usage.add(views_).add(accessors_).add(materials_).add(meshes_).add(nodes_);
+}
+
+std::size_t GltfDocument::addAccessor(const GltfAccessor &accessor) {
+    accessors_.push_back(accessor);
+    return accessors_.size() - 1;
+}
+
+std::size_t GltfDocument::addMaterial(const MaterialDef &material) {
+    materials_.push_back(material);
+    return materials_.size() - 1;
+}
+
+std::size_t GltfDocument::addMesh(GltfMesh mesh) {
+    meshes_.push_back(std::move(mesh));
+    return meshes_.size() - 1;
+}
+
+std::size_t GltfDocument::addNode(GltfNode node) {
+    nodes_.push_back(std::move(node));
+    return nodes_.size() - 1;
+}
+
+void GltfDocument::useExtension(const std::string &name, bool required) {
+    if (std::find(extensionsUsed_.begin(), extensionsUsed_.end(), name) == extensionsUsed_.end()) {
+        extensionsUsed_.push_back(name);
+    }
+    if (required &&
+        std::find(extensionsRequired_.begin(), extensionsRequired_.end(), name) == extensionsRequired_.end()) {
+        extensionsRequired_.push_back(name);
+    }
+}
+
+int GltfDocument::addVec3Accessor(const std::vector<float> &values, int target, bool withBounds) {
+    if (values.empty()) return -1;
+    GltfAccessor acc;
+    acc.count = values.size() / 3;
+    acc.bufferView = addElementView(values.data(), acc.count, 3 * sizeof(float), target);
+    if (withBounds) {
+        acc.hasMinMax = true;
+        for (std::size_t c = 0; c < 3; ++c) acc.min[c] = acc.max[c] = values[c];
+        for (std::size_t i = 0; i < values.size(); i += 3) {
+            for (std::size_t c = 0; c < 3; ++c) {
+                acc.min[c] = std::min(acc.min[c], static_cast<double>(values[i + c]));
+                acc.max[c] = std::max(acc.max[c], static_cast<double>(values[i + c]));
+            }
+        }
+    }
+    return static_cast<int>(addAccessor(acc));
+}
+
+void GltfDocument::addQuantizedAttributes(const MeshBuffer &buf, std::size_t &posView,
+                                          std::size_t &normView, GltfNode &node) {
+    std::size_t vertexCount = buf.positions.size() / 3;
+    std::array<double, 3> lo{};
+    std::array<double, 3> hi{};
+    for (std::size_t c = 0; c < 3; ++c) lo[c] = hi[c] = buf.positions[c];
+    for (std::size_t v = 0; v < vertexCount; ++v) {
+        for (std::size_t c = 0; c < 3; ++c) {
+            lo[c] = std::min(lo[c], static_cast<double>(buf.positions[v * 3 + c]));
+            hi[c] = std::max(hi[c], static_cast<double>(buf.positions[v * 3 + c]));
+        }
+    }
+    // The transform is stored as floats, so quantize against the float
+    // values a viewer will apply.
+    node.hasTransform = true;
+    for (std::size_t c = 0; c < 3; ++c) {
+        node.translation[c] = static_cast<float>(lo[c]);
+        node.scale[c] = hi[c] > lo[c] ? static_cast<float>((hi[c] - lo[c]) / kPositionSteps) : 1.0f;
+    }
+    std::vector<std::uint8_t> positions(vertexCount * kQuantizedPositionStride, 0);
+    std::vector<std::uint8_t> normals(vertexCount * kQuantizedNormalStride, 0);
+    for (std::size_t v = 0; v < vertexCount; ++v) {
+        for (std::size_t c = 0; c < 3; ++c) {
+            std::uint16_t value = quantizePosition(buf.positions[v * 3 + c], node.translation[c], node.scale[c]);
+            std::memcpy(&positions[v * kQuantizedPositionStride + c * sizeof(value)], &value, sizeof(value));
+            double n = std::round(static_cast<double>(buf.normals[v * 3 + c]) * 127.0);
+            auto packed = static_cast<std::int8_t>(std::clamp(n, -127.0, 127.0));
+            std::memcpy(&normals[v * kQuantizedNormalStride + c], &packed, 1);
+        }
+    }
+    posView = addElementView(std::move(positions), vertexCount, kQuantizedPositionStride, kArrayBuffer);
+    normView = addElementView(std::move(normals), vertexCount, kQuantizedNormalStride, kArrayBuffer);
+    useExtension("KHR_mesh_quantization", true);
+}
+
+int GltfDocument::addMeshBuffer(const MeshBuffer &buf, const std::string &name, int material,
+                                GltfNode *node) {
+    if (buf.indices.empty() || buf.positions.empty()) return -1;
+    // Mesh buffers consist of independent quads (4 vertices, 6 indices), so
+    // they can be split at any quad boundary.  Primitives are capped below
+    // 65535 vertices, letting every one of them use 16-bit indices.
+    constexpr std::size_t kMaxPrimitiveVertices = 65532;
+    std::size_t vertexCount = buf.positions.size() / 3;
+    const bool quantized = encoding_.quantize && node;
+    std::size_t posView = 0;
+    std::size_t normView = 0;
+    if (quantized) {
+        addQuantizedAttributes(buf, posView, normView, *node);
+    } else {
+        posView = addElementView(buf.positions.data(), vertexCount, 3 * sizeof(float), kArrayBuffer);
+        normView = addElementView(buf.normals.data(), vertexCount, 3 * sizeof(float), kArrayBuffer);
+    }
+    // indices, rebased per primitive and narrowed straight into the view
+    // (or, for meshopt, into a stream to compress)
+    std::vector<std::uint16_t> stagedIndices;
+    std::uint8_t *shortIndices = nullptr;
+    if (encoding_.meshopt) {
+        stagedIndices.resize(buf.indices.size());
+        shortIndices = reinterpret_cast<std::uint8_t *>(stagedIndices.data());
+    } else {
+        shortIndices = allocateBufferView(buf.indices.size() * sizeof(std::uint16_t), kElementArrayBuffer);
+    }
+    for (std::size_t v0 = 0; v0 < vertexCount; v0 += kMaxPrimitiveVertices) {
+        std::size_t i0 = v0 / 4 * 6;
+        std::size_t i1 = std::min(vertexCount, v0 + kMaxPrimitiveVertices) / 4 * 6;
+        for (std::size_t i = i0; i < i1; ++i) {
+            std::uint16_t index = static_cast<std::uint16_t>(buf.indices[i] - v0);
+            std::memcpy(shortIndices + i * sizeof(index), &index, sizeof(index));
+        }
+    }
+    std::size_t idxView = encoding_.meshopt
+        ? addElementView(stagedIndices.data(), stagedIndices.size(), sizeof(std::uint16_t), kElementArrayBuffer)
+        : views_.size() - 1;
+    const std::size_t posStride = quantized ? kQuantizedPositionStride : 3 * sizeof(float);
+    const std::size_t normStride = quantized ? kQuantizedNormalStride : 3 * sizeof(float);
+    // Accessor bounds are in stored units: quantized steps or cells.
+    auto storedPosition = [&](std::size_t v, std::size_t c) {
+        double value = buf.positions[v * 3 + c];
+        return quantized ? quantizePosition(value, node->translation[c], node->scale[c]) : value;
+    };
+
+    GltfMesh mesh;
+    mesh.name = name;
+    for (std::size_t v0 = 0; v0 < vertexCount; v0 += kMaxPrimitiveVertices) {
+        std::size_t v1 = std::min(vertexCount, v0 + kMaxPrimitiveVertices);
+        GltfPrimitive prim;
+        prim.material = material;
+        GltfAccessor posAcc;
+        posAcc.bufferView = posView;
+        posAcc.byteOffset = v0 * posStride;
+        posAcc.count = v1 - v0;
+        posAcc.componentType = quantized ? kUnsignedShort : kFloat;
+        posAcc.hasMinMax = true;
+        for (std::size_t c = 0; c < 3; ++c) {
+            posAcc.min[c] = posAcc.max[c] = storedPosition(v0, c);
+        }
+        for (std::size_t v = v0; v < v1; ++v) {
+            for (std::size_t c = 0; c < 3; ++c) {
+                double value = storedPosition(v, c);
+                posAcc.min[c] = std::min(posAcc.min[c], value);
+                posAcc.max[c] = std::max(posAcc.max[c], value);
+            }
+        }
+        prim.positionAccessor = static_cast<int>(addAccessor(posAcc));
+        GltfAccessor normAcc;
+        normAcc.bufferView = normView;
+        normAcc.byteOffset = v0 * normStride;
+        normAcc.count = posAcc.count;
+        if (quantized) {
+            normAcc.componentType = kByte;
+            normAcc.normalized = true;
+        }
+        prim.normalAccessor = static_cast<int>(addAccessor(normAcc));
+        GltfAccessor idxAcc;
+        idxAcc.bufferView = idxView;
+        idxAcc.byteOffset = v0 / 4 * 6 * sizeof(std::uint16_t);
+        idxAcc.count = (v1 - v0) / 4 * 6;
+        idxAcc.componentType = kUnsignedShort;
+        idxAcc.type = "SCALAR";
+        prim.indexAccessor = static_cast<int>(addAccessor(idxAcc));
+        mesh.primitives.push_back(prim);
+    }
+    return static_cast<int>(addMesh(std::move(mesh)));
+}
+
+std::string GltfDocument::json(const std::string &binUri) const {
+    std::ostringstream oss;
+    oss << "{";
+    oss << "\"asset\":{\"version\":\"2.0\",\"generator\":\"citygen\"},";
+    if (!extensionsUsed_.empty()) {
+        writeArray(oss, "extensionsUsed", extensionsUsed_,
+                   [&](const std::string &e) { oss << "\"" << e << "\""; });
+        oss << ",";
+    }
+    if (!extensionsRequired_.empty()) {
+        writeArray(oss, "extensionsRequired", extensionsRequired_,
+                   [&](const std::string &e) { oss << "\"" << e << "\""; });
+        oss << ",";
+    }
+    oss << "\"scene\":0,";
+    oss << "\"scenes\":[{";
+    writeArray(oss, "nodes", sceneNodes_, [&](std::size_t n) { oss << n; });
+    oss << "}],";
+    writeArray(oss, "nodes", nodes_, [&](const GltfNode &n) {
+        oss << "{";
+        bool first = true;
+        auto sep = [&]() { if (!first) oss << ","; first = false; };
+        if (!n.name.empty()) { sep(); oss << "\"name\":\"" << n.name << "\""; }
+        if (n.mesh >= 0) { sep(); oss << "\"mesh\":" << n.mesh; }
+        if (n.hasTransform) {
+            std::streamsize oldPrecision = oss.precision(std::numeric_limits<float>::max_digits10);
+            sep();
+            oss << "\"translation\":[" << n.translation[0] << "," << n.translation[1] << ","
+                << n.translation[2] << "],\"scale\":[" << n.scale[0] << "," << n.scale[1] << ","
+                << n.scale[2] << "]";
+            oss.precision(oldPrecision);
+        }
+        if (!n.children.empty()) {
+            sep();
+            writeArray(oss, "children", n.children, [&](std::size_t c) { oss << c; });
+        }
+        if (!n.instancing.empty() || !n.lods.empty()) {
+            sep();
+            oss << "\"extensions\":{";
+            if (!n.instancing.empty()) {
+                oss << "\"EXT_mesh_gpu_instancing\":{\"attributes\":{";
+                for (std::size_t i = 0; i < n.instancing.size(); ++i) {
+                    if (i) oss << ",";
+                    oss << "\"" << n.instancing[i].first << "\":" << n.instancing[i].second;
+                }
+                oss << "}}";
+                if (!n.lods.empty()) oss << ",";
+            }
+            if (!n.lods.empty()) {
+                oss << "\"MSFT_lod\":{";
+                writeArray(oss, "ids", n.lods, [&](std::size_t id) { oss << id; });
+                oss << "}";
+            }
+            oss << "}";
+        }
+        if (!n.screenCoverage.empty()) {
+            sep();
+            oss << "\"extras\":{";
+            writeArray(oss, "MSFT_screencoverage", n.screenCoverage, [&](double c) { oss << c; });
+            oss << "}";
+        }
+        oss << "}";
+    });
+    oss << ",";
+    writeArray(oss, "materials", materials_, [&](const MaterialDef &m) {
+        oss << "{\"name\":\"" << m.name << "\",";
+        oss << "\"pbrMetallicRoughness\":{\"baseColorFactor\":["
+            << m.r << "," << m.g << "," << m.b << ",1],";
+        oss << "\"metallicFactor\":" << m.metallic << ",";
+        oss << "\"roughnessFactor\":" << m.roughness << "},";
+        oss << "\"doubleSided\":true}";
+    });
+    oss << ",";
+    writeArray(oss, "meshes", meshes_, [&](const GltfMesh &m) {
+        oss << "{\"name\":\"" << m.name << "\",";
+        writeArray(oss, "primitives", m.primitives, [&](const GltfPrimitive &p) {
+            oss << "{\"attributes\":{\"POSITION\":" << p.positionAccessor
+                << ",\"NORMAL\":" << p.normalAccessor << "},";
+            oss << "\"indices\":" << p.indexAccessor << ",";
+            oss << "\"material\":" << p.material << "}";
+        });
+        oss << "}";
+    });
+    oss << ",";
+    writeArray(oss, "accessors", accessors_, [&](const GltfAccessor &a) {
+        oss << "{\"bufferView\":" << a.bufferView;
+        if (a.byteOffset) oss << ",\"byteOffset\":" << a.byteOffset;
+        oss << ",\"componentType\":" << a.componentType;
+        if (a.normalized) oss << ",\"normalized\":true";
+        oss << ",\"count\":" << a.count
+            << ",\"type\":\"" << a.type << "\"";
+        if (a.hasMinMax) {
+            // Bounds must enclose the stored floats exactly, so print them
+            // with enough digits to round-trip a float.
+            std::streamsize oldPrecision = oss.precision(std::numeric_limits<float>::max_digits10);
+            oss << ",\"min\":[" << a.min[0] << "," << a.min[1] << "," << a.min[2] << "]";
+            oss << ",\"max\":[" << a.max[0] << "," << a.max[1] << "," << a.max[2] << "]";
+            oss.precision(oldPrecision);
+        }
+        oss << "}";
+    });
+    oss << ",";
+    writeArray(oss, "bufferViews", views_, [&](const View &v) {
+        if (!v.meshoptMode) {
+            oss << "{\"buffer\":0,"
+                << "\"byteOffset\":" << v.offset
+                << ",\"byteLength\":" << v.length;
+        } else {
+            oss << "{\"buffer\":1,"
+                << "\"byteOffset\":" << v.fallbackOffset
+                << ",\"byteLength\":" << v.fallbackLength;
+        }
+        if (v.byteStride) oss << ",\"byteStride\":" << v.byteStride;
+        if (v.target) oss << ",\"target\":" << v.target;
+        if (v.meshoptMode) {
+            oss << ",\"extensions\":{\"EXT_meshopt_compression\":{\"buffer\":0"
+                << ",\"byteOffset\":" << v.offset
+                << ",\"byteLength\":" << v.length
+                << ",\"byteStride\":" << v.elementStride
+                << ",\"mode\":\"" << v.meshoptMode << "\""
+                << ",\"count\":" << v.count << "}}";
+        }
+        oss << "}";
+    });
+    oss << ",";
+    std::size_t paddedLength = align4(binSize_);
+    oss << "\"buffers\":[{";
+    oss << "\"byteLength\":" << paddedLength;
+    if (!binUri.empty()) {
+        oss << ",\"uri\":\"" << binUri << "\"";
+    }
+    oss << "}";
+    if (fallbackSize_ > 0) {
+        oss << ",{\"byteLength\":" << align4(fallbackSize_)
+            << ",\"extensions\":{\"EXT_meshopt_compression\":{\"fallback\":true}}}";
+    }
+    oss << "]}";
+    return oss.str();
+}
+
+std::string GltfDocument::glbPrefix() const {
+    std::string json = this->json(std::string());
+    // Pad JSON to 4-byte boundary with spaces, BIN with zeros.
+    while (json.size() % 4 != 0) json.push_back(' ');
+    std::uint32_t binLength = static_cast<std::uint32_t>(align4(binSize_));
+    std::uint32_t jsonLength = static_cast<std::uint32_t>(json.size());
+    std::uint32_t totalLength = 12 // header
+        + 8 + jsonLength
+        + 8 + binLength;
+    const std::uint32_t header[5] = {
+        0x46546C67u, // "glTF"
+        2,           // version
+        totalLength,
+        jsonLength,
+        0x4E4F534Au  // JSON
+    };
+    const std::uint32_t binHeader[2] = {binLength, 0x004E4942u}; // BIN
+    std::string prefix(reinterpret_cast<const char *>(header), sizeof(header));
+    prefix += json;
+    prefix.append(reinterpret_cast<const char *>(binHeader), sizeof(binHeader));
+    return prefix;
+}
+
+bool GltfDocument::writeGLB(const std::string &path) const {
+    GatherWriter out(path);
+    if (!out.isOpen()) return false;
+    const std::string prefix = glbPrefix();
+    out.add(prefix.data(), prefix.size());
+    for (const auto &piece : binaryPieces()) out.add(piece.first, piece.second);
+    return out.finish();
+}
+
+void GltfDocument::appendGLB(std::string &out) const {
+    const std::string prefix = glbPrefix();
+    const auto pieces = binaryPieces();
+    std::size_t size = prefix.size();
+    for (const auto &piece : pieces) size += piece.second;
+    out.reserve(out.size() + size);
+    out += prefix;
+    for (const auto &piece : pieces) out.append(static_cast<const char *>(piece.first), piece.second);
+}
+
+bool GltfDocument::writeGLTF(const std::string &path, const std::string &binPath,
+                             const std::string &binUri) const {
+    GatherWriter binOut(binPath);
+    if (!binOut.isOpen()) return false;
+    for (const auto &piece : binaryPieces()) binOut.add(piece.first, piece.second);
+    if (!binOut.finish()) return false;
+    std::ofstream gltfOut(path);
+    if (!gltfOut) return false;
+    gltfOut << json(binUri);
+    gltfOut.close();
+    return static_cast<bool>(gltfOut);
+}
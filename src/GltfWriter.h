@@ -0,0 +1,182 @@
+#pragma once
+
+#include "CityMesh.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @file GltfWriter.h
+ *
+ * glTF 2.0 document: a single binary buffer plus the JSON arrays that
+ * index into it.  The exporters fill it through the add* calls and finally
+ * serialise it as GLB or as a .gltf/.bin pair.
+ *
+ * The binary buffer is never assembled in memory.  Buffer views either
+ * borrow the caller's arrays or own a copy, and the writers compute the
+ * layout up front and gather the views straight into the file (writev
+ * where available), so exporting costs no second copy of the mesh data.
+ *
+ * A GltfEncoding can store the mesh data more compactly: quantized through
+ * KHR_mesh_quantization, and each vertex, index and instance view
+ * compressed with EXT_meshopt_compression.  Compressed views reference an
+ * uncompressed layout in a second, data-less fallback buffer, as that
+ * extension requires.
+ */
+
+/// Optional compact encodings of a document's mesh data.
+struct GltfEncoding {
+    /// KHR_mesh_quantization: baked positions as 16-bit integers over the
+    /// mesh's bounding box, dequantized by the node transform, and normals
+    /// as normalized bytes.
+    bool quantize = false;
+    /// EXT_meshopt_compression for every vertex, index and instance view.
+    bool meshopt = false;
+};
+
+struct GltfAccessor {
+    std::size_t bufferView = 0;
+    std::size_t byteOffset = 0;
+    std::size_t count = 0;
+    int componentType = 5126;
+    bool normalized = false;
+    std::string type = "VEC3";
+    bool hasMinMax = false;
+    std::array<double, 3> min{};
+    std::array<double, 3> max{};
+};
+
+struct GltfPrimitive {
+    int positionAccessor = -1;
+    int normalAccessor = -1;
+    int indexAccessor = -1;
+    int material = -1;
+};
+
+struct GltfMesh {
+    std::string name;
+    std::vector<GltfPrimitive> primitives;
+};
+
+struct GltfNode {
+    std::string name;
+    int mesh = -1;
+    std::vector<std::size_t> children;
+    /// Translation and scale, e.g. to dequantize mesh positions.
+    bool hasTransform = false;
+    std::array<double, 3> translation{};
+    std::array<double, 3> scale{1.0, 1.0, 1.0};
+    /// EXT_mesh_gpu_instancing attributes (semantic, accessor); empty when
+    /// the node is not instanced.
+    std::vector<std::pair<std::string, int>> instancing;
+    /// MSFT_lod: lower-detail alternatives of this node, finest first, and
+    /// the MSFT_screencoverage thresholds of this node and each of them.
+    std::vector<std::size_t> lods;
+    std::vector<double> screenCoverage;
+};
+
+class GltfDocument {
+public:
+    static constexpr int kArrayBuffer = 34962;
+    static constexpr int kElementArrayBuffer = 34963;
+
+    explicit GltfDocument(const GltfEncoding &encoding = GltfEncoding()) : encoding_(encoding) {}
+
+    /// Append a copy of @p len bytes (4-byte aligned) as a new buffer view;
+    /// a target of 0 leaves the view untargeted (e.g. instance attributes).
+    std::size_t addBufferView(const void *data, std::size_t len, int target);
+    /// Like addBufferView() but without copying: @p data must stay alive
+    /// and unchanged until the document has been written.
+    std::size_t addBufferViewRef(const void *data, std::size_t len, int target);
+    std::size_t addAccessor(const GltfAccessor &accessor);
+    std::size_t addMaterial(const MaterialDef &material);
+    std::size_t addMesh(GltfMesh mesh);
+    std::size_t addNode(GltfNode node);
+    void addSceneNode(std::size_t node) { sceneNodes_.push_back(node); }
+    void useExtension(const std::string &name, bool required = false);
+
+    /**
+     * @brief Add a mesh holding the quads of @p buf with material @p material.
+     *
+     * The quads are split into primitives of fewer than 65535 vertices so
+     * every primitive uses 16-bit indices.  Positions and normals are
+     * borrowed, so @p buf must outlive the write.  Returns -1 for empty
+     * buffers.
+     *
+     * With GltfEncoding::quantize, a mesh placed by @p node is stored
+     * quantized and @p node receives the dequantizing transform; without
+     * a node the attributes stay float.
+     */
+    int addMeshBuffer(const MeshBuffer &buf, const std::string &name, int material,
+                      GltfNode *node = nullptr);
+
+    /// Float VEC3 accessor over @p values (three floats per element), which
+    /// are borrowed like addBufferViewRef() unless meshopt compresses them.
+    int addVec3Accessor(const std::vector<float> &values, int target, bool withBounds);
+
+    /// Serialise the JSON part; @p binUri is omitted from the buffer when empty.
+    std::string json(const std::string &binUri) const;
+
+    bool writeGLB(const std::string &path) const;
+    /// Append the bytes writeGLB() would write to @p out.
+    void appendGLB(std::string &out) const;
+    /// Write @p path (JSON) and @p binPath, which the JSON references as
+    /// @p binUri.
+    bool writeGLTF(const std::string &path, const std::string &binPath,
+                   const std::string &binUri) const;
+
+    std::size_t binarySize() const { return binSize_; }
+
+    /// Heap bytes of the document's own storage: copied and encoded views
+    /// and the JSON-side tables.  Borrowed views are not included.
+    MemoryUsage memoryUsage() const;
+
+private:
+    struct View {
+        std::size_t offset;
+        std::size_t length;
+        int target;
+        const std::uint8_t *data;
+        std::size_t byteStride = 0; ///< 0: tightly packed, not written
+        /// EXT_meshopt_compression: data holds the compressed stream and
+        /// the view itself spans fallbackLength bytes of the fallback buffer.
+        const char *meshoptMode = nullptr;
+        std::size_t count = 0;
+        std::size_t elementStride = 0;
+        std::size_t fallbackOffset = 0;
+        std::size_t fallbackLength = 0;
+    };
+
+    /// Reserve a view of @p len bytes backed by document-owned storage.
+    std::uint8_t *allocateBufferView(std::size_t len, int target);
+    /// View of @p count elements of @p stride bytes, borrowed from @p data
+    /// or, with meshopt, compressed into document-owned storage.
+    std::size_t addElementView(const void *data, std::size_t count, std::size_t stride, int target);
+    /// addElementView() over bytes the document takes ownership of.
+    std::size_t addElementView(std::vector<std::uint8_t> &&bytes, std::size_t count,
+                               std::size_t stride, int target);
+    void addQuantizedAttributes(const MeshBuffer &buf, std::size_t &posView, std::size_t &normView,
+                                GltfNode &node);
+    /// GLB header, JSON chunk and BIN chunk header.
+    std::string glbPrefix() const;
+    /// The padded binary buffer as (data, length) pieces in file order.
+    std::vector<std::pair<const void *, std::size_t>> binaryPieces() const;
+
+    GltfEncoding encoding_;
+    std::size_t binSize_ = 0;
+    std::size_t fallbackSize_ = 0;
+    std::vector<View> views_;
+    std::deque<std::vector<std::uint8_t>> owned_; ///< Storage of copied views
+    std::vector<GltfAccessor> accessors_;
+    std::vector<MaterialDef> materials_;
+    std::vector<GltfMesh> meshes_;
+    std::vector<GltfNode> nodes_;
+    std::vector<std::size_t> sceneNodes_;
+    std::vector<std::string> extensionsUsed_;
+    std::vector<std::string> extensionsRequired_;
+};
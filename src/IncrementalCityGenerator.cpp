@@ -0,0 +1,56 @@
+#include "IncrementalCityGenerator.h"
+
+#include "GeneratorStages.h"
+#include "Trace.h"
+
+std::shared_ptr<const City> IncrementalCityGenerator::generate(const Config &cfg, Trace *trace) {
+    Trace::Scope total(trace, "generate");
+    const ZoningKey zoningKey{cfg.seed, cfg.grid_size, cfg.city_radius};
+    const LayoutKey layoutKey{cfg.population, cfg.layout, cfg.rng_mode, cfg.green_mode};
+    const FacilityKey facilityKey{cfg.hospitals, cfg.schools, cfg.transport_mode};
+    lastStages_ = 0;
+    if (!haveZoning_ || !(zoningKey_ == zoningKey)) {
+        zoned_ = City(cfg.grid_size);
+        zoneCity(cfg, zoned_, trace);
+        zoningKey_ = zoningKey;
+        haveZoning_ = true;
+        haveLayout_ = false;
+        lastStages_ |= Zoning;
+    }
+    if (!haveLayout_ || !(layoutKey_ == layoutKey)) {
+        laidOut_ = zoned_;
+        layoutCity(cfg, laidOut_, facilityOrder_, trace);
+        layoutKey_ = layoutKey;
+        haveLayout_ = true;
+        result_.reset();
+        lastStages_ |= Layout;
+    }
+    if (!result_ || !(facilityKey_ == facilityKey)) {
+        auto city = std::make_shared<City>(laidOut_);
+        placeFacilities(cfg, *city, facilityOrder_, trace);
+        facilityKey_ = facilityKey;
+        result_ = std::move(city);
+        lastStages_ |= Facilities;
+    }
+    return result_;
+}
+
+unsigned IncrementalCityGenerator::pendingStages(const Config &cfg) const {
+    const ZoningKey zoningKey{cfg.seed, cfg.grid_size, cfg.city_radius};
+    const LayoutKey layoutKey{cfg.population, cfg.layout, cfg.rng_mode, cfg.green_mode};
+    const FacilityKey facilityKey{cfg.hospitals, cfg.schools, cfg.transport_mode};
+    if (!haveZoning_ || !(zoningKey_ == zoningKey)) return Zoning | Layout | Facilities;
+    if (!haveLayout_ || !(layoutKey_ == layoutKey)) return Layout | Facilities;
+    if (!result_ || !(facilityKey_ == facilityKey)) return Facilities;
+    return 0;
+}
+
+void IncrementalCityGenerator::clear() {
+    haveZoning_ = false;
+    haveLayout_ = false;
+    zoned_ = City();
+    laidOut_ = City();
+    facilityOrder_.clear();
+    result_.reset();
+    lastStages_ = 0;
+}
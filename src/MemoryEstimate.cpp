@@ -0,0 +1,165 @@
+#include "CityGenerator.h"
+#include "CityMesh.h"
+#include "GeneratorStages.h"
+#include "OutputBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Parcels of one subdivideRect() call: it stops splitting at depth 7.
+constexpr std::size_t kMaxParcelsPerStrip = 128;
+// Grid blocks split into four courtyard strips, radial wedges into one.
+constexpr std::size_t kGridStripsPerBlock = 4;
+// Parcels are at least 3 x 3 cells.
+constexpr double kMinParcelCells = 9.0;
+// Fewest cells per parcel assumed on average; both layouts measure more
+// than twice this on every size, radius and population tried.
+constexpr double kCellsPerParcel = 24.0;
+// Prisms per building: most buildings are one prism, parks and
+// facilities two or three.
+constexpr double kPrismsPerBuilding = 1.5;
+// Allocation of an array grown by push_back, relative to its size.
+constexpr std::size_t kGrowth = 2;
+constexpr double kPi = 3.14159265358979323846;
+// Cells per side of the lattice sampled for natural green space.
+constexpr int kGreenSampleSide = 128;
+
+// Columns of BuildingStore per building, without the corner table.
+constexpr std::size_t kStoreBytes =
+    sizeof(Rect) + sizeof(ZoneType) + sizeof(int) + sizeof(std::uint8_t) + sizeof(std::uint32_t);
+// Baked glTF prism: float positions and normals plus 32-bit indices.
+constexpr std::size_t kBakedPrismBytes = kPrismVertices * 6 * sizeof(float) + kPrismIndices * 4;
+// Instanced glTF prism: a float translation and scale.
+constexpr std::size_t kInstancePrismBytes = 6 * sizeof(float);
+
+double blockArea(const StreetPlan &plan, std::size_t i) {
+    if (i < plan.wedges.size()) {
+        const StreetPlan::Wedge &w = plan.wedges[i];
+        return 0.5 * (w.r1 * w.r1 - w.r0 * w.r0) * (w.a1 - w.a0);
+    }
+    const Rect &b = plan.blocks[i].bounds;
+    return b.width() * b.height();
+}
+
+// Bytes a GltfDocument owns per baked prism: the 16-bit index copy and
+// the quantized attributes or, with meshopt, the streams alone.  The
+// encoders reserve half the attribute input and a byte per index, which
+// is more than the streams take on city meshes.
+std::size_t documentPrismBytes(const Config &cfg) {
+    std::size_t attributes = kPrismVertices * (cfg.gltf_quantize ? 12 : 6 * sizeof(float));
+    if (cfg.gltf_meshopt) return attributes / 2 + kPrismIndices;
+    return kPrismIndices * sizeof(std::uint16_t) + (cfg.gltf_quantize ? attributes : 0);
+}
+
+// Green cells before conversion, extrapolated from a lattice of cells.
+std::uint64_t sampledGreenCells(const Config &cfg) {
+    const int step = std::max(1, cfg.grid_size / kGreenSampleSide);
+    std::uint64_t green = 0;
+    for (int y = step / 2; y < cfg.grid_size; y += step) {
+        for (int x = step / 2; x < cfg.grid_size; x += step) {
+            green += zoneCell(cfg, x, y) == ZoneType::Green;
+        }
+    }
+    return green * static_cast<std::uint64_t>(step) * static_cast<std::uint64_t>(step);
+}
+
+} // namespace
+
+MemoryEstimate CityGenerator::estimateMemory(const Config &cfg) {
+    MemoryEstimate estimate;
+    const std::size_t cells = static_cast<std::size_t>(std::max(cfg.grid_size, 0)) *
+                              static_cast<std::size_t>(std::max(cfg.grid_size, 0));
+    const double radius = cfg.grid_size * cfg.city_radius / 2.0;
+    const auto zonedCells = std::min(cells, static_cast<std::size_t>(std::ceil(kPi * radius * radius)));
+
+    // Streets read neither zoning nor the RNG, so plan them for real; the
+    // road index and graph are cheap to build from them.
+    StreetPlan plan;
+    planStreets(cfg, plan, nullptr);
+    const bool radial = !plan.wedges.empty();
+    std::size_t buildings = 0;
+    for (std::size_t i = 0; i < plan.blocks.size(); ++i) {
+        // Every strip rounds its parcel count up.
+        std::size_t strips = radial ? 1 : kGridStripsPerBlock;
+        auto byArea = static_cast<std::size_t>(std::ceil(blockArea(plan, i) / kCellsPerParcel)) + strips;
+        buildings += std::min(kMaxParcelsPerStrip * strips, byArea);
+    }
+    estimate.buildings = buildings;
+    RoadIndex roadIndex;
+    roadIndex.build(plan.roads, cfg.grid_size);
+    RoadGraph graph;
+    graph.build(plan.roads, cfg.grid_size, &roadIndex);
+    const std::size_t roads = plan.roads.size();
+    const std::size_t facilities = std::size_t(cfg.hospitals) + cfg.schools;
+
+    // City containers.  Radial buildings all need a corner quad.
+    std::size_t perBuilding = kStoreBytes + (radial ? sizeof(std::array<Vec2, 4>) : 0);
+    estimate.city = cells * sizeof(ZoneType) + buildings * perBuilding * kGrowth +
+                    facilities * sizeof(Facility) * kGrowth + plan.roads.capacity() * sizeof(RoadSegment) +
+                    plan.blocks.size() * sizeof(Block) + roadIndex.memoryUsage().capacity;
+
+    // Generation: the largest of the green, parcels and facility scratch.
+    // Green conversion only runs when natural green space falls short of
+    // the target; the sample must cover twice the target to rule it out.
+    std::uint64_t green = std::min<std::uint64_t>(greenTargetCells(cfg), zonedCells);
+    std::size_t greenBytes = 0;
+    if (green > 0 && sampledGreenCells(cfg) < 2 * green) {
+        greenBytes = cfg.green_mode == Config::GreenMode::Shuffle
+                         ? zonedCells * sizeof(std::size_t)
+                         : static_cast<std::size_t>(green) * 4 * sizeof(std::uint64_t); // ranks + set
+    }
+    std::size_t parcelBytes = cfg.rng_mode == Config::RngMode::PerBlock
+                                  ? buildings * sizeof(Building) * kGrowth +
+                                        plan.blocks.size() * sizeof(std::vector<Building>)
+                                  : 0;
+    std::size_t candidateBytes = buildings * (sizeof(ParcelCandidate) + sizeof(std::size_t));
+    estimate.generate = std::max({greenBytes, parcelBytes, candidateBytes});
+
+    // Export: prisms shared by the writers, then each writer's transients.
+    const auto prisms = static_cast<std::size_t>(std::ceil(buildings * kPrismsPerBuilding)) + 2 * facilities;
+    const bool instanced = cfg.gltf_instancing && !radial;
+    const std::size_t scenePrism = instanced ? kInstancePrismBytes : kBakedPrismBytes;
+    const std::size_t documentPrism = instanced ? (cfg.gltf_meshopt ? kInstancePrismBytes : 0)
+                                                : documentPrismBytes(cfg);
+    // Summary: two distances and a centre per residential building, the
+    // travel times of finish(), the graph and per-node minutes per type.
+    std::size_t summary = buildings * (4 * sizeof(double) * kGrowth + 4 * sizeof(double)) +
+                          graph.memoryUsage().capacity + 2 * graph.nodeCount() * sizeof(double) * kGrowth;
+    std::size_t exporting = summary;
+    if (cfg.tile_size > 0.0) {
+        // One tile at a time, plus the building and road lists per tile.
+        auto tilesPerSide = static_cast<std::size_t>(
+            std::max(1.0, std::ceil(cfg.grid_size / cfg.tile_size)));
+        // Parcel centres in a tile: small tiles are bounded by the
+        // smallest parcel rather than the average one.
+        double reach = cfg.tile_size + 3.0;
+        std::size_t tileBuildings = std::min(
+            buildings, static_cast<std::size_t>(std::ceil(reach * reach / kMinParcelCells)));
+        std::size_t tilePrisms = static_cast<std::size_t>(std::ceil(tileBuildings * kPrismsPerBuilding)) + roads;
+        exporting += tilePrisms * (scenePrism * kGrowth + documentPrism);
+        exporting += 2 * tilesPerSide * tilesPerSide * sizeof(std::vector<std::size_t>) +
+                     buildings * sizeof(std::size_t) * kGrowth +
+                     roads * tilesPerSide * sizeof(std::size_t) * kGrowth + roads * sizeof(Rect);
+    } else {
+        exporting += prisms * sizeof(Prism) + roads * sizeof(Quad);
+        std::size_t documents = 0;
+        for (Config::ExportFormat format : exportFormats(cfg)) {
+            if (format == Config::ExportFormat::OBJ) {
+                exporting += OutputBuffer::kDefaultCapacity;
+            } else {
+                ++documents;
+            }
+        }
+        if (documents > 0) {
+            std::size_t scenePrisms = prisms + roads;
+            exporting += scenePrisms * scenePrism;
+            // The coarse level: a mass per block and the simplified roads.
+            if (cfg.gltf_lod) exporting += (plan.blocks.size() + roads) * kBakedPrismBytes * kGrowth;
+            exporting += documents * scenePrisms * documentPrism;
+        }
+    }
+    estimate.exportPeak = exporting;
+    return estimate;
+}
@@ -0,0 +1,167 @@
+#include "MemoryReport.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <iomanip>
+
+namespace {
+
+void writeUsageJson(std::ostream &out, const MemoryUsage &usage) {
+    out << "{\"bytes\": " << usage.bytes << ", \"capacity\": " << usage.capacity << "}";
+}
+
+void writeComponentsJson(std::ostream &out, const std::vector<MemoryComponent> &components,
+                         const MemoryUsage &total, const std::string &indent) {
+    out << "{";
+    for (const auto &c : components) {
+        out << "\n" << indent << "  \"" << c.name << "\": ";
+        writeUsageJson(out, c.usage);
+        out << ",";
+    }
+    out << "\n" << indent << "  \"total\": ";
+    writeUsageJson(out, total);
+    out << "\n" << indent << "}";
+}
+
+void writeStagesJson(std::ostream &out, const std::vector<MemoryReport::Stage> &stages,
+                     const std::string &indent) {
+    out << "{";
+    for (std::size_t i = 0; i < stages.size(); ++i) {
+        out << (i ? ",\n" : "\n") << indent << "  \"" << stages[i].name << "\": ";
+        writeComponentsJson(out, stages[i].components, stages[i].total, indent + "  ");
+    }
+    out << (stages.empty() ? "}" : "\n" + indent + "}");
+}
+
+double mebibytes(std::size_t bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); }
+
+void writeTextRow(std::ostream &out, const std::string &name, const MemoryUsage &usage, int depth) {
+    out << std::string(static_cast<std::size_t>(2 + depth * 2), ' ') << std::left
+        << std::setw(30 - depth * 2) << name << std::right << std::setw(12) << mebibytes(usage.bytes)
+        << std::setw(12) << mebibytes(usage.capacity) << "\n";
+}
+
+void writeStagesText(std::ostream &out, const char *title, const std::vector<MemoryReport::Stage> &stages) {
+    if (stages.empty()) return;
+    out << "  " << title << "\n";
+    for (const auto &s : stages) {
+        writeTextRow(out, s.name, s.total, 1);
+        for (const auto &c : s.components) writeTextRow(out, c.name, c.usage, 2);
+    }
+}
+
+} // namespace
+
+MemoryUsage totalUsage(const std::vector<MemoryComponent> &components) {
+    MemoryUsage total;
+    for (const auto &c : components) total.add(c.usage);
+    return total;
+}
+
+void writeEstimateJson(std::ostream &out, const MemoryEstimate &estimate) {
+    out << "{\"buildings\": " << estimate.buildings << ", \"city\": " << estimate.city
+        << ", \"generate\": " << estimate.generate << ", \"export\": " << estimate.exportPeak
+        << ", \"peak\": " << estimate.peak() << "}";
+}
+
+void MemoryReport::setCity(std::vector<MemoryComponent> components) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    city_ = std::move(components);
+}
+
+void MemoryReport::record(std::vector<Stage> &stages, const std::string &name,
+                          std::vector<MemoryComponent> components) {
+    MemoryUsage total = totalUsage(components);
+    auto it = std::find_if(stages.begin(), stages.end(), [&](const Stage &s) { return s.name == name; });
+    if (it == stages.end()) {
+        stages.push_back({name, std::move(components), total});
+    } else if (total.capacity > it->total.capacity) {
+        it->components = std::move(components);
+        it->total = total;
+    }
+}
+
+void MemoryReport::recordGenerateStage(const std::string &stage, std::vector<MemoryComponent> components) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    record(generate_, stage, std::move(components));
+}
+
+void MemoryReport::recordExportStage(const std::string &stage, std::vector<MemoryComponent> components) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    record(export_, stage, std::move(components));
+}
+
+void MemoryReport::setEstimate(const MemoryEstimate &estimate) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    estimate_ = estimate;
+    hasEstimate_ = true;
+}
+
+MemoryUsage MemoryReport::city() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return totalUsage(city_);
+}
+
+std::size_t MemoryReport::peakLocked() const {
+    std::size_t generate = 0;
+    for (const auto &s : generate_) generate = std::max(generate, s.total.capacity);
+    std::size_t exporting = 0;
+    for (const auto &s : export_) exporting += s.total.capacity;
+    return totalUsage(city_).capacity + std::max(generate, exporting);
+}
+
+std::size_t MemoryReport::peak() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return peakLocked();
+}
+
+void MemoryReport::writeJson(std::ostream &out, const std::string &indent) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    out << "{\n" << indent << "  \"city\": ";
+    writeComponentsJson(out, city_, totalUsage(city_), indent + "  ");
+    out << ",\n" << indent << "  \"generate\": ";
+    writeStagesJson(out, generate_, indent + "  ");
+    out << ",\n" << indent << "  \"export\": ";
+    writeStagesJson(out, export_, indent + "  ");
+    out << ",\n" << indent << "  \"peak\": " << peakLocked();
+    out << ",\n" << indent << "  \"peakRss\": " << peakResidentBytes();
+    if (hasEstimate_) {
+        out << ",\n" << indent << "  \"predicted\": ";
+        writeEstimateJson(out, estimate_);
+    }
+    out << "\n" << indent << "}";
+}
+
+void MemoryReport::writeText(std::ostream &out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(2);
+    out << "Memory (MiB)" << std::string(20, ' ') << std::setw(12) << "used" << std::setw(12)
+        << "allocated" << "\n";
+    out << "  city\n";
+    for (const auto &c : city_) writeTextRow(out, c.name, c.usage, 1);
+    writeTextRow(out, "total", totalUsage(city_), 1);
+    writeStagesText(out, "generate (per-stage high-water mark)", generate_);
+    writeStagesText(out, "export (per-stage high-water mark)", export_);
+    out << "  accounted peak" << std::string(28, ' ') << std::setw(12) << mebibytes(peakLocked()) << "\n";
+    if (hasEstimate_) {
+        out << "  predicted peak" << std::string(28, ' ') << std::setw(12) << mebibytes(estimate_.peak())
+            << "\n";
+    }
+    out << "  process peak RSS" << std::string(26, ' ') << std::setw(12)
+        << mebibytes(peakResidentBytes()) << "\n";
+    out.flags(flags);
+    out.precision(precision);
+}
+
+std::size_t MemoryReport::peakResidentBytes() {
+    struct rusage usage {};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<std::size_t>(usage.ru_maxrss); // bytes on macOS
+#else
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024; // KiB on Linux
+#endif
+}
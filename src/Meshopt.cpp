@@ -0,0 +1,142 @@
+#include "Meshopt.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr std::uint8_t kVertexHeader = 0xa0; // version 0
+constexpr std::uint8_t kSequenceHeader = 0xd1; // version 1
+constexpr std::size_t kByteGroupSize = 16;
+constexpr std::size_t kVertexBlockSizeBytes = 8192;
+constexpr std::size_t kVertexBlockMaxSize = 256;
+constexpr std::size_t kTailMinSize = 32;
+
+// Elements per block; the decoder derives the same value from the stride.
+std::size_t vertexBlockSize(std::size_t stride) {
+    std::size_t result = (kVertexBlockSizeBytes / stride) & ~(kByteGroupSize - 1);
+    return std::min(result, kVertexBlockMaxSize);
+}
+
+std::uint8_t zigzag8(std::uint8_t v) {
+    return static_cast<std::uint8_t>(((v & 0x80) ? 0xff : 0) ^ (v << 1));
+}
+
+// Encoded size of a group of 16 bytes at 0, 2, 4 or 8 bits per value.
+// Values at or above the 2/4-bit sentinel spill into one extra byte.
+std::size_t groupSize(const std::uint8_t *group, int bits) {
+    if (bits == 0) {
+        for (std::size_t i = 0; i < kByteGroupSize; ++i) {
+            if (group[i] != 0) return kByteGroupSize + 1; // never chosen
+        }
+        return 0;
+    }
+    if (bits == 8) return kByteGroupSize;
+    std::size_t size = kByteGroupSize * bits / 8;
+    std::uint8_t sentinel = static_cast<std::uint8_t>((1 << bits) - 1);
+    for (std::size_t i = 0; i < kByteGroupSize; ++i) size += group[i] >= sentinel;
+    return size;
+}
+
+void writeGroup(std::vector<std::uint8_t> &out, const std::uint8_t *group, int bits) {
+    if (bits == 0) return;
+    if (bits == 8) {
+        out.insert(out.end(), group, group + kByteGroupSize);
+        return;
+    }
+    // Packed values, most significant bits first, then the spilled bytes.
+    std::uint8_t sentinel = static_cast<std::uint8_t>((1 << bits) - 1);
+    std::size_t perByte = 8 / static_cast<std::size_t>(bits);
+    for (std::size_t i = 0; i < kByteGroupSize; i += perByte) {
+        std::uint8_t byte = 0;
+        for (std::size_t k = 0; k < perByte; ++k) {
+            byte = static_cast<std::uint8_t>(byte << bits);
+            byte |= std::min(group[i + k], sentinel);
+        }
+        out.push_back(byte);
+    }
+    for (std::size_t i = 0; i < kByteGroupSize; ++i) {
+        if (group[i] >= sentinel) out.push_back(group[i]);
+    }
+}
+
+// One byte column of a block: a 2-bit width per group, four groups per
+// header byte from the low bits up, then the groups.
+void writeBytes(std::vector<std::uint8_t> &out, const std::uint8_t *column, std::size_t size) {
+    static const int kBits[4] = {0, 2, 4, 8};
+    std::size_t header = out.size();
+    out.resize(header + (size / kByteGroupSize + 3) / 4, 0);
+    for (std::size_t g = 0; g * kByteGroupSize < size; ++g) {
+        const std::uint8_t *group = column + g * kByteGroupSize;
+        int best = 3;
+        for (int b = 0; b < 3; ++b) {
+            if (groupSize(group, kBits[b]) < groupSize(group, kBits[best])) best = b;
+        }
+        out[header + g / 4] |= static_cast<std::uint8_t>(best << ((g % 4) * 2));
+        writeGroup(out, group, kBits[best]);
+    }
+}
+
+void writeVByte(std::vector<std::uint8_t> &out, std::uint32_t v) {
+    while (v >= 128) {
+        out.push_back(static_cast<std::uint8_t>((v & 127) | 128));
+        v >>= 7;
+    }
+    out.push_back(static_cast<std::uint8_t>(v));
+}
+
+} // namespace
+
+std::vector<std::uint8_t> meshoptEncodeAttributes(const void *data, std::size_t count,
+                                                  std::size_t stride) {
+    const auto *bytes = static_cast<const std::uint8_t *>(data);
+    std::vector<std::uint8_t> out;
+    out.reserve(count * stride / 2 + kTailMinSize + 1);
+    out.push_back(kVertexHeader);
+    // Deltas of the first block are taken against the first element,
+    // which the stream repeats in its tail.
+    std::vector<std::uint8_t> first(stride, 0);
+    if (count > 0) std::memcpy(first.data(), bytes, stride);
+    std::vector<std::uint8_t> last = first;
+    std::uint8_t column[kVertexBlockMaxSize];
+    const std::size_t blockSize = vertexBlockSize(stride);
+    for (std::size_t begin = 0; begin < count; begin += blockSize) {
+        std::size_t n = std::min(blockSize, count - begin);
+        std::size_t aligned = (n + kByteGroupSize - 1) & ~(kByteGroupSize - 1);
+        const std::uint8_t *block = bytes + begin * stride;
+        for (std::size_t k = 0; k < stride; ++k) {
+            std::uint8_t prev = last[k];
+            for (std::size_t i = 0; i < n; ++i) {
+                std::uint8_t v = block[i * stride + k];
+                column[i] = zigzag8(static_cast<std::uint8_t>(v - prev));
+                prev = v;
+            }
+            std::fill(column + n, column + aligned, column[n - 1]);
+            writeBytes(out, column, aligned);
+        }
+        std::memcpy(last.data(), block + (n - 1) * stride, stride);
+    }
+    if (stride < kTailMinSize) out.resize(out.size() + kTailMinSize - stride, 0);
+    out.insert(out.end(), first.begin(), first.end());
+    return out;
+}
+
+std::vector<std::uint8_t> meshoptEncodeIndices(const std::uint16_t *indices, std::size_t count) {
+    std::vector<std::uint8_t> out;
+    out.reserve(count + 5);
+    out.push_back(kSequenceHeader);
+    std::uint32_t last[2] = {0, 0};
+    std::uint32_t current = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        std::uint32_t index = indices[i];
+        // Switch baselines when the delta would not fit one byte.
+        auto cd = static_cast<std::int32_t>(index - last[current]);
+        current ^= static_cast<std::uint32_t>((cd < 0 ? -cd : cd) >= 30);
+        std::uint32_t d = index - last[current];
+        std::uint32_t v = (d << 1) ^ static_cast<std::uint32_t>(static_cast<std::int32_t>(d) >> 31);
+        writeVByte(out, (v << 1) | current);
+        last[current] = index;
+    }
+    out.insert(out.end(), 4, 0);
+    return out;
+}
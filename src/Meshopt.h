@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @file Meshopt.h
+ *
+ * Encoders for the EXT_meshopt_compression bitstreams, written from the
+ * extension specification.  Decoders (meshoptimizer, three.js, Babylon)
+ * undo them at memory bandwidth, and the output compresses further under
+ * gzip or Brotli on a CDN.
+ */
+
+/**
+ * @brief Encode @p count elements of @p stride bytes in "ATTRIBUTES" mode
+ * (vertex codec version 0).
+ *
+ * Each byte position is delta-coded against the previous element, zigzag
+ * mapped and bit-packed in groups of 16.  @p stride must be a multiple of
+ * 4 no larger than 256.
+ */
+std::vector<std::uint8_t> meshoptEncodeAttributes(const void *data, std::size_t count,
+                                                  std::size_t stride);
+
+/**
+ * @brief Encode @p count indices in "INDICES" mode (index sequence codec
+ * version 1): zigzag varint deltas against one of two baselines.
+ *
+ * Unlike "TRIANGLES" mode this puts no constraint on the index order, so
+ * it suits any index buffer.
+ */
+std::vector<std::uint8_t> meshoptEncodeIndices(const std::uint16_t *indices, std::size_t count);
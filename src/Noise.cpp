@@ -0,0 +1,180 @@
+#include "Noise.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CITYGEN_NOISE_AVX2 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define CITYGEN_NOISE_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+constexpr int kOctaves = 4;
+constexpr std::uint32_t kOctaveSeedStep = 17u;
+
+// 32-bit avalanche hash shared by every kernel.  Returns the 24 bits that
+// noise() scales into [0,1).
+inline std::uint32_t hashBits(std::uint32_t ux, std::uint32_t uy, std::uint32_t seed) {
+    // Compute a simple 32-bit hash based on coordinates and seed.  The
+    // constants are arbitrary primes chosen to decorrelate bits.  We avoid
+    // std::hash for portability.
+    std::uint32_t h = ux * 374761393u;
+    h += uy * 668265263u;
+    h ^= seed + 0x9e3779b9u + (h << 6) + (h >> 2);
+    // Final mix
+    h ^= (h >> 17);
+    h *= 0xed5ad4bbU;
+    h ^= (h >> 11);
+    h *= 0xac4c1b51U;
+    h ^= (h >> 15);
+    return h & 0xFFFFFFu;
+}
+
+// Four-octave noise expressed as an integer: octave i contributes its 24-bit
+// hash weighted by 2^(3-i).  Every partial sum of fractalNoise() is exactly
+// representable in a double, so sum == S / 2^27 and the row kernels can
+// accumulate in integers without changing a single bit of the result.
+inline std::uint32_t octaveSum(int x, int y, std::uint32_t seed) {
+    std::uint32_t s = 0;
+    for (int i = 0; i < kOctaves; ++i) {
+        std::uint32_t ux = static_cast<std::uint32_t>(x) << i;
+        std::uint32_t uy = static_cast<std::uint32_t>(y) << i;
+        s += hashBits(ux, uy, seed + static_cast<std::uint32_t>(i) * kOctaveSeedStep)
+             << (kOctaves - 1 - i);
+    }
+    return s;
+}
+
+inline double octaveSumToValue(std::uint32_t s) {
+    const double amplitudeSum = 1.875; // 1 + 1/2 + 1/4 + 1/8
+    return (static_cast<double>(s) * (1.0 / 134217728.0)) / amplitudeSum;
+}
+
+#if defined(CITYGEN_NOISE_AVX2)
+
+__attribute__((target("avx2")))
+void octaveSumsAvx2(int x0, int y, int count, std::uint32_t seed, std::uint32_t *sums) {
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i c1 = _mm256_set1_epi32(374761393);
+    const __m256i c2 = _mm256_set1_epi32(668265263);
+    const __m256i c3 = _mm256_set1_epi32(static_cast<int>(0xed5ad4bbU));
+    const __m256i c4 = _mm256_set1_epi32(static_cast<int>(0xac4c1b51U));
+    const __m256i mask = _mm256_set1_epi32(0xFFFFFF);
+    const __m256i uy = _mm256_set1_epi32(y);
+    for (int i = 0; i < count; i += 8) {
+        __m256i ux = _mm256_add_epi32(_mm256_set1_epi32(x0 + i), lane);
+        __m256i sum = _mm256_setzero_si256();
+        for (int o = 0; o < kOctaves; ++o) {
+            __m256i sx = _mm256_slli_epi32(ux, o);
+            __m256i sy = _mm256_slli_epi32(uy, o);
+            std::uint32_t octaveSeed = seed + static_cast<std::uint32_t>(o) * kOctaveSeedStep + 0x9e3779b9u;
+            __m256i h = _mm256_add_epi32(_mm256_mullo_epi32(sx, c1), _mm256_mullo_epi32(sy, c2));
+            __m256i mix = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(octaveSeed)),
+                                           _mm256_add_epi32(_mm256_slli_epi32(h, 6), _mm256_srli_epi32(h, 2)));
+            h = _mm256_xor_si256(h, mix);
+            h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 17));
+            h = _mm256_mullo_epi32(h, c3);
+            h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 11));
+            h = _mm256_mullo_epi32(h, c4);
+            h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+            h = _mm256_and_si256(h, mask);
+            sum = _mm256_add_epi32(sum, _mm256_slli_epi32(h, kOctaves - 1 - o));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(sums + i), sum);
+    }
+}
+
+bool haveAvx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+#elif defined(CITYGEN_NOISE_NEON)
+
+inline uint32x4_t hashNeon(uint32x4_t ux, uint32x4_t uy, std::uint32_t seed) {
+    uint32x4_t h = vaddq_u32(vmulq_n_u32(ux, 374761393u), vmulq_n_u32(uy, 668265263u));
+    uint32x4_t mix = vaddq_u32(vdupq_n_u32(seed + 0x9e3779b9u),
+                               vaddq_u32(vshlq_n_u32(h, 6), vshrq_n_u32(h, 2)));
+    h = veorq_u32(h, mix);
+    h = veorq_u32(h, vshrq_n_u32(h, 17));
+    h = vmulq_n_u32(h, 0xed5ad4bbU);
+    h = veorq_u32(h, vshrq_n_u32(h, 11));
+    h = vmulq_n_u32(h, 0xac4c1b51U);
+    h = veorq_u32(h, vshrq_n_u32(h, 15));
+    return vandq_u32(h, vdupq_n_u32(0xFFFFFFu));
+}
+
+void octaveSumsNeon(int x0, int y, int count, std::uint32_t seed, std::uint32_t *sums) {
+    static const std::uint32_t laneInit[4] = {0, 1, 2, 3};
+    const uint32x4_t lane = vld1q_u32(laneInit);
+    for (int i = 0; i < count; i += 8) {
+        uint32x4_t uxLo = vaddq_u32(vdupq_n_u32(static_cast<std::uint32_t>(x0 + i)), lane);
+        uint32x4_t uxHi = vaddq_u32(uxLo, vdupq_n_u32(4));
+        uint32x4_t sumLo = vdupq_n_u32(0);
+        uint32x4_t sumHi = vdupq_n_u32(0);
+        for (int o = 0; o < kOctaves; ++o) {
+            int32x4_t shift = vdupq_n_s32(o);
+            int32x4_t weight = vdupq_n_s32(kOctaves - 1 - o);
+            uint32x4_t uy = vdupq_n_u32(static_cast<std::uint32_t>(y) << o);
+            std::uint32_t octaveSeed = seed + static_cast<std::uint32_t>(o) * kOctaveSeedStep;
+            sumLo = vaddq_u32(sumLo, vshlq_u32(hashNeon(vshlq_u32(uxLo, shift), uy, octaveSeed), weight));
+            sumHi = vaddq_u32(sumHi, vshlq_u32(hashNeon(vshlq_u32(uxHi, shift), uy, octaveSeed), weight));
+        }
+        vst1q_u32(sums + i, sumLo);
+        vst1q_u32(sums + i + 4, sumHi);
+    }
+}
+
+#endif
+
+} // namespace
+
+double noise(int x, int y, std::uint32_t seed) {
+    std::uint32_t h = hashBits(static_cast<std::uint32_t>(x), static_cast<std::uint32_t>(y), seed);
+    // Scale to [0,1)
+    return h / static_cast<double>(0x1000000u);
+}
+
+double fractalNoise(int x, int y, std::uint32_t seed, int octaves) {
+    double sum = 0.0;
+    double amplitude = 1.0;
+    double frequency = 1.0;
+    double amplitudeSum = 0.0;
+    for (int i = 0; i < octaves; ++i) {
+        // Sample noise at scaled coordinates; cast to int to avoid large
+        // floating point increments (coarse sampling is acceptable here).
+        int sx = static_cast<int>(x * frequency);
+        int sy = static_cast<int>(y * frequency);
+        double n = noise(sx, sy, seed + static_cast<std::uint32_t>(i) * kOctaveSeedStep);
+        sum += amplitude * n;
+        amplitudeSum += amplitude;
+        amplitude *= 0.5;
+        frequency *= 2.0;
+    }
+    return sum / amplitudeSum;
+}
+
+void fractalNoiseRow(int x0, int y, int count, std::uint32_t seed, double *out) {
+    constexpr int kBatch = 256;
+    alignas(32) std::uint32_t sums[kBatch];
+    for (int start = 0; start < count; start += kBatch) {
+        int n = (count - start < kBatch) ? (count - start) : kBatch;
+        int vectorised = 0;
+#if defined(CITYGEN_NOISE_AVX2)
+        if (haveAvx2()) {
+            vectorised = n & ~7;
+            octaveSumsAvx2(x0 + start, y, vectorised, seed, sums);
+        }
+#elif defined(CITYGEN_NOISE_NEON)
+        vectorised = n & ~7;
+        octaveSumsNeon(x0 + start, y, vectorised, seed, sums);
+#endif
+        for (int i = vectorised; i < n; ++i) {
+            sums[i] = octaveSum(x0 + start + i, y, seed);
+        }
+        for (int i = 0; i < n; ++i) {
+            out[start + i] = octaveSumToValue(sums[i]);
+        }
+    }
+}
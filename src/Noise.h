@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @file Noise.h
+ *
+ * Position-pure hash noise used for zoning.  The scalar functions are the
+ * reference implementation; fractalNoiseRow() evaluates a run of cells with
+ * the widest SIMD kernel available at runtime (AVX2 or NEON, eight cells per
+ * step) and produces bit-identical values.
+ */
+
+/// Hash-based pseudo-random noise for integer coordinates in [0,1).
+double noise(int x, int y, std::uint32_t seed);
+
+/// Fractal noise combining multiple octaves.  Each successive octave doubles
+/// the frequency and halves the amplitude.
+double fractalNoise(int x, int y, std::uint32_t seed, int octaves = 4);
+
+/// Evaluate fractalNoise(x, y, seed) with the default four octaves for
+/// x in [x0, x0 + count) and store the results in out[0..count).
+void fractalNoiseRow(int x0, int y, int count, std::uint32_t seed, double *out);
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @file OutputBuffer.h
+ *
+ * Buffered text/binary output for the exporters.  Bytes accumulate in a
+ * fixed-size buffer that is handed to a ByteSink in large chunks; numbers
+ * are formatted in place with std::to_chars, avoiding iostream locale and
+ * sentry overhead on every value.
+ */
+
+/// Destination receiving flushed chunks.
+class ByteSink {
+public:
+    virtual ~ByteSink() = default;
+    /// Consume @p len bytes; returns false on an I/O error.
+    virtual bool write(const char *data, std::size_t len) = 0;
+};
+
+/// ByteSink writing to a file opened in binary mode.
+class FileSink : public ByteSink {
+public:
+    explicit FileSink(const std::string &path) : file_(std::fopen(path.c_str(), "wb")) {}
+    ~FileSink() override {
+        if (file_) std::fclose(file_);
+    }
+    FileSink(const FileSink &) = delete;
+    FileSink &operator=(const FileSink &) = delete;
+
+    bool isOpen() const { return file_ != nullptr; }
+
+    bool write(const char *data, std::size_t len) override {
+        return file_ && std::fwrite(data, 1, len, file_) == len;
+    }
+
+    /// Close the file; false if it was never open or the final flush failed.
+    bool close() {
+        if (!file_) return false;
+        bool ok = std::fclose(file_) == 0;
+        file_ = nullptr;
+        return ok;
+    }
+
+private:
+    std::FILE *file_;
+};
+
+/**
+ * @brief Chunked writer in front of a ByteSink.
+ *
+ * Doubles are written either like the default iostream formatting (%g with
+ * six significant digits) or, when a non-negative fixed precision is set,
+ * with that many fractional digits.
+ */
+class OutputBuffer {
+public:
+    static constexpr std::size_t kDefaultCapacity = 1u << 20;
+    /// More fractional digits than any double needs.
+    static constexpr int kMaxFixedPrecision = 17;
+
+    explicit OutputBuffer(ByteSink &sink, std::size_t capacity = kDefaultCapacity)
+        : sink_(sink), buffer_(capacity < 64 ? 64 : capacity) {}
+    ~OutputBuffer() { flush(); }
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+    /// Size of the chunk buffer, allocated up front.
+    std::size_t capacity() const { return buffer_.size(); }
+
+    /// Fixed number of fractional digits for doubles, at most
+    /// kMaxFixedPrecision; negative selects %g.
+    void setFixedPrecision(int digits) { precision_ = std::min(digits, kMaxFixedPrecision); }
+
+    void put(char c) {
+        if (used_ == buffer_.size()) flush();
+        buffer_[used_++] = c;
+    }
+
+    void put(std::string_view s) {
+        if (s.size() > buffer_.size() - used_) {
+            flush();
+            if (s.size() > buffer_.size()) {
+                ok_ = sink_.write(s.data(), s.size()) && ok_;
+                return;
+            }
+        }
+        std::memcpy(buffer_.data() + used_, s.data(), s.size());
+        used_ += s.size();
+    }
+
+    /// Raw bytes (binary payloads).
+    void putBytes(const void *data, std::size_t len) {
+        put(std::string_view(static_cast<const char *>(data), len));
+    }
+
+    void putUInt(std::uint64_t v) {
+        reserve(24);
+        auto res = std::to_chars(cursor(), end(), v);
+        used_ = static_cast<std::size_t>(res.ptr - buffer_.data());
+    }
+
+    void putDouble(double v) {
+        // Fixed output of huge values can be long; 350 bytes covers any double
+        // at the precisions the exporters use.
+        reserve(precision_ >= 0 ? 350 + static_cast<std::size_t>(precision_) : 32);
+        auto res = (precision_ >= 0)
+            ? std::to_chars(cursor(), end(), v, std::chars_format::fixed, precision_)
+            : std::to_chars(cursor(), end(), v, std::chars_format::general, 6);
+        if (res.ec != std::errc()) {
+            put("nan");
+            return;
+        }
+        used_ = static_cast<std::size_t>(res.ptr - buffer_.data());
+    }
+
+    /// Hand buffered bytes to the sink.
+    void flush() {
+        if (used_ == 0) return;
+        ok_ = sink_.write(buffer_.data(), used_) && ok_;
+        used_ = 0;
+    }
+
+    /// False once any sink write has failed.
+    bool ok() const { return ok_; }
+
+private:
+    void reserve(std::size_t n) {
+        if (buffer_.size() - used_ < n) flush();
+        if (buffer_.size() < n) buffer_.resize(n);
+    }
+    char *cursor() { return buffer_.data() + used_; }
+    char *end() { return buffer_.data() + buffer_.size(); }
+
+    ByteSink &sink_;
+    std::vector<char> buffer_;
+    std::size_t used_ = 0;
+    int precision_ = -1;
+    bool ok_ = true;
+};
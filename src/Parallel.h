@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @file Parallel.h
+ *
+ * Minimal fork/join helpers used by the generator and exporters.  Work is
+ * split into fixed chunks that threads claim dynamically; since chunk
+ * boundaries never depend on the thread count, any per-chunk reduction
+ * combined in chunk order is reproducible for every thread count.
+ */
+
+/// Resolve a requested worker count: 0 selects the hardware concurrency.
+inline unsigned resolveThreadCount(int requested) {
+    if (requested > 0) return static_cast<unsigned>(requested);
+    unsigned hw = std::thread::hardware_concurrency();
+    return hw == 0 ? 1u : hw;
+}
+
+/**
+ * @brief Invoke fn(chunkIndex, begin, end) for consecutive chunks of
+ * [0, count), each at most @p grain items long, on up to @p threads workers.
+ *
+ * The calling thread participates.  The first exception thrown by a chunk
+ * is rethrown after all workers have joined.
+ */
+template <class Fn>
+void parallelForChunks(std::size_t count, std::size_t grain, int threads, Fn &&fn) {
+    if (count == 0) return;
+    grain = std::max<std::size_t>(grain, 1);
+    std::size_t chunks = (count + grain - 1) / grain;
+    std::size_t workers = std::min<std::size_t>(resolveThreadCount(threads), chunks);
+    if (workers <= 1) {
+        for (std::size_t c = 0; c < chunks; ++c) {
+            fn(c, c * grain, std::min(count, (c + 1) * grain));
+        }
+        return;
+    }
+    std::atomic<std::size_t> next{0};
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+    auto worker = [&]() {
+        for (;;) {
+            std::size_t c = next.fetch_add(1, std::memory_order_relaxed);
+            if (c >= chunks) return;
+            try {
+                fn(c, c * grain, std::min(count, (c + 1) * grain));
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(failureMutex);
+                if (!failure) failure = std::current_exception();
+                next.store(chunks, std::memory_order_relaxed);
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    pool.reserve(workers - 1);
+    for (std::size_t i = 1; i < workers; ++i) pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool) t.join();
+    if (failure) std::rethrow_exception(failure);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+/**
+ * @file Random.h
+ *
+ * Counter-based random number generation.  Philox4x32-10 (Salmon et al.,
+ * "Parallel random numbers: as easy as 1, 2, 3") maps a 128-bit counter and
+ * a 64-bit key to four 32-bit outputs.  Giving every work item its own
+ * stream id in the counter yields independent, reproducible sequences that
+ * do not depend on scheduling order.
+ */
+
+/// Philox4x32-10 engine satisfying UniformRandomBitGenerator.
+class Philox4x32 {
+public:
+    using result_type = std::uint32_t;
+
+    /// Create the engine for stream @p stream under key @p seed.
+    Philox4x32(std::uint32_t seed, std::uint64_t stream)
+        : key_{seed, 0x5ca1ab1eu},
+          counter_{0u, 0u, static_cast<std::uint32_t>(stream),
+                   static_cast<std::uint32_t>(stream >> 32)} {}
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    result_type operator()() {
+        if (next_ == 4) {
+            refill();
+        }
+        return block_[next_++];
+    }
+
+    /// Number of 32-bit values produced so far.
+    std::uint64_t draws() const {
+        std::uint64_t blocks = (static_cast<std::uint64_t>(counter_[1]) << 32) | counter_[0];
+        return blocks * 4 - (4 - static_cast<std::uint64_t>(next_));
+    }
+
+private:
+    void refill() {
+        std::array<std::uint32_t, 4> c = counter_;
+        std::uint32_t k0 = key_[0];
+        std::uint32_t k1 = key_[1];
+        for (int round = 0; round < 10; ++round) {
+            std::uint64_t p0 = static_cast<std::uint64_t>(0xD2511F53u) * c[0];
+            std::uint64_t p1 = static_cast<std::uint64_t>(0xCD9E8D57u) * c[2];
+            std::uint32_t hi0 = static_cast<std::uint32_t>(p0 >> 32);
+            std::uint32_t lo0 = static_cast<std::uint32_t>(p0);
+            std::uint32_t hi1 = static_cast<std::uint32_t>(p1 >> 32);
+            std::uint32_t lo1 = static_cast<std::uint32_t>(p1);
+            c = {hi1 ^ c[1] ^ k0, lo1, hi0 ^ c[3] ^ k1, lo0};
+            k0 += 0x9E3779B9u;
+            k1 += 0xBB67AE85u;
+        }
+        block_ = c;
+        next_ = 0;
+        // 64-bit block counter in the low words; the stream id stays fixed.
+        if (++counter_[0] == 0) ++counter_[1];
+    }
+
+    std::array<std::uint32_t, 2> key_;
+    std::array<std::uint32_t, 4> counter_;
+    std::array<std::uint32_t, 4> block_{};
+    int next_ = 4;
+};
+
+/// UniformRandomBitGenerator adapter counting the values drawn from an
+/// engine.  Output is identical to the wrapped engine.
+template <class Engine>
+class CountingEngine {
+public:
+    using result_type = typename Engine::result_type;
+
+    explicit CountingEngine(Engine engine) : engine_(engine) {}
+
+    static constexpr result_type min() { return Engine::min(); }
+    static constexpr result_type max() { return Engine::max(); }
+
+    result_type operator()() {
+        ++draws_;
+        return engine_();
+    }
+
+    std::uint64_t draws() const { return draws_; }
+
+private:
+    Engine engine_;
+    std::uint64_t draws_ = 0;
+};
@@ -0,0 +1,286 @@
+#include "City.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+// Points closer than this (in cells) become one node.
+constexpr double kSnapDistance = 1e-6;
+// Slack on segment parameters when testing for crossings, so segments
+// that merely touch still connect.
+constexpr double kParamSlack = 1e-9;
+// Side of the first nearest-edge query square; doubled until it holds a
+// closer edge than its half-size.
+constexpr double kFirstQueryHalfSize = 4.0;
+
+// One grid cell is 100 m; speeds are km/h.
+constexpr double kCellKm = 0.1;
+constexpr double kWalkKmh = 5.0;
+
+// Travel speed per transport mode and road type (arterial, secondary,
+// local).  Transit speeds include stops.
+double roadSpeedKmh(Config::TransportMode mode, RoadType type) {
+    static const double kSpeeds[3][3] = {
+        {50.0, 40.0, 30.0}, // car
+        {30.0, 22.0, 15.0}, // transit
+        {kWalkKmh, kWalkKmh, kWalkKmh}
+    };
+    return kSpeeds[static_cast<int>(mode)][static_cast<int>(type)];
+}
+
+double minutesAt(double cells, double kmh) {
+    return cells * kCellKm / kmh * 60.0;
+}
+
+struct SnapKey {
+    long long x;
+    long long y;
+    bool operator==(const SnapKey &o) const { return x == o.x && y == o.y; }
+};
+
+struct SnapKeyHash {
+    std::size_t operator()(const SnapKey &k) const {
+        return std::hash<long long>()(k.x * 1000003LL ^ k.y);
+    }
+};
+
+// Crossing parameters of segments a and b.  Parallel segments never
+// cross; shared endpoints are joined by snapping instead.
+bool segmentsCross(const RoadSegment &a, const RoadSegment &b, double &ta, double &tb) {
+    double rx = a.x2 - a.x1;
+    double ry = a.y2 - a.y1;
+    double sx = b.x2 - b.x1;
+    double sy = b.y2 - b.y1;
+    double denom = rx * sy - ry * sx;
+    double scale = std::sqrt((rx * rx + ry * ry) * (sx * sx + sy * sy));
+    if (std::abs(denom) <= 1e-12 * scale) return false;
+    double qx = b.x1 - a.x1;
+    double qy = b.y1 - a.y1;
+    ta = (qx * sy - qy * sx) / denom;
+    tb = (qx * ry - qy * rx) / denom;
+    if (ta < -kParamSlack || ta > 1.0 + kParamSlack || tb < -kParamSlack || tb > 1.0 + kParamSlack) {
+        return false;
+    }
+    ta = std::clamp(ta, 0.0, 1.0);
+    tb = std::clamp(tb, 0.0, 1.0);
+    return true;
+}
+
+// Closest point of segment s to (x, y) as a parameter in [0, 1].
+double closestParam(const RoadSegment &s, double x, double y) {
+    double dx = s.x2 - s.x1;
+    double dy = s.y2 - s.y1;
+    double len2 = dx * dx + dy * dy;
+    if (len2 <= 0.0) return 0.0;
+    return std::clamp(((x - s.x1) * dx + (y - s.y1) * dy) / len2, 0.0, 1.0);
+}
+
+} // namespace
+
+double RoadGraph::walkMinutes(double distance) {
+    return minutesAt(distance, kWalkKmh);
+}
+
+double RoadGraph::edgeMinutes(std::size_t edge, Config::TransportMode mode) const {
+    return minutesAt(edgeLength_[edge], roadSpeedKmh(mode, edgeType_[edge]));
+}
+
+void RoadGraph::build(const std::vector<RoadSegment> &roads, int gridSize,
+                      const RoadIndex *segments) {
+    nodes_.clear();
+    arcStart_.clear();
+    arcTarget_.clear();
+    arcEdge_.clear();
+    edgeNodes_.clear();
+    edgeLength_.clear();
+    edgeType_.clear();
+    edgeSegments_.clear();
+    maxQueryRadius_ = 0.0;
+    // Cut parameters per segment: both ends plus every crossing.
+    std::vector<std::vector<double>> cuts(roads.size(), std::vector<double>{0.0, 1.0});
+    RoadIndex ownIndex;
+    if (!segments) {
+        ownIndex.build(roads, gridSize);
+        segments = &ownIndex;
+    }
+    std::vector<std::size_t> nearby;
+    for (std::size_t i = 0; i < roads.size(); ++i) {
+        const RoadSegment &a = roads[i];
+        Rect box{std::min(a.x1, a.x2), std::min(a.y1, a.y2), std::max(a.x1, a.x2), std::max(a.y1, a.y2)};
+        nearby.clear();
+        segments->query(box, nearby);
+        for (std::size_t j : nearby) {
+            if (j <= i) continue;
+            double ta = 0.0;
+            double tb = 0.0;
+            if (segmentsCross(a, roads[j], ta, tb)) {
+                cuts[i].push_back(ta);
+                cuts[j].push_back(tb);
+            }
+        }
+    }
+    // Snap cut points to nodes and chain each segment's cuts into edges.
+    std::unordered_map<SnapKey, std::uint32_t, SnapKeyHash> snapped;
+    auto nodeAt = [&](double x, double y) {
+        SnapKey key{std::llround(x / kSnapDistance), std::llround(y / kSnapDistance)};
+        for (long long dy = -1; dy <= 1; ++dy) {
+            for (long long dx = -1; dx <= 1; ++dx) {
+                auto it = snapped.find({key.x + dx, key.y + dy});
+                if (it == snapped.end()) continue;
+                const Vec2 &p = nodes_[it->second];
+                if (std::hypot(p.x - x, p.y - y) <= kSnapDistance) return it->second;
+            }
+        }
+        auto id = static_cast<std::uint32_t>(nodes_.size());
+        nodes_.push_back({x, y});
+        snapped.emplace(key, id);
+        return id;
+    };
+    for (std::size_t i = 0; i < roads.size(); ++i) {
+        const RoadSegment &road = roads[i];
+        std::vector<double> &t = cuts[i];
+        std::sort(t.begin(), t.end());
+        std::uint32_t prev = 0;
+        for (std::size_t k = 0; k < t.size(); ++k) {
+            std::uint32_t node = nodeAt(road.x1 + (road.x2 - road.x1) * t[k],
+                                        road.y1 + (road.y2 - road.y1) * t[k]);
+            if (k > 0 && node != prev) {
+                const Vec2 &p = nodes_[prev];
+                const Vec2 &q = nodes_[node];
+                edgeNodes_.push_back({prev, node});
+                edgeLength_.push_back(std::hypot(q.x - p.x, q.y - p.y));
+                edgeType_.push_back(road.type);
+                edgeSegments_.push_back({p.x, p.y, q.x, q.y, road.type});
+            }
+            prev = node;
+        }
+    }
+    // CSR adjacency: every edge is an arc in both directions.
+    arcStart_.assign(nodes_.size() + 1, 0);
+    for (const auto &e : edgeNodes_) {
+        arcStart_[e[0] + 1]++;
+        arcStart_[e[1] + 1]++;
+    }
+    for (std::size_t n = 0; n < nodes_.size(); ++n) arcStart_[n + 1] += arcStart_[n];
+    arcTarget_.resize(arcStart_.back());
+    arcEdge_.resize(arcStart_.back());
+    std::vector<std::uint32_t> fill(arcStart_.begin(), arcStart_.end() - 1);
+    for (std::size_t e = 0; e < edgeNodes_.size(); ++e) {
+        const auto &ends = edgeNodes_[e];
+        for (int side = 0; side < 2; ++side) {
+            std::uint32_t at = fill[ends[side]]++;
+            arcTarget_[at] = ends[1 - side];
+            arcEdge_[at] = static_cast<std::uint32_t>(e);
+        }
+    }
+    edgeIndex_.build(edgeSegments_, gridSize);
+    // A query square this large reaches every edge from anywhere on the grid.
+    maxQueryRadius_ = 4.0 * std::max(gridSize, 1);
+    for (const auto &p : nodes_) {
+        maxQueryRadius_ = std::max(maxQueryRadius_, 2.0 * (std::abs(p.x) + std::abs(p.y)));
+    }
+}
+
+MemoryUsage RoadGraph::memoryUsage() const {
+    return MemoryUsage()
+        .add(nodes_).add(arcStart_).add(arcTarget_).add(arcEdge_).add(edgeNodes_)
+        .add(edgeLength_).add(edgeType_).add(edgeSegments_).add(edgeIndex_.memoryUsage());
+}
+
+bool RoadGraph::anchor(double x, double y, Anchor &out) const {
+    if (edgeSegments_.empty()) return false;
+    std::vector<std::size_t> nearby;
+    double best = std::numeric_limits<double>::max();
+    for (double half = kFirstQueryHalfSize;; half *= 2.0) {
+        nearby.clear();
+        edgeIndex_.query(Rect{x - half, y - half, x + half, y + half}, nearby);
+        for (std::size_t e : nearby) {
+            const RoadSegment &s = edgeSegments_[e];
+            double t = closestParam(s, x, y);
+            double px = s.x1 + (s.x2 - s.x1) * t;
+            double py = s.y1 + (s.y2 - s.y1) * t;
+            double d = std::hypot(px - x, py - y);
+            if (d < best) {
+                best = d;
+                out.edge = e;
+                out.along = t * edgeLength_[e];
+                out.offset = d;
+            }
+        }
+        // Any edge within half of the point overlaps the query square.
+        if (best <= half || half > maxQueryRadius_) break;
+    }
+    return best < std::numeric_limits<double>::max();
+}
+
+std::vector<double> RoadGraph::travelMinutes(const std::vector<Anchor> &sources,
+                                             Config::TransportMode mode) const {
+    std::vector<double> minutes(nodes_.size(), std::numeric_limits<double>::infinity());
+    using Item = std::pair<double, std::uint32_t>;
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item>> open;
+    auto relax = [&](std::uint32_t node, double m) {
+        if (m < minutes[node]) {
+            minutes[node] = m;
+            open.push({m, node});
+        }
+    };
+    for (const Anchor &s : sources) {
+        const auto &ends = edgeNodes_[s.edge];
+        double full = edgeMinutes(s.edge, mode);
+        double frac = edgeLength_[s.edge] > 0.0 ? s.along / edgeLength_[s.edge] : 0.0;
+        double start = walkMinutes(s.offset);
+        relax(ends[0], start + frac * full);
+        relax(ends[1], start + (1.0 - frac) * full);
+    }
+    while (!open.empty()) {
+        auto [m, node] = open.top();
+        open.pop();
+        if (m > minutes[node]) continue;
+        for (std::uint32_t a = arcStart_[node]; a < arcStart_[node + 1]; ++a) {
+            relax(arcTarget_[a], m + edgeMinutes(arcEdge_[a], mode));
+        }
+    }
+    return minutes;
+}
+
+void FacilityAccess::build(const RoadGraph &graph, const std::vector<Facility> &facilities,
+                           Facility::Type type, Config::TransportMode mode) {
+    graph_ = &graph;
+    mode_ = mode;
+    sources_.clear();
+    nodeMinutes_.clear();
+    for (const auto &f : facilities) {
+        RoadGraph::Anchor a;
+        if (f.type == type && graph.anchor(f.x, f.y, a)) sources_.push_back(a);
+    }
+    std::sort(sources_.begin(), sources_.end(),
+              [](const RoadGraph::Anchor &a, const RoadGraph::Anchor &b) { return a.edge < b.edge; });
+    if (!sources_.empty()) nodeMinutes_ = graph.travelMinutes(sources_, mode);
+}
+
+double FacilityAccess::travelMinutes(double x, double y) const {
+    RoadGraph::Anchor a;
+    if (sources_.empty() || !graph_->anchor(x, y, a)) return -1.0;
+    const auto &ends = graph_->edgeNodes(a.edge);
+    double length = graph_->edgeLength(a.edge);
+    double full = graph_->edgeMinutes(a.edge, mode_);
+    double frac = length > 0.0 ? a.along / length : 0.0;
+    double network = std::min(nodeMinutes_[ends[0]] + frac * full,
+                              nodeMinutes_[ends[1]] + (1.0 - frac) * full);
+    // Facilities on the same edge are reachable without passing a node.
+    auto lo = std::lower_bound(sources_.begin(), sources_.end(), a.edge,
+                               [](const RoadGraph::Anchor &s, std::size_t e) { return s.edge < e; });
+    for (auto it = lo; it != sources_.end() && it->edge == a.edge; ++it) {
+        double direct = RoadGraph::walkMinutes(it->offset) +
+                        (length > 0.0 ? std::abs(it->along - a.along) / length * full : 0.0);
+        network = std::min(network, direct);
+    }
+    if (!std::isfinite(network)) return -1.0;
+    return RoadGraph::walkMinutes(a.offset) + network;
+}
@@ -0,0 +1,170 @@
+#include "City.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Target number of segments per cell; keeps rings cheap to scan without
+// blowing up the number of empty cells for sparse networks.
+constexpr double kSegmentsPerCell = 2.0;
+constexpr int kMaxCellsPerSide = 512;
+
+} // namespace
+
+double RoadIndex::rectDistance(const Rect &r, const Rect &box) {
+    double dx = 0.0;
+    if (r.x1 < box.x0) dx = box.x0 - r.x1;
+    else if (r.x0 > box.x1) dx = r.x0 - box.x1;
+    double dy = 0.0;
+    if (r.y1 < box.y0) dy = box.y0 - r.y1;
+    else if (r.y0 > box.y1) dy = r.y0 - box.y1;
+    return (dx == 0.0 || dy == 0.0) ? std::max(dx, dy) : std::sqrt(dx * dx + dy * dy);
+}
+
+void RoadIndex::build(const std::vector<RoadSegment> &roads, int gridSize) {
+    boxes_.clear();
+    cellStart_.clear();
+    cellItems_.clear();
+    cells_ = 0;
+    if (roads.empty()) return;
+    boxes_.reserve(roads.size());
+    Rect extent{std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+                std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()};
+    for (const auto &road : roads) {
+        double halfWidth = 0.5 * roadWidth(road.type);
+        Rect box{std::min(road.x1, road.x2) - halfWidth,
+                 std::min(road.y1, road.y2) - halfWidth,
+                 std::max(road.x1, road.x2) + halfWidth,
+                 std::max(road.y1, road.y2) + halfWidth};
+        extent.x0 = std::min(extent.x0, box.x0);
+        extent.y0 = std::min(extent.y0, box.y0);
+        extent.x1 = std::max(extent.x1, box.x1);
+        extent.y1 = std::max(extent.y1, box.y1);
+        boxes_.push_back(box);
+    }
+    // Cells are square and sized from the grid dimension; the origin follows
+    // the network extent so roads hugging the border still land in a cell.
+    int perSide = static_cast<int>(std::ceil(std::sqrt(roads.size() / kSegmentsPerCell)));
+    cells_ = std::clamp(perSide, 1, kMaxCellsPerSide);
+    double span = std::max({static_cast<double>(gridSize), extent.width(), extent.height(), 1.0});
+    cellSize_ = span / static_cast<double>(cells_);
+    originX_ = extent.x0;
+    originY_ = extent.y0;
+
+    // Two-pass CSR fill: count registrations per cell, then scatter ids.
+    std::size_t cellCount = static_cast<std::size_t>(cells_) * static_cast<std::size_t>(cells_);
+    cellStart_.assign(cellCount + 1, 0);
+    for (const auto &box : boxes_) {
+        int ix0, iy0, ix1, iy1;
+        cellRange(box, ix0, iy0, ix1, iy1);
+        for (int y = iy0; y <= iy1; ++y) {
+            for (int x = ix0; x <= ix1; ++x) {
+                cellStart_[static_cast<std::size_t>(y) * cells_ + x + 1]++;
+            }
+        }
+    }
+    for (std::size_t c = 0; c < cellCount; ++c) {
+        cellStart_[c + 1] += cellStart_[c];
+    }
+    cellItems_.resize(cellStart_[cellCount]);
+    std::vector<std::uint32_t> cursor(cellStart_.begin(), cellStart_.end() - 1);
+    for (std::size_t i = 0; i < boxes_.size(); ++i) {
+        int ix0, iy0, ix1, iy1;
+        cellRange(boxes_[i], ix0, iy0, ix1, iy1);
+        for (int y = iy0; y <= iy1; ++y) {
+            for (int x = ix0; x <= ix1; ++x) {
+                cellItems_[cursor[static_cast<std::size_t>(y) * cells_ + x]++] =
+                    static_cast<std::uint32_t>(i);
+            }
+        }
+    }
+}
+
+MemoryUsage RoadIndex::memoryUsage() const {
+    return MemoryUsage().add(boxes_).add(cellStart_).add(cellItems_);
+}
+
+void RoadIndex::cellRange(const Rect &r, int &ix0, int &iy0, int &ix1, int &iy1) const {
+    auto cellOf = [&](double v, double origin) {
+        double c = std::floor((v - origin) / cellSize_);
+        if (!(c >= 0.0)) return 0;
+        if (c >= static_cast<double>(cells_ - 1)) return cells_ - 1;
+        return static_cast<int>(c);
+    };
+    ix0 = cellOf(r.x0, originX_);
+    ix1 = cellOf(r.x1, originX_);
+    iy0 = cellOf(r.y0, originY_);
+    iy1 = cellOf(r.y1, originY_);
+}
+
+double RoadIndex::distanceTo(const Rect &r, std::size_t *nearest) const {
+    double best = std::numeric_limits<double>::max();
+    if (boxes_.empty()) return best;
+    int ix0, iy0, ix1, iy1;
+    cellRange(r, ix0, iy0, ix1, iy1);
+    const double inf = std::numeric_limits<double>::infinity();
+    // Slack absorbs rounding in the cell assignment so the early exit never
+    // skips a segment that a linear scan would have found closer.
+    const double slack = 1e-9 * (std::abs(originX_) + std::abs(originY_) +
+                                 cellSize_ * cells_ + 1.0);
+    auto visitCell = [&](int x, int y) {
+        std::size_t c = static_cast<std::size_t>(y) * cells_ + x;
+        for (std::uint32_t k = cellStart_[c]; k < cellStart_[c + 1]; ++k) {
+            std::uint32_t id = cellItems_[k];
+            double d = rectDistance(r, boxes_[id]);
+            if (d < best) {
+                best = d;
+                if (nearest) *nearest = id;
+            }
+        }
+    };
+    for (int ring = 0;; ++ring) {
+        int rx0 = ix0 - ring, rx1 = ix1 + ring;
+        int ry0 = iy0 - ring, ry1 = iy1 + ring;
+        // Visit only cells on the perimeter of the current ring.
+        for (int y = std::max(ry0, 0); y <= std::min(ry1, cells_ - 1); ++y) {
+            bool edgeRow = (ring == 0) || y == ry0 || y == ry1;
+            if (edgeRow) {
+                for (int x = std::max(rx0, 0); x <= std::min(rx1, cells_ - 1); ++x) {
+                    visitCell(x, y);
+                }
+            } else {
+                if (rx0 >= 0) visitCell(rx0, y);
+                if (rx1 <= cells_ - 1) visitCell(rx1, y);
+            }
+        }
+        bool coversAll = rx0 <= 0 && ry0 <= 0 && rx1 >= cells_ - 1 && ry1 >= cells_ - 1;
+        if (coversAll) break;
+        // Any unvisited segment lies entirely outside the explored window,
+        // so its distance is at least the gap to the nearest window edge.
+        double left = (rx0 <= 0) ? -inf : originX_ + rx0 * cellSize_;
+        double right = (rx1 >= cells_ - 1) ? inf : originX_ + (rx1 + 1) * cellSize_;
+        double bottom = (ry0 <= 0) ? -inf : originY_ + ry0 * cellSize_;
+        double top = (ry1 >= cells_ - 1) ? inf : originY_ + (ry1 + 1) * cellSize_;
+        double gap = std::min({r.x0 - left, right - r.x1, r.y0 - bottom, top - r.y1});
+        if (best < gap - slack) break;
+    }
+    return best;
+}
+
+void RoadIndex::query(const Rect &area, std::vector<std::size_t> &out) const {
+    if (boxes_.empty()) return;
+    int ix0, iy0, ix1, iy1;
+    cellRange(area, ix0, iy0, ix1, iy1);
+    std::size_t first = out.size();
+    for (int y = iy0; y <= iy1; ++y) {
+        for (int x = ix0; x <= ix1; ++x) {
+            std::size_t c = static_cast<std::size_t>(y) * cells_ + x;
+            for (std::uint32_t k = cellStart_[c]; k < cellStart_[c + 1]; ++k) {
+                std::uint32_t id = cellItems_[k];
+                const Rect &b = boxes_[id];
+                if (b.x1 < area.x0 || b.x0 > area.x1 || b.y1 < area.y0 || b.y0 > area.y1) continue;
+                out.push_back(id);
+            }
+        }
+    }
+    std::sort(out.begin() + static_cast<std::ptrdiff_t>(first), out.end());
+    out.erase(std::unique(out.begin() + static_cast<std::ptrdiff_t>(first), out.end()), out.end());
+}
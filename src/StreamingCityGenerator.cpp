@@ -0,0 +1,307 @@
+#include "StreamingCityGenerator.h"
+
+#include "City.h"
+#include "CityExport.h"
+#include "CityMesh.h"
+#include "GeneratorStages.h"
+#include "Parallel.h"
+#include "Random.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Rows zoned per parallel chunk while counting.
+constexpr std::size_t kZoneTileRows = 16;
+
+// Zone totals of the grid and green candidates (residential plus
+// industrial cells) per row.
+struct ZoningTotals {
+    ZoneCounts cells{};
+    std::vector<std::uint32_t> rowCandidates;
+};
+
+ZoningTotals countZoning(const Config &cfg) {
+    const std::size_t size = static_cast<std::size_t>(cfg.grid_size);
+    ZoningTotals totals;
+    totals.rowCandidates.resize(size);
+    std::vector<ZoneCounts> partial((size + kZoneTileRows - 1) / kZoneTileRows);
+    parallelForChunks(size, kZoneTileRows, cfg.threads,
+                      [&](std::size_t chunk, std::size_t rowBegin, std::size_t rowEnd) {
+        std::vector<ZoneType> row(size);
+        std::vector<double> values;
+        ZoneCounts &sum = partial[chunk];
+        for (std::size_t y = rowBegin; y < rowEnd; ++y) {
+            zoneRow(cfg, static_cast<int>(y), row.data(), values);
+            const ZoneCounts rowCells = countZones(row.data(), size);
+            for (std::size_t z = 0; z < kZoneTypeCount; ++z) sum[z] += rowCells[z];
+            totals.rowCandidates[y] = static_cast<std::uint32_t>(
+                rowCells[static_cast<std::size_t>(ZoneType::Residential)] +
+                rowCells[static_cast<std::size_t>(ZoneType::Industrial)]);
+        }
+    });
+    for (const auto &sum : partial) {
+        for (std::size_t z = 0; z < kZoneTypeCount; ++z) totals.cells[z] += sum[z];
+    }
+    return totals;
+}
+
+// Map sorted candidate ranks to sorted row-major cell indices.  Only rows
+// holding at least one rank are zoned again.  Decrements the zone counts
+// of the converted cells.
+std::vector<std::uint64_t> locateGreenCells(const Config &cfg, const ZoningTotals &totals,
+                                            const std::vector<std::uint64_t> &ranks,
+                                            ZoneCounts &cells) {
+    const std::size_t size = static_cast<std::size_t>(cfg.grid_size);
+    std::vector<std::uint64_t> located;
+    located.reserve(ranks.size());
+    std::vector<ZoneType> row(size);
+    std::vector<double> values;
+    std::size_t next = 0;
+    std::uint64_t rowFirst = 0;
+    for (std::size_t y = 0; y < size && next < ranks.size(); ++y) {
+        const std::uint64_t rowEnd = rowFirst + totals.rowCandidates[y];
+        if (ranks[next] < rowEnd) {
+            zoneRow(cfg, static_cast<int>(y), row.data(), values);
+            std::uint64_t rank = rowFirst;
+            for (std::size_t x = 0; x < size && next < ranks.size(); ++x) {
+                if (!isGreenCandidate(row[x])) continue;
+                if (ranks[next] == rank) {
+                    located.push_back(static_cast<std::uint64_t>(y) * size + x);
+                    cells[static_cast<std::size_t>(row[x])]--;
+                    ++next;
+                }
+                ++rank;
+            }
+        }
+        rowFirst = rowEnd;
+    }
+    return located;
+}
+
+bool isFacilityCandidate(ZoneType z) {
+    return z == ZoneType::Residential || z == ZoneType::Commercial;
+}
+
+// A chosen facility site.
+struct Site {
+    std::size_t idx;
+    Facility::Type type;
+    Rect footprint;
+};
+
+} // anonymous namespace
+
+StreamingStats StreamingCityGenerator::generate(const Config &cfg, const std::string &objPath,
+                                                const std::string &summaryPath, Trace *trace) {
+    if (cfg.green_mode != Config::GreenMode::Sample) {
+        throw std::invalid_argument("streaming generation requires --green=sample");
+    }
+    if (cfg.export_format != Config::ExportFormat::OBJ || !cfg.extra_export_formats.empty() ||
+        cfg.tile_size > 0.0) {
+        throw std::invalid_argument("streaming generation only writes a single OBJ model");
+    }
+    Trace::Scope total(trace, "generate");
+    StreamingStats stats;
+    const bool sequential = cfg.rng_mode == Config::RngMode::Sequential;
+    LayoutRng rng{std::mt19937(cfg.seed)};
+
+    Trace::Scope zoningStage(trace, "zoning");
+    ZoningTotals zoning = countZoning(cfg);
+    ZoneCounts cells = zoning.cells;
+    zoningStage.end();
+
+    // Green space: the same ranks as the in-memory sample mode, kept as
+    // the list of converted cells.
+    Trace::Scope greenStage(trace, "green");
+    const std::uint64_t target = greenTargetCells(cfg);
+    const std::uint64_t currentGreen = cells[static_cast<std::size_t>(ZoneType::Green)];
+    const std::uint64_t candidateCells = cells[static_cast<std::size_t>(ZoneType::Residential)] +
+                                         cells[static_cast<std::size_t>(ZoneType::Industrial)];
+    std::vector<std::uint64_t> greenCells;
+    bool allCandidatesGreen = false;
+    if (currentGreen < target) {
+        const std::uint64_t diff = target - currentGreen;
+        std::vector<std::uint64_t> ranks = sampleGreenRanks(candidateCells, diff, rng);
+        if (diff >= candidateCells) {
+            allCandidatesGreen = true;
+            cells[static_cast<std::size_t>(ZoneType::Residential)] = 0;
+            cells[static_cast<std::size_t>(ZoneType::Industrial)] = 0;
+        } else {
+            greenCells = locateGreenCells(cfg, zoning, ranks, cells);
+        }
+        cells[static_cast<std::size_t>(ZoneType::Green)] += std::min(diff, candidateCells);
+        greenStage.count("cellsConverted", static_cast<std::int64_t>(std::min(diff, candidateCells)));
+    }
+    zoning.rowCandidates = std::vector<std::uint32_t>();
+    greenStage.end();
+    const ZoneField zones(cfg, greenCells, allCandidatesGreen);
+
+    StreetPlan plan;
+    planStreets(cfg, plan, trace);
+    RoadIndex roadIndex;
+    roadIndex.build(plan.roads, cfg.grid_size);
+    const std::size_t blockCount = plan.blocks.size();
+    stats.blocks = blockCount;
+
+    // Regenerate block i into @p sink, from the start-of-block engine state.
+    std::vector<LayoutRng> blockRngs;
+    auto reparcelize = [&](std::size_t i, BuildingSink &sink) {
+        if (sequential) {
+            LayoutRng blockRng = blockRngs[i];
+            parcelizeStreetBlock(cfg, plan, i, zones, blockRng, sink);
+        } else {
+            Philox4x32 blockRng(cfg.seed, i);
+            parcelizeStreetBlock(cfg, plan, i, zones, blockRng, sink);
+        }
+    };
+
+    // First parcel pass: building counts, material slots and facility
+    // candidates per block.  Candidate indices are block-local until the
+    // block offsets are known.
+    Trace::Scope parcelsStage(trace, "parcels");
+    std::vector<std::size_t> blockStart(blockCount + 1, 0);
+    std::vector<unsigned> blockSlots(blockCount, 0);
+    std::vector<std::vector<ParcelCandidate>> blockCandidates(blockCount);
+    auto collect = [&](std::size_t i, std::size_t &count) {
+        return BuildingSink{[&, i](const Building &b) {
+            blockSlots[i] |= 1u << materialSlotForZone(b.zone);
+            if (isFacilityCandidate(b.zone)) {
+                blockCandidates[i].push_back({count, roadIndex.distanceTo(b.footprint)});
+            }
+            ++count;
+        }};
+    };
+    if (sequential) {
+        blockRngs.reserve(blockCount);
+        for (std::size_t i = 0; i < blockCount; ++i) {
+            blockRngs.push_back(rng);
+            std::size_t count = 0;
+            BuildingSink sink = collect(i, count);
+            parcelizeStreetBlock(cfg, plan, i, zones, rng, sink);
+            blockStart[i + 1] = count;
+        }
+    } else {
+        parallelForChunks(blockCount, 1, cfg.threads, [&](std::size_t i, std::size_t, std::size_t) {
+            std::size_t count = 0;
+            BuildingSink sink = collect(i, count);
+            reparcelize(i, sink);
+            blockStart[i + 1] = count;
+        });
+    }
+    for (std::size_t i = 0; i < blockCount; ++i) blockStart[i + 1] += blockStart[i];
+    stats.buildings = blockStart[blockCount];
+    std::vector<ParcelCandidate> candidates;
+    for (std::size_t i = 0; i < blockCount; ++i) {
+        for (const auto &c : blockCandidates[i]) candidates.push_back({blockStart[i] + c.idx, c.roadDistance});
+        blockCandidates[i] = std::vector<ParcelCandidate>();
+    }
+    if (candidates.empty()) {
+        // No residential or commercial parcels: every building qualifies.
+        for (std::size_t i = 0; i < blockCount; ++i) {
+            std::size_t idx = blockStart[i];
+            BuildingSink sink{[&](const Building &b) {
+                candidates.push_back({idx++, roadIndex.distanceTo(b.footprint)});
+            }};
+            reparcelize(i, sink);
+        }
+    }
+    parcelsStage.count("buildings", static_cast<std::int64_t>(stats.buildings));
+    parcelsStage.end();
+
+    Trace::Scope candidatesStage(trace, "facilityCandidates");
+    std::vector<std::size_t> facilityOrder;
+    orderFacilityCandidates(candidates, rng, facilityOrder);
+    stats.facilityCandidates = candidates.size();
+    candidates = std::vector<ParcelCandidate>();
+    candidatesStage.end();
+
+    // Facilities take the head of the order: hospitals first, then schools.
+    Trace::Scope facilitiesStage(trace, "facilities");
+    std::vector<Site> sites;
+    for (std::size_t k = 0; k < facilityOrder.size(); ++k) {
+        if (k < static_cast<std::size_t>(cfg.hospitals)) {
+            sites.push_back({facilityOrder[k], Facility::Type::Hospital, Rect{}});
+        } else if (k < static_cast<std::size_t>(cfg.hospitals) + static_cast<std::size_t>(cfg.schools)) {
+            sites.push_back({facilityOrder[k], Facility::Type::School, Rect{}});
+        } else {
+            break;
+        }
+    }
+    facilityOrder = std::vector<std::size_t>();
+    // Sites sorted by building index, for lookup while regenerating.
+    std::vector<std::size_t> byIdx(sites.size());
+    for (std::size_t s = 0; s < sites.size(); ++s) byIdx[s] = s;
+    std::sort(byIdx.begin(), byIdx.end(),
+              [&](std::size_t a, std::size_t b) { return sites[a].idx < sites[b].idx; });
+    auto findSite = [&](std::size_t idx) -> Site * {
+        auto it = std::lower_bound(byIdx.begin(), byIdx.end(), idx,
+                                   [&](std::size_t s, std::size_t v) { return sites[s].idx < v; });
+        return (it != byIdx.end() && sites[*it].idx == idx) ? &sites[*it] : nullptr;
+    };
+    for (std::size_t k = 0; k < byIdx.size();) {
+        const std::size_t block = static_cast<std::size_t>(
+            std::upper_bound(blockStart.begin(), blockStart.end(), sites[byIdx[k]].idx) -
+            blockStart.begin()) - 1;
+        std::size_t idx = blockStart[block];
+        BuildingSink sink{[&](const Building &b) {
+            if (Site *site = findSite(idx)) site->footprint = b.footprint;
+            ++idx;
+        }};
+        reparcelize(block, sink);
+        while (k < byIdx.size() && sites[byIdx[k]].idx < blockStart[block + 1]) ++k;
+    }
+    std::vector<Facility> facilities;
+    for (const auto &site : sites) {
+        facilities.push_back({site.footprint.centreX(), site.footprint.centreY(), site.type});
+    }
+    facilitiesStage.count("facilities", static_cast<std::int64_t>(facilities.size()));
+    facilitiesStage.end();
+
+    // Final pass: one sweep over the blocks per material, as the OBJ groups
+    // faces by material.
+    Trace::Scope exportStage(trace, "export");
+    ObjStreamWriter writer(objPath, cfg.obj_precision);
+    SummaryBuilder summary(cfg.grid_size, cells, facilities, plan.roads, cfg.transport_mode,
+                           cfg.threads, &roadIndex);
+    for (std::size_t slot = 0; slot < kMaterialCount; ++slot) {
+        bool selected = false;
+        for (std::size_t i = 0; i < blockCount; ++i) {
+            if (!(blockSlots[i] & (1u << slot))) continue;
+            if (!selected) {
+                writer.beginMaterial(slot);
+                selected = true;
+            }
+            std::size_t idx = blockStart[i];
+            BuildingSink sink{[&](const Building &b) {
+                const std::size_t current = idx++;
+                if (materialSlotForZone(b.zone) != slot) return;
+                Building out = b;
+                if (const Site *site = findSite(current)) {
+                    out.facility = true;
+                    out.facilityType = site->type;
+                    out.height = facilityHeight(site->type, out.footprint);
+                }
+                writer.writeBuilding(out);
+                summary.addBuilding(out.zone, out.height, out.footprint);
+            }};
+            reparcelize(i, sink);
+        }
+    }
+    writer.writeRoads(plan.roads);
+    if (!writer.finish()) throw std::runtime_error("could not write " + objPath);
+    exportStage.end();
+    total.end();
+    std::ofstream summaryFile(summaryPath);
+    if (summaryFile) summary.write(summaryFile, trace);
+    summaryFile.close();
+    if (!summaryFile) throw std::runtime_error("could not write " + summaryPath);
+    return stats;
+}
@@ -0,0 +1,101 @@
+#include "Trace.h"
+
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+
+Trace::Trace() : origin_(Clock::now()) {}
+
+double Trace::nowUs() const {
+    return std::chrono::duration<double, std::micro>(Clock::now() - origin_).count();
+}
+
+void Trace::addStage(const char *name, Clock::time_point start, Clock::time_point end, int thread,
+                     std::vector<Counter> counters) {
+    Stage stage;
+    stage.name = name;
+    stage.depth = depth_;
+    stage.thread = thread;
+    stage.startUs = std::chrono::duration<double, std::micro>(start - origin_).count();
+    stage.durationUs = std::chrono::duration<double, std::micro>(end - start).count();
+    stage.counters = std::move(counters);
+    stages_.push_back(std::move(stage));
+}
+
+std::int64_t Trace::threadCpuUs() {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    timespec ts{};
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0;
+    return static_cast<std::int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#else
+    return 0;
+#endif
+}
+
+Trace::Scope::Scope(Trace *trace, const char *name) : trace_(trace) {
+    if (!trace_) return;
+    Stage stage;
+    stage.name = name;
+    stage.depth = trace_->depth_++;
+    stage.startUs = trace_->nowUs();
+    trace_->stages_.push_back(std::move(stage));
+    index_ = trace_->stages_.size() - 1;
+    open_ = true;
+}
+
+void Trace::Scope::count(const char *name, std::int64_t value) {
+    if (!trace_) return;
+    auto &counters = trace_->stages_[index_].counters;
+    for (auto &c : counters) {
+        if (c.name == name) {
+            c.value += value;
+            return;
+        }
+    }
+    counters.push_back({name, value});
+}
+
+void Trace::Scope::end() {
+    if (!open_) return;
+    Stage &stage = trace_->stages_[index_];
+    stage.durationUs = trace_->nowUs() - stage.startUs;
+    --trace_->depth_;
+    open_ = false;
+}
+
+bool Trace::writeChromeTrace(const std::string &path) const {
+    std::ofstream ofs(path);
+    if (!ofs) return false;
+    ofs << std::fixed << std::setprecision(3);
+    ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    ofs << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"citygen\"}}";
+    for (const auto &s : stages_) {
+        ofs << ",\n{\"name\":\"" << s.name << "\",\"cat\":\"citygen\",\"ph\":\"X\",\"pid\":1,\"tid\":" << 1 + s.thread
+            << ",\"ts\":" << s.startUs << ",\"dur\":" << s.durationUs << ",\"args\":{";
+        for (std::size_t i = 0; i < s.counters.size(); ++i) {
+            if (i) ofs << ",";
+            ofs << "\"" << s.counters[i].name << "\":" << s.counters[i].value;
+        }
+        ofs << "}}";
+    }
+    ofs << "\n]}\n";
+    return static_cast<bool>(ofs);
+}
+
+void Trace::writeTimingsJson(std::ostream &out, const std::string &indent) const {
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    out << "{";
+    for (std::size_t i = 0; i < stages_.size(); ++i) {
+        const auto &s = stages_[i];
+        out << (i ? ",\n" : "\n") << indent << "  \"" << s.name << "\": {\"ms\": " << s.durationUs / 1000.0;
+        for (const auto &c : s.counters) {
+            out << ", \"" << c.name << "\": " << c.value;
+        }
+        out << "}";
+    }
+    out << "\n" << indent << "}";
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,285 @@
+#include "citygen_c.h"
+
+#include "City.h"
+#include "CityGenerator.h"
+#include "Config.h"
+#include "IncrementalCityGenerator.h"
+
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+// The array accessors hand out C++ storage directly, so the C structs must
+// match the C++ layouts exactly.
+static_assert(sizeof(citygen_rect) == sizeof(Rect), "citygen_rect must mirror Rect");
+static_assert(offsetof(citygen_rect, x1) == offsetof(Rect, x1), "citygen_rect must mirror Rect");
+static_assert(sizeof(citygen_vec2) == sizeof(Vec2), "citygen_vec2 must mirror Vec2");
+static_assert(sizeof(citygen_road) == sizeof(RoadSegment), "citygen_road must mirror RoadSegment");
+static_assert(offsetof(citygen_road, type) == offsetof(RoadSegment, type),
+              "citygen_road must mirror RoadSegment");
+static_assert(sizeof(RoadType) == sizeof(std::int32_t), "RoadType must be 32-bit");
+static_assert(sizeof(citygen_facility) == sizeof(Facility), "citygen_facility must mirror Facility");
+static_assert(offsetof(citygen_facility, type) == offsetof(Facility, type),
+              "citygen_facility must mirror Facility");
+static_assert(sizeof(ZoneType) == sizeof(std::uint8_t), "ZoneType must be 8-bit");
+static_assert(sizeof(int) == sizeof(std::int32_t), "building heights are exported as int32_t");
+static_assert(CITYGEN_STAGE_ZONING == IncrementalCityGenerator::Zoning &&
+              CITYGEN_STAGE_LAYOUT == IncrementalCityGenerator::Layout &&
+              CITYGEN_STAGE_FACILITIES == IncrementalCityGenerator::Facilities,
+              "stage bits must match");
+
+struct citygen_city {
+    std::shared_ptr<const City> city;
+};
+
+struct citygen_incremental {
+    IncrementalCityGenerator generator;
+};
+
+namespace {
+
+thread_local std::string lastError;
+
+int fail(int status, const std::string &message) {
+    lastError = message;
+    return status;
+}
+
+// Run @p fn, translating exceptions into status codes.
+template <class Fn>
+int guarded(Fn &&fn) {
+    try {
+        lastError.clear();
+        return fn();
+    } catch (const std::invalid_argument &e) {
+        return fail(CITYGEN_ERROR_INVALID_ARGUMENT, e.what());
+    } catch (const std::bad_alloc &) {
+        return fail(CITYGEN_ERROR_OUT_OF_MEMORY, "out of memory");
+    } catch (const std::exception &e) {
+        return fail(CITYGEN_ERROR_INTERNAL, e.what());
+    } catch (...) {
+        return fail(CITYGEN_ERROR_INTERNAL, "unknown error");
+    }
+}
+
+// Map an exporter's result to a status.
+int checkWritten(bool written, const std::string &path) {
+    return written ? CITYGEN_OK : fail(CITYGEN_ERROR_IO, "could not write " + path);
+}
+
+Config toConfig(const citygen_config &in) {
+    Config cfg;
+    cfg.seed = in.seed;
+    cfg.population = in.population;
+    cfg.grid_size = in.grid_size;
+    cfg.city_radius = in.city_radius;
+    cfg.hospitals = in.hospitals;
+    cfg.schools = in.schools;
+    cfg.green_m2_per_capita = in.green_m2_per_capita;
+    switch (in.transport) {
+        case CITYGEN_TRANSPORT_CAR: cfg.transport_mode = Config::TransportMode::Car; break;
+        case CITYGEN_TRANSPORT_TRANSIT: cfg.transport_mode = Config::TransportMode::PublicTransit; break;
+        case CITYGEN_TRANSPORT_WALK: cfg.transport_mode = Config::TransportMode::Walk; break;
+        default: throw std::invalid_argument("Unknown transport mode: " + std::to_string(in.transport));
+    }
+    switch (in.layout) {
+        case CITYGEN_LAYOUT_GRID: cfg.layout = Config::LayoutType::Grid; break;
+        case CITYGEN_LAYOUT_RADIAL: cfg.layout = Config::LayoutType::Radial; break;
+        default: throw std::invalid_argument("Unknown layout type: " + std::to_string(in.layout));
+    }
+    switch (in.rng_mode) {
+        case CITYGEN_RNG_SEQUENTIAL: cfg.rng_mode = Config::RngMode::Sequential; break;
+        case CITYGEN_RNG_PER_BLOCK: cfg.rng_mode = Config::RngMode::PerBlock; break;
+        default: throw std::invalid_argument("Unknown RNG mode: " + std::to_string(in.rng_mode));
+    }
+    switch (in.green_mode) {
+        case CITYGEN_GREEN_SHUFFLE: cfg.green_mode = Config::GreenMode::Shuffle; break;
+        case CITYGEN_GREEN_SAMPLE: cfg.green_mode = Config::GreenMode::Sample; break;
+        default: throw std::invalid_argument("Unknown green mode: " + std::to_string(in.green_mode));
+    }
+    cfg.threads = in.threads;
+    cfg.normalize();
+    return cfg;
+}
+
+// Fields past the caller's struct_size keep their defaults.
+citygen_config completeConfig(const citygen_config &in) {
+    citygen_config full;
+    citygen_config_init(&full);
+    std::memcpy(&full, &in, in.struct_size);
+    return full;
+}
+
+GltfExportOptions toGltfOptions(unsigned flags) {
+    GltfExportOptions options;
+    options.binary = (flags & CITYGEN_GLTF_BINARY) != 0;
+    options.instancing = (flags & CITYGEN_GLTF_INSTANCING) != 0;
+    options.lod = (flags & CITYGEN_GLTF_LOD) != 0;
+    options.quantize = (flags & CITYGEN_GLTF_QUANTIZE) != 0;
+    options.meshopt = (flags & CITYGEN_GLTF_MESHOPT) != 0;
+    return options;
+}
+
+} // anonymous namespace
+
+extern "C" {
+
+int citygen_api_version(void) {
+    return CITYGEN_C_API_VERSION;
+}
+
+const char *citygen_last_error(void) {
+    return lastError.c_str();
+}
+
+void citygen_config_init(citygen_config *cfg) {
+    if (!cfg) return;
+    Config defaults;
+    std::memset(cfg, 0, sizeof(*cfg));
+    cfg->struct_size = sizeof(citygen_config);
+    cfg->seed = defaults.seed;
+    cfg->population = defaults.population;
+    cfg->grid_size = defaults.grid_size;
+    cfg->city_radius = defaults.city_radius;
+    cfg->hospitals = defaults.hospitals;
+    cfg->schools = defaults.schools;
+    cfg->green_m2_per_capita = defaults.green_m2_per_capita;
+    cfg->transport = static_cast<std::int32_t>(defaults.transport_mode);
+    cfg->layout = static_cast<std::int32_t>(defaults.layout);
+    cfg->rng_mode = static_cast<std::int32_t>(defaults.rng_mode);
+    cfg->threads = defaults.threads;
+    cfg->green_mode = static_cast<std::int32_t>(defaults.green_mode);
+}
+
+int citygen_generate(const citygen_config *cfg, citygen_city **out) {
+    if (!cfg || !out) return fail(CITYGEN_ERROR_INVALID_ARGUMENT, "null argument");
+    *out = nullptr;
+    if (cfg->struct_size == 0 || cfg->struct_size > sizeof(citygen_config)) {
+        return fail(CITYGEN_ERROR_INVALID_ARGUMENT, "unsupported citygen_config size");
+    }
+    return guarded([&]() {
+        Config config = toConfig(completeConfig(*cfg));
+        *out = new citygen_city{std::make_shared<const City>(CityGenerator::generate(config))};
+        return CITYGEN_OK;
+    });
+}
+
+citygen_incremental *citygen_incremental_create(void) {
+    try {
+        return new citygen_incremental;
+    } catch (const std::bad_alloc &) {
+        fail(CITYGEN_ERROR_OUT_OF_MEMORY, "out of memory");
+        return nullptr;
+    }
+}
+
+void citygen_incremental_free(citygen_incremental *generator) {
+    delete generator;
+}
+
+int citygen_incremental_generate(citygen_incremental *generator, const citygen_config *cfg,
+                                 citygen_city **out) {
+    if (!generator || !cfg || !out) return fail(CITYGEN_ERROR_INVALID_ARGUMENT, "null argument");
+    *out = nullptr;
+    if (cfg->struct_size == 0 || cfg->struct_size > sizeof(citygen_config)) {
+        return fail(CITYGEN_ERROR_INVALID_ARGUMENT, "unsupported citygen_config size");
+    }
+    return guarded([&]() {
+        Config config = toConfig(completeConfig(*cfg));
+        *out = new citygen_city{generator->generator.generate(config)};
+        return CITYGEN_OK;
+    });
+}
+
+unsigned citygen_incremental_last_stages(const citygen_incremental *generator) {
+    return generator ? generator->generator.lastStages() : 0u;
+}
+
+void citygen_city_free(citygen_city *city) {
+    delete city;
+}
+
+int32_t citygen_city_grid_size(const citygen_city *city) {
+    return city ? city->city->size : 0;
+}
+
+const uint8_t *citygen_city_zones(const citygen_city *city, size_t *count) {
+    if (count) *count = city ? city->city->zones.size() : 0;
+    return city ? reinterpret_cast<const uint8_t *>(city->city->zones.data()) : nullptr;
+}
+
+size_t citygen_city_building_count(const citygen_city *city) {
+    return city ? city->city->buildings.size() : 0;
+}
+
+const citygen_rect *citygen_city_building_footprints(const citygen_city *city) {
+    return city ? reinterpret_cast<const citygen_rect *>(city->city->buildings.footprints().data()) : nullptr;
+}
+
+const uint8_t *citygen_city_building_zones(const citygen_city *city) {
+    return city ? reinterpret_cast<const uint8_t *>(city->city->buildings.zones().data()) : nullptr;
+}
+
+const int32_t *citygen_city_building_heights(const citygen_city *city) {
+    return city ? reinterpret_cast<const int32_t *>(city->city->buildings.heights().data()) : nullptr;
+}
+
+int citygen_city_building_corners(const citygen_city *city, size_t index, citygen_vec2 corners[4]) {
+    if (!city || !corners) return fail(CITYGEN_ERROR_INVALID_ARGUMENT, "null argument");
+    if (index >= city->city->buildings.size()) {
+        return fail(CITYGEN_ERROR_INVALID_ARGUMENT, "building index out of range");
+    }
+    std::array<Vec2, 4> quad = city->city->buildings.corners(index);
+    for (int i = 0; i < 4; ++i) {
+        corners[i].x = quad[i].x;
+        corners[i].y = quad[i].y;
+    }
+    return CITYGEN_OK;
+}
+
+const citygen_road *citygen_city_roads(const citygen_city *city, size_t *count) {
+    if (count) *count = city ? city->city->roads().size() : 0;
+    return city ? reinterpret_cast<const citygen_road *>(city->city->roads().data()) : nullptr;
+}
+
+const citygen_facility *citygen_city_facilities(const citygen_city *city, size_t *count) {
+    if (count) *count = city ? city->city->facilities.size() : 0;
+    return city ? reinterpret_cast<const citygen_facility *>(city->city->facilities.data()) : nullptr;
+}
+
+int citygen_city_save_obj(const citygen_city *city, const char *path, int fixed_precision) {
+    if (!city || !path) return fail(CITYGEN_ERROR_INVALID_ARGUMENT, "null argument");
+    return guarded([&]() {
+        return checkWritten(city->city->saveOBJ(path, fixed_precision), path);
+    });
+}
+
+int citygen_city_save_gltf(const citygen_city *city, const char *path, unsigned flags) {
+    if (!city || !path) return fail(CITYGEN_ERROR_INVALID_ARGUMENT, "null argument");
+    return guarded([&]() {
+        return checkWritten(city->city->saveGLTF(path, toGltfOptions(flags)), path);
+    });
+}
+
+int citygen_city_save_tiles(const citygen_city *city, const char *directory, double tile_size,
+                            unsigned flags) {
+    if (!city || !directory) return fail(CITYGEN_ERROR_INVALID_ARGUMENT, "null argument");
+    if (!(tile_size > 0.0)) return fail(CITYGEN_ERROR_INVALID_ARGUMENT, "tile_size must be positive");
+    return guarded([&]() {
+        return checkWritten(city->city->saveTiles(directory, tile_size, toGltfOptions(flags)),
+                            directory);
+    });
+}
+
+int citygen_city_save_summary(const citygen_city *city, const char *path) {
+    if (!city || !path) return fail(CITYGEN_ERROR_INVALID_ARGUMENT, "null argument");
+    return guarded([&]() {
+        return checkWritten(city->city->saveSummary(path), path);
+    });
+}
+
+} // extern "C"
@@ -1,10 +1,17 @@
+#include "BatchGenerator.h"
 #include "CityGenerator.h"
+#include "CityServer.h"
+#include "CitySnapshot.h"
 #include "Config.h"
+#include "MemoryReport.h"
+#include "StreamingCityGenerator.h"
+#include "Trace.h"
 
 #include <iostream>
 #include <string>
 #include <cstdlib>
 #include <filesystem>
+#include <fstream>
 #include <stdexcept>
 
 /**
@@ -34,6 +41,16 @@ static std::string parseArg(const std::string &arg, const std::string &prefix) {
 int main(int argc, char **argv) {
     Config cfg;
     std::string outDir;
+    std::string traceFile;
+    std::string snapshotOut;
+    std::string snapshotIn;
+    std::string batchManifest;
+    bool batchMeshes = false;
+    bool stream = false;
+    bool greenModeSet = false;
+    bool memReport = false;
+    bool predictMemory = false;
+    ServerOptions server;
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         if (auto s = parseArg(arg, "--population="); !s.empty()) {
@@ -52,7 +69,14 @@ int main(int argc, char **argv) {
             cfg.city_radius = std::strtod(s.c_str(), nullptr);
         } else if (auto s = parseArg(arg, "--format="); !s.empty()) {
             try {
-                cfg.export_format = exportFormatFromString(s);
+                setExportFormats(cfg, s);
+            } catch (const std::invalid_argument &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else if (auto s = parseArg(arg, "--obj-precision="); !s.empty()) {
+            try {
+                cfg.obj_precision = objPrecisionFromInt(std::strtol(s.c_str(), nullptr, 10));
             } catch (const std::invalid_argument &e) {
                 std::cerr << e.what() << std::endl;
                 return 1;
@@ -64,6 +88,55 @@ int main(int argc, char **argv) {
                 std::cerr << e.what() << std::endl;
                 return 1;
             }
+        } else if (auto s = parseArg(arg, "--threads="); !s.empty()) {
+            cfg.threads = static_cast<int>(std::strtol(s.c_str(), nullptr, 10));
+        } else if (auto s = parseArg(arg, "--rng="); !s.empty()) {
+            try {
+                cfg.rng_mode = rngModeFromString(s);
+            } catch (const std::invalid_argument &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else if (auto s = parseArg(arg, "--green="); !s.empty()) {
+            try {
+                cfg.green_mode = greenModeFromString(s);
+                greenModeSet = true;
+            } catch (const std::invalid_argument &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else if (auto s = parseArg(arg, "--tile-size="); !s.empty()) {
+            cfg.tile_size = std::strtod(s.c_str(), nullptr);
+        } else if (arg == "--instancing") {
+            cfg.gltf_instancing = true;
+        } else if (arg == "--lod") {
+            cfg.gltf_lod = true;
+        } else if (arg == "--quantize") {
+            cfg.gltf_quantize = true;
+        } else if (arg == "--meshopt") {
+            cfg.gltf_meshopt = true;
+        } else if (auto s = parseArg(arg, "--snapshot="); !s.empty()) {
+            snapshotOut = s;
+        } else if (auto s = parseArg(arg, "--from-snapshot="); !s.empty()) {
+            snapshotIn = s;
+        } else if (auto s = parseArg(arg, "--batch="); !s.empty()) {
+            batchManifest = s;
+        } else if (arg == "--batch-meshes") {
+            batchMeshes = true;
+        } else if (arg == "--stream") {
+            stream = true;
+        } else if (auto s = parseArg(arg, "--serve="); !s.empty()) {
+            server.listen = s;
+        } else if (auto s = parseArg(arg, "--workers="); !s.empty()) {
+            server.workers = static_cast<int>(std::strtol(s.c_str(), nullptr, 10));
+        } else if (auto s = parseArg(arg, "--cache-entries="); !s.empty()) {
+            server.cacheEntries = static_cast<std::size_t>(std::strtoul(s.c_str(), nullptr, 10));
+        } else if (auto s = parseArg(arg, "--trace="); !s.empty()) {
+            traceFile = s;
+        } else if (arg == "--mem-report") {
+            memReport = true;
+        } else if (arg == "--predict-memory") {
+            predictMemory = true;
         } else if (auto s = parseArg(arg, "--output="); !s.empty()) {
             outDir = s;
         } else if (arg == "--help" || arg == "-h") {
@@ -76,9 +149,34 @@ int main(int argc, char **argv) {
                       << "  --seed=<number>            RNG seed (default 0)\n"
                       << "  --grid-size=<number>       Width/height of the grid (default 100)\n"
                       << "  --radius-fraction=<float>  Fraction of half grid forming city radius (default 0.8)\n"
-                      << "  --format=<obj|gltf|glb>    Output mesh format (default obj)\n"
+                      << "  --format=<obj|gltf|glb>[,...]\n"
+                      << "                             Output mesh format(s), written in parallel (default obj)\n"
+                      << "  --obj-precision=<digits>   Fixed decimals for OBJ coordinates, 1-17 (default: 6 significant)\n"
+                      << "  --instancing               glTF/GLB: instance boxes via EXT_mesh_gpu_instancing\n"
+                      << "  --lod                      glTF/GLB: add a coarse block-level LOD via MSFT_lod\n"
+                      << "  --quantize                 glTF/GLB: 16-bit positions, 8-bit normals (KHR_mesh_quantization)\n"
+                      << "  --meshopt                  glTF/GLB: compress buffers via EXT_meshopt_compression\n"
+                      << "  --tile-size=<cells>        Write GLB tiles + tileset.json instead of one model\n"
                       << "  --layout=<grid|radial>     Street layout type (default grid)\n"
-                      << "  --output=<dir>             Directory to output results (required)\n"
+                      << "  --threads=<number>         Worker threads, 0 = all cores (default 0)\n"
+                      << "  --rng=<sequential|per-block> Parcel RNG streams (default sequential)\n"
+                      << "  --green=<shuffle|sample>   Green-space cell selection (default shuffle)\n"
+                      << "  --snapshot=<file>          Also save the generated city as a binary snapshot\n"
+                      << "  --from-snapshot=<file>     Load the city from a snapshot instead of generating\n"
+                      << "  --batch=<manifest>         Generate every row of a JSONL/CSV manifest into\n"
+                      << "                             <dir>/batch_summary.jsonl (options above are defaults)\n"
+                      << "  --batch-meshes             With --batch: also export each mesh to <dir>/<id>/\n"
+                      << "  --stream                   Generate out of core, streaming the OBJ block by block\n"
+                      << "                             (implies --green=sample; OBJ output only)\n"
+                      << "  --serve=<port|host:port|unix:path>\n"
+                      << "                             Serve /summary and /glb over HTTP from an in-memory\n"
+                      << "                             city cache (options above are request defaults)\n"
+                      << "  --workers=<number>         With --serve: concurrent generations (default: all cores)\n"
+                      << "  --cache-entries=<number>   With --serve: cities kept in memory (default 32)\n"
+                      << "  --trace=<file>             Write a Chrome trace of stage timings; adds timings to the summary\n"
+                      << "  --mem-report               Print bytes per container and stage; adds them to the summary\n"
+                      << "  --predict-memory           Print the predicted peak memory as JSON and exit\n"
+                      << "  --output=<dir>             Directory to output results (required unless --serve)\n"
                       << std::endl;
             return 0;
         } else {
@@ -86,36 +184,148 @@ int main(int argc, char **argv) {
             return 1;
         }
     }
+    if (!server.listen.empty()) {
+        if (stream || !batchManifest.empty() || !snapshotIn.empty() || !snapshotOut.empty()) {
+            std::cerr << "Error: --serve cannot be combined with --stream, --batch or snapshots"
+                      << std::endl;
+            return 1;
+        }
+        server.defaults = cfg;
+        try {
+            CityServer daemon(server);
+            std::cout << "Serving on " << daemon.bind() << std::endl;
+            daemon.run();
+        } catch (const std::exception &e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (predictMemory) {
+        writeEstimateJson(std::cout, CityGenerator::estimateMemory(cfg));
+        std::cout << std::endl;
+        return 0;
+    }
     if (outDir.empty()) {
         std::cerr << "Error: --output=<dir> must be specified" << std::endl;
         return 1;
     }
     // Create output directory if it does not exist
     std::filesystem::create_directories(outDir);
-    // Generate city
-    City city = CityGenerator::generate(cfg);
+    if (stream && !batchManifest.empty()) {
+        std::cerr << "Error: --stream cannot be combined with --batch" << std::endl;
+        return 1;
+    }
+    if (memReport && (stream || !batchManifest.empty())) {
+        std::cerr << "Error: --mem-report cannot be combined with --stream or --batch" << std::endl;
+        return 1;
+    }
+    if (!batchManifest.empty()) {
+        std::string batchPath = outDir + "/batch_summary.jsonl";
+        try {
+            std::vector<BatchJob> jobs = BatchGenerator::loadManifest(batchManifest, cfg);
+            std::ofstream summaries(batchPath);
+            if (!summaries) throw std::runtime_error("cannot create " + batchPath);
+            BatchOptions options;
+            options.threads = cfg.threads;
+            options.exportMeshes = batchMeshes;
+            options.outputDir = outDir;
+            BatchStats stats = BatchGenerator::run(jobs, options, summaries);
+            summaries.close();
+            if (!summaries) throw std::runtime_error("could not write " + batchPath);
+            std::cout << "Generated " << stats.cities << " cities (" << stats.failures
+                      << " failed) in " << stats.seconds << " s ("
+                      << (stats.seconds > 0.0 ? stats.cities / stats.seconds : 0.0)
+                      << " cities/s); summaries: " << batchPath << std::endl;
+            return stats.failures == 0 ? 0 : 1;
+        } catch (const std::exception &e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    // Tracing is off unless requested; a null trace makes every scope a no-op.
+    Trace trace;
+    Trace *tracePtr = traceFile.empty() ? nullptr : &trace;
+    MemoryReport memory;
+    MemoryReport *memoryPtr = memReport ? &memory : nullptr;
+    if (memoryPtr) memory.setEstimate(CityGenerator::estimateMemory(cfg));
+    if (stream) {
+        std::string objPath = outDir + "/city.obj";
+        std::string summaryPath = outDir + "/city_summary.json";
+        try {
+            if (!snapshotIn.empty() || !snapshotOut.empty()) {
+                throw std::invalid_argument("--stream cannot be combined with snapshots");
+            }
+            if (greenModeSet && cfg.green_mode != Config::GreenMode::Sample) {
+                throw std::invalid_argument("--stream requires --green=sample");
+            }
+            cfg.green_mode = Config::GreenMode::Sample;
+            StreamingCityGenerator::generate(cfg, objPath, summaryPath, tracePtr);
+        } catch (const std::exception &e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        if (tracePtr && !trace.writeChromeTrace(traceFile)) {
+            std::cerr << "Error: could not write trace file " << traceFile << std::endl;
+            return 1;
+        }
+        std::cout << "Generated city at: " << objPath << " and summary: " << summaryPath << std::endl;
+        return 0;
+    }
+    // Generate city, or map a previously saved one
+    City city;
+    try {
+        if (!snapshotIn.empty()) {
+            Trace::Scope load(tracePtr, "loadSnapshot");
+            city = CitySnapshot(snapshotIn).toCity();
+            // Snapshots store geometry only; the summary uses this run's mode.
+            city.transportMode = cfg.transport_mode;
+            if (memoryPtr) memory.setCity(city.memoryUsage());
+        } else {
+            city = CityGenerator::generate(cfg, tracePtr, memoryPtr);
+        }
+        if (!snapshotOut.empty()) {
+            Trace::Scope save(tracePtr, "saveSnapshot");
+            CitySnapshot::write(city, snapshotOut);
+        }
+    } catch (const std::runtime_error &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
     // Save outputs
-    std::string objPath = outDir + "/city.obj";
-    std::string gltfPath = outDir + "/city.gltf";
-    std::string glbPath = outDir + "/city.glb";
     std::string modelPath;
     std::string summaryPath = outDir + "/city_summary.json";
-    switch (cfg.export_format) {
-        case Config::ExportFormat::OBJ:
-            city.saveOBJ(objPath);
-            modelPath = objPath;
-            break;
-        case Config::ExportFormat::GLB:
-            city.saveGLTF(glbPath, true);
-            modelPath = glbPath;
-            break;
-        case Config::ExportFormat::GLTF:
-        default:
-            city.saveGLTF(gltfPath, false);
-            modelPath = gltfPath;
-            break;
+    GltfExportOptions gltfOptions;
+    gltfOptions.instancing = cfg.gltf_instancing;
+    gltfOptions.lod = cfg.gltf_lod;
+    gltfOptions.quantize = cfg.gltf_quantize;
+    gltfOptions.meshopt = cfg.gltf_meshopt;
+    gltfOptions.threads = cfg.threads;
+    bool written = true;
+    if (cfg.tile_size > 0.0) {
+        Trace::Scope exportStage(tracePtr, "export");
+        written = city.saveTiles(outDir, cfg.tile_size, gltfOptions, memoryPtr);
+        modelPath = outDir + "/tileset.json";
+        exportStage.end();
+        written = city.saveSummary(summaryPath, tracePtr, memoryPtr, cfg.threads) && written;
+    } else {
+        std::vector<ModelOutput> models;
+        for (Config::ExportFormat format : exportFormats(cfg)) {
+            models.push_back({format, outDir + "/city" + exportFormatExtension(format)});
+            modelPath += (modelPath.empty() ? "" : ", ") + models.back().path;
+        }
+        written = city.saveModels(models, gltfOptions, cfg.obj_precision, summaryPath, tracePtr,
+                                  memoryPtr);
+    }
+    if (!written) {
+        std::cerr << "Error: could not write the city to " << outDir << std::endl;
+        return 1;
+    }
+    if (tracePtr && !trace.writeChromeTrace(traceFile)) {
+        std::cerr << "Error: could not write trace file " << traceFile << std::endl;
+        return 1;
     }
-    city.saveSummary(summaryPath);
     std::cout << "Generated city at: " << modelPath << " and summary: " << summaryPath << std::endl;
+    if (memoryPtr) memory.writeText(std::cout);
     return 0;
 }
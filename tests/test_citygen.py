@@ -11,9 +11,12 @@ green space based on the population as described in the urban planning
 guidelines【25†L825-L834】【26†L7-L10】.
 """
 
+import ctypes
+import http.client
 import json
 import os
 import shutil
+import struct
 import subprocess
 import tempfile
 import unittest
@@ -32,6 +35,7 @@ EXECUTABLE = PROJECT_ROOT / "citygen"
 sys.path.append(str(PROJECT_ROOT / "python"))
 
 from generate_city import CityArtifacts, CityConfig, CitySummary, generate
+import citygen_native
 
 
 def compile_generator():
@@ -62,13 +66,16 @@ def compile_generator():
 
 def run_generator(population: int = 100000, hospitals: int = 1, schools: int = 1,
                   seed: int = 0, grid_size: int = 100, radius: float = 0.8,
-                  output_dir: Path | None = None) -> dict:
+                  output_dir: Path | None = None,
+                  extra_args: list[str] | None = None) -> dict:
     """Run the city generator and return the summary data.
 
     If the compiled C++ executable exists, this function invokes it and
     parses the resulting JSON.  If the executable does not exist (e.g.
     because a C++ compiler is unavailable), the fallback Python
     implementation in ``python/citygen_py.py`` is used directly.
+    ``extra_args`` are passed verbatim to the executable and ignored by the
+    fallback.
     """
     # Use compiled binary if present
     if EXECUTABLE.exists():
@@ -86,7 +93,7 @@ def run_generator(population: int = 100000, hospitals: int = 1, schools: int = 1
             f"--grid-size={grid_size}",
             f"--radius-fraction={radius}",
             f"--output={output_dir}"
-        ]
+        ] + list(extra_args or [])
         result = subprocess.run(args, capture_output=True, text=True)
         if result.returncode != 0:
             raise RuntimeError(f"Generator failed: {result.stderr}")
@@ -108,6 +115,146 @@ def run_generator(population: int = 100000, hospitals: int = 1, schools: int = 1
         return generate_py(cfg)
 
 
+def read_glb_json(path: Path) -> dict:
+    """Return the JSON chunk of a GLB file."""
+    data = path.read_bytes()
+    magic, _version, length = struct.unpack_from("<4sII", data, 0)
+    if magic != b"glTF" or length != len(data):
+        raise ValueError(f"{path} is not a valid GLB file")
+    json_length, _chunk_type = struct.unpack_from("<II", data, 12)
+    return json.loads(data[20:20 + json_length])
+
+
+def read_glb(path: Path) -> tuple[dict, bytes]:
+    """Return the JSON and binary chunks of a GLB file."""
+    data = path.read_bytes()
+    json_length, _chunk_type = struct.unpack_from("<II", data, 12)
+    bin_start = 20 + json_length
+    bin_length, _chunk_type = struct.unpack_from("<II", data, bin_start)
+    return read_glb_json(path), data[bin_start + 8:bin_start + 8 + bin_length]
+
+
+def decode_meshopt_attributes(data: bytes, count: int, stride: int) -> bytes:
+    """Decode an EXT_meshopt_compression "ATTRIBUTES" stream (version 0)."""
+    if data[0] != 0xA0:
+        raise ValueError("unsupported vertex codec header")
+    block_size = min((8192 // stride) & ~15, 256)
+    out = bytearray(count * stride)
+    last = bytearray(data[len(data) - stride:])
+    pos = 1
+    for begin in range(0, count, block_size):
+        n = min(block_size, count - begin)
+        aligned = (n + 15) & ~15
+        for k in range(stride):
+            header = data[pos:pos + (aligned // 16 + 3) // 4]
+            pos += len(header)
+            values = []
+            for g in range(aligned // 16):
+                bits = (0, 2, 4, 8)[(header[g // 4] >> ((g % 4) * 2)) & 3]
+                if bits == 0:
+                    values += [0] * 16
+                elif bits == 8:
+                    values += data[pos:pos + 16]
+                    pos += 16
+                else:
+                    packed = data[pos:pos + 2 * bits]
+                    spill = pos + 2 * bits
+                    sentinel = (1 << bits) - 1
+                    for i in range(16):
+                        byte = packed[i * bits // 8]
+                        v = (byte >> (8 - bits - (i * bits) % 8)) & sentinel
+                        if v == sentinel:
+                            v = data[spill]
+                            spill += 1
+                        values.append(v)
+                    pos = spill
+            p = last[k]
+            for i in range(n):
+                v = values[i]
+                p = (p + ((v >> 1) ^ -(v & 1))) & 0xFF
+                out[(begin + i) * stride + k] = p
+        last = out[(begin + n - 1) * stride:(begin + n) * stride]
+    if len(data) - pos != max(stride, 32):
+        raise ValueError("vertex stream has trailing data")
+    return bytes(out)
+
+
+def decode_meshopt_indices(data: bytes, count: int, stride: int) -> bytes:
+    """Decode an EXT_meshopt_compression "INDICES" stream."""
+    if data[0] & 0xF0 != 0xD0:
+        raise ValueError("unsupported index sequence header")
+    last = [0, 0]
+    pos = 1
+    out = []
+    for _ in range(count):
+        v = shift = 0
+        while True:
+            byte = data[pos]
+            pos += 1
+            v |= (byte & 127) << shift
+            shift += 7
+            if byte < 128:
+                break
+        current = v & 1
+        v >>= 1
+        index = (last[current] + ((v >> 1) ^ -(v & 1))) & 0xFFFFFFFF
+        last[current] = index
+        out.append(index)
+    if len(data) - pos != 4:
+        raise ValueError("index stream has trailing data")
+    return struct.pack(f"<{count}{'H' if stride == 2 else 'I'}", *out)
+
+
+def glb_buffer_views(path: Path) -> list[bytes]:
+    """Contents of every buffer view of a GLB, decoding meshopt streams."""
+    doc, binary = read_glb(path)
+    views = []
+    for view in doc["bufferViews"]:
+        meshopt = view.get("extensions", {}).get("EXT_meshopt_compression")
+        if meshopt is None:
+            views.append(binary[view.get("byteOffset", 0):][:view["byteLength"]])
+            continue
+        stream = binary[meshopt.get("byteOffset", 0):][:meshopt["byteLength"]]
+        decode = (decode_meshopt_indices if meshopt["mode"] == "INDICES"
+                  else decode_meshopt_attributes)
+        views.append(decode(stream, meshopt["count"], meshopt["byteStride"]))
+    return views
+
+
+def glb_triangle_count(doc: dict, skip_material: str | None = None) -> int:
+    """Triangles drawn by a glTF scene, counting every GPU instance.
+
+    Primitives using the material named ``skip_material`` are ignored.
+    """
+    total = 0
+    for node in doc["nodes"]:
+        if "mesh" not in node:
+            continue
+        instancing = node.get("extensions", {}).get("EXT_mesh_gpu_instancing")
+        copies = 1
+        if instancing:
+            copies = doc["accessors"][instancing["attributes"]["TRANSLATION"]]["count"]
+        for prim in doc["meshes"][node["mesh"]]["primitives"]:
+            if doc["materials"][prim["material"]]["name"] == skip_material:
+                continue
+            total += copies * doc["accessors"][prim["indices"]]["count"] // 3
+    return total
+
+
+def node_triangle_count(doc: dict, index: int) -> int:
+    """Triangles drawn by node ``index`` and its descendants, with instancing."""
+    node = doc["nodes"][index]
+    total = sum(node_triangle_count(doc, child) for child in node.get("children", []))
+    if "mesh" in node:
+        instancing = node.get("extensions", {}).get("EXT_mesh_gpu_instancing")
+        copies = 1
+        if instancing:
+            copies = doc["accessors"][instancing["attributes"]["TRANSLATION"]]["count"]
+        for prim in doc["meshes"][node["mesh"]]["primitives"]:
+            total += copies * doc["accessors"][prim["indices"]]["count"] // 3
+    return total
+
+
 class TestCityGenerator(unittest.TestCase):
     @classmethod
     def setUpClass(cls) -> None:
@@ -120,6 +267,388 @@ class TestCityGenerator(unittest.TestCase):
         data2 = run_generator(population=50000, hospitals=2, schools=3, seed=123)
         self.assertEqual(data1, data2, "Generator output differs for identical seeds")
 
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_thread_count_invariance(self):
+        """Parallel stages must not change the result for any thread count."""
+        for rng_mode in ("sequential", "per-block"):
+            for layout in ("grid", "radial"):
+                base_args = [f"--rng={rng_mode}", f"--layout={layout}"]
+                reference = run_generator(population=50000, hospitals=2, schools=3, seed=5,
+                                          grid_size=160,
+                                          extra_args=base_args + ["--threads=1"])
+                for threads in (2, 3, 8):
+                    data = run_generator(population=50000, hospitals=2, schools=3, seed=5,
+                                         grid_size=160,
+                                         extra_args=base_args + [f"--threads={threads}"])
+                    self.assertEqual(reference, data,
+                                     f"Summary differs with --threads={threads} "
+                                     f"({rng_mode}, {layout})")
+
+    def test_zone_counts_cover_grid(self):
+        """Zone cell counts partition the grid, including a ragged tail."""
+        data = run_generator(population=30000, hospitals=1, schools=2, seed=3, grid_size=157)
+        keys = ("residentialCells", "commercialCells", "industrialCells", "greenCells",
+                "undevelopedCells")
+        self.assertEqual(157 * 157, sum(data[k] for k in keys))
+        self.assertTrue(all(data[k] > 0 for k in keys))
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_green_sample_mode(self):
+        """Sampled green enforcement converts as many cells as the shuffle."""
+        # 2.4M inhabitants need far more parks than zoning produces.
+        params = dict(population=2400000, hospitals=2, schools=3, seed=8, grid_size=200)
+        shuffled = run_generator(**params)
+        sampled = run_generator(**params, extra_args=["--green=sample"])
+        self.assertEqual(sampled, run_generator(**params, extra_args=["--green=sample"]))
+        self.assertEqual(shuffled["greenCells"], sampled["greenCells"])
+        self.assertGreaterEqual(sampled["greenCells"], 2400000 * 8 // 10000)
+        self.assertNotEqual(shuffled, sampled)
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_obj_precision(self):
+        """--obj-precision writes fixed decimals without changing the mesh."""
+        def obj_lines(out_dir: Path, prefix: str) -> list:
+            with open(out_dir / "city.obj") as f:
+                return [line.split()[1:] for line in f if line.startswith(prefix)]
+
+        params = dict(population=40000, hospitals=1, schools=2, seed=5, grid_size=80)
+        with tempfile.TemporaryDirectory() as default_dir, \
+                tempfile.TemporaryDirectory() as fixed_dir:
+            run_generator(**params, output_dir=Path(default_dir))
+            run_generator(**params, output_dir=Path(fixed_dir), extra_args=["--obj-precision=3"])
+            vertices = obj_lines(Path(fixed_dir), "v ")
+            self.assertTrue(vertices)
+            for coords in vertices:
+                self.assertEqual(3, len(coords))
+                for value in coords:
+                    self.assertRegex(value, r"^-?\d+\.\d{3}$")
+            self.assertEqual(len(obj_lines(Path(default_dir), "v ")), len(vertices))
+            self.assertEqual(obj_lines(Path(default_dir), "f "), obj_lines(Path(fixed_dir), "f "))
+        for digits in ("0", "18", "-2"):
+            result = subprocess.run([str(EXECUTABLE), f"--obj-precision={digits}"],
+                                    capture_output=True, text=True)
+            self.assertEqual(1, result.returncode, digits)
+            self.assertIn("OBJ precision", result.stderr)
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_stream_matches_in_memory(self):
+        """--stream writes the same files as in-memory sampled generation."""
+        for rng in ("sequential", "per-block"):
+            for layout in ("grid", "radial"):
+                with tempfile.TemporaryDirectory() as mem_dir, \
+                        tempfile.TemporaryDirectory() as stream_dir:
+                    args = [f"--rng={rng}", f"--layout={layout}"]
+                    params = dict(population=1200000, hospitals=3, schools=5, seed=4,
+                                  grid_size=180)
+                    run_generator(**params, output_dir=Path(mem_dir),
+                                  extra_args=args + ["--green=sample"])
+                    run_generator(**params, output_dir=Path(stream_dir),
+                                  extra_args=args + ["--stream"])
+                    for name in ("city.obj", "city_summary.json"):
+                        self.assertEqual((Path(mem_dir) / name).read_bytes(),
+                                         (Path(stream_dir) / name).read_bytes(),
+                                         f"{name} differs ({rng}, {layout})")
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_gltf_instancing(self):
+        """Instanced GLB export draws the same triangles as the baked export."""
+        for layout in ("grid", "radial"):
+            with tempfile.TemporaryDirectory() as baked_dir, \
+                    tempfile.TemporaryDirectory() as inst_dir:
+                args = ["--format=glb", f"--layout={layout}"]
+                run_generator(population=40000, hospitals=2, schools=4, seed=9,
+                              output_dir=Path(baked_dir), extra_args=args)
+                run_generator(population=40000, hospitals=2, schools=4, seed=9,
+                              output_dir=Path(inst_dir), extra_args=args + ["--instancing"])
+                baked = read_glb_json(Path(baked_dir) / "city.glb")
+                instanced = read_glb_json(Path(inst_dir) / "city.glb")
+                self.assertIn("EXT_mesh_gpu_instancing", instanced.get("extensionsUsed", []))
+                self.assertNotIn("extensionsUsed", baked)
+                self.assertEqual(glb_triangle_count(baked), glb_triangle_count(instanced),
+                                 f"Instanced export changes the scene ({layout})")
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_gltf_indexed_primitives(self):
+        """Meshes use 16-bit indices, split at 65532 vertices, 24 per prism."""
+        with tempfile.TemporaryDirectory() as tmp:
+            out = Path(tmp)
+            run_generator(population=6000000, hospitals=2, schools=4, seed=3, grid_size=1800,
+                          output_dir=out, extra_args=["--layout=radial", "--format=obj,glb"])
+            doc, binary = read_glb(out / "city.glb")
+            with open(out / "city.obj") as f:
+                lines = [line[:2] for line in f]
+            vertices = 0
+            triangles = 0
+            split = False
+            for mesh in doc["meshes"]:
+                split = split or len(mesh["primitives"]) > 1
+                mesh_vertices = 0
+                for prim in mesh["primitives"]:
+                    indices = doc["accessors"][prim["indices"]]
+                    count = doc["accessors"][prim["attributes"]["POSITION"]]["count"]
+                    self.assertEqual(5123, indices["componentType"])
+                    self.assertLessEqual(count, 65532)
+                    view = doc["bufferViews"][indices["bufferView"]]
+                    start = view.get("byteOffset", 0) + indices.get("byteOffset", 0)
+                    values = struct.unpack_from(f"<{indices['count']}H", binary, start)
+                    self.assertLess(max(values), count)
+                    mesh_vertices += count
+                    triangles += indices["count"] // 3
+                # Each prism's six faces keep their own four corners.
+                self.assertEqual(0, mesh_vertices % 24, mesh["name"])
+                vertices += mesh_vertices
+            self.assertTrue(split, "no mesh needed a second primitive")
+            # The OBJ shares eight corners per prism and draws the same triangles.
+            self.assertEqual(lines.count("v ") * 3, vertices)
+            self.assertEqual(lines.count("f "), triangles)
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_multi_format_export(self):
+        """One run with several formats writes the files of one run per format."""
+        with tempfile.TemporaryDirectory() as tmp:
+            multi = Path(tmp) / "multi"
+            run_generator(population=40000, hospitals=2, schools=4, seed=9, output_dir=multi,
+                          extra_args=["--format=obj,glb,gltf", "--lod"])
+            for fmt in ("obj", "glb", "gltf"):
+                single = Path(tmp) / fmt
+                run_generator(population=40000, hospitals=2, schools=4, seed=9, output_dir=single,
+                              extra_args=[f"--format={fmt}", "--lod"])
+                for path in single.iterdir():
+                    self.assertEqual(path.read_bytes(), (multi / path.name).read_bytes(),
+                                     f"{path.name} differs from the --format={fmt} run")
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_gltf_quantized_meshopt(self):
+        """Quantized GLBs keep the scene and meshopt streams decode to them."""
+        for layout, extra in (("grid", []), ("radial", ["--instancing"])):
+            with tempfile.TemporaryDirectory() as tmp:
+                sizes = {}
+                for name, flags in (("plain", []), ("quantized", ["--quantize"]),
+                                    ("packed", ["--quantize", "--meshopt"])):
+                    run_generator(population=40000, hospitals=2, schools=4, seed=9, grid_size=60,
+                                  output_dir=Path(tmp) / name,
+                                  extra_args=["--format=glb", f"--layout={layout}"] + extra + flags)
+                    sizes[name] = (Path(tmp) / name / "city.glb").stat().st_size
+                plain = read_glb_json(Path(tmp) / "plain" / "city.glb")
+                quantized = read_glb_json(Path(tmp) / "quantized" / "city.glb")
+                packed = read_glb_json(Path(tmp) / "packed" / "city.glb")
+                self.assertIn("KHR_mesh_quantization", quantized["extensionsRequired"])
+                self.assertIn("EXT_meshopt_compression", packed["extensionsRequired"])
+                self.assertEqual(glb_triangle_count(plain), glb_triangle_count(quantized))
+                # Dequantized bounds match the float bounds to within a step.
+                for node in quantized["nodes"]:
+                    if "translation" not in node:
+                        continue  # instanced unit boxes stay float
+                    prims = quantized["meshes"][node["mesh"]]["primitives"]
+                    plain_prims = plain["meshes"][node["mesh"]]["primitives"]
+                    for prim, plain_prim in zip(prims, plain_prims):
+                        acc = quantized["accessors"][prim["attributes"]["POSITION"]]
+                        ref = plain["accessors"][plain_prim["attributes"]["POSITION"]]
+                        for c in range(3):
+                            for key in ("min", "max"):
+                                value = node["translation"][c] + acc[key][c] * node["scale"][c]
+                                self.assertAlmostEqual(value, ref[key][c],
+                                                       delta=node["scale"][c] + 1e-4)
+                self.assertEqual(glb_buffer_views(Path(tmp) / "packed" / "city.glb"),
+                                 glb_buffer_views(Path(tmp) / "quantized" / "city.glb"),
+                                 f"meshopt streams do not decode to the quantized views ({layout})")
+                self.assertLess(sizes["quantized"], sizes["plain"])
+                self.assertLess(sizes["packed"], sizes["quantized"])
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_gltf_lod(self):
+        """--lod adds a much coarser MSFT_lod level beside unchanged full detail."""
+        for layout in ("grid", "radial"):
+            with tempfile.TemporaryDirectory() as plain_dir, \
+                    tempfile.TemporaryDirectory() as lod_dir:
+                args = ["--format=glb", f"--layout={layout}"]
+                run_generator(population=150000, hospitals=2, schools=4, seed=6, grid_size=200,
+                              output_dir=Path(plain_dir), extra_args=args)
+                run_generator(population=150000, hospitals=2, schools=4, seed=6, grid_size=200,
+                              output_dir=Path(lod_dir), extra_args=args + ["--lod"])
+                plain = read_glb_json(Path(plain_dir) / "city.glb")
+                doc = read_glb_json(Path(lod_dir) / "city.glb")
+                self.assertIn("MSFT_lod", doc["extensionsUsed"])
+                self.assertNotIn("extensionsRequired", doc)
+                (root,) = doc["scenes"][0]["nodes"]
+                (coarse,) = doc["nodes"][root]["extensions"]["MSFT_lod"]["ids"]
+                self.assertEqual(2, len(doc["nodes"][root]["extras"]["MSFT_screencoverage"]))
+                detail = node_triangle_count(doc, root)
+                self.assertEqual(glb_triangle_count(plain), detail)
+                self.assertLess(node_triangle_count(doc, coarse) * 2, detail,
+                                f"coarse level is not much coarser ({layout})")
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_tiled_export(self):
+        """Tiles partition the buildings of the single-file export."""
+        with tempfile.TemporaryDirectory() as single_dir, \
+                tempfile.TemporaryDirectory() as tiled_dir:
+            run_generator(population=60000, hospitals=2, schools=4, seed=4, grid_size=150,
+                          output_dir=Path(single_dir), extra_args=["--format=glb"])
+            run_generator(population=60000, hospitals=2, schools=4, seed=4, grid_size=150,
+                          output_dir=Path(tiled_dir), extra_args=["--tile-size=40"])
+            with open(Path(tiled_dir) / "tileset.json") as f:
+                tileset = json.load(f)
+            root_box = tileset["root"]["boundingVolume"]["box"]
+            children = tileset["root"]["children"]
+            self.assertGreater(len(children), 1)
+            tiled_triangles = 0
+            for child in children:
+                box = child["boundingVolume"]["box"]
+                for axis in range(3):
+                    half, root_half = box[3 + 4 * axis], root_box[3 + 4 * axis]
+                    self.assertLessEqual(abs(box[axis] - root_box[axis]) + half,
+                                         root_half + 1e-6)
+                doc = read_glb_json(Path(tiled_dir) / child["content"]["uri"])
+                tiled_triangles += glb_triangle_count(doc, skip_material="mat_road")
+            single = read_glb_json(Path(single_dir) / "city.glb")
+            self.assertEqual(glb_triangle_count(single, skip_material="mat_road"),
+                             tiled_triangles)
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_trace_output(self):
+        """--trace writes a Chrome trace and adds stage timings to the summary."""
+        with tempfile.TemporaryDirectory() as out_dir:
+            trace_path = Path(out_dir) / "trace.json"
+            data = run_generator(population=40000, hospitals=1, schools=3, seed=6,
+                                 output_dir=Path(out_dir), extra_args=[f"--trace={trace_path}"])
+            with open(trace_path) as f:
+                events = json.load(f)["traceEvents"]
+            names = {e["name"] for e in events if e["ph"] == "X"}
+            for stage in ("generate", "zoning", "roads", "parcels", "facilities", "export"):
+                self.assertIn(stage, names)
+                self.assertIn(stage, data["timings"])
+            parcels = data["timings"]["parcels"]
+            self.assertGreaterEqual(parcels["parcels"], parcels["buildings"])
+            self.assertGreater(parcels["rngDraws"], 0)
+        self.assertNotIn("timings", run_generator(population=40000, hospitals=1, schools=3, seed=6))
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_mem_report(self):
+        """--mem-report accounts memory per stage and stays under the prediction."""
+        args = ["--layout=radial", "--format=obj,glb", "--quantize"]
+        data = run_generator(population=60000, hospitals=2, schools=4, seed=8, grid_size=400,
+                             extra_args=args + ["--mem-report"])
+        memory = data["memory"]
+        self.assertGreater(memory["city"]["buildings"]["capacity"], 0)
+        for stage in ("geometry", "obj", "glb", "summary"):
+            self.assertIn(stage, memory["export"])
+        self.assertGreaterEqual(memory["predicted"]["peak"], memory["peak"])
+        result = subprocess.run([str(EXECUTABLE), "--population=60000", "--hospitals=2",
+                                 "--schools=4", "--seed=8", "--grid-size=400",
+                                 "--radius-fraction=0.8", "--predict-memory"] + args,
+                                capture_output=True, text=True, check=True)
+        self.assertEqual(json.loads(result.stdout), memory["predicted"])
+        self.assertNotIn("memory", run_generator(population=60000, seed=8, grid_size=400))
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_snapshot_round_trip(self):
+        """Meshes exported from a snapshot match those of the generating run."""
+        with tempfile.TemporaryDirectory() as gen_dir, \
+                tempfile.TemporaryDirectory() as load_dir:
+            snapshot = Path(gen_dir) / "city.snap"
+            expected = run_generator(population=50000, hospitals=2, schools=4, seed=17,
+                                     output_dir=Path(gen_dir),
+                                     extra_args=["--layout=radial", f"--snapshot={snapshot}"])
+            loaded = run_generator(population=1, hospitals=0, schools=0, seed=99,
+                                   output_dir=Path(load_dir),
+                                   extra_args=[f"--from-snapshot={snapshot}"])
+            self.assertEqual(expected, loaded)
+            self.assertEqual((Path(gen_dir) / "city.obj").read_bytes(),
+                             (Path(load_dir) / "city.obj").read_bytes())
+            truncated = Path(load_dir) / "truncated.snap"
+            truncated.write_bytes(snapshot.read_bytes()[:200])
+            with self.assertRaises(RuntimeError):
+                run_generator(output_dir=Path(load_dir),
+                              extra_args=[f"--from-snapshot={truncated}"])
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_serve_matches_cli(self):
+        """--serve answers from its cache with the bytes a CLI run writes."""
+        server = subprocess.Popen([str(EXECUTABLE), "--serve=0", "--workers=2", "--schools=3"],
+                                  stdout=subprocess.PIPE, text=True)
+        try:
+            host, port = server.stdout.readline().split()[-1].rsplit(":", 1)
+            conn = http.client.HTTPConnection(host, int(port), timeout=60)
+
+            def get(target, body=None):
+                conn.request("POST" if body else "GET", target, body=body)
+                response = conn.getresponse()
+                return response.status, response.getheader("X-Citygen-Cache"), response.read()
+
+            query = "population=60000&seed=4&grid_size=80&hospitals=2"
+            status, cache, summary = get(f"/summary?{query}")
+            self.assertEqual((status, cache), (200, "miss"))
+            self.assertEqual(get(f"/summary?{query}")[1:], ("hit", summary))
+            _, cache, glb = get("/glb", json.dumps({"population": 60000, "seed": 4,
+                                                    "grid_size": 80, "hospitals": 2}))
+            self.assertEqual(cache, "hit")
+            with tempfile.TemporaryDirectory() as out:
+                run_generator(population=60000, hospitals=2, schools=3, seed=4, grid_size=80,
+                              output_dir=Path(out), extra_args=["--format=glb"])
+                self.assertEqual(summary, (Path(out) / "city_summary.json").read_bytes())
+                self.assertEqual(glb, (Path(out) / "city.glb").read_bytes())
+            # A near-duplicate reuses the cached zoning and layout.
+            self.assertEqual(get(f"/summary?{query}&schools=5")[:2], (200, "miss"))
+            self.assertEqual(get("/summary?population=abc")[0], 400)
+            stats = json.loads(get("/stats")[2])
+            self.assertEqual((stats["hits"], stats["misses"]), (2, 2))
+            self.assertEqual((stats["zoningRuns"], stats["layoutRuns"], stats["facilityRuns"]),
+                             (1, 1, 2))
+            conn.close()
+        finally:
+            server.terminate()
+            server.wait()
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_batch_manifest(self):
+        """Batch rows stream in order and match individually generated cities."""
+        rows = [dict(id=f"city{i}", seed=i, population=20000 + 5000 * i,
+                     layout="radial" if i % 2 else "grid") for i in range(6)]
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out = Path(tmpdir)
+            jsonl = out / "sweep.jsonl"
+            jsonl.write_text("\n".join(json.dumps(r) for r in rows) + "\n")
+            csv = out / "sweep.csv"
+            csv.write_text("id,seed,population,layout\n" + "".join(
+                f"{r['id']},{r['seed']},{r['population']},{r['layout']}\n" for r in rows))
+            for manifest in (jsonl, csv):
+                result = subprocess.run(
+                    [str(EXECUTABLE), f"--batch={manifest}", "--threads=3", "--schools=3",
+                     "--batch-meshes", "--format=glb", f"--output={out / manifest.stem}"],
+                    capture_output=True, text=True)
+                self.assertEqual(0, result.returncode, result.stderr)
+                with open(out / manifest.stem / "batch_summary.jsonl") as f:
+                    lines = [json.loads(line) for line in f]
+                self.assertEqual(list(range(len(rows))), [line["index"] for line in lines])
+                for row, line in zip(rows, lines):
+                    self.assertEqual(row["id"], line["id"])
+                    self.assertTrue((out / manifest.stem / row["id"] / "city.glb").exists())
+            single = run_generator(population=rows[3]["population"], schools=3,
+                                   seed=rows[3]["seed"], extra_args=["--layout=radial"])
+            self.assertEqual(single, lines[3]["summary"])
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_batch_mesh_write_failure(self):
+        """A mesh that cannot be written turns its row into an error."""
+        rows = [dict(id=f"city{i}", seed=i, population=20000) for i in range(3)]
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out = Path(tmpdir)
+            manifest = out / "sweep.jsonl"
+            manifest.write_text("\n".join(json.dumps(r) for r in rows) + "\n")
+            # A directory where the mesh file should go makes its write fail.
+            (out / "batch" / "city1" / "city.glb").mkdir(parents=True)
+            result = subprocess.run(
+                [str(EXECUTABLE), f"--batch={manifest}", "--batch-meshes", "--format=glb",
+                 f"--output={out / 'batch'}"],
+                capture_output=True, text=True)
+            self.assertEqual(1, result.returncode, result.stderr)
+            with open(out / "batch" / "batch_summary.jsonl") as f:
+                lines = [json.loads(line) for line in f]
+            self.assertEqual(["summary", "error", "summary"],
+                             ["error" if "error" in line else "summary" for line in lines])
+            self.assertIn("could not write", lines[1]["error"])
+
     def test_facility_counts(self):
         """Ensure the requested number of hospitals and schools appear in the summary."""
         data = run_generator(population=20000, hospitals=3, schools=5, seed=42)
@@ -160,6 +689,40 @@ class TestCityGenerator(unittest.TestCase):
         self.assertLessEqual(data["maxDistanceToHospital"], max_allowed_hospital,
                              "Hospitals are too far from residential parcels")
 
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_accessibility_distribution(self):
+        """Mean and percentile distances are ordered and bounded by the maximum."""
+        data = run_generator(population=80000, hospitals=3, schools=40, seed=8, grid_size=200)
+        for kind in ("School", "Hospital"):
+            p50, p90, p95 = (data[f"p{p}DistanceTo{kind}"] for p in (50, 90, 95))
+            maximum = data[f"maxDistanceTo{kind}"]
+            self.assertGreaterEqual(p50, 0.0)
+            self.assertLessEqual(p50, p90)
+            self.assertLessEqual(p90, p95)
+            self.assertLessEqual(p95, maximum)
+            self.assertLessEqual(data[f"meanDistanceTo{kind}"], maximum)
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_network_travel_times(self):
+        """Street travel is never faster than walking the straight line, and
+        driving is never slower than walking the same streets."""
+        for layout in ("grid", "radial"):
+            car = run_generator(population=80000, hospitals=2, schools=5, seed=8, grid_size=150,
+                                extra_args=[f"--layout={layout}"])
+            walk = run_generator(population=80000, hospitals=2, schools=5, seed=8, grid_size=150,
+                                 extra_args=[f"--layout={layout}", "--transport=walk"])
+            self.assertEqual(car["transportMode"], "car")
+            self.assertEqual(walk["transportMode"], "walk")
+            self.assertGreater(car["roadGraphEdges"], 0)
+            self.assertEqual(car["roadGraphNodes"], walk["roadGraphNodes"])
+            for kind in ("School", "Hospital"):
+                for stat in ("p50", "p90", "p95", "max"):
+                    # 5 km/h over 100 m cells is 1.2 minutes per cell.
+                    straight = 1.2 * walk[f"{stat}DistanceTo{kind}"]
+                    self.assertGreaterEqual(walk[f"{stat}TravelMinutesTo{kind}"], straight - 1e-3)
+                    self.assertLessEqual(car[f"{stat}TravelMinutesTo{kind}"],
+                                         walk[f"{stat}TravelMinutesTo{kind}"] + 1e-3)
+
     def test_height_limits_by_zone(self):
         """Building heights should respect zoning caps."""
         data = run_generator(population=40000, hospitals=1, schools=4, seed=33)
@@ -201,5 +764,109 @@ class TestPythonBindings(unittest.TestCase):
             self.assertTrue(artifacts.model_path.exists())
 
 
+def compile_shared_library(directory: Path) -> Path | None:
+    """Build ``libcitygen.so`` from ``src`` (without the CLI entry point)."""
+    compiler = shutil.which("g++")
+    if compiler is None:
+        return None
+    sources = [str(p) for p in (PROJECT_ROOT / "src").glob("*.cpp") if p.name != "main.cpp"]
+    output = directory / "libcitygen.so"
+    cmd = [
+        compiler, "-std=c++17", "-O2", "-Wall", "-shared", "-fPIC",
+        "-I", str(PROJECT_ROOT / "include"),
+    ] + sources + ["-o", str(output)]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        raise RuntimeError(f"Compilation failed:\n{result.stderr}")
+    return output
+
+
+class TestNativeBindings(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls) -> None:
+        compile_generator()
+        cls._build_dir = tempfile.TemporaryDirectory()
+        cls.library = os.environ.get("CITYGEN_LIBRARY")
+        if not cls.library or not Path(cls.library).exists():
+            cls.library = compile_shared_library(Path(cls._build_dir.name))
+
+    @classmethod
+    def tearDownClass(cls) -> None:
+        cls._build_dir.cleanup()
+
+    def setUp(self) -> None:
+        if self.library is None or not EXECUTABLE.exists():
+            self.skipTest("C++ toolchain not available")
+
+    def test_matches_cli_summary(self):
+        """In-process generation produces the same city as the executable."""
+        params = dict(population=60000, hospitals=2, schools=5, seed=21, grid_size=120)
+        for layout in ("grid", "radial"):
+            with tempfile.TemporaryDirectory() as tmpdir:
+                expected = run_generator(**params, extra_args=[f"--layout={layout}"])
+                city = citygen_native.generate(layout=layout, library=self.library,
+                                               transport="car", **params)
+                summary_path = Path(tmpdir) / "summary.json"
+                city.save_summary(summary_path)
+                with open(summary_path) as f:
+                    self.assertEqual(expected, json.load(f))
+                heights = city.building_heights
+                zones = city.building_zones
+                residential = [h for h, z in zip(heights, zones) if z == 1]
+                self.assertEqual(expected["maxResidentialHeight"], max(residential))
+                self.assertEqual(expected["numSchools"] + expected["numHospitals"],
+                                 len(city.facilities))
+
+    def test_incremental_matches_full_generation(self):
+        """Incremental regeneration re-runs only invalidated stages."""
+        generator = citygen_native.IncrementalGenerator(library=self.library)
+        base = dict(population=80000, seed=12, grid_size=150)
+        steps = [
+            (dict(hospitals=1, schools=2), ("zoning", "layout", "facilities")),
+            (dict(hospitals=3, schools=6), ("facilities",)),
+            (dict(hospitals=3, schools=6, threads=1), ()),
+            (dict(hospitals=3, schools=6, population=90000), ("layout", "facilities")),
+            (dict(hospitals=2, schools=6, population=90000, seed=13),
+             ("zoning", "layout", "facilities")),
+        ]
+        with tempfile.TemporaryDirectory() as tmpdir:
+            for i, (change, stages) in enumerate(steps):
+                params = dict(base, **change)
+                threads = params.pop("threads", 0)
+                city = generator.generate(threads=threads, **params)
+                self.assertEqual(stages, generator.last_stages)
+                fresh = citygen_native.generate(library=self.library, **params)
+                paths = [Path(tmpdir) / f"{i}_{kind}.json" for kind in ("inc", "fresh")]
+                city.save_summary(paths[0])
+                fresh.save_summary(paths[1])
+                self.assertEqual(paths[1].read_bytes(), paths[0].read_bytes())
+
+    @unittest.skipUnless(Path("/dev/full").exists(), "no /dev/full")
+    def test_failed_writes_report_errors(self):
+        """Exporters report short writes rather than success."""
+        city = citygen_native.generate(population=30000, seed=3, grid_size=80,
+                                       library=self.library)
+        for save in (city.save_obj, city.save_summary):
+            with self.subTest(save=save.__name__):
+                with self.assertRaisesRegex(OSError, "could not write"):
+                    save("/dev/full")
+
+    def test_arrays_alias_city_storage(self):
+        """Array views share the C++ buffers and keep the city alive."""
+        city = citygen_native.generate(population=30000, seed=3, grid_size=80,
+                                       library=self.library)
+        zones = memoryview(city.zones)
+        self.assertEqual((80, 80), zones.shape)
+        self.assertEqual(1, zones.itemsize)
+        footprints = city.building_footprints
+        self.assertEqual(ctypes.addressof(footprints), ctypes.addressof(city.building_footprints))
+        self.assertEqual((city.building_count, 4), memoryview(footprints).shape)
+        first = tuple(footprints[0])
+        del city
+        self.assertEqual(first, tuple(footprints[0]))
+        with self.assertRaises(ValueError):
+            citygen_native.generate(layout="spiral", library=self.library)
+
+
 if __name__ == '__main__':
     unittest.main()
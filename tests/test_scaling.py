@@ -0,0 +1,216 @@
+"""
+test_scaling.py
+===============
+
+Scaling regression suite for the ``citygen`` executable.  Each sweep
+generates cities at doubling input sizes and fits, per stage, the exponent
+``k`` of ``cost ~ driver ** k``, where the driver is the input the sweep
+doubles (grid cells or facilities) as counted by ``--trace``.  Runtime
+comes from ``--trace`` and memory from ``--mem-report``.  A stage fails
+when its exponent exceeds the bound declared for it below, which catches
+accidental quadratic loops long before they show up as slow runs.
+
+Exponents are fitted over the largest points of a sweep, where the leading
+term dominates.  Times are the minimum of a few runs, and points faster
+than a floor are dropped as noise; memory figures are exact.  The bounds
+leave room for timer noise but not for a stage that turns quadratic in its
+driver.
+
+The suite also checks that the parallel modes write byte-identical
+outputs for every thread count on a large city.
+"""
+
+import json
+import math
+import subprocess
+import sys
+import tempfile
+import unittest
+from pathlib import Path
+
+PROJECT_ROOT = Path(__file__).resolve().parents[1]
+EXECUTABLE = PROJECT_ROOT / "citygen"
+
+LAYOUTS = ("grid", "radial")
+# Runs per point; each stage keeps its fastest time.
+REPEATS = 3
+# Points of a sweep the exponents are fitted over, largest first.
+FIT_POINTS = 4
+# Stage times below this are timer noise rather than work.  The grid
+# layout's parcel and facility-candidate stages stay within a few
+# milliseconds, so the floor sits below them.
+TIME_FLOOR_MS = 0.5
+# Memory below this is dominated by fixed-size buffers.
+MEMORY_FLOOR_BYTES = 64 * 1024
+
+# Grid size doubles and population quadruples, keeping density constant.
+SIZE_SWEEP = [dict(grid_size=500 * 2 ** k, population=62500 * 4 ** k, hospitals=2, schools=4)
+              for k in range(5)]
+# Facility counts double on a fixed city.
+FACILITY_SWEEP = [dict(grid_size=1500, population=500000, hospitals=2 ** k, schools=2 ** k)
+                  for k in range(1, 12, 2)]
+
+# Stage: (driver, largest exponent).  Stages absent from a run (green
+# conversion that did not run, say) are skipped.  The street plan caps the
+# parcels of a block, so buildings grow well below linearly in cells and
+# the stages that work per building get a sublinear bound; a loop that is
+# quadratic in buildings doubles their exponent.  The summary histograms
+# the zoning grid, and its per-building and per-road-node work is bounded
+# by cells, so it is linear in cells like the zoning stages.
+SIZE_TIME_BOUNDS = {
+    "zoning": ("cells", 1.15),
+    "green": ("cells", 1.15),
+    "generate": ("cells", 1.15),
+    "parcels": ("cells", 0.75),
+    "facilityCandidates": ("cells", 0.75),
+    "obj": ("cells", 0.75),
+    "summary": ("cells", 1.15),
+    "export": ("cells", 0.75),
+}
+# Stages every layout must fit: parcel generation and the road-distance
+# queries of the facility candidates.
+SIZE_REQUIRED_STAGES = ("parcels", "facilityCandidates")
+SIZE_MEMORY_BOUNDS = {
+    "city": ("cells", 1.05),
+    "facilityCandidates": ("cells", 0.5),
+    "geometry": ("cells", 0.5),
+    "summary": ("cells", 0.5),
+}
+# Nearest-facility queries go through k-d trees and travel times through
+# one multi-source search per type, so the summary barely notices them.
+FACILITY_TIME_BOUNDS = {
+    "facilities": ("facilities", 1.35),
+    "facilityCandidates": ("facilities", 0.35),
+    "summary": ("facilities", 0.35),
+}
+FACILITY_MEMORY_BOUNDS = {
+    "summary": ("facilities", 0.35),
+}
+
+
+def run_city(params: dict, layout: str, out_dir: Path, extra_args=()) -> dict:
+    """Run citygen and return its summary."""
+    args = [str(EXECUTABLE), f"--layout={layout}", f"--output={out_dir}"]
+    args += [f"--{key.replace('_', '-')}={value}" for key, value in params.items()]
+    subprocess.run(args + list(extra_args), check=True, capture_output=True)
+    with open(out_dir / "city_summary.json") as f:
+        return json.load(f)
+
+
+def drivers(summary: dict) -> dict:
+    """Work measures of a run, from its stage counters."""
+    timings = summary["timings"]
+    return {
+        "cells": timings["zoning"]["cells"],
+        "facilities": timings["facilities"]["facilities"],
+    }
+
+
+def stage_times(summary: dict) -> dict:
+    """Milliseconds per stage.  Export tasks run concurrently, so they are
+    measured by the CPU time of their own thread."""
+    return {name: stage["cpuUs"] / 1000.0 if "cpuUs" in stage else stage["ms"]
+            for name, stage in summary["timings"].items()}
+
+
+def stage_memory(summary: dict) -> dict:
+    """Allocated bytes of the city and of every generation and export stage."""
+    memory = summary["memory"]
+    usage = {"city": memory["city"]["total"]["capacity"]}
+    for group in ("generate", "export"):
+        for name, stage in memory[group].items():
+            usage[name] = stage["total"]["capacity"]
+    return usage
+
+
+def measure(sweep: list, layout: str) -> list:
+    """(drivers, times, memory) for every point of @p sweep."""
+    points = []
+    with tempfile.TemporaryDirectory() as out_dir:
+        for params in sweep:
+            times = {}
+            for repeat in range(REPEATS):
+                summary = run_city(params, layout, Path(out_dir),
+                                   ["--trace=" + str(Path(out_dir) / "trace.json"), "--mem-report"])
+                for name, ms in stage_times(summary).items():
+                    times[name] = min(ms, times.get(name, math.inf))
+            points.append((drivers(summary), times, stage_memory(summary)))
+    return points
+
+
+def fit_exponent(xs: list, ys: list) -> float:
+    """Least-squares slope of log(ys) against log(xs)."""
+    lx = [math.log(x) for x in xs]
+    ly = [math.log(y) for y in ys]
+    mx = sum(lx) / len(lx)
+    my = sum(ly) / len(ly)
+    sxx = sum((x - mx) ** 2 for x in lx)
+    return sum((x - mx) * (y - my) for x, y in zip(lx, ly)) / sxx
+
+
+def stage_exponents(points: list, column: int, bounds: dict, floor: float) -> dict:
+    """Stage: (exponent, driver, bound) for the stages with enough points to fit."""
+    exponents = {}
+    for stage, (driver, bound) in bounds.items():
+        samples = [(p[0][driver], p[column][stage]) for p in points
+                   if p[column].get(stage, 0) >= floor]
+        samples = samples[-FIT_POINTS:]
+        if len(samples) < FIT_POINTS or samples[0][0] == samples[-1][0]:
+            continue
+        exponents[stage] = (fit_exponent(*zip(*samples)), driver, bound)
+    return exponents
+
+
+@unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+class TestScaling(unittest.TestCase):
+    def check_sweep(self, name: str, sweep: list, time_bounds: dict, memory_bounds: dict,
+                    required: tuple = ()):
+        for layout in LAYOUTS:
+            points = measure(sweep, layout)
+            results = {
+                "time": stage_exponents(points, 1, time_bounds, TIME_FLOOR_MS),
+                "memory": stage_exponents(points, 2, memory_bounds, MEMORY_FLOOR_BYTES),
+            }
+            for kind, exponents in results.items():
+                for stage, (exponent, driver, bound) in exponents.items():
+                    print(f"{name} {layout} {kind} {stage}: {driver}^{exponent:.2f} "
+                          f"(bound {bound})", file=sys.stderr)
+                    with self.subTest(layout=layout, kind=kind, stage=stage):
+                        self.assertLessEqual(exponent, bound,
+                                             f"{stage} {kind} grows as {driver}^{exponent:.2f}")
+            self.assertTrue(results["time"], f"{name} sweep too small to fit")
+            for stage in required:
+                self.assertIn(stage, results["time"], f"{name} {layout} did not fit {stage}")
+
+    def test_size_scaling(self):
+        """Stages stay within their complexity bound as the city grows."""
+        self.check_sweep("size", SIZE_SWEEP, SIZE_TIME_BOUNDS, SIZE_MEMORY_BOUNDS,
+                         SIZE_REQUIRED_STAGES)
+
+    def test_facility_scaling(self):
+        """Facility lookups stay sublinear in the facility count."""
+        self.check_sweep("facilities", FACILITY_SWEEP, FACILITY_TIME_BOUNDS, FACILITY_MEMORY_BOUNDS)
+
+    def test_parallel_modes_match_across_threads(self):
+        """Parallel modes write byte-identical outputs for every thread count."""
+        params = dict(SIZE_SWEEP[-2], seed=11)
+        modes = (["--rng=sequential"], ["--rng=per-block"], ["--rng=per-block", "--green=sample"])
+        with tempfile.TemporaryDirectory() as out_dir:
+            out = Path(out_dir)
+            for layout in LAYOUTS:
+                for mode in modes:
+                    reference = None
+                    for threads in (1, 2, 5):
+                        run_city(params, layout, out, mode + [f"--threads={threads}"])
+                        outputs = ((out / "city_summary.json").read_bytes(),
+                                   (out / "city.obj").read_bytes())
+                        if reference is None:
+                            reference = outputs
+                        else:
+                            self.assertEqual(reference, outputs,
+                                             f"{layout} {' '.join(mode)} differs with "
+                                             f"--threads={threads}")
+
+
+if __name__ == "__main__":
+    unittest.main()